@@ -12,6 +12,7 @@ class Memory {
   final double importance; // 0.0 to 1.0
   final String? category; // e.g., "preference", "fact", "event"
   final String? relatedFaceId; // Link to face recognition
+  final List<double>? embedding; // Unit-length, from the local model
 
   Memory({
     required this.id,
@@ -25,6 +26,7 @@ class Memory {
     this.importance = 0.5,
     this.category,
     this.relatedFaceId,
+    this.embedding,
   });
 
   /// Create from JSON
@@ -45,6 +47,9 @@ class Memory {
       importance: (json['importance'] as num).toDouble(),
       category: json['category'] as String?,
       relatedFaceId: json['relatedFaceId'] as String?,
+      embedding: json['embedding'] != null
+          ? (json['embedding'] as List).map((v) => (v as num).toDouble()).toList()
+          : null,
     );
   }
 
@@ -62,6 +67,7 @@ class Memory {
       'importance': importance,
       'category': category,
       'relatedFaceId': relatedFaceId,
+      'embedding': embedding,
     };
   }
 
@@ -142,13 +148,15 @@ class ConversationSummary {
 /// Memory search result
 class MemorySearchResult {
   final Memory memory;
-  final double relevanceScore;
-  final double tfidfScore;
+  final double relevanceScore; // fused rank score, importance weighted
+  final double tfidfScore; // BM25; 0 when no word matched
+  final double semanticScore; // cosine similarity; 0 without embeddings
 
   MemorySearchResult({
     required this.memory,
     required this.relevanceScore,
     required this.tfidfScore,
+    this.semanticScore = 0.0,
   });
 
   @override
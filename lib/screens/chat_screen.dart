@@ -53,6 +53,8 @@ class _ChatScreenState extends State<ChatScreen> {
     if (llmService.state == LLMServiceState.uninitialized) {
       await llmService.initialize();
     }
+    // Restore this agent's cached conversation state ahead of the first message
+    llmService.prepareAgent(widget.agent);
   }
 
   Future<void> _loadMessages() async {
@@ -3,8 +3,10 @@
 /// This file provides Dart bindings to the C++ llama.cpp library
 /// for on-device LLM inference with thread-safe operations.
 
+import 'dart:convert';
 import 'dart:ffi';
 import 'dart:io';
+import 'dart:typed_data';
 
 import 'package:ffi/ffi.dart';
 
@@ -59,6 +61,305 @@ typedef _LLMGenerate = int Function(
   int buffer_size,
 );
 
+/// Native callback receiving each decoded token fragment.
+/// Returns non-zero to stop generation.
+typedef LLMTokenCallbackNative = Int32 Function(
+  Pointer<Utf8> piece,
+  Int32 length,
+  Pointer<Void> user_data,
+);
+
+/// Native callback receiving prompt prefill progress after each
+/// micro-batch. Returns non-zero to stop generation.
+typedef LLMProgressCallbackNative = Int32 Function(
+  Int32 n_done,
+  Int32 n_total,
+  Pointer<Void> user_data,
+);
+
+typedef _LLMGenerateStreamNative = Int32 Function(
+  Pointer<Utf8> prompt,
+  Int32 max_tokens,
+  Pointer<NativeFunction<LLMTokenCallbackNative>> callback,
+  Pointer<Void> user_data,
+);
+typedef _LLMGenerateStream = int Function(
+  Pointer<Utf8> prompt,
+  int max_tokens,
+  Pointer<NativeFunction<LLMTokenCallbackNative>> callback,
+  Pointer<Void> user_data,
+);
+
+typedef _LLMModelLoadNative = Pointer<Void> Function(Pointer<Utf8> model_path, Int32 n_threads);
+typedef _LLMModelLoad = Pointer<Void> Function(Pointer<Utf8> model_path, int n_threads);
+
+typedef _LLMHandleFreeNative = Void Function(Pointer<Void> handle);
+typedef _LLMHandleFree = void Function(Pointer<Void> handle);
+
+typedef _LLMHandleIntNative = Int32 Function(Pointer<Void> handle);
+typedef _LLMHandleInt = int Function(Pointer<Void> handle);
+
+typedef _LLMContextCreateKVNative = Pointer<Void> Function(Pointer<Void> model, Int32 n_ctx, Int32 kv_type);
+typedef _LLMContextCreateKV = Pointer<Void> Function(Pointer<Void> model, int n_ctx, int kv_type);
+
+typedef _LLMContextGenerateNative = Int32 Function(
+  Pointer<Void> ctx,
+  Pointer<Utf8> prompt,
+  Pointer<Utf8> output_buffer,
+  Int32 buffer_size,
+);
+typedef _LLMContextGenerate = int Function(
+  Pointer<Void> ctx,
+  Pointer<Utf8> prompt,
+  Pointer<Utf8> output_buffer,
+  int buffer_size,
+);
+
+typedef _LLMContextGenerateStreamNative = Int32 Function(
+  Pointer<Void> ctx,
+  Pointer<Utf8> prompt,
+  Int32 max_tokens,
+  Pointer<NativeFunction<LLMTokenCallbackNative>> callback,
+  Pointer<Void> user_data,
+);
+typedef _LLMContextGenerateStream = int Function(
+  Pointer<Void> ctx,
+  Pointer<Utf8> prompt,
+  int max_tokens,
+  Pointer<NativeFunction<LLMTokenCallbackNative>> callback,
+  Pointer<Void> user_data,
+);
+
+typedef _LLMContextGenerateStreamProgressNative = Int32 Function(
+  Pointer<Void> ctx,
+  Pointer<Utf8> prompt,
+  Int32 max_tokens,
+  Pointer<NativeFunction<LLMTokenCallbackNative>> callback,
+  Pointer<NativeFunction<LLMProgressCallbackNative>> progress,
+  Pointer<Void> user_data,
+);
+typedef _LLMContextGenerateStreamProgress = int Function(
+  Pointer<Void> ctx,
+  Pointer<Utf8> prompt,
+  int max_tokens,
+  Pointer<NativeFunction<LLMTokenCallbackNative>> callback,
+  Pointer<NativeFunction<LLMProgressCallbackNative>> progress,
+  Pointer<Void> user_data,
+);
+
+typedef _LLMContextStateNative = Int32 Function(Pointer<Void> ctx, Pointer<Utf8> path);
+typedef _LLMContextState = int Function(Pointer<Void> ctx, Pointer<Utf8> path);
+
+typedef _LLMContextSetSamplerNative = Int32 Function(
+  Pointer<Void> ctx,
+  Float temperature,
+  Int32 top_k,
+  Float top_p,
+  Float min_p,
+  Float repeat_penalty,
+  Int32 repeat_last_n,
+  Uint32 seed,
+);
+typedef _LLMContextSetSampler = int Function(
+  Pointer<Void> ctx,
+  double temperature,
+  int top_k,
+  double top_p,
+  double min_p,
+  double repeat_penalty,
+  int repeat_last_n,
+  int seed,
+);
+
+typedef _LLMContextSetLookupNative = Int32 Function(Pointer<Void> ctx, Int32 n_draft);
+typedef _LLMContextSetLookup = int Function(Pointer<Void> ctx, int n_draft);
+
+typedef _LLMContextSetUBatchNative = Int32 Function(Pointer<Void> ctx, Int32 n_ubatch);
+typedef _LLMContextSetUBatch = int Function(Pointer<Void> ctx, int n_ubatch);
+
+typedef _LLMContextSetTextNative = Int32 Function(Pointer<Void> ctx, Pointer<Utf8> text);
+typedef _LLMContextSetText = int Function(Pointer<Void> ctx, Pointer<Utf8> text);
+
+typedef _LLMContextSetDraftNative = Int32 Function(Pointer<Void> ctx, Pointer<Void> draft, Int32 n_draft);
+typedef _LLMContextSetDraft = int Function(Pointer<Void> ctx, Pointer<Void> draft, int n_draft);
+
+typedef _LLMModelTokenizeNative = Int32 Function(
+  Pointer<Void> model,
+  Pointer<Utf8> text,
+  Pointer<Int32> tokens,
+  Int32 n_max,
+);
+typedef _LLMModelTokenize = int Function(
+  Pointer<Void> model,
+  Pointer<Utf8> text,
+  Pointer<Int32> tokens,
+  int n_max,
+);
+
+typedef _LLMModelTokenizeBatchNative = Int32 Function(
+  Pointer<Void> model,
+  Pointer<Pointer<Utf8>> texts,
+  Int32 n_texts,
+  Pointer<Int32> counts,
+  Pointer<Int32> tokens,
+  Int32 n_max,
+);
+typedef _LLMModelTokenizeBatch = int Function(
+  Pointer<Void> model,
+  Pointer<Pointer<Utf8>> texts,
+  int n_texts,
+  Pointer<Int32> counts,
+  Pointer<Int32> tokens,
+  int n_max,
+);
+
+typedef _LLMEmbedNative = Int32 Function(
+  Pointer<Void> ctx,
+  Pointer<Pointer<Utf8>> texts,
+  Int32 n_texts,
+  Int32 pooling,
+  Pointer<Float> out,
+  Int32 n_max,
+);
+typedef _LLMEmbed = int Function(
+  Pointer<Void> ctx,
+  Pointer<Pointer<Utf8>> texts,
+  int n_texts,
+  int pooling,
+  Pointer<Float> out,
+  int n_max,
+);
+
+typedef _LLMIndexOpenNative = Pointer<Void> Function(Pointer<Utf8> path, Int32 dim);
+typedef _LLMIndexOpen = Pointer<Void> Function(Pointer<Utf8> path, int dim);
+
+typedef _LLMIndexAddNative = Int32 Function(Pointer<Void> index, Pointer<Utf8> id, Pointer<Float> vector);
+typedef _LLMIndexAdd = int Function(Pointer<Void> index, Pointer<Utf8> id, Pointer<Float> vector);
+
+typedef _LLMIndexSearchNative = Int32 Function(
+  Pointer<Void> index,
+  Pointer<Float> query,
+  Int32 k,
+  Pointer<Uint8> ids,
+  Pointer<Float> scores,
+);
+typedef _LLMIndexSearch = int Function(
+  Pointer<Void> index,
+  Pointer<Float> query,
+  int k,
+  Pointer<Uint8> ids,
+  Pointer<Float> scores,
+);
+
+typedef _LLMHandleCreateNative = Pointer<Void> Function();
+typedef _LLMHandleCreate = Pointer<Void> Function();
+
+typedef _LLMKeywordIndexAddNative = Int32 Function(
+  Pointer<Void> index,
+  Pointer<Utf8> id,
+  Pointer<Utf8> text,
+  Float importance,
+  Int64 expires_at,
+);
+typedef _LLMKeywordIndexAdd = int Function(
+  Pointer<Void> index,
+  Pointer<Utf8> id,
+  Pointer<Utf8> text,
+  double importance,
+  int expires_at,
+);
+
+typedef _LLMKeywordIndexSearchNative = Int32 Function(
+  Pointer<Void> index,
+  Pointer<Utf8> query,
+  Int32 k,
+  Pointer<Uint8> ids,
+  Pointer<Float> scores,
+);
+typedef _LLMKeywordIndexSearch = int Function(
+  Pointer<Void> index,
+  Pointer<Utf8> query,
+  int k,
+  Pointer<Uint8> ids,
+  Pointer<Float> scores,
+);
+
+typedef _LLMMemorySearchNative = Int32 Function(
+  Pointer<Void> keywords,
+  Pointer<Void> vectors,
+  Pointer<Utf8> query,
+  Pointer<Float> query_vector,
+  Float min_similarity,
+  Int64 now_ms,
+  Int32 k,
+  Pointer<Uint8> ids,
+  Pointer<Float> scores,
+  Pointer<Float> lexical,
+  Pointer<Float> semantic,
+);
+typedef _LLMMemorySearch = int Function(
+  Pointer<Void> keywords,
+  Pointer<Void> vectors,
+  Pointer<Utf8> query,
+  Pointer<Float> query_vector,
+  double min_similarity,
+  int now_ms,
+  int k,
+  Pointer<Uint8> ids,
+  Pointer<Float> scores,
+  Pointer<Float> lexical,
+  Pointer<Float> semantic,
+);
+
+typedef _LLMQAMatcherOpenNative = Pointer<Void> Function(Pointer<Utf8> path);
+typedef _LLMQAMatcherOpen = Pointer<Void> Function(Pointer<Utf8> path);
+
+typedef _LLMQAMatcherAddNative = Int32 Function(
+  Pointer<Void> matcher,
+  Pointer<Utf8> id,
+  Pointer<Utf8> question,
+  Pointer<Utf8> answer,
+  Pointer<Utf8> category,
+  Pointer<Pointer<Utf8>> keywords,
+  Int32 n_keywords,
+  Float priority,
+);
+typedef _LLMQAMatcherAdd = int Function(
+  Pointer<Void> matcher,
+  Pointer<Utf8> id,
+  Pointer<Utf8> question,
+  Pointer<Utf8> answer,
+  Pointer<Utf8> category,
+  Pointer<Pointer<Utf8>> keywords,
+  int n_keywords,
+  double priority,
+);
+
+typedef _LLMQAMatcherEntryTextNative = Pointer<Utf8> Function(Pointer<Void> matcher, Int32 index, Int32 field);
+typedef _LLMQAMatcherEntryText = Pointer<Utf8> Function(Pointer<Void> matcher, int index, int field);
+
+typedef _LLMQAMatcherEntryKeywordsNative = Int32 Function(
+  Pointer<Void> matcher,
+  Int32 index,
+  Pointer<Pointer<Utf8>> keywords,
+  Int32 max_keywords,
+);
+typedef _LLMQAMatcherEntryKeywords = int Function(
+  Pointer<Void> matcher,
+  int index,
+  Pointer<Pointer<Utf8>> keywords,
+  int max_keywords,
+);
+
+typedef _LLMQAMatcherEntryPriorityNative = Float Function(Pointer<Void> matcher, Int32 index);
+typedef _LLMQAMatcherEntryPriority = double Function(Pointer<Void> matcher, int index);
+
+typedef _LLMQAMatcherMatchNative = Int32 Function(Pointer<Void> matcher, Pointer<Utf8> query, Pointer<Float> scores);
+typedef _LLMQAMatcherMatch = int Function(Pointer<Void> matcher, Pointer<Utf8> query, Pointer<Float> scores);
+
+typedef _LLMModelGetSystemInfoNative = Void Function(Pointer<Void> model, Pointer<Utf8> buffer, Int32 buffer_size);
+typedef _LLMModelGetSystemInfo = void Function(Pointer<Void> model, Pointer<Utf8> buffer, int buffer_size);
+
 typedef _LLMTokenizeNative = Int32 Function(
   Pointer<Utf8> text,
 );
@@ -91,12 +392,65 @@ class LlamaBindings {
   late final _LLMIsModelLoaded _isModelLoaded;
   late final _LLMUnloadModel _unloadModel;
   late final _LLMGenerate _generate;
+  late final _LLMGenerateStream _generateStream;
   late final _LLMTokenize _tokenize;
   late final _LLMGetContextSize _getContextSize;
   late final _LLMGetVocabSize _getVocabSize;
   late final _LLMHasGpuSupport _hasGpuSupport;
   late final _LLMGetSystemInfo _getSystemInfo;
   late final _LLMGetLastError _getLastError;
+  late final _LLMModelLoad _modelLoad;
+  late final _LLMHandleFree _modelFree;
+  late final _LLMHandleInt _modelVocabSize;
+  late final _LLMHandleInt _modelThreadCount;
+  late final _LLMHandleInt _modelEmbeddingSize;
+  late final _LLMEmbed _embed;
+  late final _LLMModelGetSystemInfo _modelGetSystemInfo;
+  late final _LLMContextCreateKV _contextCreate;
+  late final _LLMHandleFree _contextFree;
+  late final _LLMHandleFree _contextRetain;
+  late final _LLMHandleFree _contextReserve;
+  late final _LLMHandleFree _contextCancel;
+  late final _LLMContextSetSampler _contextSetSampler;
+  late final _LLMContextSetDraft _contextSetDraft;
+  late final _LLMContextSetLookup _contextSetLookup;
+  late final _LLMContextSetUBatch _contextSetUBatch;
+  late final _LLMContextSetText _contextSetGrammar;
+  late final _LLMContextSetText _contextSetJsonSchema;
+  late final _LLMHandleInt _contextSize;
+  late final _LLMContextGenerate _contextGenerate;
+  late final _LLMContextGenerateStream _contextGenerateStream;
+  late final _LLMContextGenerateStreamProgress _contextGenerateStreamProgress;
+  late final _LLMContextState _contextSaveState;
+  late final _LLMContextState _contextLoadState;
+  late final _LLMModelTokenize _modelTokenize;
+  late final _LLMModelTokenizeBatch _modelTokenizeBatch;
+  late final _LLMIndexOpen _indexOpen;
+  late final _LLMHandleFree _indexClose;
+  late final _LLMIndexAdd _indexAdd;
+  late final _LLMContextSetText _indexRemove;
+  late final _LLMIndexSearch _indexSearch;
+  late final _LLMHandleInt _indexDim;
+  late final _LLMHandleInt _indexSize;
+  late final _LLMHandleInt _indexRemoved;
+  late final _LLMHandleInt _indexCompact;
+  late final _LLMHandleFree _indexFlush;
+  late final _LLMHandleCreate _keywordIndexCreate;
+  late final _LLMHandleFree _keywordIndexFree;
+  late final _LLMKeywordIndexAdd _keywordIndexAdd;
+  late final _LLMContextSetText _keywordIndexRemove;
+  late final _LLMKeywordIndexSearch _keywordIndexSearch;
+  late final _LLMHandleInt _keywordIndexSize;
+  late final _LLMMemorySearch _memorySearch;
+  late final _LLMHandleCreate _qaMatcherCreate;
+  late final _LLMQAMatcherOpen _qaMatcherOpen;
+  late final _LLMHandleFree _qaMatcherFree;
+  late final _LLMQAMatcherAdd _qaMatcherAdd;
+  late final _LLMQAMatcherMatch _qaMatcherMatch;
+  late final _LLMHandleInt _qaMatcherSize;
+  late final _LLMQAMatcherEntryText _qaMatcherEntryText;
+  late final _LLMQAMatcherEntryKeywords _qaMatcherEntryKeywords;
+  late final _LLMQAMatcherEntryPriority _qaMatcherEntryPriority;
   
   bool _initialized = false;
 
@@ -112,12 +466,65 @@ class LlamaBindings {
     _isModelLoaded = _library.lookup<NativeFunction<_LLMIsModelLoadedNative>>('llm_is_model_loaded').asFunction();
     _unloadModel = _library.lookup<NativeFunction<_LLMUnloadModelNative>>('llm_unload_model').asFunction();
     _generate = _library.lookup<NativeFunction<_LLMGenerateNative>>('llm_generate').asFunction();
+    _generateStream = _library.lookup<NativeFunction<_LLMGenerateStreamNative>>('llm_generate_stream').asFunction();
     _tokenize = _library.lookup<NativeFunction<_LLMTokenizeNative>>('llm_tokenize').asFunction();
     _getContextSize = _library.lookup<NativeFunction<_LLMGetContextSizeNative>>('llm_get_context_size').asFunction();
     _getVocabSize = _library.lookup<NativeFunction<_LLMGetVocabSizeNative>>('llm_get_vocab_size').asFunction();
     _hasGpuSupport = _library.lookup<NativeFunction<_LLMHasGpuSupportNative>>('llm_has_gpu_support').asFunction();
     _getSystemInfo = _library.lookup<NativeFunction<_LLMGetSystemInfoNative>>('llm_get_system_info').asFunction();
     _getLastError = _library.lookup<NativeFunction<_LLMGetLastErrorNative>>('llm_get_last_error').asFunction();
+    _modelLoad = _library.lookup<NativeFunction<_LLMModelLoadNative>>('llm_model_load').asFunction();
+    _modelFree = _library.lookup<NativeFunction<_LLMHandleFreeNative>>('llm_model_free').asFunction();
+    _modelVocabSize = _library.lookup<NativeFunction<_LLMHandleIntNative>>('llm_model_vocab_size').asFunction();
+    _modelEmbeddingSize = _library.lookup<NativeFunction<_LLMHandleIntNative>>('llm_model_embedding_size').asFunction();
+    _embed = _library.lookup<NativeFunction<_LLMEmbedNative>>('llm_embed').asFunction();
+    _modelThreadCount = _library.lookup<NativeFunction<_LLMHandleIntNative>>('llm_model_n_threads').asFunction();
+    _modelGetSystemInfo = _library.lookup<NativeFunction<_LLMModelGetSystemInfoNative>>('llm_model_get_system_info').asFunction();
+    _contextCreate = _library.lookup<NativeFunction<_LLMContextCreateKVNative>>('llm_context_create_kv').asFunction();
+    _contextFree = _library.lookup<NativeFunction<_LLMHandleFreeNative>>('llm_context_free').asFunction();
+    _contextRetain = _library.lookup<NativeFunction<_LLMHandleFreeNative>>('llm_context_retain').asFunction();
+    _contextReserve = _library.lookup<NativeFunction<_LLMHandleFreeNative>>('llm_context_reserve').asFunction();
+    _contextCancel = _library.lookup<NativeFunction<_LLMHandleFreeNative>>('llm_context_cancel').asFunction();
+    _contextSetSampler = _library.lookup<NativeFunction<_LLMContextSetSamplerNative>>('llm_context_set_sampler').asFunction();
+    _contextSetDraft = _library.lookup<NativeFunction<_LLMContextSetDraftNative>>('llm_context_set_draft').asFunction();
+    _contextSetLookup = _library.lookup<NativeFunction<_LLMContextSetLookupNative>>('llm_context_set_lookup').asFunction();
+    _contextSetUBatch = _library.lookup<NativeFunction<_LLMContextSetUBatchNative>>('llm_context_set_ubatch').asFunction();
+    _contextSetGrammar = _library.lookup<NativeFunction<_LLMContextSetTextNative>>('llm_context_set_grammar').asFunction();
+    _contextSetJsonSchema = _library.lookup<NativeFunction<_LLMContextSetTextNative>>('llm_context_set_json_schema').asFunction();
+    _contextSize = _library.lookup<NativeFunction<_LLMHandleIntNative>>('llm_context_size').asFunction();
+    _contextGenerate = _library.lookup<NativeFunction<_LLMContextGenerateNative>>('llm_context_generate').asFunction();
+    _contextGenerateStream = _library.lookup<NativeFunction<_LLMContextGenerateStreamNative>>('llm_context_generate_stream').asFunction();
+    _contextGenerateStreamProgress = _library.lookup<NativeFunction<_LLMContextGenerateStreamProgressNative>>('llm_context_generate_stream_progress').asFunction();
+    _contextSaveState = _library.lookup<NativeFunction<_LLMContextStateNative>>('llm_context_save_state').asFunction();
+    _contextLoadState = _library.lookup<NativeFunction<_LLMContextStateNative>>('llm_context_load_state').asFunction();
+    _modelTokenize = _library.lookup<NativeFunction<_LLMModelTokenizeNative>>('llm_model_tokenize').asFunction();
+    _modelTokenizeBatch = _library.lookup<NativeFunction<_LLMModelTokenizeBatchNative>>('llm_model_tokenize_batch').asFunction();
+    _indexOpen = _library.lookup<NativeFunction<_LLMIndexOpenNative>>('llm_index_open').asFunction();
+    _indexClose = _library.lookup<NativeFunction<_LLMHandleFreeNative>>('llm_index_close').asFunction();
+    _indexAdd = _library.lookup<NativeFunction<_LLMIndexAddNative>>('llm_index_add').asFunction();
+    _indexRemove = _library.lookup<NativeFunction<_LLMContextSetTextNative>>('llm_index_remove').asFunction();
+    _indexSearch = _library.lookup<NativeFunction<_LLMIndexSearchNative>>('llm_index_search').asFunction();
+    _indexDim = _library.lookup<NativeFunction<_LLMHandleIntNative>>('llm_index_dim').asFunction();
+    _indexSize = _library.lookup<NativeFunction<_LLMHandleIntNative>>('llm_index_size').asFunction();
+    _indexRemoved = _library.lookup<NativeFunction<_LLMHandleIntNative>>('llm_index_removed').asFunction();
+    _indexCompact = _library.lookup<NativeFunction<_LLMHandleIntNative>>('llm_index_compact').asFunction();
+    _indexFlush = _library.lookup<NativeFunction<_LLMHandleFreeNative>>('llm_index_flush').asFunction();
+    _keywordIndexCreate = _library.lookup<NativeFunction<_LLMHandleCreateNative>>('llm_keyword_index_create').asFunction();
+    _keywordIndexFree = _library.lookup<NativeFunction<_LLMHandleFreeNative>>('llm_keyword_index_free').asFunction();
+    _keywordIndexAdd = _library.lookup<NativeFunction<_LLMKeywordIndexAddNative>>('llm_keyword_index_add').asFunction();
+    _keywordIndexRemove = _library.lookup<NativeFunction<_LLMContextSetTextNative>>('llm_keyword_index_remove').asFunction();
+    _keywordIndexSearch = _library.lookup<NativeFunction<_LLMKeywordIndexSearchNative>>('llm_keyword_index_search').asFunction();
+    _keywordIndexSize = _library.lookup<NativeFunction<_LLMHandleIntNative>>('llm_keyword_index_size').asFunction();
+    _memorySearch = _library.lookup<NativeFunction<_LLMMemorySearchNative>>('llm_memory_search').asFunction();
+    _qaMatcherCreate = _library.lookup<NativeFunction<_LLMHandleCreateNative>>('llm_qa_matcher_create').asFunction();
+    _qaMatcherOpen = _library.lookup<NativeFunction<_LLMQAMatcherOpenNative>>('llm_qa_matcher_open').asFunction();
+    _qaMatcherFree = _library.lookup<NativeFunction<_LLMHandleFreeNative>>('llm_qa_matcher_free').asFunction();
+    _qaMatcherAdd = _library.lookup<NativeFunction<_LLMQAMatcherAddNative>>('llm_qa_matcher_add').asFunction();
+    _qaMatcherMatch = _library.lookup<NativeFunction<_LLMQAMatcherMatchNative>>('llm_qa_matcher_match').asFunction();
+    _qaMatcherSize = _library.lookup<NativeFunction<_LLMHandleIntNative>>('llm_qa_matcher_size').asFunction();
+    _qaMatcherEntryText = _library.lookup<NativeFunction<_LLMQAMatcherEntryTextNative>>('llm_qa_matcher_entry_text').asFunction();
+    _qaMatcherEntryKeywords = _library.lookup<NativeFunction<_LLMQAMatcherEntryKeywordsNative>>('llm_qa_matcher_entry_keywords').asFunction();
+    _qaMatcherEntryPriority = _library.lookup<NativeFunction<_LLMQAMatcherEntryPriorityNative>>('llm_qa_matcher_entry_priority').asFunction();
   }
   
   /// Initialize the library
@@ -180,7 +587,273 @@ class LlamaBindings {
     }
   }
   
-  /// Tokenize text and return token count
+  /// Generate text, calling [onToken] with each decoded fragment as soon
+  /// as it is sampled. Return false from [onToken] to stop early.
+  ///
+  /// Blocks the calling isolate until generation finishes, so call it from
+  /// a background isolate. Returns the number of generated tokens.
+  int generateStream(
+    String prompt,
+    bool Function(String piece) onToken, {
+    int maxTokens = 256,
+  }) {
+    return _withTokenCallback(prompt, onToken, (promptPtr, callback) =>
+        _generateStream(promptPtr, maxTokens, callback, nullptr));
+  }
+  
+  /// Run a streaming native call with an isolate-local token callback
+  int _withTokenCallback(
+    String prompt,
+    bool Function(String piece) onToken,
+    int Function(Pointer<Utf8> prompt, Pointer<NativeFunction<LLMTokenCallbackNative>> callback) call,
+  ) {
+    final promptPtr = prompt.toNativeUtf8();
+    // Invoked synchronously on this isolate's thread from inside the call
+    final callback = NativeCallable<LLMTokenCallbackNative>.isolateLocal(
+      (Pointer<Utf8> piece, int length, Pointer<Void> userData) {
+        final bytes = piece.cast<Uint8>().asTypedList(length);
+        return onToken(utf8.decode(bytes, allowMalformed: true)) ? 0 : 1;
+      },
+      exceptionalReturn: 1,
+    );
+    
+    try {
+      final result = call(promptPtr, callback.nativeFunction);
+      
+      if (result < 0) {
+        throw LlamaException(getLastError());
+      }
+      
+      return result;
+    } finally {
+      callback.close();
+      calloc.free(promptPtr);
+    }
+  }
+  
+  // ==========================================================================
+  // Handle-based API: one model shared by many independent contexts
+  // ==========================================================================
+  
+  /// Load a model and return its handle. The weights are memory-mapped
+  /// once and shared by every context created from it. With [nThreads]
+  /// of 0 the native side times a few matmuls at load and picks the
+  /// thread count itself, preferring the performance cores.
+  LlamaModelHandle loadModelHandle(String modelPath, {int nThreads = 0}) {
+    final pathPtr = modelPath.toNativeUtf8();
+    try {
+      final handle = _modelLoad(pathPtr, nThreads);
+      if (handle == nullptr) {
+        throw LlamaException(getLastError());
+      }
+      return LlamaModelHandle(handle.address);
+    } finally {
+      calloc.free(pathPtr);
+    }
+  }
+  
+  /// Release a model handle. Contexts created from it stay usable until
+  /// they are freed themselves.
+  void freeModel(LlamaModelHandle model) => _modelFree(model.pointer);
+  
+  /// Vocabulary size of a loaded model
+  int modelVocabSize(LlamaModelHandle model) => _modelVocabSize(model.pointer);
+  
+  /// Length of the vectors [embed] returns for a model
+  int modelEmbeddingSize(LlamaModelHandle model) => _modelEmbeddingSize(model.pointer);
+  
+  /// Decode threads the model's worker pool runs with
+  int modelThreadCount(LlamaModelHandle model) => _modelThreadCount(model.pointer);
+  
+  /// System information for a loaded model
+  String modelSystemInfo(LlamaModelHandle model) {
+    final buffer = calloc.allocate<Uint8>(1024).cast<Utf8>();
+    try {
+      _modelGetSystemInfo(model.pointer, buffer, 1024);
+      return buffer.toDartString();
+    } finally {
+      calloc.free(buffer);
+    }
+  }
+  
+  /// Create a context with its own KV cache on a loaded model. A
+  /// quantized [cacheType] fits a longer [nCtx] in the same memory.
+  LlamaContextHandle createContext(
+    LlamaModelHandle model, {
+    int nCtx = 2048,
+    KVCacheType cacheType = KVCacheType.f16,
+  }) {
+    final handle = _contextCreate(model.pointer, nCtx, cacheType.index);
+    if (handle == nullptr) {
+      throw LlamaException(getLastError());
+    }
+    return LlamaContextHandle(handle.address);
+  }
+  
+  /// Drop a reference to a context. It is deleted once no call is
+  /// running on it and every [retainContext] has been freed too.
+  void freeContext(LlamaContextHandle ctx) => _contextFree(ctx.pointer);
+  
+  /// Take another reference to [ctx], released with [freeContext], so a
+  /// worker isolate can keep using it after its owner frees it
+  void retainContext(LlamaContextHandle ctx) => _contextRetain(ctx.pointer);
+  
+  /// Sampling settings for later generations on [ctx]
+  void setSamplerParams(LlamaContextHandle ctx, LLMGenerateParams params) {
+    final result = _contextSetSampler(
+      ctx.pointer,
+      params.temperature,
+      params.topK,
+      params.topP,
+      params.minP,
+      params.repeatPenalty,
+      params.repeatLastN,
+      params.seed,
+    );
+    if (result != 0) {
+      throw LlamaException(getLastError());
+    }
+  }
+  
+  /// Decode speculatively on [ctx]: [draft], a much smaller model with the
+  /// same vocabulary, proposes up to [nDraft] tokens that the main model
+  /// checks in one batched pass. Output is unchanged, only faster. Pass
+  /// null to turn it off.
+  void setDraftModel(LlamaContextHandle ctx, LlamaModelHandle? draft, {int nDraft = 4}) {
+    final result = _contextSetDraft(ctx.pointer, draft?.pointer ?? nullptr, nDraft);
+    if (result != 0) {
+      throw LlamaException(getLastError());
+    }
+  }
+  
+  /// Speculate on [ctx] without a draft model: when the last few tokens
+  /// occurred earlier in the prompt or reply, propose the [nDraft] tokens
+  /// that followed them. Pays off when replies quote injected memories.
+  /// An [nDraft] of 0 turns it off.
+  void setPromptLookup(LlamaContextHandle ctx, {int nDraft = 6}) {
+    if (_contextSetLookup(ctx.pointer, nDraft) != 0) {
+      throw LlamaException(getLastError());
+    }
+  }
+  
+  /// Prefill prompts on [ctx] in micro-batches of [nUBatch] tokens
+  /// (1-512, default 64). Larger batches process long prompts faster but
+  /// need more scratch memory.
+  void setMicroBatch(LlamaContextHandle ctx, int nUBatch) {
+    if (_contextSetUBatch(ctx.pointer, nUBatch) != 0) {
+      throw LlamaException(getLastError());
+    }
+  }
+  
+  /// Constrain generations on [ctx] to text the GBNF [grammar] matches;
+  /// generation stops once the match is complete. Null removes it.
+  void setGrammar(LlamaContextHandle ctx, String? grammar) {
+    _setText(_contextSetGrammar, ctx, grammar);
+  }
+  
+  /// Constrain generations on [ctx] to JSON matching the JSON [schema]
+  /// (types, properties, required, items, enum, const, anyOf and length
+  /// limits). Null removes it.
+  void setJsonSchema(LlamaContextHandle ctx, String? schema) {
+    _setText(_contextSetJsonSchema, ctx, schema);
+  }
+  
+  void _setText(_LLMContextSetText fn, LlamaContextHandle ctx, String? text) {
+    final Pointer<Utf8> textPtr = text?.toNativeUtf8() ?? nullptr;
+    try {
+      if (fn(ctx.pointer, textPtr) != 0) {
+        throw LlamaException(getLastError());
+      }
+    } finally {
+      if (textPtr != nullptr) calloc.free(textPtr);
+    }
+  }
+  
+  /// Announce a generation about to run on [ctx] from another isolate or
+  /// queue, so [cancelContext] stops it even before it reaches native code
+  void reserveGeneration(LlamaContextHandle ctx) => _contextReserve(ctx.pointer);
+  
+  /// Stop the generation running on [ctx], and any reserved with
+  /// [reserveGeneration], from any isolate. It returns within one decode
+  /// step with the output produced so far; later generations are unaffected.
+  void cancelContext(LlamaContextHandle ctx) => _contextCancel(ctx.pointer);
+  
+  /// Context window of a context
+  int contextSizeOf(LlamaContextHandle ctx) => _contextSize(ctx.pointer);
+  
+  /// Generate text on a specific context
+  String generateWithContext(LlamaContextHandle ctx, String prompt) {
+    final promptPtr = prompt.toNativeUtf8();
+    final outputBuffer = calloc.allocate<Uint8>(8192).cast<Utf8>();
+    
+    try {
+      final result = _contextGenerate(ctx.pointer, promptPtr, outputBuffer, 8192);
+      
+      if (result < 0) {
+        throw LlamaException(getLastError());
+      }
+      
+      return outputBuffer.toDartString();
+    } finally {
+      calloc.free(promptPtr);
+      calloc.free(outputBuffer);
+    }
+  }
+  
+  /// Streaming generation on a specific context; see [generateStream].
+  /// [onPrefill], when given, is called after each prompt micro-batch with
+  /// the prompt tokens evaluated so far and the prompt length; return
+  /// false from it to stop before decoding.
+  int generateStreamWithContext(
+    LlamaContextHandle ctx,
+    String prompt,
+    bool Function(String piece) onToken, {
+    int maxTokens = 256,
+    bool Function(int done, int total)? onPrefill,
+  }) {
+    if (onPrefill == null) {
+      return _withTokenCallback(prompt, onToken, (promptPtr, callback) =>
+          _contextGenerateStream(ctx.pointer, promptPtr, maxTokens, callback, nullptr));
+    }
+    final progress = NativeCallable<LLMProgressCallbackNative>.isolateLocal(
+      (int done, int total, Pointer<Void> userData) => onPrefill(done, total) ? 0 : 1,
+      exceptionalReturn: 1,
+    );
+    try {
+      return _withTokenCallback(prompt, onToken, (promptPtr, callback) =>
+          _contextGenerateStreamProgress(
+              ctx.pointer, promptPtr, maxTokens, callback, progress.nativeFunction, nullptr));
+    } finally {
+      progress.close();
+    }
+  }
+  
+  /// Save a context's cached tokens and KV state to [path].
+  /// Returns the number of positions written.
+  int saveContextState(LlamaContextHandle ctx, String path) =>
+      _withPath(path, (pathPtr) => _contextSaveState(ctx.pointer, pathPtr));
+  
+  /// Restore a snapshot written by [saveContextState] with the same model.
+  /// Returns the number of positions restored; throws if the file is
+  /// missing, corrupt or belongs to a different model.
+  int loadContextState(LlamaContextHandle ctx, String path) =>
+      _withPath(path, (pathPtr) => _contextLoadState(ctx.pointer, pathPtr));
+  
+  int _withPath(String path, int Function(Pointer<Utf8> path) call) {
+    final pathPtr = path.toNativeUtf8();
+    try {
+      final result = call(pathPtr);
+      if (result < 0) {
+        throw LlamaException(getLastError());
+      }
+      return result;
+    } finally {
+      calloc.free(pathPtr);
+    }
+  }
+  
+  /// Tokenize text and return token count (default model; a rough
+  /// estimate when no model is loaded)
   int tokenize(String text) {
     final textPtr = text.toNativeUtf8();
     try {
@@ -190,6 +863,423 @@ class LlamaBindings {
     }
   }
   
+  /// Tokenize text with a model's vocabulary and return the token ids
+  List<int> tokenizeIds(LlamaModelHandle model, String text) {
+    final textPtr = text.toNativeUtf8();
+    // Byte-level BPE never yields more tokens than bytes (+1 for BOS)
+    final capacity = textPtr.length + 1;
+    final tokens = calloc<Int32>(capacity);
+    try {
+      final n = _modelTokenize(model.pointer, textPtr, tokens, capacity);
+      return List<int>.of(tokens.asTypedList(n));
+    } finally {
+      calloc.free(textPtr);
+      calloc.free(tokens);
+    }
+  }
+  
+  /// Exact token count of text for a model
+  int countTokens(LlamaModelHandle model, String text) {
+    final textPtr = text.toNativeUtf8();
+    try {
+      return _modelTokenize(model.pointer, textPtr, nullptr, 0);
+    } finally {
+      calloc.free(textPtr);
+    }
+  }
+  
+  /// Tokenize many strings in a single native call
+  List<List<int>> tokenizeBatch(LlamaModelHandle model, List<String> texts) {
+    return _withTexts(texts, (textPtrs, counts, capacity) {
+      final tokens = calloc<Int32>(capacity);
+      try {
+        _modelTokenizeBatch(model.pointer, textPtrs, texts.length, counts, tokens, capacity);
+        final result = <List<int>>[];
+        var offset = 0;
+        for (var i = 0; i < texts.length; i++) {
+          final n = counts[i];
+          result.add(List<int>.of((tokens + offset).asTypedList(n)));
+          offset += n;
+        }
+        return result;
+      } finally {
+        calloc.free(tokens);
+      }
+    });
+  }
+  
+  /// Token counts of many strings in a single native call
+  List<int> countTokensBatch(LlamaModelHandle model, List<String> texts) {
+    return _withTexts(texts, (textPtrs, counts, capacity) {
+      _modelTokenizeBatch(model.pointer, textPtrs, texts.length, counts, nullptr, 0);
+      return List<int>.of(counts.asTypedList(texts.length));
+    });
+  }
+  
+  /// Embed [texts] with [ctx]'s model in one native call: one unit-length
+  /// vector per text, so a dot product is the cosine similarity. [ctx]'s
+  /// KV cache is cleared, so use a context reserved for embeddings.
+  List<Float32List> embed(
+    LlamaContextHandle ctx,
+    List<String> texts, {
+    EmbeddingPooling pooling = EmbeddingPooling.mean,
+  }) {
+    if (texts.isEmpty) return [];
+    final dim = _embed(ctx.pointer, nullptr, 0, pooling.index, nullptr, 0);
+    if (dim < 0) {
+      throw LlamaException(getLastError());
+    }
+    return _withTexts(texts, (textPtrs, counts, capacity) {
+      final total = dim * texts.length;
+      final out = calloc<Float>(total);
+      try {
+        if (_embed(ctx.pointer, textPtrs, texts.length, pooling.index, out, total) < 0) {
+          throw LlamaException(getLastError());
+        }
+        final vectors = out.asTypedList(total);
+        return [
+          for (var i = 0; i < texts.length; i++)
+            vectors.sublist(i * dim, (i + 1) * dim),
+        ];
+      } finally {
+        calloc.free(out);
+      }
+    });
+  }
+  
+  /// Marshal texts into a native string array plus a counts buffer.
+  /// [capacity] is an upper bound on the total number of tokens.
+  T _withTexts<T>(
+    List<String> texts,
+    T Function(Pointer<Pointer<Utf8>> textPtrs, Pointer<Int32> counts, int capacity) call,
+  ) {
+    final textPtrs = calloc<Pointer<Utf8>>(texts.length);
+    final counts = calloc<Int32>(texts.length);
+    var capacity = 0;
+    try {
+      for (var i = 0; i < texts.length; i++) {
+        textPtrs[i] = texts[i].toNativeUtf8();
+        capacity += textPtrs[i].length + 1;
+      }
+      return call(textPtrs, counts, capacity);
+    } finally {
+      for (var i = 0; i < texts.length; i++) {
+        if (textPtrs[i] != nullptr) calloc.free(textPtrs[i]);
+      }
+      calloc.free(textPtrs);
+      calloc.free(counts);
+    }
+  }
+  
+  // ==================== VECTOR INDEX ====================
+  
+  /// Bytes per id slot in native search results
+  static const int _indexIdSize = 48;
+  
+  /// Open (or create) the on-disk nearest-neighbour index at [path] for
+  /// vectors of [dim] floats. Opening maps the file without reading it.
+  /// Throws for a file of another dimension or one left half-written;
+  /// delete it and add the vectors again.
+  VectorIndexHandle openIndex(String path, int dim) {
+    final pathPtr = path.toNativeUtf8();
+    try {
+      final handle = _indexOpen(pathPtr, dim);
+      if (handle == nullptr) {
+        throw LlamaException(getLastError());
+      }
+      return VectorIndexHandle(handle.address);
+    } finally {
+      calloc.free(pathPtr);
+    }
+  }
+  
+  /// Write pending changes and close an index
+  void closeIndex(VectorIndexHandle index) => _indexClose(index.pointer);
+  
+  /// Insert or replace the vector stored under [id] (at most 47 bytes)
+  void indexAdd(VectorIndexHandle index, String id, List<double> vector) {
+    final idPtr = id.toNativeUtf8();
+    final vectorPtr = calloc<Float>(vector.length);
+    try {
+      vectorPtr.asTypedList(vector.length).setAll(0, vector);
+      if (_indexAdd(index.pointer, idPtr, vectorPtr) != 0) {
+        throw LlamaException(getLastError());
+      }
+    } finally {
+      calloc.free(idPtr);
+      calloc.free(vectorPtr);
+    }
+  }
+  
+  /// Remove [id]'s vector; false if it had none
+  bool indexRemove(VectorIndexHandle index, String id) {
+    final idPtr = id.toNativeUtf8();
+    try {
+      return _indexRemove(index.pointer, idPtr) == 1;
+    } finally {
+      calloc.free(idPtr);
+    }
+  }
+  
+  /// The [k] stored vectors most similar to [query], best first
+  List<IndexMatch> indexSearch(VectorIndexHandle index, List<double> query, int k) {
+    final queryPtr = calloc<Float>(query.length);
+    final ids = calloc<Uint8>(k * _indexIdSize);
+    final scores = calloc<Float>(k);
+    try {
+      queryPtr.asTypedList(query.length).setAll(0, query);
+      final found = _indexSearch(index.pointer, queryPtr, k, ids, scores);
+      if (found < 0) {
+        throw LlamaException(getLastError());
+      }
+      return [
+        for (var i = 0; i < found; i++)
+          IndexMatch((ids + i * _indexIdSize).cast<Utf8>().toDartString(), scores[i]),
+      ];
+    } finally {
+      calloc.free(queryPtr);
+      calloc.free(ids);
+      calloc.free(scores);
+    }
+  }
+  
+  /// Dimension of the vectors an index holds
+  int indexDimension(VectorIndexHandle index) => _indexDim(index.pointer);
+  
+  /// Vectors an index can return
+  int indexSize(VectorIndexHandle index) => _indexSize(index.pointer);
+  
+  /// Removed vectors still occupying the index until [compactIndex]
+  int indexRemoved(VectorIndexHandle index) => _indexRemoved(index.pointer);
+  
+  /// Rebuild an index's file without its removed vectors
+  void compactIndex(VectorIndexHandle index) {
+    if (_indexCompact(index.pointer) != 0) {
+      throw LlamaException(getLastError());
+    }
+  }
+  
+  /// Make an index's changes durable
+  void flushIndex(VectorIndexHandle index) => _indexFlush(index.pointer);
+  
+  // ==================== KEYWORD INDEX ====================
+  
+  /// Create an empty in-memory BM25 index
+  KeywordIndexHandle createKeywordIndex() =>
+      KeywordIndexHandle(_keywordIndexCreate().address);
+  
+  /// Free a keyword index
+  void freeKeywordIndex(KeywordIndexHandle index) => _keywordIndexFree(index.pointer);
+  
+  /// Index [text] under [id], replacing what [id] had. [importance]
+  /// weights it in [memorySearch], which stops returning it after
+  /// [expiresAt].
+  void keywordIndexAdd(
+    KeywordIndexHandle index,
+    String id,
+    String text, {
+    double importance = 1.0,
+    DateTime? expiresAt,
+  }) {
+    final idPtr = id.toNativeUtf8();
+    final textPtr = text.toNativeUtf8();
+    try {
+      final expires = expiresAt?.millisecondsSinceEpoch ?? 0;
+      if (_keywordIndexAdd(index.pointer, idPtr, textPtr, importance, expires) != 0) {
+        throw LlamaException(getLastError());
+      }
+    } finally {
+      calloc.free(idPtr);
+      calloc.free(textPtr);
+    }
+  }
+  
+  /// Remove [id]'s text; false if it had none
+  bool keywordIndexRemove(KeywordIndexHandle index, String id) {
+    final idPtr = id.toNativeUtf8();
+    try {
+      return _keywordIndexRemove(index.pointer, idPtr) == 1;
+    } finally {
+      calloc.free(idPtr);
+    }
+  }
+  
+  /// The [k] texts scoring best against [query] under BM25, best first.
+  /// Only texts sharing a word with the query are returned.
+  List<IndexMatch> keywordIndexSearch(KeywordIndexHandle index, String query, int k) {
+    final queryPtr = query.toNativeUtf8();
+    final ids = calloc<Uint8>(k * _indexIdSize);
+    final scores = calloc<Float>(k);
+    try {
+      final found = _keywordIndexSearch(index.pointer, queryPtr, k, ids, scores);
+      if (found < 0) {
+        throw LlamaException(getLastError());
+      }
+      return [
+        for (var i = 0; i < found; i++)
+          IndexMatch((ids + i * _indexIdSize).cast<Utf8>().toDartString(), scores[i]),
+      ];
+    } finally {
+      calloc.free(queryPtr);
+      calloc.free(ids);
+      calloc.free(scores);
+    }
+  }
+  
+  /// Texts in a keyword index
+  int keywordIndexSize(KeywordIndexHandle index) => _keywordIndexSize(index.pointer);
+  
+  // ==================== MEMORY SEARCH ====================
+  
+  /// The [k] memories best matching [query] in one native call: BM25 over
+  /// [keywords] and, with [vectors] and [queryVector], nearest neighbours
+  /// at least [minSimilarity] alike, fused by reciprocal rank and weighted
+  /// by importance. Expired memories are skipped and removed from both
+  /// indexes.
+  List<MemoryMatch> memorySearch(
+    KeywordIndexHandle keywords,
+    VectorIndexHandle? vectors,
+    String query,
+    List<double>? queryVector, {
+    required int k,
+    double minSimilarity = 0.0,
+  }) {
+    final queryPtr = query.toNativeUtf8();
+    final vectorPtr = queryVector == null ? nullptr : calloc<Float>(queryVector.length);
+    final ids = calloc<Uint8>(k * _indexIdSize);
+    final scores = calloc<Float>(k * 3);
+    try {
+      if (queryVector != null) {
+        vectorPtr.asTypedList(queryVector.length).setAll(0, queryVector);
+      }
+      final found = _memorySearch(
+        keywords.pointer,
+        vectors?.pointer ?? nullptr,
+        queryPtr,
+        vectorPtr,
+        minSimilarity,
+        DateTime.now().millisecondsSinceEpoch,
+        k,
+        ids,
+        scores,
+        scores + k,
+        scores + 2 * k,
+      );
+      if (found < 0) {
+        throw LlamaException(getLastError());
+      }
+      return [
+        for (var i = 0; i < found; i++)
+          MemoryMatch(
+            (ids + i * _indexIdSize).cast<Utf8>().toDartString(),
+            score: scores[i],
+            lexical: scores[k + i],
+            semantic: scores[2 * k + i],
+          ),
+      ];
+    } finally {
+      calloc.free(queryPtr);
+      if (vectorPtr != nullptr) calloc.free(vectorPtr);
+      calloc.free(ids);
+      calloc.free(scores);
+    }
+  }
+  
+  // ==================== QA MATCHER ====================
+  
+  /// Create an empty fuzzy matcher for the offline QA bank
+  QAMatcherHandle createQAMatcher() => QAMatcherHandle(_qaMatcherCreate().address);
+  
+  /// Open a QA bank compiled by qa_bank_compiler. The file is mapped
+  /// read-only and used in place, so nothing is parsed or copied; entries
+  /// cannot be added to it. Throws for a file that is not a compiled bank
+  /// of this version.
+  QAMatcherHandle openQAMatcher(String path) {
+    final pathPtr = path.toNativeUtf8();
+    try {
+      final handle = _qaMatcherOpen(pathPtr);
+      if (handle == nullptr) {
+        throw LlamaException(getLastError());
+      }
+      return QAMatcherHandle(handle.address);
+    } finally {
+      calloc.free(pathPtr);
+    }
+  }
+  
+  /// Free a QA matcher
+  void freeQAMatcher(QAMatcherHandle matcher) => _qaMatcherFree(matcher.pointer);
+  
+  /// Add a bank entry; returns its index, counting from 0 in the order
+  /// entries are added
+  int qaMatcherAdd(QAMatcherHandle matcher, QABankRecord entry) {
+    final fields = [entry.id, entry.question, entry.answer, entry.category];
+    return _withTexts(fields, (fieldPtrs, _, __) {
+      return _withTexts(entry.keywords, (keywordPtrs, _, __) {
+        final index = _qaMatcherAdd(
+          matcher.pointer,
+          fieldPtrs[0],
+          fieldPtrs[1],
+          fieldPtrs[2],
+          fieldPtrs[3],
+          keywordPtrs,
+          entry.keywords.length,
+          entry.priority,
+        );
+        if (index < 0) {
+          throw LlamaException(getLastError());
+        }
+        return index;
+      });
+    });
+  }
+  
+  /// Number of entries in a matcher
+  int qaMatcherSize(QAMatcherHandle matcher) => _qaMatcherSize(matcher.pointer);
+  
+  /// Read entry [index] back from a matcher, as added or as compiled
+  QABankRecord qaMatcherEntry(QAMatcherHandle matcher, int index) {
+    String text(int field) {
+      final ptr = _qaMatcherEntryText(matcher.pointer, index, field);
+      if (ptr == nullptr) {
+        throw LlamaException('QA bank entry $index out of range');
+      }
+      return ptr.toDartString();
+    }
+    
+    final id = text(0);
+    final count = _qaMatcherEntryKeywords(matcher.pointer, index, nullptr, 0);
+    final keywordPtrs = calloc<Pointer<Utf8>>(count > 0 ? count : 1);
+    try {
+      _qaMatcherEntryKeywords(matcher.pointer, index, keywordPtrs, count);
+      return QABankRecord(
+        id: id,
+        question: text(1),
+        answer: text(2),
+        category: text(3),
+        keywords: [for (var i = 0; i < count; i++) keywordPtrs[i].toDartString()],
+        priority: _qaMatcherEntryPriority(matcher.pointer, index),
+      );
+    } finally {
+      calloc.free(keywordPtrs);
+    }
+  }
+  
+  /// The entry best matching [query] by edit distance and shared
+  /// keywords, weighted by priority; null when nothing scored at all
+  QAMatch? qaMatcherMatch(QAMatcherHandle matcher, String query) {
+    final queryPtr = query.toNativeUtf8();
+    final scores = calloc<Float>(3);
+    try {
+      final entry = _qaMatcherMatch(matcher.pointer, queryPtr, scores);
+      if (entry < 0) return null;
+      return QAMatch(entry, score: scores[0], levenshtein: scores[1], keyword: scores[2]);
+    } finally {
+      calloc.free(queryPtr);
+      calloc.free(scores);
+    }
+  }
+  
   /// Get the context size of the loaded model
   int get contextSize => _getContextSize();
   
@@ -217,6 +1307,102 @@ class LlamaBindings {
   }
 }
 
+/// Opaque handle to a loaded model.
+///
+/// Holds the raw native address so it can be sent to worker isolates.
+class LlamaModelHandle {
+  final int address;
+  
+  const LlamaModelHandle(this.address);
+  
+  Pointer<Void> get pointer => Pointer<Void>.fromAddress(address);
+}
+
+/// Opaque handle to an on-disk vector index
+class VectorIndexHandle {
+  final int address;
+  
+  const VectorIndexHandle(this.address);
+  
+  Pointer<Void> get pointer => Pointer<Void>.fromAddress(address);
+}
+
+/// Opaque handle to an in-memory keyword index
+class KeywordIndexHandle {
+  final int address;
+  
+  const KeywordIndexHandle(this.address);
+  
+  Pointer<Void> get pointer => Pointer<Void>.fromAddress(address);
+}
+
+/// A vector or keyword index search hit
+class IndexMatch {
+  final String id;
+  final double score; // cosine similarity, or BM25 score
+  
+  const IndexMatch(this.id, this.score);
+}
+
+/// Opaque handle to a QA bank matcher
+class QAMatcherHandle {
+  final int address;
+  
+  const QAMatcherHandle(this.address);
+  
+  Pointer<Void> get pointer => Pointer<Void>.fromAddress(address);
+}
+
+/// A QA bank entry as the native matcher stores it
+class QABankRecord {
+  final String id;
+  final String question;
+  final String answer;
+  final String category;
+  final List<String> keywords;
+  final double priority;
+  
+  const QABankRecord({
+    required this.id,
+    required this.question,
+    required this.answer,
+    required this.category,
+    required this.keywords,
+    required this.priority,
+  });
+}
+
+/// Best QA bank entry for a query
+class QAMatch {
+  final int entry; // index in the order entries were added
+  final double score; // combined, priority weighted
+  final double levenshtein;
+  final double keyword;
+  
+  const QAMatch(this.entry, {required this.score, required this.levenshtein, required this.keyword});
+}
+
+/// A memory search hit
+class MemoryMatch {
+  final String id;
+  final double score; // fused rank score, importance weighted
+  final double lexical; // BM25 score; 0 if no word matched
+  final double semantic; // cosine similarity; 0 if not a vector match
+  
+  const MemoryMatch(this.id, {required this.score, required this.lexical, required this.semantic});
+}
+
+/// Opaque handle to an inference context (KV cache + sampling state).
+///
+/// Holds the raw native address so it can be sent to worker isolates.
+class LlamaContextHandle {
+  final int address;
+  
+  const LlamaContextHandle(this.address);
+  
+  Pointer<Void> get pointer => Pointer<Void>.fromAddress(address);
+}
+
 /// Exception thrown by LLM operations
 class LlamaException implements Exception {
   final String message;
@@ -246,23 +1432,51 @@ class LLMModelParams {
   });
 }
 
-/// Generation parameters for inference
+/// How [LlamaBindings.embed] pools per-token hidden states, in the native
+/// enum's order
+enum EmbeddingPooling {
+  /// Average over every token; suits models not trained for embeddings
+  mean,
+  
+  /// The last token's state, which has seen the whole text
+  last,
+}
+
+/// Storage format of a context's KV cache, in the native enum's order
+enum KVCacheType {
+  /// 2 bytes per value
+  f16,
+  
+  /// 8-bit blocks, about half of f16; output is nearly unchanged
+  q8_0,
+  
+  /// 4-bit blocks, about a quarter of f16; noticeably lossier
+  q4_0,
+}
+
+/// Generation parameters for inference. A temperature of 0 decodes
+/// greedily; topK <= 0, topP >= 1, minP <= 0 and repeatPenalty == 1
+/// each disable their stage. A seed of 0 picks a random one.
 class LLMGenerateParams {
   final int nPredict;
   final double temperature;
   final double topP;
   final int topK;
+  final double minP;
   final double repeatPenalty;
   final int repeatLastN;
+  final int seed;
   final String? stopSequences;
 
-  LLMGenerateParams({
+  const LLMGenerateParams({
     this.nPredict = 256,
     this.temperature = 0.7,
     this.topP = 0.9,
     this.topK = 40,
+    this.minP = 0.05,
     this.repeatPenalty = 1.1,
     this.repeatLastN = 64,
+    this.seed = 0,
     this.stopSequences,
   });
 }
@@ -7,11 +7,15 @@
 /// - Multi-threaded inference using Dart Isolates
 /// - Non-blocking model loading
 /// - Streaming token generation
+/// - Per-agent KV state saved to disk for instant conversation resume
 /// - Priority-based task scheduling
 
 import 'dart:async';
+import 'dart:convert';
 import 'dart:io';
+import 'dart:isolate';
 import 'dart:math' as math;
+import 'dart:typed_data';
 
 import 'package:flutter/foundation.dart';
 import 'package:flutter/services.dart';
@@ -49,22 +53,49 @@ class LocalLLMService extends ChangeNotifier {
   LLMServiceState _state = LLMServiceState.uninitialized;
   String? _error;
   String? _modelPath;
+  String? _stateDir;
   bool _isModelExtracted = false;
   
-  // Generation state
-  bool _isGenerating = false;
-  String? _currentTaskId;
+  // Native handles: one shared model, one warm context per agent
+  LlamaModelHandle? _model;
+  LlamaModelHandle? _draftModel; // optional, for speculative decoding
+  final Map<String, LlamaContextHandle> _contexts = {}; // LRU order
+  // Small context for schema-constrained extraction, so agents' cached
+  // conversations are never disturbed
+  LlamaContextHandle? _extractionContext;
+  bool _extracting = false;
+  // Context for embeddings; each call clears its cache
+  LlamaContextHandle? _embeddingContext;
+  
+  // Generation state (per agent, so different agents never block each other)
+  final Map<String, String> _activeTasks = {}; // agentId -> taskId
   final StreamController<String> _generationController = StreamController<String>.broadcast();
   
   // Model info
   String _modelName = 'SmolLM2-360M-Instruct';
-  int _contextSize = 2048;
+  int _contextSize = _defaultContextSize;
   int _vocabSize = 49152;
   int _optimalThreads = 4;
   
   // Configuration
   static const String _defaultModelAsset = 'assets/models/SmolLM2-360M-Instruct-Q4_K_M.gguf';
   static const String _modelFileName = 'SmolLM2-360M-Instruct-Q4_K_M.gguf';
+  // Not bundled; used for speculative decoding when placed in the models
+  // directory. It shares the 360M model's vocabulary.
+  static const String _draftModelFileName = 'SmolLM2-135M-Instruct-Q8_0.gguf';
+  static const int _draftTokens = 4;
+  // Prompt lookup drafts from the prompt itself, mostly RAG memories
+  static const int _lookupTokens = 6;
+  // A Q8_0 KV cache holds 4096 tokens in about the memory F16 needed for
+  // 2048: each warm context takes ~85 MB
+  static const int _defaultContextSize = 4096;
+  static const KVCacheType _cacheType = KVCacheType.q8_0;
+  static const int _maxWarmContexts = 3;
+  static const int _extractionContextSize = 1024;
+  // Memories and queries are short; longer text is cut to fit
+  static const int _embeddingContextSize = 512;
+  // Past messages kept in the prompt
+  static const int _maxHistoryMessages = 24;
   
   // Performance tracking
   final List<InferenceMetrics> _metrics = [];
@@ -73,7 +104,8 @@ class LocalLLMService extends ChangeNotifier {
   LLMServiceState get state => _state;
   String? get error => _error;
   bool get isReady => _state == LLMServiceState.ready;
-  bool get isGenerating => _isGenerating;
+  bool get isGenerating => _activeTasks.isNotEmpty;
+  bool isGeneratingFor(String agentId) => _activeTasks.containsKey(agentId);
   bool get isModelExtracted => _isModelExtracted;
   
   String get modelName => _modelName;
@@ -83,7 +115,8 @@ class LocalLLMService extends ChangeNotifier {
   String? get modelPath => _modelPath;
   
   bool get hasGpuSupport => _bindings.hasGpuSupport;
-  String get systemInfo => _bindings.systemInfo;
+  String get systemInfo =>
+      _model != null ? _bindings.modelSystemInfo(_model!) : _bindings.systemInfo;
   Stream<String> get generationStream => _generationController.stream;
   List<InferenceMetrics> get metrics => List.unmodifiable(_metrics);
   
@@ -97,30 +130,27 @@ class LocalLLMService extends ChangeNotifier {
     _setState(LLMServiceState.extractingModel);
     
     try {
-      // Calculate optimal thread count
-      _optimalThreads = _calculateOptimalThreads();
-      debugPrint('Using $_optimalThreads threads for inference');
-      
       // Check if FFI is available (on main thread)
       if (!LlamaBindings.isAvailable) {
         throw Exception('Native library not available. Please rebuild with native support.');
       }
       
-      // Extract model in background
-      await _threading.submit(
+      // Extract model in background. The task runs on a copy of this
+      // service, so only its result comes back to this isolate.
+      _modelPath = await _threading.submit(
         type: TaskType.modelLoad,
         priority: TaskPriority.critical,
         operation: _ensureModelExtracted,
       );
+      _isModelExtracted = true;
+      _stateDir = await _ensureStateDir();
       
       _setState(LLMServiceState.loading);
       
-      // Load the model in background
-      await _threading.submit(
-        type: TaskType.modelLoad,
-        priority: TaskPriority.critical,
-        operation: _loadModel,
-      );
+      // Load the model here: the native handle has to belong to this
+      // isolate, and loading is only an mmap of the weights
+      await _loadModel();
+      await _loadDraftModel();
       
       _setState(LLMServiceState.ready);
     } catch (e) {
@@ -130,16 +160,9 @@ class LocalLLMService extends ChangeNotifier {
     }
   }
   
-  /// Calculate optimal thread count based on device
-  int _calculateOptimalThreads() {
-    final processors = Platform.numberOfProcessors;
-    // Use 75% of available cores, max 4 for mobile
-    // Leave cores for UI and other services
-    return math.min(4, math.max(2, processors * 3 ~/ 4));
-  }
   
-  /// Extract model from assets to app documents
-  Future<void> _ensureModelExtracted() async {
+  /// Extract model from assets to app documents, returning its path
+  Future<String> _ensureModelExtracted() async {
     final appDir = await getApplicationDocumentsDirectory();
     final modelDir = Directory(path.join(appDir.path, 'models'));
     
@@ -148,11 +171,9 @@ class LocalLLMService extends ChangeNotifier {
     }
     
     final modelFile = File(path.join(modelDir.path, _modelFileName));
-    _modelPath = modelFile.path;
     
     if (await modelFile.exists()) {
-      _isModelExtracted = true;
-      return;
+      return modelFile.path;
     }
     
     // Extract model from assets
@@ -174,37 +195,147 @@ class LocalLLMService extends ChangeNotifier {
       }
       
       await raf.close();
-      _isModelExtracted = true;
       
       debugPrint('Model extracted successfully (${bytes.length ~/ 1024 ~/ 1024} MB)');
+      return modelFile.path;
     } catch (e) {
       throw Exception('Failed to extract model: $e');
     }
   }
   
+  /// Directory for per-agent KV snapshots, next to the model. Resolved on
+  /// this isolate, since snapshots are saved and restored from here.
+  Future<String> _ensureStateDir() async {
+    final appDir = await getApplicationDocumentsDirectory();
+    final stateDir = Directory(path.join(appDir.path, 'kv_state'));
+    if (!await stateDir.exists()) {
+      await stateDir.create(recursive: true);
+    }
+    return stateDir.path;
+  }
+  
   /// Load the model into memory
   Future<void> _loadModel() async {
     if (_modelPath == null) {
       throw Exception('Model path not set');
     }
     
-    final success = _bindings.loadModel(
-      _modelPath!,
-      nCtx: 2048,
-      nThreads: _optimalThreads,
-    );
-    
-    if (!success) {
-      throw Exception('Failed to load model: ${_bindings.getLastError()}');
+    try {
+      // The native side picks the decode thread count by calibration and
+      // keeps the workers on the performance cores
+      _model = _bindings.loadModelHandle(_modelPath!);
+    } on LlamaException catch (e) {
+      throw Exception('Failed to load model: ${e.message}');
     }
     
     // Get model info
-    _contextSize = _bindings.contextSize;
-    _vocabSize = _bindings.vocabSize;
+    _contextSize = _defaultContextSize;
+    _vocabSize = _bindings.modelVocabSize(_model!);
+    _optimalThreads = _bindings.modelThreadCount(_model!);
     
     debugPrint('Model loaded successfully');
     debugPrint('Context size: $_contextSize');
     debugPrint('Vocab size: $_vocabSize');
+    debugPrint('Using $_optimalThreads threads for inference');
+  }
+  
+  /// Load the draft model for speculative decoding when one sits next to
+  /// the main model. It is an optimization, so failures only turn it off.
+  Future<void> _loadDraftModel() async {
+    final draftFile = File(path.join(path.dirname(_modelPath!), _draftModelFileName));
+    if (!await draftFile.exists()) return;
+    try {
+      // Draft contexts run on the main model's threads, so no pool of its own
+      _draftModel = _bindings.loadModelHandle(draftFile.path, nThreads: 1);
+      debugPrint('Speculative decoding with $_draftModelFileName');
+    } on LlamaException catch (e) {
+      debugPrint('Draft model not used: ${e.message}');
+    }
+  }
+  
+  /// Get the warm context for an agent, creating it on first use.
+  /// When the pool is full the least recently used idle context is freed;
+  /// the model weights are shared and never reloaded.
+  LlamaContextHandle _contextFor(String agentId) {
+    final existing = _contexts.remove(agentId);
+    if (existing != null) {
+      _contexts[agentId] = existing; // mark most recently used
+      return existing;
+    }
+    
+    if (_contexts.length >= _maxWarmContexts) {
+      final idle = _contexts.keys.cast<String?>().firstWhere(
+        (id) => !_activeTasks.containsKey(id),
+        orElse: () => null,
+      );
+      if (idle != null) {
+        _bindings.freeContext(_contexts.remove(idle)!);
+      }
+    }
+    
+    final ctx = _bindings.createContext(_model!, nCtx: _contextSize, cacheType: _cacheType);
+    _bindings.setPromptLookup(ctx, nDraft: _lookupTokens);
+    if (_draftModel != null) {
+      try {
+        _bindings.setDraftModel(ctx, _draftModel, nDraft: _draftTokens);
+      } on LlamaException catch (e) {
+        debugPrint('Speculative decoding off: ${e.message}');
+      }
+    }
+    _contexts[agentId] = ctx;
+    _restoreState(agentId, ctx);
+    return ctx;
+  }
+  
+  /// Warm up an agent's context ahead of its first message, restoring its
+  /// saved system prompt and history from disk
+  void prepareAgent(Agent agent) {
+    if (!isReady || _contexts.containsKey(agent.id)) return;
+    try {
+      _contextFor(agent.id);
+    } catch (e) {
+      debugPrint('Failed to prepare context for ${agent.name}: $e');
+    }
+  }
+  
+  /// Sampling settings that suit an agent's role: advisors stay close to
+  /// the most likely wording, companions get more variety
+  LLMGenerateParams _samplingFor(Agent agent) {
+    switch (agent.role) {
+      case AgentRoles.lawyer:
+      case AgentRoles.financialAdvisor:
+        return const LLMGenerateParams(temperature: 0.3, topP: 0.85, repeatPenalty: 1.1);
+      case AgentRoles.teacher:
+      case AgentRoles.careerCoach:
+        return const LLMGenerateParams(temperature: 0.5, topP: 0.9, repeatPenalty: 1.1);
+      case AgentRoles.therapist:
+        return const LLMGenerateParams(temperature: 0.6, topP: 0.9, repeatPenalty: 1.15);
+      case AgentRoles.girlfriend:
+      case AgentRoles.boyfriend:
+      case AgentRoles.friend:
+        return const LLMGenerateParams(temperature: 0.85, topP: 0.95, repeatPenalty: 1.15);
+      default:
+        return const LLMGenerateParams();
+    }
+  }
+  
+  /// KV snapshot file for an agent. The native side stores the model
+  /// fingerprint and cached tokens in the file, so a snapshot is only ever
+  /// restored onto the same model and reused up to the shared prefix.
+  String? _statePath(String agentId) =>
+      _stateDir != null ? path.join(_stateDir!, '$agentId.kvs') : null;
+  
+  void _restoreState(String agentId, LlamaContextHandle ctx) {
+    final statePath = _statePath(agentId);
+    if (statePath == null || !File(statePath).existsSync()) return;
+    try {
+      final restored = _bindings.loadContextState(ctx, statePath);
+      debugPrint('Restored $restored cached tokens for agent $agentId');
+    } on LlamaException catch (e) {
+      // Stale (other model or cache type) or corrupt: drop it and prefill normally
+      debugPrint('Discarding KV snapshot for agent $agentId: ${e.message}');
+      File(statePath).deleteSync();
+    }
   }
   
   /// Send a message and get a response (non-blocking)
@@ -217,17 +348,21 @@ class LocalLLMService extends ChangeNotifier {
       throw Exception('LLM Service not ready. Current state: $_state');
     }
     
-    if (_isGenerating) {
-      throw Exception('Already generating a response');
+    if (isGeneratingFor(agent.id)) {
+      throw Exception('Already generating a response for ${agent.name}');
     }
     
-    _isGenerating = true;
+    final taskId = 'inference_${agent.id}_${DateTime.now().millisecondsSinceEpoch}';
+    _activeTasks[agent.id] = taskId;
     notifyListeners();
     
-    final taskId = 'inference_${DateTime.now().millisecondsSinceEpoch}';
-    _currentTaskId = taskId;
-    
     try {
+      final ctx = _contextFor(agent.id);
+      _bindings.setSamplerParams(ctx, _samplingFor(agent));
+      // From here a cancel reaches this generation even while it is
+      // queued or waiting for the context
+      _bindings.reserveGeneration(ctx);
+      
       // Build the prompt
       final prompt = _buildPrompt(
         content: content,
@@ -235,15 +370,13 @@ class LocalLLMService extends ChangeNotifier {
         history: conversationHistory,
       );
       
-      // Check prompt length on main thread (fast)
-      final tokenCount = _bindings.tokenize(prompt);
-      if (tokenCount > _contextSize - 256) {
-        throw Exception('Input too long ($tokenCount tokens). Maximum: ${_contextSize - 256}');
-      }
+      // No length check: the native context drops the oldest turns
+      // after the system prompt when the conversation outgrows the window
       
       // Run inference in background isolate
+      final statePath = _statePath(agent.id);
       final response = await _threading.runInference<String>(
-        () async => _runInference(prompt, agent),
+        () async => _runInference(prompt, ctx, statePath),
         priority: TaskPriority.high,
         taskId: taskId,
       );
@@ -259,43 +392,55 @@ class LocalLLMService extends ChangeNotifier {
         timestamp: DateTime.now(),
         metadata: {
           'model': _modelName,
-          'tokens_generated': _bindings.tokenize(response),
+          'tokens_generated': _countTokens(response),
           'local': true,
           'threads': _optimalThreads,
         },
       );
     } finally {
-      _isGenerating = false;
-      _currentTaskId = null;
+      _activeTasks.remove(agent.id);
       notifyListeners();
     }
   }
   
   /// Run inference in isolate
-  String _runInference(String prompt, Agent agent) {
+  String _runInference(String prompt, LlamaContextHandle ctx, String? statePath) {
     final stopwatch = Stopwatch()..start();
     
     // Generate response using bindings
-    final response = _bindings.generate(prompt);
+    final response = _bindings.generateWithContext(ctx, prompt);
     
     stopwatch.stop();
     
-    // Track metrics
-    final metrics = InferenceMetrics(
+    if (statePath != null) {
+      _saveState(_bindings, ctx, statePath);
+    }
+    
+    // Track metrics (both counts in one native call)
+    final counts = _model != null
+        ? _bindings.countTokensBatch(_model!, [prompt, response])
+        : [_bindings.tokenize(prompt), _bindings.tokenize(response)];
+    _recordMetrics(InferenceMetrics(
       timestamp: DateTime.now(),
       duration: stopwatch.elapsed,
-      inputTokens: _bindings.tokenize(prompt),
-      outputTokens: _bindings.tokenize(response),
+      inputTokens: counts[0],
+      outputTokens: counts[1],
       threadsUsed: _optimalThreads,
-    );
-    _metrics.add(metrics);
+    ));
     
-    // Keep only last 100 metrics
+    return response;
+  }
+  
+  /// Exact token count with the loaded model's vocabulary
+  int _countTokens(String text) =>
+      _model != null ? _bindings.countTokens(_model!, text) : _bindings.tokenize(text);
+  
+  /// Record inference metrics, keeping only the last 100
+  void _recordMetrics(InferenceMetrics metrics) {
+    _metrics.add(metrics);
     if (_metrics.length > 100) {
       _metrics.removeAt(0);
     }
-    
-    return response;
   }
   
   /// Build the chat prompt
@@ -311,10 +456,12 @@ class LocalLLMService extends ChangeNotifier {
     buffer.writeln(agent.systemPrompt);
     buffer.writeln('<|im_end|>');
     
-    // Conversation history (last 10 messages)
-    final recentHistory = history.length > 10 
-        ? history.sublist(history.length - 10) 
-        : history;
+    // Conversation history (at most the last _maxHistoryMessages). The
+    // window is trimmed in blocks of 6 so the transcript prefix stays
+    // identical for several turns and the native KV cache can reuse it.
+    final overflow = history.length - _maxHistoryMessages;
+    final start = overflow > 0 ? ((overflow + 5) ~/ 6) * 6 : 0;
+    final recentHistory = history.sublist(start);
     
     for (final msg in recentHistory) {
       final role = msg.role == 'user' ? 'user' : 'assistant';
@@ -350,6 +497,64 @@ class LocalLLMService extends ChangeNotifier {
     return cleaned;
   }
   
+  /// Ask the model about [input] and get JSON matching [schema] back.
+  /// Decoding is constrained to the schema, so the output always parses;
+  /// it runs greedily on a dedicated context. Returns null when the model
+  /// is not ready or another extraction is running.
+  Future<Map<String, dynamic>?> extractStructured({
+    required String instruction,
+    required String input,
+    required String schema,
+    int maxTokens = 256,
+  }) async {
+    if (!isReady || _extracting) return null;
+    _extracting = true;
+    try {
+      final ctx = _extractionContext ??=
+          _bindings.createContext(_model!, nCtx: _extractionContextSize, cacheType: _cacheType);
+      _bindings.setSamplerParams(ctx, const LLMGenerateParams(temperature: 0, repeatPenalty: 1.0));
+      _bindings.setJsonSchema(ctx, schema);
+      
+      final prompt = '<|im_start|>system\n$instruction\n<|im_end|>\n'
+          '<|im_start|>user\n$input\n<|im_end|>\n'
+          '<|im_start|>assistant\n';
+      final output = await _threading.runInference<String>(
+        () async {
+          final buffer = StringBuffer();
+          _bindings.generateStreamWithContext(ctx, prompt, (piece) {
+            buffer.write(piece);
+            return true;
+          }, maxTokens: maxTokens);
+          return buffer.toString();
+        },
+        priority: TaskPriority.low,
+        taskId: 'extract_${DateTime.now().millisecondsSinceEpoch}',
+      );
+      // Output cut off by maxTokens is incomplete JSON
+      final decoded = jsonDecode(output);
+      return decoded is Map<String, dynamic> ? decoded : null;
+    } on FormatException {
+      return null;
+    } finally {
+      _extracting = false;
+    }
+  }
+  
+  /// Unit-length embeddings of [texts] from the loaded model (mean of its
+  /// final hidden states), so a dot product is the cosine similarity.
+  /// Returns null when the model is not ready.
+  Future<List<Float32List>?> embed(List<String> texts) async {
+    if (!isReady) return null;
+    if (texts.isEmpty) return [];
+    final ctx = _embeddingContext ??=
+        _bindings.createContext(_model!, nCtx: _embeddingContextSize, cacheType: _cacheType);
+    return _threading.runInference<List<Float32List>>(
+      () async => _bindings.embed(ctx, texts),
+      priority: TaskPriority.normal,
+      taskId: 'embed_${DateTime.now().microsecondsSinceEpoch}',
+    );
+  }
+  
   /// Stream generation with real-time token streaming
   /// 
   /// This uses a separate isolate for generation while streaming
@@ -363,63 +568,124 @@ class LocalLLMService extends ChangeNotifier {
       throw Exception('LLM Service not ready');
     }
     
-    if (_isGenerating) {
-      throw Exception('Already generating a response');
+    if (isGeneratingFor(agent.id)) {
+      throw Exception('Already generating a response for ${agent.name}');
     }
     
-    _isGenerating = true;
-    notifyListeners();
-    
     final buffer = StringBuffer();
-    final taskId = 'stream_${DateTime.now().millisecondsSinceEpoch}';
-    _currentTaskId = taskId;
+    final taskId = 'stream_${agent.id}_${DateTime.now().millisecondsSinceEpoch}';
+    _activeTasks[agent.id] = taskId;
+    notifyListeners();
     
+    // Completes when the stream isolate exits. It snapshots the context
+    // after the reply is delivered, so the agent stays active (and its
+    // context out of LRU eviction) until then.
+    Future<void>? isolateExit;
     try {
+      final ctx = _contextFor(agent.id);
+      _bindings.setSamplerParams(ctx, _samplingFor(agent));
+      // From here a cancel reaches this generation even while it is
+      // queued or waiting for the context
+      _bindings.reserveGeneration(ctx);
       final prompt = _buildPrompt(
         content: content,
         agent: agent,
         history: conversationHistory,
       );
       
-      // For now, simulate streaming with word-by-word output
-      // In production, this would hook into llama.cpp's token callback
-      final fullResponse = await _threading.runInference<String>(
-        () async => _runInference(prompt, agent),
-        priority: TaskPriority.high,
-        taskId: taskId,
-      );
-      
-      // Stream words for UI responsiveness
-      final words = fullResponse.split(' ');
-      for (int i = 0; i < words.length; i++) {
-        final word = words[i];
-        buffer.write(word);
-        if (i < words.length - 1) buffer.write(' ');
-        
-        yield buffer.toString();
-        _generationController.add(buffer.toString());
+      // Generate on a background isolate; the native callback posts each
+      // decoded fragment back here as soon as it is sampled. The isolate
+      // holds its own reference to the context, so an unload meanwhile
+      // cannot delete it under the isolate.
+      final receivePort = ReceivePort();
+      final exitPort = ReceivePort();
+      final stopwatch = Stopwatch()..start();
+      try {
+        _bindings.retainContext(ctx);
+        try {
+          await Isolate.spawn(
+            _streamGenerationEntry,
+            _StreamRequest(
+              prompt: prompt,
+              contextAddress: ctx.address,
+              statePath: _statePath(agent.id),
+              sendPort: receivePort.sendPort,
+            ),
+            onExit: exitPort.sendPort,
+            debugName: 'TuTuStream',
+          );
+        } catch (_) {
+          _bindings.freeContext(ctx);
+          exitPort.close();
+          rethrow;
+        }
+        isolateExit = exitPort.first.whenComplete(exitPort.close);
         
-        // Small delay for streaming effect
-        await Future.delayed(const Duration(milliseconds: 20));
+        await for (final message in receivePort) {
+          if (message is String) {
+            buffer.write(message);
+            yield buffer.toString();
+            _generationController.add(buffer.toString());
+          } else if (message is _StreamDone) {
+            stopwatch.stop();
+            _recordMetrics(InferenceMetrics(
+              timestamp: DateTime.now(),
+              duration: stopwatch.elapsed,
+              inputTokens: _countTokens(prompt),
+              outputTokens: message.tokensGenerated,
+              threadsUsed: _optimalThreads,
+            ));
+            break;
+          } else if (message is _StreamError) {
+            throw LlamaException(message.error);
+          }
+        }
+      } finally {
+        receivePort.close();
       }
     } finally {
-      _isGenerating = false;
-      _currentTaskId = null;
-      notifyListeners();
+      if (isolateExit == null) {
+        _finishTask(agent.id, taskId);
+      } else {
+        isolateExit.then((_) => _finishTask(agent.id, taskId));
+      }
+    }
+  }
+  
+  /// Mark an agent's task finished, unless a newer one replaced it
+  void _finishTask(String agentId, String taskId) {
+    if (_activeTasks[agentId] == taskId) {
+      _activeTasks.remove(agentId);
     }
+    notifyListeners();
   }
   
-  /// Cancel current generation
-  bool cancelGeneration() {
-    if (_currentTaskId != null && _isGenerating) {
-      final cancelled = _threading.cancelTask(_currentTaskId!);
-      if (cancelled) {
-        _isGenerating = false;
-        notifyListeners();
+  /// Cancel current generation (for one agent, or all agents).
+  /// A queued request is dropped; one already running in native code
+  /// stops within a token and completes with its partial output.
+  bool cancelGeneration({String? agentId}) {
+    final agentIds = agentId != null ? [agentId] : _activeTasks.keys.toList();
+    var cancelled = false;
+    for (final id in agentIds) {
+      final taskId = _activeTasks[id];
+      if (taskId == null) continue;
+      // Drop it if still queued; otherwise it is on its way to native
+      // code (or a stream isolate) and cancelling its reservation on the
+      // context stops it, whether or not it has started decoding
+      if (_threading.isTaskRunning(taskId) || !_threading.cancelTask(taskId)) {
+        final ctx = _contexts[id];
+        if (ctx != null) {
+          _bindings.cancelContext(ctx);
+        }
       }
-      return cancelled;
+      // The task stays active until its native call returns, so the
+      // context cannot be evicted while it is still unwinding
+      cancelled = true;
     }
-    return false;
+    if (cancelled) {
+      notifyListeners();
+    }
+    return cancelled;
   }
   
   /// Get performance statistics
@@ -459,15 +725,40 @@ class LocalLLMService extends ChangeNotifier {
   
   /// Unload model and free resources
   Future<void> unload() async {
-    _bindings.unloadModel();
+    _releaseHandles();
     _setState(LLMServiceState.uninitialized);
   }
   
+  /// Free every warm context and the shared model
+  void _releaseHandles() {
+    for (final ctx in _contexts.values) {
+      _bindings.freeContext(ctx);
+    }
+    _contexts.clear();
+    if (_extractionContext != null) {
+      _bindings.freeContext(_extractionContext!);
+      _extractionContext = null;
+    }
+    if (_embeddingContext != null) {
+      _bindings.freeContext(_embeddingContext!);
+      _embeddingContext = null;
+    }
+    if (_model != null) {
+      _bindings.freeModel(_model!);
+      _model = null;
+    }
+    if (_draftModel != null) {
+      _bindings.freeModel(_draftModel!);
+      _draftModel = null;
+    }
+  }
+  
   /// Dispose the service
   @override
   void dispose() {
     cancelGeneration();
     _generationController.close();
+    _releaseHandles();
     _bindings.dispose();
     _threading.dispose();
     super.dispose();
@@ -481,9 +772,10 @@ class LocalLLMService extends ChangeNotifier {
   
   /// Get estimated memory usage
   String get estimatedMemoryUsage {
-    // SmolLM2-360M Q4_K_M is about 258MB on disk
-    // Loaded in memory it's about 400-500MB
-    return '~450 MB';
+    // SmolLM2-360M Q4_K_M is about 258MB on disk. The weights are
+    // memory-mapped, so they are shared with the page cache of the
+    // extracted file; KV cache and scratch buffers add the rest.
+    return '~300 MB';
   }
   
   /// Check if model needs to be re-extracted
@@ -500,6 +792,75 @@ class LocalLLMService extends ChangeNotifier {
   }
 }
 
+/// Request sent to the streaming generation isolate
+class _StreamRequest {
+  final String prompt;
+  final int contextAddress;
+  final String? statePath;
+  final SendPort sendPort;
+
+  _StreamRequest({
+    required this.prompt,
+    required this.contextAddress,
+    required this.statePath,
+    required this.sendPort,
+  });
+}
+
+/// Sent when streaming generation has finished
+class _StreamDone {
+  final int tokensGenerated;
+
+  _StreamDone(this.tokensGenerated);
+}
+
+/// Sent when streaming generation failed
+class _StreamError {
+  final String error;
+
+  _StreamError(this.error);
+}
+
+/// Streaming generation isolate entry point.
+/// Posts each decoded fragment as a String, then a _StreamDone. Owns one
+/// reference to the context (taken by the spawner), dropped on the way out.
+void _streamGenerationEntry(_StreamRequest request) {
+  final bindings = LlamaBindings();
+  final ctx = LlamaContextHandle(request.contextAddress);
+  try {
+    try {
+      final generated = bindings.generateStreamWithContext(
+        ctx,
+        request.prompt,
+        (piece) {
+          request.sendPort.send(piece);
+          return true;
+        },
+      );
+      request.sendPort.send(_StreamDone(generated));
+    } catch (e) {
+      request.sendPort.send(_StreamError(e.toString()));
+      return;
+    }
+    
+    // Snapshot after the reply is delivered so the UI never waits on disk
+    if (request.statePath != null) {
+      _saveState(bindings, ctx, request.statePath!);
+    }
+  } finally {
+    bindings.freeContext(ctx);
+  }
+}
+
+/// Persist a context's KV state; failures only cost a re-prefill later
+void _saveState(LlamaBindings bindings, LlamaContextHandle ctx, String statePath) {
+  try {
+    bindings.saveContextState(ctx, statePath);
+  } on LlamaException catch (e) {
+    debugPrint('Failed to save KV snapshot: ${e.message}');
+  }
+}
+
 /// Inference performance metrics
 class InferenceMetrics {
   final DateTime timestamp;
@@ -1,87 +1,192 @@
 import 'dart:convert';
+import 'dart:io';
 import 'dart:math';
+import 'package:flutter/foundation.dart';
 import 'package:flutter/services.dart';
+import 'package:path/path.dart' as path;
+import 'package:path_provider/path_provider.dart';
 
 import '../models/qa_bank_model.dart';
+import 'llama_bindings.dart';
 
 /// Offline QA Service - Provides answers without internet
-/// Uses fuzzy matching and keyword search on local QA bank
+/// Uses fuzzy matching and keyword search on local QA bank, scored
+/// natively in one call per query. The bank ships compiled (see
+/// native/tools/qa_bank_compiler.cpp) and is memory-mapped, so startup
+/// decodes nothing; entries are read back only when answered or listed.
+/// Where the native library is missing, the JSON bank is loaded and
+/// scored in Dart with the same formula.
 class OfflineQAService {
   static final OfflineQAService _instance = OfflineQAService._internal();
   factory OfflineQAService() => _instance;
   OfflineQAService._internal();
 
-  List<QABankEntry> _qaBank = [];
+  /// Compiled bank in the app bundle, built from assets/qa_bank.json
+  static const String _bankAsset = 'assets/qa_bank.bin';
+
+  /// Bank source, scored in Dart where the native library is missing
+  static const String _jsonBankAsset = 'assets/qa_bank.json';
+
+  /// Size and checksum of the compiled bank, written beside it by the
+  /// compiler; a copy whose saved stamp matches is current
+  static const String _bankStampAsset = 'assets/qa_bank.stamp';
+
   bool _isLoaded = false;
 
+  /// Native matcher holding the bank, normalized and indexed at build time
+  QAMatcherHandle? _matcher;
+
+  /// Entries read back from the matcher, by index
+  final Map<int, QABankEntry> _entries = {};
+
+  /// The bank when it is scored in Dart (no native matcher)
+  List<QABankEntry>? _dartBank;
+
   /// Minimum confidence threshold for a match (0.0 - 1.0)
   static const double _confidenceThreshold = 0.75;
 
-  /// Load QA bank from assets
+  /// Map the compiled QA bank, or load the JSON one without the native
+  /// library
   Future<void> initialize() async {
     if (_isLoaded) return;
 
+    if (LlamaBindings.isAvailable) {
+      try {
+        _matcher = await _openBank();
+      } catch (e) {
+        // Build the matcher from the JSON bank instead (the built-in list
+        // only if that cannot be read either)
+        debugPrint('Compiled QA bank unavailable, using the JSON bank: $e');
+        _matcher = _buildMatcher(await _loadJsonBank());
+      }
+    }
+    if (_matcher == null) {
+      _dartBank = await _loadJsonBank();
+    }
+    _isLoaded = true;
+  }
+
+  /// Load the QA bank source from assets, for the Dart scorer or when the
+  /// compiled bank is unusable
+  Future<List<QABankEntry>> _loadJsonBank() async {
     try {
-      final jsonString = await rootBundle.loadString('assets/qa_bank.json');
+      final jsonString = await rootBundle.loadString(_jsonBankAsset);
       final List<dynamic> jsonList = jsonDecode(jsonString);
-
-      _qaBank = jsonList
+      return jsonList
           .map((json) => QABankEntry.fromJson(json as Map<String, dynamic>))
           .toList();
-
-      _isLoaded = true;
     } catch (e) {
       // If loading fails, use fallback QA bank
-      _qaBank = _fallbackQABank;
-      _isLoaded = true;
+      return _fallbackQABank;
     }
   }
 
-  /// Find best matching answer for a query
-  Future<QASearchResult?> findAnswer(String query) async {
-    if (!_isLoaded) {
-      await initialize();
+  /// Map the extracted bank. A copy that fails its checks (damaged on
+  /// disk since it was stamped) is extracted again once.
+  Future<QAMatcherHandle> _openBank() async {
+    try {
+      return LlamaBindings().openQAMatcher(await _extractBank());
+    } on LlamaException catch (e) {
+      debugPrint('Extracted QA bank rejected, extracting again: $e');
+      return LlamaBindings().openQAMatcher(await _extractBank(force: true));
     }
+  }
 
-    final normalizedQuery = _normalizeText(query);
-    final queryWords = _tokenize(normalizedQuery);
+  /// Copy the compiled bank out of the app bundle, where it cannot be
+  /// mapped, unless the copy from an earlier run has the bundled stamp.
+  /// Only the small stamp asset is read when the copy is current.
+  Future<String> _extractBank({bool force = false}) async {
+    final appDir = await getApplicationDocumentsDirectory();
+    final bankFile = File(path.join(appDir.path, 'qa_bank.bin'));
+    final stampFile = File('${bankFile.path}.stamp');
+
+    final stamp = (await rootBundle.loadString(_bankStampAsset)).trim();
+    if (!force &&
+        await bankFile.exists() &&
+        await stampFile.exists() &&
+        (await stampFile.readAsString()).trim() == stamp) {
+      return bankFile.path;
+    }
 
-    QABankEntry? bestMatch;
-    double bestScore = 0.0;
-    double bestLevenshtein = 0.0;
-    double bestKeyword = 0.0;
+    // Drop the old stamp first and write beside the bank then rename, so
+    // neither a half-written bank nor a stale stamp is ever trusted
+    if (await stampFile.exists()) await stampFile.delete();
+    final byteData = await rootBundle.load(_bankAsset);
+    final tempFile = File('${bankFile.path}.tmp');
+    await tempFile.writeAsBytes(
+      byteData.buffer.asUint8List(byteData.offsetInBytes, byteData.lengthInBytes),
+      flush: true,
+    );
+    await tempFile.rename(bankFile.path);
+    await stampFile.writeAsString(stamp, flush: true);
+    return bankFile.path;
+  }
 
-    for (final entry in _qaBank) {
-      // Calculate Levenshtein similarity with question
-      final normalizedQuestion = _normalizeText(entry.question);
-      final levScore = _levenshteinSimilarity(
-        normalizedQuery,
-        normalizedQuestion,
-      );
+  /// Load entries into a native matcher, in bank order; null if the
+  /// native library is unavailable
+  QAMatcherHandle? _buildMatcher(List<QABankEntry> entries) {
+    try {
+      final bindings = LlamaBindings();
+      final matcher = bindings.createQAMatcher();
+      for (final entry in entries) {
+        bindings.qaMatcherAdd(
+          matcher,
+          QABankRecord(
+            id: entry.id,
+            question: entry.question,
+            answer: entry.answer,
+            category: entry.category,
+            keywords: entry.keywords,
+            priority: entry.priority,
+          ),
+        );
+      }
+      return matcher;
+    } catch (e) {
+      debugPrint('QA matcher unavailable: $e');
+      return null;
+    }
+  }
 
-      // Calculate keyword overlap score
-      final entryWords = _tokenize(normalizedQuestion);
-      final entryKeywords = entry.keywords.map(_normalizeText).toList();
-      final keyScore = _keywordScore(queryWords, entryWords, entryKeywords);
+  /// Entry [index] of the bank, read from the matcher on first use
+  QABankEntry _entryAt(QAMatcherHandle matcher, int index) {
+    return _entries.putIfAbsent(index, () {
+      final record = LlamaBindings().qaMatcherEntry(matcher, index);
+      return QABankEntry(
+        id: record.id,
+        question: record.question,
+        answer: record.answer,
+        category: record.category,
+        keywords: record.keywords,
+        priority: record.priority,
+      );
+    });
+  }
 
-      // Combine scores with weights
-      final combinedScore = (levScore * 0.6) + (keyScore * 0.4);
-      final weightedScore = combinedScore * entry.priority;
+  /// Every entry of the bank, for the listing helpers below
+  List<QABankEntry> get _qaBank {
+    final matcher = _matcher;
+    if (matcher == null) return _dartBank ?? const [];
+    final count = LlamaBindings().qaMatcherSize(matcher);
+    return [for (var i = 0; i < count; i++) _entryAt(matcher, i)];
+  }
 
-      if (weightedScore > bestScore) {
-        bestScore = weightedScore;
-        bestLevenshtein = levScore;
-        bestKeyword = keyScore;
-        bestMatch = entry;
-      }
+  /// Find best matching answer for a query
+  Future<QASearchResult?> findAnswer(String query) async {
+    if (!_isLoaded) {
+      await initialize();
     }
 
-    if (bestMatch != null && bestScore >= _confidenceThreshold) {
+    final matcher = _matcher;
+    if (matcher == null) return _findAnswerInDart(query);
+
+    final match = LlamaBindings().qaMatcherMatch(matcher, query);
+    if (match != null && match.score >= _confidenceThreshold) {
       return QASearchResult(
-        entry: bestMatch,
-        confidence: bestScore,
-        levenshteinScore: bestLevenshtein,
-        keywordScore: bestKeyword,
+        entry: _entryAt(matcher, match.entry),
+        confidence: match.score,
+        levenshteinScore: match.levenshtein,
+        keywordScore: match.keyword,
       );
     }
 
@@ -123,7 +228,59 @@ class OfflineQAService {
   }
 
   /// Get total QA entries count
-  int get entryCount => _qaBank.length;
+  int get entryCount {
+    final matcher = _matcher;
+    if (matcher == null) return _dartBank?.length ?? 0;
+    return LlamaBindings().qaMatcherSize(matcher);
+  }
+
+  /// Score every entry of the Dart bank against [query], as the native
+  /// matcher does
+  QASearchResult? _findAnswerInDart(String query) {
+    final normalizedQuery = _normalizeText(query);
+    final queryWords = _tokenize(normalizedQuery);
+
+    QABankEntry? bestMatch;
+    double bestScore = 0.0;
+    double bestLevenshtein = 0.0;
+    double bestKeyword = 0.0;
+
+    for (final entry in _dartBank ?? const <QABankEntry>[]) {
+      // Calculate Levenshtein similarity with question
+      final normalizedQuestion = _normalizeText(entry.question);
+      final levScore = _levenshteinSimilarity(
+        normalizedQuery,
+        normalizedQuestion,
+      );
+
+      // Calculate keyword overlap score
+      final entryWords = _tokenize(normalizedQuestion);
+      final entryKeywords = entry.keywords.map(_normalizeText).toList();
+      final keyScore = _keywordScore(queryWords, entryWords, entryKeywords);
+
+      // Combine scores with weights
+      final combinedScore = (levScore * 0.6) + (keyScore * 0.4);
+      final weightedScore = combinedScore * entry.priority;
+
+      if (weightedScore > bestScore) {
+        bestScore = weightedScore;
+        bestLevenshtein = levScore;
+        bestKeyword = keyScore;
+        bestMatch = entry;
+      }
+    }
+
+    if (bestMatch != null && bestScore >= _confidenceThreshold) {
+      return QASearchResult(
+        entry: bestMatch,
+        confidence: bestScore,
+        levenshteinScore: bestLevenshtein,
+        keywordScore: bestKeyword,
+      );
+    }
+
+    return null;
+  }
 
   /// Normalize text for comparison
   String _normalizeText(String text) {
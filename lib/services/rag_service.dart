@@ -1,23 +1,75 @@
-import 'dart:math';
+import 'dart:convert';
+import 'dart:io';
+import 'package:flutter/foundation.dart';
+import 'package:path/path.dart' as path;
+import 'package:path_provider/path_provider.dart';
 import 'package:uuid/uuid.dart';
 
 import '../models/agent_model.dart';
 import '../models/message_model.dart';
 import '../models/memory_model.dart';
+import 'llama_bindings.dart';
+import 'local_llm_service.dart';
 import 'storage_service.dart';
 
 /// RAG Service - Retrieval Augmented Generation
 /// Provides semantic search over conversation history and memories
 class RAGService {
   final StorageService _storage = StorageService();
+  // Only touched once the native library is known to load
+  late final LocalLLMService _llm = LocalLLMService();
   final _uuid = const Uuid();
 
+  /// Native bindings, loaded on first use; null where the bridge library
+  /// is missing, in which case memories are scored in Dart
+  static final LlamaBindings? _native = _loadBindings();
+
+  /// Per-agent embedding indexes, opening or open, shared by every
+  /// RAGService so one file never has two writers
+  static final Map<String, Future<VectorIndexHandle?>> _indexes = {};
+
+  /// Per-agent BM25 indexes, built from storage on first use each run
+  static final Map<String, Future<KeywordIndexHandle>> _keywordIndexes = {};
+
   /// Maximum memories to retrieve for context
   static const int _maxRetrievedMemories = 5;
 
   /// Auto-summarization threshold
   static const int _summarizationThreshold = 100;
 
+  /// Cosine similarity below which an embedding match is ignored; mean
+  /// pooled chat-model vectors are never far apart
+  static const double _minSemanticScore = 0.5;
+
+  /// Shape of the model's memory extraction output. Decoding is
+  /// constrained to it, so every reply parses into these fields.
+  static final String _memorySchema = jsonEncode({
+    'type': 'object',
+    'properties': {
+      'memories': {
+        'type': 'array',
+        'maxItems': 4,
+        'items': {
+          'type': 'object',
+          'properties': {
+            'content': {'type': 'string', 'minLength': 1, 'maxLength': 200},
+            'type': {'enum': ['preference', 'fact', 'event']},
+            'category': {'type': 'string', 'maxLength': 24},
+            'importance': {'type': 'number'},
+          },
+          'required': ['content', 'type', 'category', 'importance'],
+        },
+      },
+    },
+    'required': ['memories'],
+  });
+
+  static const String _extractionInstruction =
+      'Extract facts worth remembering about the user from their message: '
+      'preferences, personal facts and upcoming events. Write each as a '
+      'short third-person sentence and rate its importance from 0 to 1. '
+      'Return an empty list when there is nothing to remember.';
+
   /// Add content to agent's memory
   Future<void> addToMemory({
     required String agentId,
@@ -30,6 +82,7 @@ class RAGService {
   }) async {
     // Extract keywords from content
     final keywords = _extractKeywords(content);
+    final embedding = await _embed(content);
 
     final memory = Memory(
       id: _uuid.v4(),
@@ -42,9 +95,28 @@ class RAGService {
       category: category,
       relatedFaceId: relatedFaceId,
       metadata: metadata,
+      embedding: embedding,
     );
 
     await _storage.saveMemory(memory);
+
+    // The memory is saved either way; an index that cannot take it only
+    // leaves it out of native searches
+    final bindings = _native;
+    if (bindings == null) return;
+    try {
+      final keywordIndex = await _keywordIndexFor(agentId);
+      if (keywordIndex != null) _addToKeywordIndex(keywordIndex, memory);
+      if (embedding != null) {
+        final index = await _indexFor(agentId, embedding.length);
+        if (index != null) {
+          bindings.indexAdd(index, memory.id, embedding);
+          bindings.flushIndex(index);
+        }
+      }
+    } on LlamaException catch (e) {
+      debugPrint('Memory indexing failed: $e');
+    }
   }
 
   /// Search agent's memory for relevant content
@@ -53,32 +125,98 @@ class RAGService {
     required String query,
     int limit = _maxRetrievedMemories,
   }) async {
-    // Get all memories for agent
-    final memories = await _storage.getMemoriesByAgent(agentId);
-    if (memories.isEmpty) return [];
+    final bindings = _native;
+    final keywordIndex = await _keywordIndexFor(agentId);
+    if (bindings == null || keywordIndex == null) {
+      return _searchMemoryInDart(agentId, query, limit);
+    }
+
+    // BM25 over the agent's words and nearest neighbours of the query's
+    // embedding, fused natively; words alone when there is no embedding
+    final queryEmbedding = await _embed(query);
+    final vectors = queryEmbedding == null
+        ? null
+        : await _indexFor(agentId, queryEmbedding.length);
+    final List<MemoryMatch> matches;
+    try {
+      matches = bindings.memorySearch(
+        keywordIndex,
+        vectors,
+        query,
+        vectors == null ? null : queryEmbedding,
+        k: limit,
+        minSimilarity: _minSemanticScore,
+      );
+    } on LlamaException catch (e) {
+      debugPrint('Memory search failed: $e');
+      return [];
+    }
+    if (matches.isEmpty) return [];
+
+    final memories = {
+      for (final memory in await _storage.getMemoriesByIds([for (final m in matches) m.id]))
+        memory.id: memory,
+    };
+
+    // Drop index entries whose memory was deleted
+    if (memories.length < matches.length) {
+      for (final match in matches.where((m) => !memories.containsKey(m.id))) {
+        bindings.keywordIndexRemove(keywordIndex, match.id);
+        if (vectors != null) bindings.indexRemove(vectors, match.id);
+      }
+      if (vectors != null) bindings.flushIndex(vectors);
+    }
 
-    // Normalize query
-    final normalizedQuery = _normalizeText(query);
-    final queryWords = _tokenize(normalizedQuery);
+    // Already best first
+    return [
+      for (final match in matches)
+        if (memories[match.id] != null)
+          MemorySearchResult(
+            memory: memories[match.id]!,
+            relevanceScore: match.score,
+            tfidfScore: match.lexical,
+            semanticScore: match.semantic,
+          ),
+    ];
+  }
 
-    // Calculate TF-IDF scores
-    final scoredMemories = <MemorySearchResult>[];
+  /// Search without the native indexes: each memory's share of query
+  /// words, weighted by its importance
+  Future<List<MemorySearchResult>> _searchMemoryInDart(
+    String agentId,
+    String query,
+    int limit,
+  ) async {
+    final queryWords = _tokenize(_normalizeText(query));
+    if (queryWords.isEmpty) return [];
 
-    for (final memory in memories) {
-      final score = _calculateTFIDFScore(queryWords, memory);
+    final scored = <MemorySearchResult>[];
+    for (final memory in await _storage.getMemoriesByAgent(agentId)) {
+      final score = _keywordScore(queryWords, memory);
       if (score > 0) {
-        scoredMemories.add(MemorySearchResult(
+        scored.add(MemorySearchResult(
           memory: memory,
           relevanceScore: score * memory.importance,
           tfidfScore: score,
         ));
       }
     }
+    scored.sort((a, b) => b.relevanceScore.compareTo(a.relevanceScore));
+    return scored.take(limit).toList();
+  }
 
-    // Sort by relevance
-    scoredMemories.sort((a, b) => b.relevanceScore.compareTo(a.relevanceScore));
+  /// Term frequency of the query words in a memory, averaged over the
+  /// query
+  double _keywordScore(List<String> queryWords, Memory memory) {
+    final memoryWords =
+        _tokenize(_normalizeText('${memory.content} ${memory.keywords.join(' ')}'));
+    if (memoryWords.isEmpty) return 0.0;
 
-    return scoredMemories.take(limit).toList();
+    var score = 0.0;
+    for (final queryWord in queryWords) {
+      score += memoryWords.where((w) => w == queryWord).length / memoryWords.length;
+    }
+    return score / queryWords.length;
   }
 
   /// Process conversation for memory extraction
@@ -93,8 +231,10 @@ class RAGService {
     // Only process user messages for memory extraction
     if (!lastMessage.isUser) return;
 
-    // Extract important information
-    final extractedInfo = _extractImportantInfo(lastMessage.content);
+    // Extract important information with the model, falling back to
+    // pattern matching when it is unavailable
+    final extractedInfo = await _extractWithModel(lastMessage.content) ??
+        _extractImportantInfo(lastMessage.content);
     
     for (final info in extractedInfo) {
       await addToMemory(
@@ -172,7 +312,141 @@ class RAGService {
     );
   }
 
-  /// Extract important information from message
+  /// Embedding of text from the local model, or null when it is not loaded
+  Future<List<double>?> _embed(String text) async {
+    if (_native == null || !_llm.isReady) return null;
+    try {
+      final vectors = await _llm.embed([text]);
+      // A plain list, so storage can serialize it
+      return vectors == null ? null : List<double>.of(vectors.first);
+    } catch (_) {
+      return null;
+    }
+  }
+
+  /// The agent's embedding index, opened on first use. An index that
+  /// cannot be opened (left half-written, or built for another model's
+  /// dimension) is deleted and rebuilt from the stored embeddings, as is
+  /// a new one for an agent that already has memories.
+  Future<VectorIndexHandle?> _indexFor(String agentId, int dim) async {
+    final bindings = _native;
+    if (bindings == null) return null;
+    final pending = _indexes[agentId];
+    if (pending == null) {
+      // Registered before the first await, so concurrent callers share it
+      return _indexes[agentId] = _openIndex(bindings, agentId, dim);
+    }
+
+    final open = await pending;
+    if (open != null && bindings.indexDimension(open) == dim) return open;
+    // Unavailable last time, or the model changed and its vectors are not
+    // comparable. Whoever finds the entry still in place replaces it.
+    if (identical(_indexes[agentId], pending)) {
+      _indexes.remove(agentId);
+      if (open != null) bindings.closeIndex(open);
+    }
+    return _indexFor(agentId, dim);
+  }
+
+  /// Open the agent's index file for [_indexFor], rebuilding it if needed
+  Future<VectorIndexHandle?> _openIndex(LlamaBindings bindings, String agentId, int dim) async {
+    final appDir = await getApplicationDocumentsDirectory();
+    final dir = Directory(path.join(appDir.path, 'memory_index'));
+    if (!await dir.exists()) {
+      await dir.create(recursive: true);
+    }
+    final file = File(path.join(dir.path, '$agentId.hnsw'));
+
+    VectorIndexHandle index;
+    try {
+      index = bindings.openIndex(file.path, dim);
+    } on LlamaException catch (e) {
+      debugPrint('Rebuilding memory index for $agentId: $e');
+      try {
+        await file.delete();
+        index = bindings.openIndex(file.path, dim);
+      } on Exception catch (e) {
+        debugPrint('Memory index unavailable: $e');
+        return null;
+      }
+    }
+
+    if (bindings.indexSize(index) == 0 && bindings.indexRemoved(index) == 0) {
+      final memories = await _storage.getMemoriesByAgent(agentId);
+      for (final memory in memories) {
+        final embedding = memory.embedding;
+        if (embedding != null && embedding.length == dim) {
+          bindings.indexAdd(index, memory.id, embedding);
+        }
+      }
+      bindings.flushIndex(index);
+    }
+    return index;
+  }
+
+  /// The agent's keyword index, built from its stored memories the first
+  /// time it is needed and kept up to date by [addToMemory]; null without
+  /// the native library
+  Future<KeywordIndexHandle?> _keywordIndexFor(String agentId) async {
+    final bindings = _native;
+    if (bindings == null) return null;
+    return _keywordIndexes.putIfAbsent(agentId, () async {
+      final index = bindings.createKeywordIndex();
+      for (final memory in await _storage.getMemoriesByAgent(agentId)) {
+        _addToKeywordIndex(index, memory);
+      }
+      return index;
+    });
+  }
+
+  /// Index a memory by its words, keeping the importance and expiry that
+  /// weight it in searches
+  void _addToKeywordIndex(KeywordIndexHandle index, Memory memory) {
+    _native!.keywordIndexAdd(
+      index,
+      memory.id,
+      '${memory.content} ${memory.keywords.join(' ')}',
+      importance: memory.importance,
+      expiresAt: memory.expiresAt,
+    );
+  }
+
+  /// Extract important information with schema-constrained generation.
+  /// Returns null when the model is not loaded or busy extracting.
+  Future<List<_ExtractedInfo>?> _extractWithModel(String content) async {
+    if (_native == null || !_llm.isReady) return null;
+    final Map<String, dynamic>? result;
+    try {
+      result = await _llm.extractStructured(
+        instruction: _extractionInstruction,
+        input: content,
+        schema: _memorySchema,
+      );
+    } catch (_) {
+      return null;
+    }
+    if (result == null) return null;
+
+    const types = {
+      'preference': MemoryType.preference,
+      'fact': MemoryType.fact,
+      'event': MemoryType.event,
+    };
+    return [
+      for (final item in (result['memories'] as List).cast<Map<String, dynamic>>())
+        if ((item['content'] as String).trim().isNotEmpty)
+          _ExtractedInfo(
+            content: (item['content'] as String).trim(),
+            type: types[item['type']]!,
+            importance: (item['importance'] as num).toDouble().clamp(0.0, 1.0),
+            category: (item['category'] as String).isEmpty
+                ? item['type'] as String
+                : item['category'] as String,
+          ),
+    ];
+  }
+
+  /// Extract important information from message by pattern matching
   List<_ExtractedInfo> _extractImportantInfo(String content) {
     final extracted = <_ExtractedInfo>[];
     final normalized = _normalizeText(content);
@@ -257,6 +531,16 @@ class RAGService {
     return extracted;
   }
 
+  static LlamaBindings? _loadBindings() {
+    if (!LlamaBindings.isAvailable) return null;
+    try {
+      return LlamaBindings();
+    } catch (e) {
+      debugPrint('Native memory search unavailable: $e');
+      return null;
+    }
+  }
+
   /// Extract keywords from text
   List<String> _extractKeywords(String text) {
     final normalized = _normalizeText(text);
@@ -326,31 +610,6 @@ class RAGService {
            'Main topics: ${topics.join(', ')}.';
   }
 
-  /// Calculate TF-IDF score for a memory
-  double _calculateTFIDFScore(List<String> queryWords, Memory memory) {
-    if (queryWords.isEmpty) return 0.0;
-
-    // Calculate term frequency
-    double score = 0.0;
-    final memoryText = '${memory.content} ${memory.keywords.join(' ')}';
-    final memoryWords = _tokenize(_normalizeText(memoryText));
-
-    for (final queryWord in queryWords) {
-      // TF: frequency in memory
-      final tf = memoryWords.where((w) => w == queryWord).length / 
-                 max(memoryWords.length, 1);
-      
-      // IDF: inverse document frequency (simplified)
-      // We assume a corpus size of 1000 for approximation
-      const idf = 1.0; // Simplified IDF
-      
-      score += tf * idf;
-    }
-
-    // Normalize by query length
-    return score / queryWords.length;
-  }
-
   /// Normalize text
   String _normalizeText(String text) {
     return text
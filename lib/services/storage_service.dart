@@ -198,6 +198,15 @@ class StorageService {
       ..removeWhere((m) => m.isExpired);
   }
 
+  /// Get memories by id; missing and expired ones are left out
+  Future<List<Memory>> getMemoriesByIds(List<String> ids) async {
+    final values = await _memoriesStore.records(ids).get(_db!);
+    return [
+      for (final value in values)
+        if (value != null) Memory.fromJson(value),
+    ]..removeWhere((m) => m.isExpired);
+  }
+
   /// Search memories by keywords
   Future<List<Memory>> searchMemories(
     String agentId,
@@ -77,7 +77,7 @@ class ThreadPoolConfig {
 
   const ThreadPoolConfig({
     this.maxIsolates = 4,
-    this.maxConcurrentInference = 1,
+    this.maxConcurrentInference = 2,
     this.maxConcurrentRAG = 2,
     this.taskTimeout = const Duration(seconds: 120),
     this.idleTimeout = const Duration(minutes: 5),
@@ -91,7 +91,7 @@ class ThreadPoolConfig {
     
     return ThreadPoolConfig(
       maxIsolates: processors,
-      maxConcurrentInference: 1,  // Only one inference at a time
+      maxConcurrentInference: 2,  // Merged into shared passes natively
       maxConcurrentRAG: math.min(2, processors),
       taskTimeout: const Duration(seconds: 120),
       idleTimeout: const Duration(minutes: 5),
@@ -133,6 +133,9 @@ class ThreadingService {
   int get pendingTaskCount => _taskQueue.length;
   int get activeTaskCount => _activeTasks.length;
 
+  /// Whether the task has left the queue and is executing
+  bool isTaskRunning(String taskId) => _activeTasks.containsKey(taskId);
+
   /// Initialize the threading service
   Future<void> initialize({ThreadPoolConfig? config}) async {
     if (_initialized) return;
@@ -209,12 +212,16 @@ class ThreadingService {
   bool _shouldQueueTask(BackgroundTask task) {
     switch (task.type) {
       case TaskType.inference:
+        // Concurrent generations share forward passes in the native
+        // scheduler, so a couple at once beat running them in turn
+        final activeModel = _activeTasks.values.where((t) => t.type == TaskType.modelLoad).length;
+        final activeInference = _activeTasks.values.where((t) => t.type == TaskType.inference).length;
+        return activeModel > 0 || activeInference >= _config.maxConcurrentInference;
+        
       case TaskType.modelLoad:
-        // Only one inference/model load at a time
-        final activeInference = _activeTasks.values
-            .where((t) => t.type == TaskType.inference || t.type == TaskType.modelLoad)
-            .length;
-        return activeInference >= _config.maxConcurrentInference;
+        // A model load runs alone
+        return _activeTasks.values
+            .any((t) => t.type == TaskType.inference || t.type == TaskType.modelLoad);
         
       case TaskType.ragSearch:
         final activeRAG = _activeTasks.values
@@ -74,7 +74,7 @@ class Routes {
 
 /// Asset paths
 class Assets {
-  static const String qaBank = 'assets/qa_bank.json';
+  static const String qaBank = 'assets/qa_bank.bin';
   static const String defaultModel = 'assets/models/SmolLM2-360M-Instruct-Q4_K_M.gguf';
   static const String imagesDir = 'assets/images/';
   static const String modelsDir = 'assets/models/';
@@ -0,0 +1,115 @@
+/**
+ * batch_scheduler.cpp - Continuous batching of contexts sharing one model
+ */
+
+#include "batch_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace tutu {
+
+namespace {
+
+// How long the leading thread holds a pass for active contexts that have
+// not submitted their step yet. Long enough to cover sampling and a token
+// callback, short next to a forward pass.
+constexpr auto kGatherWait = std::chrono::milliseconds(1);
+
+// Every merged step returns at least one row of logits
+constexpr int32_t kMaxSeqs = LlamaContext::kMaxLogitRows;
+
+} // namespace
+
+void BatchScheduler::begin() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_active;
+}
+
+void BatchScheduler::end() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    --m_active;
+    // A leader may be waiting for this context's step
+    m_cv.notify_all();
+}
+
+int32_t BatchScheduler::take(LlamaContext::Seq* seqs, Request** reqs) {
+    const LlamaContext& first = *m_queue.front()->seq.ctx;
+    const int32_t max_rows = first.n_ubatch();
+    const int32_t max_out = std::min(max_rows, LlamaContext::kMaxLogitRows);
+    int32_t n_seqs = 0;
+    int32_t rows = 0;
+    int32_t out = 0;
+    for (auto it = m_queue.begin(); it != m_queue.end() && n_seqs < kMaxSeqs;) {
+        const LlamaContext::Seq& seq = (*it)->seq;
+        const int32_t seq_out = seq.all_logits ? seq.n : 1;
+        // The front request always goes, so a bad one cannot stall the queue
+        if (n_seqs > 0 && (seq.ctx->model() != first.model() || rows + seq.n > max_rows ||
+                           out + seq_out > max_out)) {
+            ++it;
+            continue;
+        }
+        seqs[n_seqs] = seq;
+        reqs[n_seqs] = *it;
+        ++n_seqs;
+        rows += seq.n;
+        out += seq_out;
+        it = m_queue.erase(it);
+    }
+    return n_seqs;
+}
+
+const float* BatchScheduler::decode(LlamaContext& ctx, const int32_t* tokens, int32_t n, bool all_logits) {
+    Request req;
+    req.seq = {&ctx, tokens, n, all_logits, nullptr};
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue.push_back(&req);
+    m_cv.notify_all();
+
+    while (!req.done) {
+        if (m_running) {
+            m_cv.wait(lock);
+            continue;
+        }
+
+        // Lead the next pass, once the other active contexts have had a
+        // moment to submit their steps
+        const auto deadline = std::chrono::steady_clock::now() + kGatherWait;
+        while (!req.done && !m_running && static_cast<int32_t>(m_queue.size()) < m_active) {
+            if (m_cv.wait_until(lock, deadline) == std::cv_status::timeout) break;
+        }
+        if (req.done || m_running) continue;
+
+        LlamaContext::Seq seqs[kMaxSeqs];
+        Request* reqs[kMaxSeqs];
+        const int32_t n_seqs = take(seqs, reqs);
+        m_running = true;
+        lock.unlock();
+        try {
+            LlamaContext::decode_multi(seqs, n_seqs);
+        } catch (...) {
+            // Fail the whole pass rather than leave the other contexts
+            // waiting on it for good
+            lock.lock();
+            m_running = false;
+            for (int32_t i = 0; i < n_seqs; ++i) {
+                reqs[i]->seq.logits = nullptr;
+                reqs[i]->done = true;
+            }
+            if (!req.done) m_queue.erase(std::find(m_queue.begin(), m_queue.end(), &req));
+            m_cv.notify_all();
+            throw;
+        }
+        lock.lock();
+        m_running = false;
+        for (int32_t i = 0; i < n_seqs; ++i) {
+            reqs[i]->seq.logits = seqs[i].logits;
+            reqs[i]->done = true;
+        }
+        m_cv.notify_all();
+    }
+    return req.seq.logits;
+}
+
+} // namespace tutu
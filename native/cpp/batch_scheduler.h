@@ -0,0 +1,70 @@
+/**
+ * batch_scheduler.h - Continuous batching of contexts sharing one model
+ *
+ * Each generating context still runs its own loop on its own thread, and
+ * sampling and token callbacks stay on that thread. Only the forward
+ * passes meet here: a step submitted while others are pending is merged
+ * with them into one LlamaContext::decode_multi call, run by whichever
+ * waiting thread gets there first. A chat reply and a background summary
+ * then share every pass over the weights instead of taking turns.
+ *
+ * Contexts count as active between begin() and end() (generate() brackets
+ * itself with an Active guard). Before running a pass, the leading thread
+ * waits a moment for every active context to submit its step, since the
+ * others are usually just sampling their previous one.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "llama_context.h"
+
+namespace tutu {
+
+class BatchScheduler {
+public:
+    // Marks a context active for its lifetime; a null scheduler is a no-op
+    class Active {
+    public:
+        explicit Active(BatchScheduler* scheduler) : m_scheduler(scheduler) {
+            if (m_scheduler != nullptr) m_scheduler->begin();
+        }
+        ~Active() {
+            if (m_scheduler != nullptr) m_scheduler->end();
+        }
+        Active(const Active&) = delete;
+        Active& operator=(const Active&) = delete;
+
+    private:
+        BatchScheduler* m_scheduler;
+    };
+
+    void begin();
+    void end();
+
+    // Evaluate tokens on ctx like ctx.decode_batch, merged with whatever
+    // other contexts have submitted. Blocks until this step is done.
+    const float* decode(LlamaContext& ctx, const int32_t* tokens, int32_t n, bool all_logits);
+
+private:
+    struct Request {
+        LlamaContext::Seq seq;
+        bool done = false;
+    };
+
+    // Move the request at the front of the queue, and the later ones that
+    // fit its micro-batch with it, into seqs/reqs. Returns how many.
+    int32_t take(LlamaContext::Seq* seqs, Request** reqs);
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Request*> m_queue;
+    int32_t m_active = 0;
+    bool m_running = false;
+};
+
+} // namespace tutu
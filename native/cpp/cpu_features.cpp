@@ -0,0 +1,70 @@
+/**
+ * cpu_features.cpp - Runtime detection of SIMD instruction sets
+ */
+
+#include "cpu_features.h"
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#elif defined(__aarch64__) && defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+
+namespace tutu {
+
+namespace {
+
+CpuFeatures detect() {
+    CpuFeatures f;
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    // __builtin_cpu_supports also checks that the OS saves AVX state
+    __builtin_cpu_init();
+    f.avx2 = __builtin_cpu_supports("avx2");
+    f.fma = __builtin_cpu_supports("fma");
+    f.f16c = __builtin_cpu_supports("f16c");
+    f.avx512f = __builtin_cpu_supports("avx512f");
+    f.avx512bw = __builtin_cpu_supports("avx512bw");
+#elif defined(__aarch64__)
+    // Advanced SIMD is mandatory on AArch64
+    f.neon = true;
+#if defined(__linux__)
+    // HWCAP_ASIMDDP; spelled out for older NDK headers
+    const unsigned long hwcap = getauxval(AT_HWCAP);
+    f.dotprod = (hwcap & (1UL << 20)) != 0;
+#elif defined(__APPLE__)
+    int value = 0;
+    size_t size = sizeof(value);
+    if (sysctlbyname("hw.optional.arm.FEAT_DotProd", &value, &size, nullptr, 0) == 0) {
+        f.dotprod = value != 0;
+    }
+#endif
+#endif
+    return f;
+}
+
+} // namespace
+
+const CpuFeatures& cpu_features() {
+    static const CpuFeatures features = detect();
+    return features;
+}
+
+std::string cpu_features_string() {
+    const CpuFeatures& f = cpu_features();
+    std::string s;
+    auto add = [&s](bool on, const char* name) {
+        if (!on) return;
+        if (!s.empty()) s += ' ';
+        s += name;
+    };
+    add(f.avx2, "AVX2");
+    add(f.fma, "FMA");
+    add(f.f16c, "F16C");
+    add(f.avx512f, "AVX512F");
+    add(f.avx512bw, "AVX512BW");
+    add(f.neon, "NEON");
+    add(f.dotprod, "DOTPROD");
+    return s.empty() ? "none" : s;
+}
+
+} // namespace tutu
@@ -0,0 +1,30 @@
+/**
+ * cpu_features.h - Runtime detection of SIMD instruction sets
+ *
+ * Queried once per process. On x86 this uses cpuid (including the OS
+ * XSAVE check for AVX state); on ARM it reads the auxiliary vector
+ * hwcaps, or sysctl on Apple platforms.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace tutu {
+
+struct CpuFeatures {
+    bool avx2 = false;
+    bool fma = false;
+    bool f16c = false;
+    bool avx512f = false;
+    bool avx512bw = false;
+    bool neon = false;
+    bool dotprod = false;
+};
+
+const CpuFeatures& cpu_features();
+
+// Space-separated list of the detected features, for diagnostics
+std::string cpu_features_string();
+
+} // namespace tutu
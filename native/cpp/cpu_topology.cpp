@@ -0,0 +1,159 @@
+/**
+ * cpu_topology.cpp - Core layout of heterogeneous (big.LITTLE) CPUs
+ */
+
+#include "cpu_topology.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace tutu {
+
+namespace {
+
+// First unsigned integer in a sysfs file, or 0
+uint32_t read_u32(const std::string& path) {
+    std::ifstream in(path);
+    unsigned long value = 0;
+    if (!(in >> value)) return 0;
+    return static_cast<uint32_t>(value);
+}
+
+// Parse a sysfs cpu list such as "0-3,6,8-9"
+std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+        const std::string item = list.substr(pos, end - pos);
+        int first = 0;
+        int last = 0;
+        const int n = sscanf(item.c_str(), "%d-%d", &first, &last);
+        if (n >= 1) {
+            if (n == 1) last = first;
+            for (int c = first; c <= last && c - first < 4096; ++c) cpus.push_back(c);
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+CpuTopology detect() {
+    CpuTopology topo;
+#if defined(__linux__)
+    const std::string base = "/sys/devices/system/cpu/";
+    std::string online;
+    {
+        std::ifstream in(base + "online");
+        std::getline(in, online);
+    }
+
+    for (int id : parse_cpu_list(online)) {
+        const std::string dir = base + "cpu" + std::to_string(id) + "/";
+        CpuCore core;
+        core.id = id;
+        core.max_freq_khz = read_u32(dir + "cpufreq/cpuinfo_max_freq");
+        core.capacity = read_u32(dir + "cpu_capacity");
+        topo.cores.push_back(core);
+    }
+
+    // Rank by frequency, or by capacity when some frequency is missing
+    const bool have_freq = !topo.cores.empty() &&
+        std::all_of(topo.cores.begin(), topo.cores.end(), [](const CpuCore& c) { return c.max_freq_khz > 0; });
+    const bool have_capacity = !topo.cores.empty() &&
+        std::all_of(topo.cores.begin(), topo.cores.end(), [](const CpuCore& c) { return c.capacity > 0; });
+    auto speed = [&](const CpuCore& c) { return have_freq ? c.max_freq_khz : c.capacity; };
+
+    if (have_freq || have_capacity) {
+        uint32_t slowest = UINT32_MAX;
+        for (const CpuCore& c : topo.cores) slowest = std::min(slowest, speed(c));
+        for (const CpuCore& c : topo.cores) {
+            if (speed(c) > slowest) topo.performance.push_back(c.id);
+        }
+    }
+    if (topo.performance.empty()) {
+        for (const CpuCore& c : topo.cores) topo.performance.push_back(c.id);
+    }
+#endif
+    return topo;
+}
+
+} // namespace
+
+const CpuTopology& cpu_topology() {
+    static const CpuTopology topology = detect();
+    return topology;
+}
+
+std::vector<int> cpu_affinity_for(int n_threads) {
+    const CpuTopology& topo = cpu_topology();
+    // Pinning only pays off when it actually excludes slower cores
+    if (topo.performance.size() == topo.cores.size()) return {};
+    if (n_threads > static_cast<int>(topo.performance.size())) return {};
+    return topo.performance;
+}
+
+bool pin_current_thread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) {
+        if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+std::string cpu_topology_string() {
+    const CpuTopology& topo = cpu_topology();
+    if (topo.cores.empty()) return "unknown";
+
+    // Count cores per distinct speed, slowest first
+    std::map<uint32_t, int> groups;
+    bool by_freq = true;
+    for (const CpuCore& c : topo.cores) by_freq = by_freq && c.max_freq_khz > 0;
+    for (const CpuCore& c : topo.cores) ++groups[by_freq ? c.max_freq_khz : c.capacity];
+
+    std::string s = std::to_string(topo.cores.size()) + (topo.cores.size() == 1 ? " core" : " cores");
+    if (groups.size() == 1 && groups.begin()->first == 0) return s;
+    s += ":";
+    bool first = true;
+    for (const auto& g : groups) {
+        char buf[64];
+        if (by_freq) {
+            snprintf(buf, sizeof(buf), "%s %d x %.2f GHz", first ? "" : ",", g.second, g.first / 1e6);
+        } else {
+            snprintf(buf, sizeof(buf), "%s %d x capacity %u", first ? "" : ",", g.second, g.first);
+        }
+        s += buf;
+        first = false;
+    }
+    return s;
+}
+
+std::string cpu_list_string(const std::vector<int>& cpus) {
+    std::string s;
+    size_t i = 0;
+    while (i < cpus.size()) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+        if (!s.empty()) s += ',';
+        s += std::to_string(cpus[i]);
+        if (j > i) s += "-" + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return s;
+}
+
+} // namespace tutu
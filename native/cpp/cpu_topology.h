@@ -0,0 +1,48 @@
+/**
+ * cpu_topology.h - Core layout of heterogeneous (big.LITTLE) CPUs
+ *
+ * Reads each core's maximum frequency from /sys/devices/system/cpu (or
+ * its relative capacity when cpufreq is unavailable) so decode threads
+ * can be kept off the efficiency cluster. On platforms without sysfs
+ * the core list is empty and nothing is pinned.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tutu {
+
+struct CpuCore {
+    int id = 0;
+    uint32_t max_freq_khz = 0;  // 0 when unknown
+    uint32_t capacity = 0;      // arm64 cpu_capacity (1024 = fastest), 0 when unknown
+};
+
+struct CpuTopology {
+    std::vector<CpuCore> cores;
+    // Cores outside the slowest cluster; every core when all are alike
+    // or their speeds are unknown
+    std::vector<int> performance;
+};
+
+// Read once per process
+const CpuTopology& cpu_topology();
+
+// Cores a pool of n_threads should be pinned to: the performance cores
+// when the pool fits on them, otherwise none (no pinning)
+std::vector<int> cpu_affinity_for(int n_threads);
+
+// Restrict the calling thread to the given cores. Returns false when
+// unsupported or refused by the OS.
+bool pin_current_thread(const std::vector<int>& cpus);
+
+// "8 cores: 4 x 1.80 GHz, 4 x 2.40 GHz", for diagnostics
+std::string cpu_topology_string();
+
+// "4-7" style list of core ids
+std::string cpu_list_string(const std::vector<int>& cpus);
+
+} // namespace tutu
@@ -0,0 +1,502 @@
+/**
+ * gguf.cpp - Memory-mapped GGUF model file reader
+ */
+
+#include "gguf.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tutu {
+
+// ============================================================================
+// Type Traits
+// ============================================================================
+
+int64_t ggml_block_size(GGMLType type) {
+    switch (type) {
+        case GGMLType::F32:
+        case GGMLType::F16:
+        case GGMLType::BF16:
+            return 1;
+        case GGMLType::Q4_0:
+        case GGMLType::Q4_1:
+        case GGMLType::Q5_0:
+        case GGMLType::Q5_1:
+        case GGMLType::Q8_0:
+        case GGMLType::Q8_1:
+            return 32;
+        case GGMLType::Q2_K:
+        case GGMLType::Q3_K:
+        case GGMLType::Q4_K:
+        case GGMLType::Q5_K:
+        case GGMLType::Q6_K:
+        case GGMLType::Q8_K:
+            return 256;
+    }
+    return 0;
+}
+
+size_t ggml_type_size(GGMLType type) {
+    switch (type) {
+        case GGMLType::F32:  return 4;
+        case GGMLType::F16:  return 2;
+        case GGMLType::BF16: return 2;
+        case GGMLType::Q4_0: return 18;
+        case GGMLType::Q4_1: return 20;
+        case GGMLType::Q5_0: return 22;
+        case GGMLType::Q5_1: return 24;
+        case GGMLType::Q8_0: return 34;
+        case GGMLType::Q8_1: return 36;
+        case GGMLType::Q2_K: return 84;
+        case GGMLType::Q3_K: return 110;
+        case GGMLType::Q4_K: return 144;
+        case GGMLType::Q5_K: return 176;
+        case GGMLType::Q6_K: return 210;
+        case GGMLType::Q8_K: return 292;
+    }
+    return 0;
+}
+
+const char* ggml_type_name(GGMLType type) {
+    switch (type) {
+        case GGMLType::F32:  return "f32";
+        case GGMLType::F16:  return "f16";
+        case GGMLType::BF16: return "bf16";
+        case GGMLType::Q4_0: return "q4_0";
+        case GGMLType::Q4_1: return "q4_1";
+        case GGMLType::Q5_0: return "q5_0";
+        case GGMLType::Q5_1: return "q5_1";
+        case GGMLType::Q8_0: return "q8_0";
+        case GGMLType::Q8_1: return "q8_1";
+        case GGMLType::Q2_K: return "q2_K";
+        case GGMLType::Q3_K: return "q3_K";
+        case GGMLType::Q4_K: return "q4_K";
+        case GGMLType::Q5_K: return "q5_K";
+        case GGMLType::Q6_K: return "q6_K";
+        case GGMLType::Q8_K: return "q8_K";
+    }
+    return "unknown";
+}
+
+size_t ggml_row_size(GGMLType type, int64_t n_elements) {
+    const int64_t block = ggml_block_size(type);
+    if (block == 0) return 0;
+    return ggml_type_size(type) * static_cast<size_t>(n_elements / block);
+}
+
+// ============================================================================
+// Bounds-checked Reader
+// ============================================================================
+
+namespace {
+
+constexpr uint32_t GGUF_MAGIC = 0x46554747; // "GGUF" little-endian
+constexpr uint32_t GGUF_DEFAULT_ALIGNMENT = 32;
+
+// Smallest possible encodings: a key/value is an empty key (8-byte
+// length), its type and a one-byte value; a tensor info is an empty name,
+// n_dims, one dimension, its type and its offset
+constexpr uint64_t GGUF_MIN_KV_SIZE = 8 + 4 + 1;
+constexpr uint64_t GGUF_MIN_TENSOR_INFO_SIZE = 8 + 4 + 8 + 4 + 8;
+
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+
+    size_t pos() const { return m_pos; }
+    size_t remaining() const { return m_size - m_pos; }
+    bool ok() const { return m_ok; }
+
+    template <typename T>
+    T read() {
+        T value{};
+        if (m_pos + sizeof(T) > m_size) {
+            m_ok = false;
+            return value;
+        }
+        memcpy(&value, m_data + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return value;
+    }
+
+    std::string_view read_string() {
+        const uint64_t len = read<uint64_t>();
+        if (!m_ok || len > m_size - m_pos) {
+            m_ok = false;
+            return {};
+        }
+        std::string_view s(reinterpret_cast<const char*>(m_data + m_pos), static_cast<size_t>(len));
+        m_pos += static_cast<size_t>(len);
+        return s;
+    }
+
+    const void* skip(uint64_t bytes) {
+        if (bytes > m_size - m_pos) {
+            m_ok = false;
+            return nullptr;
+        }
+        const void* p = m_data + m_pos;
+        m_pos += static_cast<size_t>(bytes);
+        return p;
+    }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+    bool m_ok = true;
+};
+
+size_t scalar_size(GGUFValueType type) {
+    switch (type) {
+        case GGUFValueType::UINT8:
+        case GGUFValueType::INT8:
+        case GGUFValueType::BOOL:
+            return 1;
+        case GGUFValueType::UINT16:
+        case GGUFValueType::INT16:
+            return 2;
+        case GGUFValueType::UINT32:
+        case GGUFValueType::INT32:
+        case GGUFValueType::FLOAT32:
+            return 4;
+        case GGUFValueType::UINT64:
+        case GGUFValueType::INT64:
+        case GGUFValueType::FLOAT64:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+bool read_scalar(Reader& r, GGUFValueType type, GGUFValue& v) {
+    switch (type) {
+        case GGUFValueType::UINT8:   v.u64 = r.read<uint8_t>();  v.i64 = static_cast<int64_t>(v.u64); break;
+        case GGUFValueType::INT8:    v.i64 = r.read<int8_t>();   v.u64 = static_cast<uint64_t>(v.i64); break;
+        case GGUFValueType::UINT16:  v.u64 = r.read<uint16_t>(); v.i64 = static_cast<int64_t>(v.u64); break;
+        case GGUFValueType::INT16:   v.i64 = r.read<int16_t>();  v.u64 = static_cast<uint64_t>(v.i64); break;
+        case GGUFValueType::UINT32:  v.u64 = r.read<uint32_t>(); v.i64 = static_cast<int64_t>(v.u64); break;
+        case GGUFValueType::INT32:   v.i64 = r.read<int32_t>();  v.u64 = static_cast<uint64_t>(v.i64); break;
+        case GGUFValueType::UINT64:  v.u64 = r.read<uint64_t>(); v.i64 = static_cast<int64_t>(v.u64); break;
+        case GGUFValueType::INT64:   v.i64 = r.read<int64_t>();  v.u64 = static_cast<uint64_t>(v.i64); break;
+        case GGUFValueType::BOOL:    v.u64 = r.read<uint8_t>() ? 1 : 0; v.i64 = static_cast<int64_t>(v.u64); break;
+        case GGUFValueType::FLOAT32: v.f64 = r.read<float>();  return r.ok();
+        case GGUFValueType::FLOAT64: v.f64 = r.read<double>(); return r.ok();
+        default:
+            return false;
+    }
+    v.f64 = static_cast<double>(v.i64);
+    return r.ok();
+}
+
+} // namespace
+
+// ============================================================================
+// Mapping
+// ============================================================================
+
+GGUFFile::~GGUFFile() {
+    close();
+}
+
+bool GGUFFile::open(const std::string& path, std::string& error) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "Model file not found";
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        error = "Model file is empty";
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        error = "Failed to map model file";
+        return false;
+    }
+    void* addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (addr == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        error = "Failed to map model file";
+        return false;
+    }
+    m_file_handle = file;
+    m_mapping_handle = mapping;
+    m_data = static_cast<const uint8_t*>(addr);
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = "Model file not found";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        error = "Model file is empty";
+        return false;
+    }
+    // MAP_SHARED + PROT_READ: pages come straight from the page cache and
+    // are shared with every other reader of the file.
+    void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps its own reference
+    if (addr == MAP_FAILED) {
+        error = "Failed to map model file";
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(addr);
+    m_size = static_cast<size_t>(st.st_size);
+#endif
+
+    if (!parse(error)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void GGUFFile::close() {
+    if (m_data != nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(static_cast<HANDLE>(m_mapping_handle));
+        CloseHandle(static_cast<HANDLE>(m_file_handle));
+        m_mapping_handle = nullptr;
+        m_file_handle = nullptr;
+#else
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_data_offset = 0;
+    m_version = 0;
+    m_kv.clear();
+    m_tensors.clear();
+    m_tensor_index.clear();
+}
+
+void GGUFFile::prefetch() const {
+#ifndef _WIN32
+    if (m_data == nullptr || m_data_offset >= m_size) return;
+    const long page = sysconf(_SC_PAGESIZE);
+    const size_t start = m_data_offset & ~static_cast<size_t>(page - 1);
+    madvise(const_cast<uint8_t*>(m_data) + start, m_size - start, MADV_WILLNEED);
+#endif
+}
+
+// ============================================================================
+// Parsing
+// ============================================================================
+
+bool GGUFFile::parse(std::string& error) {
+    Reader r(m_data, m_size);
+
+    if (r.read<uint32_t>() != GGUF_MAGIC) {
+        error = "Not a GGUF file";
+        return false;
+    }
+    m_version = r.read<uint32_t>();
+    if (m_version < 2 || m_version > 3) {
+        error = "Unsupported GGUF version " + std::to_string(m_version);
+        return false;
+    }
+
+    // Counts are checked against the bytes left for their records before
+    // anything is sized by them, so a damaged header fails here instead
+    // of asking for gigabytes
+    const uint64_t n_tensors = r.read<uint64_t>();
+    const uint64_t n_kv = r.read<uint64_t>();
+    if (!r.ok() || n_kv > r.remaining() / GGUF_MIN_KV_SIZE ||
+        n_tensors > (r.remaining() - n_kv * GGUF_MIN_KV_SIZE) / GGUF_MIN_TENSOR_INFO_SIZE) {
+        error = "Corrupt GGUF header";
+        return false;
+    }
+
+    // Metadata key/value pairs
+    m_kv.reserve(static_cast<size_t>(n_kv));
+    for (uint64_t i = 0; i < n_kv; ++i) {
+        const std::string_view key = r.read_string();
+        GGUFValue v;
+        v.type = static_cast<GGUFValueType>(r.read<uint32_t>());
+        if (!r.ok()) break;
+
+        if (v.type == GGUFValueType::STRING) {
+            v.str = r.read_string();
+        } else if (v.type == GGUFValueType::ARRAY) {
+            v.array_type = static_cast<GGUFValueType>(r.read<uint32_t>());
+            v.array_len = r.read<uint64_t>();
+            if (!r.ok()) break;
+            if (v.array_type == GGUFValueType::STRING) {
+                if (v.array_len > r.remaining() / sizeof(uint64_t)) {
+                    error = "Corrupt GGUF metadata array";
+                    return false;
+                }
+                v.array_str.reserve(static_cast<size_t>(v.array_len));
+                for (uint64_t j = 0; j < v.array_len && r.ok(); ++j) {
+                    v.array_str.push_back(r.read_string());
+                }
+            } else {
+                const size_t elem = scalar_size(v.array_type);
+                if (elem == 0 || v.array_len > m_size / elem) {
+                    error = "Unsupported GGUF metadata array";
+                    return false;
+                }
+                v.array_data = r.skip(v.array_len * elem);
+            }
+        } else if (!read_scalar(r, v.type, v)) {
+            error = "Unsupported GGUF metadata type for " + std::string(key);
+            return false;
+        }
+
+        if (!r.ok()) break;
+        m_kv.emplace(std::string(key), std::move(v));
+    }
+    if (!r.ok()) {
+        error = "Truncated GGUF metadata";
+        return false;
+    }
+
+    // Tensor infos
+    if (n_tensors > r.remaining() / GGUF_MIN_TENSOR_INFO_SIZE) {
+        error = "Corrupt GGUF header";
+        return false;
+    }
+    m_tensors.resize(static_cast<size_t>(n_tensors));
+    for (uint64_t i = 0; i < n_tensors; ++i) {
+        GGUFTensor& t = m_tensors[static_cast<size_t>(i)];
+        t.name = std::string(r.read_string());
+        t.n_dims = r.read<uint32_t>();
+        if (!r.ok() || t.n_dims == 0 || t.n_dims > 4) {
+            error = "Corrupt tensor info";
+            return false;
+        }
+        for (uint32_t d = 0; d < t.n_dims; ++d) {
+            t.ne[d] = static_cast<int64_t>(r.read<uint64_t>());
+            if (t.ne[d] <= 0) {
+                error = "Invalid shape for tensor " + t.name;
+                return false;
+            }
+        }
+        t.type = static_cast<GGMLType>(r.read<uint32_t>());
+        t.offset = r.read<uint64_t>();
+        if (!r.ok()) {
+            error = "Truncated tensor info";
+            return false;
+        }
+        const int64_t block = ggml_block_size(t.type);
+        if (block == 0 || ggml_type_size(t.type) == 0) {
+            error = "Unsupported tensor type for " + t.name;
+            return false;
+        }
+        if (t.ne[0] % block != 0) {
+            error = "Row size not a multiple of block size for " + t.name;
+            return false;
+        }
+        // Shapes come from the file; a product that wraps would slip past
+        // the bounds check below
+        bool overflow = __builtin_mul_overflow(static_cast<uint64_t>(t.ne[0] / block),
+                                               static_cast<uint64_t>(ggml_type_size(t.type)), &t.size);
+        for (int d = 1; d < 4; ++d) {
+            overflow = overflow || __builtin_mul_overflow(t.size, static_cast<uint64_t>(t.ne[d]), &t.size);
+        }
+        if (overflow) {
+            error = "Tensor too large: " + t.name;
+            return false;
+        }
+        m_tensor_index[t.name] = static_cast<size_t>(i);
+    }
+
+    // Tensor data starts at the next aligned offset
+    uint32_t alignment = GGUF_DEFAULT_ALIGNMENT;
+    get_u32("general.alignment", alignment);
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        error = "Invalid GGUF alignment";
+        return false;
+    }
+    const uint64_t data_offset =
+        (static_cast<uint64_t>(r.pos()) + alignment - 1) & ~static_cast<uint64_t>(alignment - 1);
+    if (data_offset > m_size) {
+        error = "Tensor data out of bounds";
+        return false;
+    }
+    m_data_offset = static_cast<size_t>(data_offset);
+
+    // Resolve tensor views into the mapping
+    for (GGUFTensor& t : m_tensors) {
+        if (t.offset % alignment != 0 ||
+            t.offset > m_size - m_data_offset ||
+            t.size > m_size - m_data_offset - t.offset) {
+            error = "Tensor data out of bounds for " + t.name;
+            return false;
+        }
+        t.data = m_data + m_data_offset + t.offset;
+    }
+
+    return true;
+}
+
+// ============================================================================
+// Lookup
+// ============================================================================
+
+const GGUFValue* GGUFFile::find(const std::string& key) const {
+    auto it = m_kv.find(key);
+    return it == m_kv.end() ? nullptr : &it->second;
+}
+
+bool GGUFFile::get_u32(const std::string& key, uint32_t& out) const {
+    const GGUFValue* v = find(key);
+    if (v == nullptr || v->type == GGUFValueType::STRING || v->type == GGUFValueType::ARRAY) {
+        return false;
+    }
+    if (v->type == GGUFValueType::FLOAT32 || v->type == GGUFValueType::FLOAT64) {
+        out = static_cast<uint32_t>(v->f64);
+    } else {
+        out = static_cast<uint32_t>(v->u64);
+    }
+    return true;
+}
+
+bool GGUFFile::get_f32(const std::string& key, float& out) const {
+    const GGUFValue* v = find(key);
+    if (v == nullptr || v->type == GGUFValueType::STRING || v->type == GGUFValueType::ARRAY) {
+        return false;
+    }
+    out = static_cast<float>(v->f64);
+    return true;
+}
+
+bool GGUFFile::get_str(const std::string& key, std::string& out) const {
+    const GGUFValue* v = find(key);
+    if (v == nullptr || v->type != GGUFValueType::STRING) {
+        return false;
+    }
+    out = std::string(v->str);
+    return true;
+}
+
+const GGUFTensor* GGUFFile::tensor(const std::string& name) const {
+    auto it = m_tensor_index.find(name);
+    return it == m_tensor_index.end() ? nullptr : &m_tensors[it->second];
+}
+
+} // namespace tutu
@@ -0,0 +1,147 @@
+/**
+ * gguf.h - Memory-mapped GGUF model file reader
+ *
+ * Maps a GGUF file read-only and exposes its metadata and tensors as
+ * views into the mapping. No tensor data is ever copied to the heap, so
+ * loading is bounded by header parsing and the weights share the page
+ * cache with the model file extracted by LocalLLMService.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace tutu {
+
+// ggml tensor types as stored in GGUF (subset that can appear in llama models)
+enum class GGMLType : uint32_t {
+    F32  = 0,
+    F16  = 1,
+    Q4_0 = 2,
+    Q4_1 = 3,
+    Q5_0 = 6,
+    Q5_1 = 7,
+    Q8_0 = 8,
+    Q8_1 = 9,
+    Q2_K = 10,
+    Q3_K = 11,
+    Q4_K = 12,
+    Q5_K = 13,
+    Q6_K = 14,
+    Q8_K = 15,
+    BF16 = 30,
+};
+
+// Elements per block and bytes per block for a tensor type (0 if unknown)
+int64_t ggml_block_size(GGMLType type);
+size_t ggml_type_size(GGMLType type);
+const char* ggml_type_name(GGMLType type);
+
+// Bytes occupied by one row of n_elements values of the given type
+size_t ggml_row_size(GGMLType type, int64_t n_elements);
+
+// GGUF metadata value types
+enum class GGUFValueType : uint32_t {
+    UINT8   = 0,
+    INT8    = 1,
+    UINT16  = 2,
+    INT16   = 3,
+    UINT32  = 4,
+    INT32   = 5,
+    FLOAT32 = 6,
+    BOOL    = 7,
+    STRING  = 8,
+    ARRAY   = 9,
+    UINT64  = 10,
+    INT64   = 11,
+    FLOAT64 = 12,
+};
+
+// A metadata entry. Scalars are widened into the matching field; strings
+// and arrays point into the mapping.
+struct GGUFValue {
+    GGUFValueType type = GGUFValueType::UINT8;
+    GGUFValueType array_type = GGUFValueType::UINT8;
+
+    uint64_t u64 = 0;
+    int64_t i64 = 0;
+    double f64 = 0.0;
+    std::string_view str;
+
+    // Arrays of numbers: raw pointer to the packed elements
+    const void* array_data = nullptr;
+    uint64_t array_len = 0;
+    // Arrays of strings: one view per element
+    std::vector<std::string_view> array_str;
+};
+
+// A tensor view into the mapped file
+struct GGUFTensor {
+    std::string name;
+    uint32_t n_dims = 0;
+    int64_t ne[4] = {1, 1, 1, 1};
+    GGMLType type = GGMLType::F32;
+    uint64_t offset = 0;       // relative to the data section
+    const void* data = nullptr; // points into the mapping
+    size_t size = 0;           // bytes
+
+    int64_t n_elements() const { return ne[0] * ne[1] * ne[2] * ne[3]; }
+    size_t row_size() const { return ggml_row_size(type, ne[0]); }
+};
+
+// Read-only memory-mapped GGUF file
+class GGUFFile {
+public:
+    GGUFFile() = default;
+    ~GGUFFile();
+
+    GGUFFile(const GGUFFile&) = delete;
+    GGUFFile& operator=(const GGUFFile&) = delete;
+
+    // Map and parse the file. Returns false and fills error on failure.
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    bool is_open() const { return m_data != nullptr; }
+    size_t file_size() const { return m_size; }
+    const uint8_t* data() const { return m_data; }
+    uint32_t version() const { return m_version; }
+    // Start of the tensor data section (end of header and metadata)
+    size_t data_offset() const { return m_data_offset; }
+
+    // Metadata lookup
+    const GGUFValue* find(const std::string& key) const;
+    bool get_u32(const std::string& key, uint32_t& out) const;
+    bool get_f32(const std::string& key, float& out) const;
+    bool get_str(const std::string& key, std::string& out) const;
+
+    // Tensor lookup
+    const GGUFTensor* tensor(const std::string& name) const;
+    const std::vector<GGUFTensor>& tensors() const { return m_tensors; }
+
+    // Hint the kernel to start paging in the tensor data asynchronously
+    void prefetch() const;
+
+private:
+    bool parse(std::string& error);
+
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_data_offset = 0;
+    uint32_t m_version = 0;
+#ifdef _WIN32
+    void* m_file_handle = nullptr;
+    void* m_mapping_handle = nullptr;
+#endif
+
+    std::unordered_map<std::string, GGUFValue> m_kv;
+    std::vector<GGUFTensor> m_tensors;
+    std::unordered_map<std::string, size_t> m_tensor_index;
+};
+
+} // namespace tutu
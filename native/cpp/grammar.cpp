@@ -0,0 +1,685 @@
+/**
+ * grammar.cpp - GBNF grammars for constrained decoding
+ */
+
+#include "grammar.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace tutu {
+
+namespace {
+
+// Largest number of non-ASCII code points a positive character class may
+// list; each becomes its own alternative
+constexpr uint32_t kMaxClassCodepoints = 4096;
+
+void utf8_append(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+bool is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+template <typename T>
+void dedupe(std::vector<T>& v) {
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+}
+
+} // namespace
+
+// ============================================================================
+// Parsing
+// ============================================================================
+
+class GbnfParser {
+public:
+    using Elem = Grammar::Elem;
+    using ElemType = Grammar::ElemType;
+
+    GbnfParser(Grammar& grammar, const std::string& text) : m_g(grammar), m_text(text) {}
+
+    bool run(std::string& error) {
+        skip_space(true);
+        while (m_error.empty() && !at_end()) {
+            std::string name;
+            if (!parse_name(name)) {
+                fail("Expected a rule name");
+                break;
+            }
+            skip_space(false);
+            if (m_text.compare(m_pos, 3, "::=") != 0) {
+                fail("Expected ::= after " + name);
+                break;
+            }
+            m_pos += 3;
+            skip_space(true);
+            const uint32_t id = symbol(name);
+            if (m_defined[id]) {
+                fail("Rule " + name + " is defined twice");
+                break;
+            }
+            m_defined[id] = true;
+            parse_alternatives(name, id, false);
+            skip_space(true);
+        }
+        if (m_error.empty()) check();
+        if (!m_error.empty()) {
+            error = m_error;
+            return false;
+        }
+        m_g.m_root = m_symbols.at("root");
+        return true;
+    }
+
+private:
+    bool at_end() const { return m_pos >= m_text.size(); }
+    char peek() const { return at_end() ? '\0' : m_text[m_pos]; }
+
+    void fail(const std::string& message) {
+        if (!m_error.empty()) return;
+        const size_t line = 1 + std::count(m_text.begin(), m_text.begin() + std::min(m_pos, m_text.size()), '\n');
+        m_error = "Grammar line " + std::to_string(line) + ": " + message;
+    }
+
+    // Spaces and comments; newlines too inside groups or between rules
+    void skip_space(bool newlines) {
+        while (!at_end()) {
+            const char c = m_text[m_pos];
+            if (c == '#') {
+                while (!at_end() && m_text[m_pos] != '\n') ++m_pos;
+            } else if (c == ' ' || c == '\t' || ((c == '\n' || c == '\r') && newlines)) {
+                ++m_pos;
+            } else {
+                break;
+            }
+        }
+    }
+
+    bool parse_name(std::string& name) {
+        const size_t start = m_pos;
+        while (!at_end() && is_name_char(m_text[m_pos])) ++m_pos;
+        name = m_text.substr(start, m_pos - start);
+        return !name.empty();
+    }
+
+    uint32_t symbol(const std::string& name) {
+        auto it = m_symbols.find(name);
+        if (it != m_symbols.end()) return it->second;
+        const uint32_t id = static_cast<uint32_t>(m_g.m_rules.size());
+        m_symbols.emplace(name, id);
+        m_names.push_back(name);
+        m_defined.push_back(false);
+        m_g.m_rules.emplace_back();
+        return id;
+    }
+
+    // A rule for a group, repetition or class inside rule base
+    uint32_t new_rule(const std::string& base) {
+        std::string name;
+        do {
+            name = base + "_" + std::to_string(m_next_id++);
+        } while (m_symbols.count(name) != 0);
+        const uint32_t id = symbol(name);
+        m_defined[id] = true;
+        return id;
+    }
+
+    Elem chars(const std::bitset<256>& set) {
+        m_g.m_sets.push_back(set);
+        return {ElemType::Chars, static_cast<uint32_t>(m_g.m_sets.size() - 1)};
+    }
+
+    void set_rule(uint32_t id, std::vector<Elem> rule) {
+        m_g.m_rules[id] = std::move(rule);
+    }
+
+    void parse_alternatives(const std::string& name, uint32_t id, bool nested) {
+        std::vector<Elem> rule;
+        parse_sequence(name, rule, nested);
+        while (m_error.empty() && peek() == '|') {
+            ++m_pos;
+            skip_space(true);
+            rule.push_back({ElemType::Alt, 0});
+            parse_sequence(name, rule, nested);
+        }
+        rule.push_back({ElemType::End, 0});
+        set_rule(id, std::move(rule));
+    }
+
+    void parse_sequence(const std::string& name, std::vector<Elem>& out, bool nested) {
+        size_t unit = out.size();
+        bool have_unit = false;
+        while (m_error.empty() && !at_end()) {
+            const char c = peek();
+            const size_t start = out.size();
+            if (c == '"') {
+                ++m_pos;
+                parse_literal(out);
+            } else if (c == '[') {
+                ++m_pos;
+                parse_class(name, out);
+            } else if (c == '.') {
+                ++m_pos;
+                out.push_back({ElemType::RuleRef, any_char(name, std::bitset<256>().set())});
+            } else if (is_name_char(c)) {
+                std::string ref;
+                parse_name(ref);
+                out.push_back({ElemType::RuleRef, symbol(ref)});
+            } else if (c == '(') {
+                ++m_pos;
+                skip_space(true);
+                const uint32_t id = new_rule(name);
+                parse_alternatives(name, id, true);
+                if (peek() != ')') {
+                    fail("Expected )");
+                    return;
+                }
+                ++m_pos;
+                out.push_back({ElemType::RuleRef, id});
+            } else if (c == '*' || c == '+' || c == '?' || c == '{') {
+                if (!have_unit) {
+                    fail(std::string("Nothing to repeat before ") + c);
+                    return;
+                }
+                ++m_pos;
+                int min = 0;
+                int max = -1;
+                if (c == '+') {
+                    min = 1;
+                } else if (c == '?') {
+                    max = 1;
+                } else if (c == '{' && !parse_bounds(min, max)) {
+                    return;
+                }
+                repeat(name, out, unit, min, max);
+                have_unit = false;
+                skip_space(nested);
+                continue;
+            } else {
+                break; // | ) or the end of the rule
+            }
+            unit = start;
+            have_unit = true;
+            skip_space(nested);
+        }
+    }
+
+    // {m}, {m,} or {m,n}, after the {
+    bool parse_bounds(int& min, int& max) {
+        auto number = [&](int& v) {
+            const size_t start = m_pos;
+            v = 0;
+            while (!at_end() && m_text[m_pos] >= '0' && m_text[m_pos] <= '9' && v < 100000) {
+                v = v * 10 + (m_text[m_pos++] - '0');
+            }
+            return m_pos > start;
+        };
+        skip_space(true);
+        if (!number(min)) {
+            fail("Expected a repetition count");
+            return false;
+        }
+        skip_space(true);
+        max = min;
+        if (peek() == ',') {
+            ++m_pos;
+            skip_space(true);
+            if (!number(max)) max = -1;
+            skip_space(true);
+        }
+        if (peek() != '}' || (max >= 0 && max < min)) {
+            fail("Bad repetition bounds");
+            return false;
+        }
+        ++m_pos;
+        return true;
+    }
+
+    // Replace the unit at out[unit..] by min to max (-1: any number of)
+    // copies of it
+    void repeat(const std::string& name, std::vector<Elem>& out, size_t unit, int min, int max) {
+        const std::vector<Elem> body(out.begin() + unit, out.end());
+        out.resize(unit);
+        for (int i = 0; i < min; ++i) out.insert(out.end(), body.begin(), body.end());
+
+        if (max < 0) {
+            // R ::= body R |
+            const uint32_t id = new_rule(name);
+            std::vector<Elem> rule = body;
+            rule.push_back({ElemType::RuleRef, id});
+            rule.push_back({ElemType::Alt, 0});
+            rule.push_back({ElemType::End, 0});
+            set_rule(id, std::move(rule));
+            out.push_back({ElemType::RuleRef, id});
+            return;
+        }
+        // Nested optionals, innermost first: R_k ::= body R_k+1 |
+        int64_t next = -1;
+        for (int i = min; i < max; ++i) {
+            const uint32_t id = new_rule(name);
+            std::vector<Elem> rule = body;
+            if (next >= 0) rule.push_back({ElemType::RuleRef, static_cast<uint32_t>(next)});
+            rule.push_back({ElemType::Alt, 0});
+            rule.push_back({ElemType::End, 0});
+            set_rule(id, std::move(rule));
+            next = id;
+        }
+        if (next >= 0) out.push_back({ElemType::RuleRef, static_cast<uint32_t>(next)});
+    }
+
+    // One character of a literal or class, escapes decoded
+    bool parse_char(uint32_t& cp) {
+        if (at_end()) return false;
+        unsigned char c = static_cast<unsigned char>(m_text[m_pos++]);
+        if (c == '\\') {
+            if (at_end()) return false;
+            const char e = m_text[m_pos++];
+            int digits = 0;
+            switch (e) {
+                case 'n': cp = '\n'; return true;
+                case 't': cp = '\t'; return true;
+                case 'r': cp = '\r'; return true;
+                case 'x': digits = 2; break;
+                case 'u': digits = 4; break;
+                case 'U': digits = 8; break;
+                default: cp = static_cast<unsigned char>(e); return true;
+            }
+            cp = 0;
+            for (int i = 0; i < digits; ++i) {
+                const int v = at_end() ? -1 : hex_value(m_text[m_pos]);
+                if (v < 0) return false;
+                cp = cp * 16 + v;
+                ++m_pos;
+            }
+            return cp <= 0x10FFFF;
+        }
+        // UTF-8 sequence
+        int len = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 0;
+        if (len == 0) return false;
+        cp = len == 1 ? c : c & (0xFF >> (len + 1));
+        for (int i = 1; i < len; ++i) {
+            if (at_end() || (static_cast<unsigned char>(m_text[m_pos]) & 0xC0) != 0x80) return false;
+            cp = (cp << 6) | (static_cast<unsigned char>(m_text[m_pos++]) & 0x3F);
+        }
+        return true;
+    }
+
+    void parse_literal(std::vector<Elem>& out) {
+        while (peek() != '"') {
+            uint32_t cp = 0;
+            if (at_end() || peek() == '\n' || !parse_char(cp)) {
+                fail("Unterminated or malformed string literal");
+                return;
+            }
+            std::string bytes;
+            utf8_append(bytes, cp);
+            for (unsigned char b : bytes) out.push_back(chars(std::bitset<256>().set(b)));
+        }
+        ++m_pos;
+    }
+
+    void parse_class(const std::string& name, std::vector<Elem>& out) {
+        bool negated = false;
+        if (peek() == '^') {
+            negated = true;
+            ++m_pos;
+        }
+        std::bitset<256> ascii;
+        std::vector<std::pair<uint32_t, uint32_t>> wide;
+        while (peek() != ']') {
+            uint32_t lo = 0;
+            uint32_t hi = 0;
+            if (at_end() || !parse_char(lo)) {
+                fail("Unterminated or malformed character class");
+                return;
+            }
+            hi = lo;
+            if (peek() == '-' && m_pos + 1 < m_text.size() && m_text[m_pos + 1] != ']') {
+                ++m_pos;
+                if (!parse_char(hi) || hi < lo) {
+                    fail("Bad character range");
+                    return;
+                }
+            }
+            for (uint32_t cp = lo; cp <= std::min<uint32_t>(hi, 0x7F); ++cp) ascii.set(cp);
+            if (hi >= 0x80) wide.emplace_back(std::max<uint32_t>(lo, 0x80), hi);
+        }
+        ++m_pos;
+
+        if (negated) {
+            if (!wide.empty()) {
+                fail("Negated classes may only list ASCII characters");
+                return;
+            }
+            std::bitset<256> allowed;
+            for (int c = 0; c < 0x80; ++c) allowed.set(c, !ascii.test(c));
+            out.push_back({ElemType::RuleRef, any_char(name, allowed)});
+            return;
+        }
+        if (wide.empty()) {
+            out.push_back(chars(ascii));
+            return;
+        }
+
+        // Non-ASCII members become literal alternatives
+        uint32_t total = 0;
+        for (const auto& r : wide) total += r.second - r.first + 1;
+        if (total > kMaxClassCodepoints) {
+            fail("Character class has too many non-ASCII characters");
+            return;
+        }
+        const uint32_t id = new_rule(name);
+        std::vector<Elem> rule;
+        if (ascii.any()) rule.push_back(chars(ascii));
+        for (const auto& r : wide) {
+            for (uint32_t cp = r.first; cp <= r.second; ++cp) {
+                if (!rule.empty()) rule.push_back({ElemType::Alt, 0});
+                std::string bytes;
+                utf8_append(bytes, cp);
+                for (unsigned char b : bytes) rule.push_back(chars(std::bitset<256>().set(b)));
+            }
+        }
+        rule.push_back({ElemType::End, 0});
+        set_rule(id, std::move(rule));
+        out.push_back({ElemType::RuleRef, id});
+    }
+
+    // A rule matching one ASCII byte of allowed, or any multi-byte UTF-8
+    // sequence
+    uint32_t any_char(const std::string& name, std::bitset<256> allowed) {
+        for (int c = 0x80; c < 0x100; ++c) allowed.reset(c);
+        std::bitset<256> cont;
+        for (int c = 0x80; c < 0xC0; ++c) cont.set(c);
+        auto lead = [](int lo, int hi) {
+            std::bitset<256> s;
+            for (int c = lo; c <= hi; ++c) s.set(c);
+            return s;
+        };
+
+        const uint32_t id = new_rule(name);
+        std::vector<Elem> rule;
+        if (allowed.any()) {
+            rule.push_back(chars(allowed));
+            rule.push_back({ElemType::Alt, 0});
+        }
+        const Elem c = chars(cont);
+        rule.push_back(chars(lead(0xC2, 0xDF)));
+        rule.push_back(c);
+        rule.push_back({ElemType::Alt, 0});
+        rule.push_back(chars(lead(0xE0, 0xEF)));
+        rule.insert(rule.end(), 2, c);
+        rule.push_back({ElemType::Alt, 0});
+        rule.push_back(chars(lead(0xF0, 0xF4)));
+        rule.insert(rule.end(), 3, c);
+        rule.push_back({ElemType::End, 0});
+        set_rule(id, std::move(rule));
+        return id;
+    }
+
+    // Every referenced rule is defined, there is a root, and no rule can
+    // reach itself without consuming input
+    void check() {
+        for (size_t i = 0; i < m_names.size(); ++i) {
+            if (!m_defined[i]) {
+                fail("Undefined rule " + m_names[i]);
+                return;
+            }
+        }
+        if (m_symbols.count("root") == 0) {
+            fail("Missing root rule");
+            return;
+        }
+
+        const auto& rules = m_g.m_rules;
+        const size_t n = rules.size();
+        std::vector<char> nullable(n, 0);
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t r = 0; r < n; ++r) {
+                if (nullable[r]) continue;
+                // Nullable when every element of some alternative is
+                bool any = false;
+                bool all = true;
+                for (const Elem& e : rules[r]) {
+                    if (e.type == ElemType::Alt || e.type == ElemType::End) {
+                        if (all) {
+                            any = true;
+                            break;
+                        }
+                        all = true;
+                    } else if (e.type == ElemType::Chars || !nullable[e.value]) {
+                        all = false;
+                    }
+                }
+                if (any) {
+                    nullable[r] = 1;
+                    changed = true;
+                }
+            }
+        }
+
+        // Rules each rule can start with
+        std::vector<std::vector<uint32_t>> left(n);
+        for (size_t r = 0; r < n; ++r) {
+            bool open = true;
+            for (const Elem& e : rules[r]) {
+                if (e.type == ElemType::Alt || e.type == ElemType::End) {
+                    open = true;
+                } else if (open && e.type == ElemType::RuleRef) {
+                    left[r].push_back(e.value);
+                    open = nullable[e.value] != 0;
+                } else {
+                    open = false;
+                }
+            }
+        }
+
+        std::vector<char> state(n, 0); // 0 new, 1 on the path, 2 done
+        for (size_t r = 0; r < n && m_error.empty(); ++r) {
+            if (state[r] == 0) visit(static_cast<uint32_t>(r), left, state);
+        }
+    }
+
+    void visit(uint32_t r, const std::vector<std::vector<uint32_t>>& left, std::vector<char>& state) {
+        state[r] = 1;
+        for (uint32_t s : left[r]) {
+            if (state[s] == 1) {
+                fail("Left recursion in rule " + m_names[s]);
+                return;
+            }
+            if (state[s] == 0) visit(s, left, state);
+            if (!m_error.empty()) return;
+        }
+        state[r] = 2;
+    }
+
+    Grammar& m_g;
+    const std::string& m_text;
+    size_t m_pos = 0;
+    uint32_t m_next_id = 1;
+    std::string m_error;
+    std::unordered_map<std::string, uint32_t> m_symbols;
+    std::vector<std::string> m_names;
+    std::vector<bool> m_defined;
+};
+
+bool Grammar::parse(const std::string& text, std::string& error) {
+    m_rules.clear();
+    m_sets.clear();
+    m_stacks.clear();
+    GbnfParser parser(*this, text);
+    if (!parser.run(error)) {
+        m_rules.clear();
+        m_sets.clear();
+        return false;
+    }
+    reset();
+    return true;
+}
+
+void Grammar::bind(const Tokenizer& tokenizer) {
+    m_tokenizer = &tokenizer;
+    m_order.clear();
+    for (int32_t id = 0; id < tokenizer.n_vocab(); ++id) {
+        if (!tokenizer.token_to_piece(id).empty()) m_order.push_back(id);
+    }
+    std::sort(m_order.begin(), m_order.end(), [&](int32_t a, int32_t b) {
+        return tokenizer.token_to_piece(a) < tokenizer.token_to_piece(b);
+    });
+}
+
+// ============================================================================
+// Matching
+// ============================================================================
+
+void Grammar::expand(const Stack& stack, Stacks& out) const {
+    if (stack.empty() || stack.back()->type != ElemType::RuleRef) {
+        out.push_back(stack);
+        return;
+    }
+    const Elem* pos = stack.back();
+    Stack rest(stack.begin(), stack.end() - 1);
+    if (!is_seq_end(pos + 1)) rest.push_back(pos + 1);
+
+    // One stack per alternative of the referenced rule
+    const Elem* alt = m_rules[pos->value].data();
+    while (true) {
+        Stack next = rest;
+        if (!is_seq_end(alt)) next.push_back(alt);
+        expand(next, out);
+        while (!is_seq_end(alt)) ++alt;
+        if (alt->type == ElemType::End) break;
+        ++alt;
+    }
+}
+
+void Grammar::advance(const Stacks& in, uint8_t c, Stacks& out) const {
+    out.clear();
+    for (const Stack& stack : in) {
+        if (stack.empty() || !m_sets[stack.back()->value].test(c)) continue;
+        const Elem* next = stack.back() + 1;
+        Stack rest(stack.begin(), stack.end() - 1);
+        if (!is_seq_end(next)) rest.push_back(next);
+        expand(rest, out);
+    }
+    dedupe(out);
+}
+
+void Grammar::reset() {
+    m_stacks.clear();
+    if (m_rules.empty()) return;
+    const Elem root = {ElemType::RuleRef, m_root};
+    // expand() only looks past the reference when it is not at a sequence
+    // end, so a lone reference needs a terminator after it
+    const Elem start[2] = {root, {ElemType::End, 0}};
+    Stack stack(1, start);
+    Stacks out;
+    expand(stack, out);
+    dedupe(out);
+    m_stacks = std::move(out);
+}
+
+bool Grammar::allows(const std::string& bytes) const {
+    Stacks cur = m_stacks;
+    Stacks next;
+    for (unsigned char c : bytes) {
+        advance(cur, c, next);
+        if (next.empty()) return false;
+        cur.swap(next);
+    }
+    return true;
+}
+
+bool Grammar::accept(const std::string& bytes) {
+    Stacks cur = m_stacks;
+    Stacks next;
+    for (unsigned char c : bytes) {
+        advance(cur, c, next);
+        if (next.empty()) return false;
+        cur.swap(next);
+    }
+    m_stacks = std::move(cur);
+    return true;
+}
+
+bool Grammar::complete() const {
+    return std::any_of(m_stacks.begin(), m_stacks.end(), [](const Stack& s) { return s.empty(); });
+}
+
+bool Grammar::finished() const {
+    return !m_stacks.empty() && std::all_of(m_stacks.begin(), m_stacks.end(), [](const Stack& s) { return s.empty(); });
+}
+
+bool Grammar::allows_token(int32_t id) const {
+    if (m_tokenizer == nullptr) return true;
+    if (m_tokenizer->is_eog(id)) return complete();
+    const std::string& piece = m_tokenizer->token_to_piece(id);
+    return !piece.empty() && allows(piece);
+}
+
+void Grammar::accept_token(int32_t id) {
+    if (m_tokenizer == nullptr || m_tokenizer->is_eog(id)) return;
+    accept(m_tokenizer->token_to_piece(id));
+}
+
+void Grammar::mask(float* logits) const {
+    if (m_tokenizer == nullptr) return;
+    const int32_t n_vocab = m_tokenizer->n_vocab();
+    std::vector<char> allowed(n_vocab, 0);
+
+    // depth[d]: the stacks after the first d bytes of the previous piece,
+    // valid for d <= n_valid. An empty entry means that prefix is dead.
+    std::vector<Stacks> depth(1, m_stacks);
+    size_t n_valid = 0;
+    const std::string* prev = nullptr;
+    for (int32_t id : m_order) {
+        const std::string& piece = m_tokenizer->token_to_piece(id);
+        size_t d = 0;
+        if (prev != nullptr) {
+            const size_t limit = std::min({n_valid, piece.size(), prev->size()});
+            while (d < limit && (*prev)[d] == piece[d]) ++d;
+        }
+        while (!depth[d].empty() && d < piece.size()) {
+            if (depth.size() < d + 2) depth.resize(d + 2);
+            advance(depth[d], static_cast<uint8_t>(piece[d]), depth[d + 1]);
+            ++d;
+        }
+        n_valid = d;
+        prev = &piece;
+        allowed[id] = d == piece.size() && !depth[d].empty();
+    }
+
+    const bool can_end = complete();
+    for (int32_t id = 0; id < n_vocab; ++id) {
+        const bool ok = m_tokenizer->is_eog(id) ? can_end : allowed[id] != 0;
+        if (!ok) logits[id] = -INFINITY;
+    }
+}
+
+} // namespace tutu
@@ -0,0 +1,105 @@
+/**
+ * grammar.h - GBNF grammars for constrained decoding
+ *
+ * Parses the GBNF dialect llama.cpp uses (rules "name ::= ...", string
+ * literals, character classes, ".", groups, alternatives, the * + ? and
+ * {m,n} operators, # comments; the start symbol is "root") into flat
+ * rules, and matches generated text against them byte by byte with a set
+ * of pushdown stacks, one per way the text so far can be parsed.
+ *
+ * Matching works on UTF-8 bytes, so it lines up with token pieces that
+ * split characters. Negated classes and "." are expanded into rules that
+ * accept one whole UTF-8 sequence.
+ *
+ * Per decode step, only the sampled token is normally checked, which
+ * costs a few byte steps. The whole vocabulary is masked only when that
+ * token is rejected: pieces are visited in sorted order, so a shared
+ * prefix is matched once and a prefix the grammar rejects skips every
+ * piece that starts with it.
+ */
+
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "tokenizer.h"
+
+namespace tutu {
+
+class Grammar {
+public:
+    Grammar() = default;
+    // Stacks point into the rules
+    Grammar(const Grammar&) = delete;
+    Grammar& operator=(const Grammar&) = delete;
+
+    // Compile GBNF text. Left-recursive rules are rejected, since they
+    // would never consume input.
+    bool parse(const std::string& text, std::string& error);
+
+    // Check tokens against tokenizer's pieces (it must outlive the grammar)
+    void bind(const Tokenizer& tokenizer);
+
+    // Start matching from the beginning of the root rule
+    void reset();
+
+    // Whether bytes can continue the text matched so far
+    bool allows(const std::string& bytes) const;
+
+    // Consume bytes; returns false (and leaves the state alone) if they
+    // are not allowed
+    bool accept(const std::string& bytes);
+
+    // The text so far is a complete match
+    bool complete() const;
+
+    // Complete, and nothing more can follow
+    bool finished() const;
+
+    // Token-level versions. An end-of-generation token is allowed exactly
+    // when the match is complete; other control tokens never are.
+    bool allows_token(int32_t id) const;
+    void accept_token(int32_t id);
+
+    // Set the logits of every token the grammar rejects to -infinity
+    void mask(float* logits) const;
+
+private:
+    enum class ElemType : uint8_t {
+        End,     // end of a rule
+        Alt,     // start of another alternative
+        RuleRef, // value: rule index
+        Chars,   // value: index into m_sets
+    };
+
+    struct Elem {
+        ElemType type;
+        uint32_t value;
+    };
+
+    // Positions still to match, innermost last
+    using Stack = std::vector<const Elem*>;
+    using Stacks = std::vector<Stack>;
+
+    friend class GbnfParser;
+
+    static bool is_seq_end(const Elem* e) { return e->type == ElemType::End || e->type == ElemType::Alt; }
+
+    // Add the stacks that stack expands to, each with a character set (or
+    // nothing) on top
+    void expand(const Stack& stack, Stacks& out) const;
+    void advance(const Stacks& in, uint8_t c, Stacks& out) const;
+
+    std::vector<std::vector<Elem>> m_rules;
+    std::vector<std::bitset<256>> m_sets;
+    uint32_t m_root = 0;
+    Stacks m_stacks;
+
+    const Tokenizer* m_tokenizer = nullptr;
+    std::vector<int32_t> m_order; // tokens with a piece, sorted by piece
+};
+
+} // namespace tutu
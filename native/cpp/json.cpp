@@ -0,0 +1,184 @@
+/**
+ * json.cpp - Minimal JSON document reader
+ */
+
+#include "json.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace tutu {
+
+namespace {
+
+// Deepest nesting a document may have
+constexpr int kMaxDepth = 64;
+
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& text) : m_s(text) {}
+
+    bool read(Json& out, std::string& error) {
+        skip();
+        if (!value(out, 0)) {
+            error = "Invalid JSON near offset " + std::to_string(m_pos);
+            return false;
+        }
+        skip();
+        if (m_pos != m_s.size()) {
+            error = "Trailing characters after JSON";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    void skip() {
+        while (m_pos < m_s.size() && (m_s[m_pos] == ' ' || m_s[m_pos] == '\t' || m_s[m_pos] == '\n' ||
+                                      m_s[m_pos] == '\r')) {
+            ++m_pos;
+        }
+    }
+
+    bool literal(const char* word) {
+        const size_t n = strlen(word);
+        if (m_s.compare(m_pos, n, word) != 0) return false;
+        m_pos += n;
+        return true;
+    }
+
+    bool value(Json& out, int depth) {
+        if (depth > kMaxDepth || m_pos >= m_s.size()) return false;
+        const char c = m_s[m_pos];
+        if (c == '{') return object(out, depth);
+        if (c == '[') return array(out, depth);
+        if (c == '"') {
+            out.kind = Json::Kind::String;
+            return string(out.text);
+        }
+        if (literal("true")) {
+            out.kind = Json::Kind::Bool;
+            out.boolean = true;
+            return true;
+        }
+        if (literal("false")) {
+            out.kind = Json::Kind::Bool;
+            return true;
+        }
+        if (literal("null")) {
+            out.kind = Json::Kind::Null;
+            return true;
+        }
+        return number(out);
+    }
+
+    bool number(Json& out) {
+        const size_t start = m_pos;
+        while (m_pos < m_s.size() && strchr("+-0123456789.eE", m_s[m_pos]) != nullptr) ++m_pos;
+        if (m_pos == start) return false;
+        out.kind = Json::Kind::Number;
+        out.text = m_s.substr(start, m_pos - start);
+        char* end = nullptr;
+        out.number = strtod(out.text.c_str(), &end);
+        return end != nullptr && *end == '\0';
+    }
+
+    bool string(std::string& out) {
+        ++m_pos; // opening quote
+        out.clear();
+        while (m_pos < m_s.size() && m_s[m_pos] != '"') {
+            char c = m_s[m_pos++];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (m_pos >= m_s.size()) return false;
+            c = m_s[m_pos++];
+            switch (c) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    if (m_pos + 4 > m_s.size()) return false;
+                    const uint32_t cp = static_cast<uint32_t>(strtoul(m_s.substr(m_pos, 4).c_str(), nullptr, 16));
+                    m_pos += 4;
+                    // Surrogate pairs are not decoded; each half is written as is
+                    if (cp < 0x80) {
+                        out += static_cast<char>(cp);
+                    } else if (cp < 0x800) {
+                        out += static_cast<char>(0xC0 | (cp >> 6));
+                        out += static_cast<char>(0x80 | (cp & 0x3F));
+                    } else {
+                        out += static_cast<char>(0xE0 | (cp >> 12));
+                        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                        out += static_cast<char>(0x80 | (cp & 0x3F));
+                    }
+                    break;
+                }
+                default: out += c; break;
+            }
+        }
+        if (m_pos >= m_s.size()) return false;
+        ++m_pos;
+        return true;
+    }
+
+    bool array(Json& out, int depth) {
+        out.kind = Json::Kind::Array;
+        ++m_pos;
+        skip();
+        if (m_pos < m_s.size() && m_s[m_pos] == ']') {
+            ++m_pos;
+            return true;
+        }
+        while (true) {
+            out.items.emplace_back();
+            if (!value(out.items.back(), depth + 1)) return false;
+            skip();
+            if (m_pos >= m_s.size()) return false;
+            if (m_s[m_pos++] == ']') return true;
+            if (m_s[m_pos - 1] != ',') return false;
+            skip();
+        }
+    }
+
+    bool object(Json& out, int depth) {
+        out.kind = Json::Kind::Object;
+        ++m_pos;
+        skip();
+        if (m_pos < m_s.size() && m_s[m_pos] == '}') {
+            ++m_pos;
+            return true;
+        }
+        while (true) {
+            if (m_pos >= m_s.size() || m_s[m_pos] != '"') return false;
+            std::string key;
+            if (!string(key)) return false;
+            skip();
+            if (m_pos >= m_s.size() || m_s[m_pos++] != ':') return false;
+            skip();
+            out.members.emplace_back(std::move(key), Json());
+            if (!value(out.members.back().second, depth + 1)) return false;
+            skip();
+            if (m_pos >= m_s.size()) return false;
+            if (m_s[m_pos++] == '}') return true;
+            if (m_s[m_pos - 1] != ',') return false;
+            skip();
+        }
+    }
+
+    const std::string& m_s;
+    size_t m_pos = 0;
+};
+
+} // namespace
+
+bool parse_json(const std::string& text, Json& out, std::string& error) {
+    JsonReader reader(text);
+    return reader.read(out, error);
+}
+
+} // namespace tutu
@@ -0,0 +1,39 @@
+/**
+ * json.h - Minimal JSON document reader
+ *
+ * Reads a whole document into a tree of Json values. Enough for the
+ * small, trusted documents the native side handles (schemas, the QA
+ * bank); numbers keep their text as written next to the parsed double.
+ */
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tutu {
+
+struct Json {
+    enum class Kind { Null, Bool, Number, String, Array, Object };
+
+    Kind kind = Kind::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string text; // string value, or a number as written
+    std::vector<Json> items;
+    std::vector<std::pair<std::string, Json>> members;
+
+    const Json* find(const std::string& key) const {
+        if (kind != Kind::Object) return nullptr;
+        for (const auto& m : members) {
+            if (m.first == key) return &m.second;
+        }
+        return nullptr;
+    }
+};
+
+// Parse text as one JSON document
+bool parse_json(const std::string& text, Json& out, std::string& error);
+
+} // namespace tutu
@@ -0,0 +1,327 @@
+/**
+ * json_schema.cpp - JSON schema to GBNF conversion for constrained decoding
+ */
+
+#include "json_schema.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "json.h"
+
+namespace tutu {
+
+namespace {
+
+// Deepest nesting a schema document may have
+constexpr int kMaxDepth = 64;
+
+// Whitespace the grammar allows between tokens; bounded so a model can
+// never pad forever
+const char* const kWhitespace = R"([ \t\n]{0,20})";
+
+// Compact JSON text of a value, as the model has to write it
+std::string dump(const Json& v) {
+    switch (v.kind) {
+        case Json::Kind::Null: return "null";
+        case Json::Kind::Bool: return v.boolean ? "true" : "false";
+        case Json::Kind::Number: return v.text;
+        case Json::Kind::String: {
+            std::string out = "\"";
+            for (unsigned char c : v.text) {
+                if (c == '"' || c == '\\') {
+                    out += '\\';
+                    out += static_cast<char>(c);
+                } else if (c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += static_cast<char>(c);
+                }
+            }
+            return out + "\"";
+        }
+        case Json::Kind::Array: {
+            std::string out = "[";
+            for (size_t i = 0; i < v.items.size(); ++i) out += (i ? "," : "") + dump(v.items[i]);
+            return out + "]";
+        }
+        case Json::Kind::Object: {
+            std::string out = "{";
+            for (size_t i = 0; i < v.members.size(); ++i) {
+                Json key;
+                key.kind = Json::Kind::String;
+                key.text = v.members[i].first;
+                out += (i ? "," : "") + dump(key) + ":" + dump(v.members[i].second);
+            }
+            return out + "}";
+        }
+    }
+    return "null";
+}
+
+// A GBNF string literal matching text exactly
+std::string gbnf_literal(const std::string& text) {
+    std::string out = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\x%02X", c);
+            out += buf;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    return out + "\"";
+}
+
+// ============================================================================
+// Conversion
+// ============================================================================
+
+// Grammar rules for the JSON primitives, added on first use
+const std::map<std::string, std::string>& primitives() {
+    static const std::map<std::string, std::string> rules = {
+        {"ws", kWhitespace},
+        {"char", R"([^"\\\x00-\x1F\x7F] | "\\" (["\\/bfnrt] | "u" [0-9a-fA-F]{4}))"},
+        {"string", R"("\"" char* "\"")"},
+        {"number", R"("-"? ("0" | [1-9] [0-9]{0,15}) ("." [0-9]{1,16})? ([eE] [-+]? [0-9]{1,3})?)"},
+        {"integer", R"("-"? ("0" | [1-9] [0-9]{0,15}))"},
+        {"boolean", R"("true" | "false")"},
+        {"null", R"("null")"},
+        {"value", "object | array | string | number | boolean | null"},
+        {"object", R"("{" ws (string ws ":" ws value ws ("," ws string ws ":" ws value ws)*)? "}")"},
+        {"array", R"("[" ws (value ws ("," ws value ws)*)? "]")"},
+    };
+    return rules;
+}
+
+// Rules each primitive refers to
+const std::map<std::string, std::vector<std::string>>& primitive_deps() {
+    static const std::map<std::string, std::vector<std::string>> deps = {
+        {"string", {"char"}},
+        {"value", {"object", "array", "string", "number", "boolean", "null"}},
+        {"object", {"ws", "string", "value"}},
+        {"array", {"ws", "value"}},
+    };
+    return deps;
+}
+
+class SchemaConverter {
+public:
+    bool convert(const Json& schema, std::string& gbnf, std::string& error) {
+        const std::string root = visit(schema, "root", 0);
+        if (!m_error.empty()) {
+            error = m_error;
+            return false;
+        }
+        // Root first; a schema that maps onto another rule gets an alias
+        gbnf.clear();
+        if (root != "root") gbnf = "root ::= " + root + "\n";
+        for (const auto& rule : m_rules) {
+            if (rule.first == "root") gbnf = rule.first + " ::= " + rule.second + "\n" + gbnf;
+        }
+        for (const auto& rule : m_rules) {
+            if (rule.first != "root") gbnf += rule.first + " ::= " + rule.second + "\n";
+        }
+        return true;
+    }
+
+private:
+    // Name of a primitive rule, adding it (and what it uses) on first use
+    std::string use(const std::string& name) {
+        if (m_used.insert(name).second) {
+            m_rules.emplace_back(name, primitives().at(name));
+            m_names.insert(name);
+            auto deps = primitive_deps().find(name);
+            if (deps != primitive_deps().end()) {
+                for (const std::string& dep : deps->second) use(dep);
+            }
+        }
+        return name;
+    }
+
+    std::string add_rule(const std::string& base, const std::string& body) {
+        std::string name = base;
+        for (int i = 1; m_names.count(name) != 0 || primitives().count(name) != 0; ++i) {
+            name = base + std::to_string(i);
+        }
+        m_names.insert(name);
+        m_rules.emplace_back(name, body);
+        return name;
+    }
+
+    static std::string sanitize(const std::string& key) {
+        std::string out;
+        for (char c : key) {
+            const bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+            out += ok ? c : '-';
+        }
+        return out.empty() ? "p" : out;
+    }
+
+    // A grammar expression for the schema: a rule name or a literal
+    std::string visit(const Json& schema, const std::string& name, int depth) {
+        if (!m_error.empty()) return "value";
+        if (depth > kMaxDepth) {
+            m_error = "JSON schema is nested too deeply";
+            return "value";
+        }
+        if (schema.kind != Json::Kind::Object) return use("value");
+
+        if (const Json* c = schema.find("const")) return gbnf_literal(dump(*c));
+        if (const Json* e = schema.find("enum")) {
+            if (e->kind != Json::Kind::Array || e->items.empty()) {
+                m_error = "enum must be a non-empty array";
+                return "value";
+            }
+            std::string body;
+            for (size_t i = 0; i < e->items.size(); ++i) body += (i ? " | " : "") + gbnf_literal(dump(e->items[i]));
+            return add_rule(name, body);
+        }
+        const Json* any = schema.find("anyOf");
+        if (any == nullptr) any = schema.find("oneOf");
+        if (any != nullptr) {
+            if (any->kind != Json::Kind::Array || any->items.empty()) {
+                m_error = "anyOf/oneOf must be a non-empty array";
+                return "value";
+            }
+            std::string body;
+            for (size_t i = 0; i < any->items.size(); ++i) {
+                body += (i ? " | " : "") + visit(any->items[i], name + "-" + std::to_string(i), depth + 1);
+            }
+            return add_rule(name, body);
+        }
+
+        const Json* type = schema.find("type");
+        if (type == nullptr) {
+            if (schema.find("properties") != nullptr) return visit_type(schema, "object", name, depth);
+            if (schema.find("items") != nullptr) return visit_type(schema, "array", name, depth);
+            return use("value");
+        }
+        if (type->kind == Json::Kind::String) return visit_type(schema, type->text, name, depth);
+        if (type->kind == Json::Kind::Array && !type->items.empty()) {
+            std::string body;
+            for (size_t i = 0; i < type->items.size(); ++i) {
+                const std::string& t = type->items[i].text;
+                body += (i ? " | " : "") + visit_type(schema, t, name + "-" + t, depth);
+            }
+            return add_rule(name, body);
+        }
+        m_error = "Invalid type in JSON schema";
+        return "value";
+    }
+
+    static int64_t bound(const Json& schema, const char* key, int64_t fallback) {
+        const Json* v = schema.find(key);
+        return v != nullptr && v->kind == Json::Kind::Number && v->number >= 0 ? static_cast<int64_t>(v->number)
+                                                                                : fallback;
+    }
+
+    std::string visit_type(const Json& schema, const std::string& type, const std::string& name, int depth) {
+        if (type == "object") return visit_object(schema, name, depth);
+        if (type == "array") {
+            const Json* items = schema.find("items");
+            if (items == nullptr) return use("array");
+            use("ws");
+            const std::string item = visit(*items, name + "-item", depth + 1);
+            const int64_t min = bound(schema, "minItems", 0);
+            const int64_t max = bound(schema, "maxItems", -1);
+            if (max >= 0 && max < min) {
+                m_error = "maxItems is below minItems";
+                return "value";
+            }
+            if (max == 0) return add_rule(name, R"("[" ws "]")");
+            // First item, then the rest as a bounded repetition
+            std::string rest = "(\",\" ws " + item + " ws)";
+            const int64_t rest_min = min > 0 ? min - 1 : 0;
+            rest += max < 0 ? "{" + std::to_string(rest_min) + ",}"
+                            : "{" + std::to_string(rest_min) + "," + std::to_string(max - 1) + "}";
+            std::string items_expr = item + " ws " + rest;
+            if (min == 0) items_expr = "(" + items_expr + ")?";
+            return add_rule(name, "\"[\" ws " + items_expr + " \"]\"");
+        }
+        if (type == "string") {
+            const int64_t min = bound(schema, "minLength", 0);
+            const int64_t max = bound(schema, "maxLength", -1);
+            if (min == 0 && max < 0) return use("string");
+            use("char");
+            const std::string reps = max < 0 ? "{" + std::to_string(min) + ",}"
+                                             : "{" + std::to_string(min) + "," + std::to_string(max) + "}";
+            return add_rule(name, "\"\\\"\" char" + reps + " \"\\\"\"");
+        }
+        if (type == "number" || type == "integer" || type == "boolean" || type == "null") return use(type);
+        m_error = "Unsupported type in JSON schema: " + type;
+        return "value";
+    }
+
+    // Properties in declaration order; required ones always, optional ones
+    // may be skipped. tail(i, first) matches the properties from i on,
+    // first meaning no comma is needed before the next one written.
+    std::string visit_object(const Json& schema, const std::string& name, int depth) {
+        const Json* props = schema.find("properties");
+        if (props == nullptr || props->kind != Json::Kind::Object) return use("object");
+        use("ws");
+
+        std::set<std::string> required;
+        if (const Json* req = schema.find("required")) {
+            for (const Json& r : req->items) required.insert(r.text);
+        }
+        const size_t n = props->members.size();
+        std::vector<std::string> pairs(n);
+        std::vector<bool> optional(n);
+        for (size_t i = 0; i < n; ++i) {
+            const std::string& key = props->members[i].first;
+            Json key_json;
+            key_json.kind = Json::Kind::String;
+            key_json.text = key;
+            const std::string value = visit(props->members[i].second, name + "-" + sanitize(key), depth + 1);
+            pairs[i] = gbnf_literal(dump(key_json)) + " ws \":\" ws " + value + " ws";
+            optional[i] = required.count(key) == 0;
+        }
+
+        std::map<std::pair<size_t, bool>, std::string> memo;
+        std::function<std::string(size_t, bool)> tail = [&](size_t i, bool first) -> std::string {
+            if (i == n) return "";
+            auto it = memo.find({i, first});
+            if (it != memo.end()) return it->second;
+            const std::string rest = tail(i + 1, false);
+            std::string body = (first ? "" : "\",\" ws ") + pairs[i] + (rest.empty() ? "" : " " + rest);
+            if (optional[i]) {
+                const std::string skip = tail(i + 1, first);
+                body = skip.empty() ? "(" + body + ")?" : body + " | " + skip;
+            }
+            const std::string rule = add_rule(name + "-" + std::to_string(i) + (first ? "-first" : ""), body);
+            memo[{i, first}] = rule;
+            return rule;
+        };
+        const std::string members = tail(0, true);
+        return add_rule(name, "\"{\" ws " + (members.empty() ? "" : members + " ") + "\"}\"");
+    }
+
+    std::vector<std::pair<std::string, std::string>> m_rules;
+    std::set<std::string> m_names;
+    std::set<std::string> m_used;
+    std::string m_error;
+};
+
+} // namespace
+
+bool json_schema_to_gbnf(const std::string& schema, std::string& gbnf, std::string& error) {
+    Json root;
+    if (!parse_json(schema, root, error)) return false;
+    SchemaConverter converter;
+    return converter.convert(root, gbnf, error);
+}
+
+} // namespace tutu
@@ -0,0 +1,24 @@
+/**
+ * json_schema.h - JSON schema to GBNF conversion for constrained decoding
+ *
+ * Covers the subset structured extraction needs: "type" (one or a list),
+ * objects with "properties" (emitted in declaration order, the ones not
+ * in "required" optional), arrays with "items", "minItems" and
+ * "maxItems", strings with "minLength" and "maxLength", numbers,
+ * integers, booleans, null, "enum", "const", "anyOf" and "oneOf". An
+ * empty schema accepts any JSON value. Objects never get properties the
+ * schema does not list.
+ *
+ * The grammar matches compact-or-indented JSON with no leading or
+ * trailing whitespace, so generation can stop at the closing bracket.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace tutu {
+
+bool json_schema_to_gbnf(const std::string& schema, std::string& gbnf, std::string& error);
+
+} // namespace tutu
@@ -0,0 +1,171 @@
+/**
+ * keyword_index.cpp - BM25 inverted index over short texts
+ */
+
+#include "keyword_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+namespace tutu {
+
+namespace {
+
+constexpr size_t kMinTermLength = 3;
+
+bool is_term_byte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+} // namespace
+
+// ============================================================================
+// Tokenizer
+// ============================================================================
+
+std::vector<std::string> KeywordIndex::tokenize(const std::string& text) {
+    std::vector<std::string> terms;
+    std::string term;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        const unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+        if (is_term_byte(c)) {
+            term += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : static_cast<char>(c);
+        } else if (!term.empty()) {
+            if (term.size() >= kMinTermLength) terms.push_back(term);
+            term.clear();
+        }
+    }
+    return terms;
+}
+
+// ============================================================================
+// Updates
+// ============================================================================
+
+void KeywordIndex::add(const std::string& id, const std::string& text, const Weight& weight) {
+    remove(id);
+
+    const std::vector<std::string> terms = tokenize(text);
+
+    uint32_t slot;
+    if (!m_free.empty()) {
+        slot = m_free.back();
+        m_free.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(m_docs.size());
+        m_docs.emplace_back();
+    }
+    Document& doc = m_docs[slot];
+    doc.id = id;
+    doc.length = static_cast<uint32_t>(terms.size());
+    doc.weight = weight;
+    doc.terms.clear();
+
+    // Term frequencies, in order of first appearance
+    std::unordered_map<uint32_t, uint32_t> tf;
+    for (const std::string& term : terms) {
+        auto it = m_terms.find(term);
+        if (it == m_terms.end()) {
+            it = m_terms.emplace(term, static_cast<uint32_t>(m_postings.size())).first;
+            m_postings.emplace_back();
+        }
+        if (tf[it->second]++ == 0) doc.terms.push_back(it->second);
+    }
+    for (uint32_t t : doc.terms) {
+        m_postings[t].push_back({slot, tf[t]});
+    }
+
+    m_ids[id] = slot;
+    m_total_length += doc.length;
+}
+
+bool KeywordIndex::remove(const std::string& id) {
+    auto it = m_ids.find(id);
+    if (it == m_ids.end()) return false;
+    const uint32_t slot = it->second;
+    m_ids.erase(it);
+
+    Document& doc = m_docs[slot];
+    for (uint32_t t : doc.terms) {
+        std::vector<Posting>& postings = m_postings[t];
+        for (size_t j = 0; j < postings.size(); ++j) {
+            if (postings[j].doc == slot) {
+                postings[j] = postings.back();
+                postings.pop_back();
+                break;
+            }
+        }
+    }
+    m_total_length -= doc.length;
+    doc.id.clear();
+    doc.length = 0;
+    doc.weight = Weight();
+    doc.terms.clear();
+    m_free.push_back(slot);
+    return true;
+}
+
+const KeywordIndex::Weight* KeywordIndex::weight(const std::string& id) const {
+    const auto it = m_ids.find(id);
+    return it == m_ids.end() ? nullptr : &m_docs[it->second].weight;
+}
+
+// ============================================================================
+// Search
+// ============================================================================
+
+std::vector<std::pair<std::string, float>> KeywordIndex::search(const std::string& query, int32_t k) {
+    std::vector<std::pair<std::string, float>> out;
+    if (k <= 0 || m_ids.empty()) return out;
+
+    // Each query term counts once
+    std::vector<std::string> terms = tokenize(query);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+    const float n = static_cast<float>(m_ids.size());
+    const float avg_length = static_cast<float>(m_total_length) / n;
+    m_scores.resize(m_docs.size(), 0.0f);
+
+    for (const std::string& term : terms) {
+        const auto it = m_terms.find(term);
+        if (it == m_terms.end()) continue;
+        const std::vector<Posting>& postings = m_postings[it->second];
+        if (postings.empty()) continue;
+
+        const float df = static_cast<float>(postings.size());
+        const float idf = std::log(1.0f + (n - df + 0.5f) / (df + 0.5f));
+        for (const Posting& p : postings) {
+            const float tf = static_cast<float>(p.tf);
+            const float norm = kK1 * (1.0f - kB + kB * static_cast<float>(m_docs[p.doc].length) / avg_length);
+            if (m_scores[p.doc] == 0.0f) m_touched.push_back(p.doc);
+            m_scores[p.doc] += idf * tf * (kK1 + 1.0f) / (tf + norm);
+        }
+    }
+
+    // Keep the k best in a min-heap, so the worst of them is on top
+    using Entry = std::pair<float, uint32_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> best;
+    for (uint32_t doc : m_touched) {
+        const float score = m_scores[doc];
+        m_scores[doc] = 0.0f;
+        if (static_cast<int32_t>(best.size()) < k) {
+            best.emplace(score, doc);
+        } else if (score > best.top().first) {
+            best.pop();
+            best.emplace(score, doc);
+        }
+    }
+    m_touched.clear();
+
+    out.resize(best.size());
+    for (size_t j = out.size(); j-- > 0;) {
+        out[j] = {m_docs[best.top().second].id, best.top().first};
+        best.pop();
+    }
+    return out;
+}
+
+} // namespace tutu
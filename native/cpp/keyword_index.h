@@ -0,0 +1,87 @@
+/**
+ * keyword_index.h - BM25 inverted index over short texts
+ *
+ * Every term maps to a posting list of the documents containing it and
+ * how often, so a query only touches the postings of its own terms, not
+ * every document. Scores are Okapi BM25: term frequency saturating with
+ * k1, discounted for documents longer than average by b, weighted by how
+ * rare the term is across the index.
+ *
+ * Terms are runs of letters, digits, underscores and non-ASCII bytes,
+ * lowercased, at least three bytes long: the words the app's Dart
+ * tokenizer keeps, plus words in other scripts.
+ *
+ * The index lives in memory and changes in place: adding a document
+ * appends to its terms' postings, removing one takes it out of them.
+ * Each document also carries the importance and expiry time it was added
+ * with, for ranking that mixes them in (memory_search.h).
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace tutu {
+
+class KeywordIndex {
+public:
+    static constexpr float kK1 = 1.2f;
+    static constexpr float kB = 0.75f;
+
+    // What a document was added with besides its text. expires_at is in
+    // milliseconds since the epoch, 0 for never.
+    struct Weight {
+        float importance = 1.0f;
+        int64_t expires_at = 0;
+    };
+
+    // Index text under id, replacing whatever id had
+    void add(const std::string& id, const std::string& text, const Weight& weight);
+
+    // Remove id. Returns false if it was not indexed.
+    bool remove(const std::string& id);
+
+    // Ids and BM25 scores of the k best matching documents, best first.
+    // Documents sharing no term with the query are not returned.
+    std::vector<std::pair<std::string, float>> search(const std::string& query, int32_t k);
+
+    // id's weight, or null if it is not indexed
+    const Weight* weight(const std::string& id) const;
+
+    uint32_t size() const { return static_cast<uint32_t>(m_ids.size()); }
+
+    // Split text into index terms, repeats included
+    static std::vector<std::string> tokenize(const std::string& text);
+
+private:
+    struct Posting {
+        uint32_t doc;
+        uint32_t tf;
+    };
+
+    struct Document {
+        std::string id;
+        uint32_t length = 0;          // terms, repeats included
+        Weight weight;
+        std::vector<uint32_t> terms;  // distinct term ids, for removal
+    };
+
+    std::unordered_map<std::string, uint32_t> m_terms;  // term -> term id
+    std::vector<std::vector<Posting>> m_postings;        // by term id
+
+    // Slots of removed documents are reused by the next add
+    std::vector<Document> m_docs;
+    std::vector<uint32_t> m_free;
+    std::unordered_map<std::string, uint32_t> m_ids;     // id -> doc slot
+    uint64_t m_total_length = 0;
+
+    // Score accumulators for search, by doc slot
+    std::vector<float> m_scores;
+    std::vector<uint32_t> m_touched;
+};
+
+} // namespace tutu
@@ -1,150 +1,847 @@
 /**
  * llama_bridge.cpp - FFI Bridge for llama.cpp
- * 
+ *
  * Simplified C interface for Dart to interact with llama.cpp
+ *
+ * Models and contexts are opaque handles. A model owns the mapped weights
+ * and can be shared by any number of contexts; each context owns its own
+ * KV cache and sampling state, so several conversations can stay warm at
+ * once. Contexts of one model generating at the same time have their
+ * decode steps merged into shared forward passes. The original
+ * single-session functions (llm_load_model, llm_generate, ...) operate on
+ * a default model/context pair.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <exception>
+#include <memory>
+#include <new>
 #include <string>
 #include <mutex>
+#include <thread>
+#include <vector>
+
+#include "batch_scheduler.h"
+#include "cpu_features.h"
+#include "cpu_topology.h"
+#include "json_schema.h"
+#include "keyword_index.h"
+#include "llama_context.h"
+#include "llama_model.h"
+#include "memory_search.h"
+#include "qa_matcher.h"
+#include "quants.h"
+#include "vector_index.h"
+
+// Opaque handle types
+struct llm_model {
+    std::shared_ptr<tutu::LlamaModel> model;
+    std::shared_ptr<tutu::ThreadPool> pool;  // shared by every context
+    std::shared_ptr<tutu::BatchScheduler> scheduler; // merges their steps
+    bool threads_tuned = false;              // size picked by calibration
+};
+
+struct llm_context {
+    std::shared_ptr<tutu::LlamaModel> model; // keeps the weights mapped
+    std::shared_ptr<tutu::ThreadPool> pool;  // outlives ctx, which uses it
+    std::shared_ptr<tutu::BatchScheduler> scheduler; // likewise
+    std::shared_ptr<tutu::LlamaModel> draft_model;
+    std::unique_ptr<tutu::LlamaContext> draft; // speculative decoding, optional
+    tutu::LlamaContext ctx;
+    std::mutex mutex;                        // one generation at a time
+    // The owner's reference (dropped by llm_context_free), plus one per
+    // call running on the handle and per llm_context_retain. The last to
+    // let go deletes it, so a free never pulls the context (or its
+    // mutex) out from under a call that is waiting on it.
+    std::atomic<int32_t> refs{1};
+};
+
+struct llm_index {
+    tutu::VectorIndex index;
+    std::mutex mutex;
+};
+
+struct llm_keyword_index {
+    tutu::KeywordIndex index;
+    std::mutex mutex;
+};
+
+struct llm_qa_matcher {
+    tutu::QAMatcher matcher;
+    std::mutex mutex;
+};
+
+// Default session used by the single-session API. g_mutex only guards
+// these pointers; generation runs on a copy so unload never waits on it.
+static std::mutex g_mutex;
+static std::unique_ptr<llm_model> g_model;
+static std::shared_ptr<llm_context> g_context;
+static int32_t g_n_ctx = 2048;
+
+// Errors are per calling thread, so concurrent sessions never clobber
+// each other's messages
+static thread_local std::string g_last_error;
+
+static void set_error(const std::string& error) {
+    try {
+        g_last_error = error;
+    } catch (...) {
+        // Out of memory for the message itself; keep the previous one
+    }
+}
+
+// Record the exception being handled as the last error. Every entry
+// point ends in a catch-all calling this: an exception unwinding through
+// the C ABI into Dart would abort the app.
+static void on_exception() {
+    try {
+        throw;
+    } catch (const std::bad_alloc&) {
+        set_error("Out of memory");
+    } catch (const std::exception& e) {
+        set_error(e.what());
+    } catch (...) {
+        set_error("Unknown native error");
+    }
+}
+
+template <typename T>
+static T on_exception(T failure) {
+    on_exception();
+    return failure;
+}
+
+static void release_context(llm_context* ctx) {
+    if (ctx->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete ctx;
+    }
+}
+
+// Reference held for the length of an entry point
+class ContextRef {
+public:
+    explicit ContextRef(llm_context* ctx) : m_ctx(ctx) {
+        m_ctx->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    ~ContextRef() { release_context(m_ctx); }
+
+    ContextRef(const ContextRef&) = delete;
+    ContextRef& operator=(const ContextRef&) = delete;
+
+private:
+    llm_context* m_ctx;
+};
+
+static std::shared_ptr<llm_context> default_context() {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return g_context;
+}
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Global state
-static std::mutex g_mutex;
-static bool g_model_loaded = false;
-static std::string g_last_error;
-static int32_t g_n_ctx = 2048;
+// Callback for streamed generation: receives each decoded UTF-8 fragment
+// (NUL-terminated, length excludes the terminator). Return non-zero to stop.
+typedef int32_t (*llm_token_callback)(const char* piece, int32_t length, void* user_data);
+
+// Callback for prompt prefill progress: called after each micro-batch with
+// the prompt tokens evaluated so far and the prompt length. Return
+// non-zero to stop.
+typedef int32_t (*llm_progress_callback)(int32_t n_done, int32_t n_total, void* user_data);
+
+// Default completion length for llm_generate
+#define LLM_DEFAULT_MAX_TOKENS 256
 
 // ============================================================================
 // Initialization
 // ============================================================================
 
-void llm_init() {
+void llm_init() try {
     // Initialize any global state
+} catch (...) {
+    on_exception();
 }
 
-void llm_deinit() {
+void llm_deinit() try {
     std::lock_guard<std::mutex> lock(g_mutex);
-    g_model_loaded = false;
+    g_context.reset();
+    g_model.reset();
+} catch (...) {
+    on_exception();
 }
 
 // ============================================================================
 // Error Handling
 // ============================================================================
 
-const char* llm_get_last_error() {
-    std::lock_guard<std::mutex> lock(g_mutex);
+const char* llm_get_last_error() try {
     return g_last_error.c_str();
-}
-
-static void set_error(const std::string& error) {
-    std::lock_guard<std::mutex> lock(g_mutex);
-    g_last_error = error;
+} catch (...) {
+    return on_exception("");
 }
 
 // ============================================================================
-// Model Management
+// Model Handles
 // ============================================================================
 
-int32_t llm_load_model(const char* model_path, int32_t n_ctx, int32_t n_threads) {
-    std::lock_guard<std::mutex> lock(g_mutex);
-    
+llm_model* llm_model_load(const char* model_path, int32_t n_threads) try {
     if (model_path == nullptr) {
         set_error("Model path is null");
-        return -1;
+        return nullptr;
     }
-    
-    // Validate file exists
-    FILE* file = fopen(model_path, "rb");
-    if (!file) {
-        set_error("Model file not found");
-        return -1;
+
+    // Map the GGUF file; weights stay in the page cache as tensor views
+    auto model = std::make_shared<tutu::LlamaModel>();
+    std::string error;
+    if (!model->load(model_path, error)) {
+        set_error(error);
+        return nullptr;
     }
-    fclose(file);
-    
-    // In production: Load actual llama.cpp model here
-    // For now, simulate success
-    g_n_ctx = n_ctx > 0 ? n_ctx : 2048;
-    g_model_loaded = true;
-    
-    return 0;
+
+    // n_threads <= 0: time the matmuls at each thread count, counting
+    // every online core as a candidate
+    llm_model* handle = new llm_model();
+    if (n_threads <= 0) {
+        const int n_cores = static_cast<int>(tutu::cpu_topology().cores.size());
+        const int hw = static_cast<int>(std::thread::hardware_concurrency());
+        n_threads = tutu::tune_thread_count(*model, n_cores > 0 ? n_cores : std::max(hw, 1));
+        handle->threads_tuned = true;
+    }
+    handle->model = std::move(model);
+    handle->pool = std::make_shared<tutu::ThreadPool>(n_threads, tutu::cpu_affinity_for(n_threads));
+    handle->scheduler = std::make_shared<tutu::BatchScheduler>();
+    return handle;
+} catch (...) {
+    return on_exception(nullptr);
 }
 
-int32_t llm_is_model_loaded() {
-    std::lock_guard<std::mutex> lock(g_mutex);
-    return g_model_loaded ? 1 : 0;
+void llm_model_free(llm_model* model) try {
+    // Contexts created from this model keep the weights alive until freed
+    delete model;
+} catch (...) {
+    on_exception();
 }
 
-void llm_unload_model() {
-    std::lock_guard<std::mutex> lock(g_mutex);
-    g_model_loaded = false;
+int32_t llm_model_vocab_size(const llm_model* model) try {
+    if (model == nullptr) {
+        return 0;
+    }
+    return static_cast<int32_t>(model->model->hparams().n_vocab);
+} catch (...) {
+    return on_exception(0);
+}
+
+int32_t llm_model_n_threads(const llm_model* model) try {
+    return model != nullptr ? model->pool->size() : 0;
+} catch (...) {
+    return on_exception(0);
+}
+
+// Length of the vectors llm_embed writes
+int32_t llm_model_embedding_size(const llm_model* model) try {
+    if (model == nullptr) {
+        return 0;
+    }
+    return static_cast<int32_t>(model->model->hparams().n_embd);
+} catch (...) {
+    return on_exception(0);
+}
+
+int32_t llm_model_context_length(const llm_model* model) try {
+    if (model == nullptr) {
+        return 0;
+    }
+    return static_cast<int32_t>(model->model->hparams().n_ctx_train);
+} catch (...) {
+    return on_exception(0);
 }
 
 // ============================================================================
-// Inference
+// Context Handles
 // ============================================================================
 
-int32_t llm_generate(const char* prompt, char* output_buffer, int32_t buffer_size) {
-    if (prompt == nullptr || output_buffer == nullptr || buffer_size <= 0) {
+// KV cache storage for llm_context_create_kv: 0 = F16, 1 = Q8_0 (about
+// half the memory), 2 = Q4_0 (about a quarter)
+llm_context* llm_context_create_kv(llm_model* model, int32_t n_ctx, int32_t kv_type) try {
+    if (model == nullptr) {
+        set_error("Model handle is null");
+        return nullptr;
+    }
+    static const tutu::GGMLType kKVTypes[] = {tutu::GGMLType::F16, tutu::GGMLType::Q8_0, tutu::GGMLType::Q4_0};
+    if (kv_type < 0 || kv_type > 2) {
+        set_error("Invalid KV cache type");
+        return nullptr;
+    }
+
+    auto* handle = new llm_context();
+    handle->model = model->model;
+    handle->pool = model->pool;
+    handle->scheduler = model->scheduler;
+
+    std::string error;
+    if (!handle->ctx.init(*handle->model, n_ctx > 0 ? n_ctx : 2048, error, handle->pool.get(),
+                          kKVTypes[kv_type])) {
+        delete handle;
+        set_error(error);
+        return nullptr;
+    }
+    handle->ctx.set_scheduler(handle->scheduler.get());
+    return handle;
+} catch (...) {
+    return on_exception(nullptr);
+}
+
+llm_context* llm_context_create(llm_model* model, int32_t n_ctx) try {
+    return llm_context_create_kv(model, n_ctx, 0);
+} catch (...) {
+    return on_exception(nullptr);
+}
+
+// Drop a reference to ctx. A call still running on it (or a holder of
+// llm_context_retain) keeps it alive; the last one out deletes it.
+void llm_context_free(llm_context* ctx) try {
+    if (ctx == nullptr) {
+        return;
+    }
+    release_context(ctx);
+} catch (...) {
+    on_exception();
+}
+
+// Take another reference to ctx, to be dropped with llm_context_free.
+// Lets a worker keep using a context its owner may free meanwhile.
+void llm_context_retain(llm_context* ctx) try {
+    if (ctx != nullptr) {
+        ctx->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+} catch (...) {
+    on_exception();
+}
+
+int32_t llm_context_size(llm_context* ctx) try {
+    return ctx != nullptr ? ctx->ctx.n_ctx() : 0;
+} catch (...) {
+    return on_exception(0);
+}
+
+// Sampling for later generations on ctx. temperature <= 0 is greedy;
+// top_k <= 0, top_p >= 1, min_p <= 0 and repeat_penalty == 1 each turn
+// that stage off. seed 0 picks a random seed.
+int32_t llm_context_set_sampler(llm_context* ctx, float temperature, int32_t top_k, float top_p,
+                                float min_p, float repeat_penalty, int32_t repeat_last_n,
+                                uint32_t seed) try {
+    if (ctx == nullptr || repeat_penalty <= 0.0f || repeat_last_n < 0) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+
+    tutu::SamplerParams params;
+    params.temperature = temperature;
+    params.top_k = top_k;
+    params.top_p = top_p;
+    params.min_p = min_p;
+    params.repeat_penalty = repeat_penalty;
+    params.repeat_last_n = repeat_last_n;
+    params.seed = seed;
+
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->ctx.set_sampler_params(params);
+    return 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Decode speculatively on ctx, with draft (a much smaller model sharing
+// the vocabulary) proposing up to n_draft tokens per step. The draft gets
+// its own KV cache of the same size and type and runs on ctx's threads. A null
+// draft or n_draft <= 0 turns it off.
+int32_t llm_context_set_draft(llm_context* ctx, llm_model* draft, int32_t n_draft) try {
+    if (ctx == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    std::string error;
+    if (draft == nullptr || n_draft <= 0) {
+        ctx->ctx.set_draft(nullptr, 0, error);
+        ctx->draft.reset();
+        ctx->draft_model.reset();
+        return 0;
+    }
+
+    auto draft_ctx = std::make_unique<tutu::LlamaContext>();
+    if (!draft_ctx->init(*draft->model, ctx->ctx.n_ctx(), error, ctx->pool.get(), ctx->ctx.kv_type()) ||
+        !ctx->ctx.set_draft(draft_ctx.get(), n_draft, error)) {
+        set_error(error);
+        return -1;
+    }
+    ctx->draft = std::move(draft_ctx);
+    ctx->draft_model = draft->model;
+    return 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Speculate on ctx by prompt lookup: continue an earlier occurrence of
+// the last few tokens of the transcript with up to n_draft tokens. Needs
+// no second model. n_draft <= 0 turns it off.
+int32_t llm_context_set_lookup(llm_context* ctx, int32_t n_draft) try {
+    if (ctx == nullptr) {
         set_error("Invalid parameters");
         return -1;
     }
-    
-    {
-        std::lock_guard<std::mutex> lock(g_mutex);
-        if (!g_model_loaded) {
-            set_error("No model loaded");
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->ctx.set_prompt_lookup(n_draft);
+    return 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Prefill prompts on ctx in micro-batches of n_ubatch tokens (1..512).
+// Larger batches evaluate prompts faster but need more scratch memory.
+int32_t llm_context_set_ubatch(llm_context* ctx, int32_t n_ubatch) try {
+    if (ctx == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    std::string error;
+    if (!ctx->ctx.set_ubatch(n_ubatch, error)) {
+        set_error(error);
+        return -1;
+    }
+    return 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Embed n_texts strings with ctx's model, writing one unit-length vector
+// of llm_model_embedding_size floats per text back to back into out
+// (room for n_max floats; may be NULL to only get the length). pooling:
+// 0 = mean of every token's hidden state, 1 = the last token's. Texts
+// longer than the context are cut. The context's KV cache is cleared, so
+// use one reserved for embeddings. Returns the vector length, or -1 on
+// error.
+int32_t llm_embed(llm_context* ctx, const char* const* texts, int32_t n_texts, int32_t pooling,
+                  float* out, int32_t n_max) try {
+    if (ctx == nullptr || n_texts < 0 || pooling < 0 || pooling > 1) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    const int32_t n_embd = static_cast<int32_t>(ctx->model->hparams().n_embd);
+    if (out == nullptr) {
+        return n_embd;
+    }
+    if (texts == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    if (static_cast<int64_t>(n_texts) * n_embd > n_max) {
+        set_error("Output buffer too small");
+        return -1;
+    }
+
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    const tutu::Pooling mode = pooling == 0 ? tutu::Pooling::Mean : tutu::Pooling::Last;
+    std::string error;
+    for (int32_t i = 0; i < n_texts; ++i) {
+        if (!ctx->ctx.embed(texts[i] != nullptr ? texts[i] : "", mode, out + static_cast<size_t>(i) * n_embd,
+                            error)) {
+            set_error(error);
             return -1;
         }
     }
-    
-    // In production: Run actual inference with llama.cpp
-    // For now, return a placeholder response
-    const char* placeholder = "I'm a local AI assistant running on your device! I process everything locally without needing an internet connection. Your privacy is completely protected.";
-    
-    int32_t len = strlen(placeholder);
+    return n_embd;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Constrain the context's generations to a GBNF grammar. Null or empty
+// removes the constraint.
+int32_t llm_context_set_grammar(llm_context* ctx, const char* gbnf) try {
+    if (ctx == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    std::string error;
+    if (!ctx->ctx.set_grammar(gbnf != nullptr ? gbnf : "", error)) {
+        set_error(error);
+        return -1;
+    }
+    return 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Constrain the context's generations to JSON matching a JSON schema (see
+// json_schema.h for the supported subset). Null or empty removes it.
+int32_t llm_context_set_json_schema(llm_context* ctx, const char* schema) try {
+    if (ctx == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    std::string gbnf;
+    std::string error;
+    if (schema != nullptr && schema[0] != '\0' && !tutu::json_schema_to_gbnf(schema, gbnf, error)) {
+        set_error(error);
+        return -1;
+    }
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    if (!ctx->ctx.set_grammar(gbnf, error)) {
+        set_error(error);
+        return -1;
+    }
+    return 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Called before a generation is handed to another thread, so a cancel
+// arriving before it takes ctx->mutex still stops it
+void llm_context_reserve(llm_context* ctx) try {
+    if (ctx != nullptr) {
+        const ContextRef ref(ctx);
+        ctx->ctx.reserve();
+    }
+} catch (...) {
+    on_exception();
+}
+
+void llm_context_cancel(llm_context* ctx) try {
+    // No lock: the generating thread holds ctx->mutex until it returns
+    if (ctx != nullptr) {
+        const ContextRef ref(ctx);
+        ctx->ctx.cancel();
+    }
+} catch (...) {
+    on_exception();
+}
+
+// Streamed generation that also reports prefill progress between
+// micro-batches (progress may be null). Both callbacks get user_data.
+int32_t llm_context_generate_stream_progress(llm_context* ctx, const char* prompt, int32_t max_tokens,
+                                             llm_token_callback callback, llm_progress_callback progress,
+                                             void* user_data) try {
+    if (ctx == nullptr || prompt == nullptr || callback == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    std::string error;
+    tutu::ProgressCallback on_progress;
+    if (progress != nullptr) {
+        on_progress = [&](int32_t n_done, int32_t n_total) {
+            return progress(n_done, n_total, user_data) == 0;
+        };
+    }
+    const int32_t n_generated = ctx->ctx.generate(
+        prompt,
+        max_tokens > 0 ? max_tokens : LLM_DEFAULT_MAX_TOKENS,
+        [&](const std::string& piece) {
+            return callback(piece.c_str(), static_cast<int32_t>(piece.size()), user_data) == 0;
+        },
+        error,
+        on_progress);
+
+    if (n_generated < 0) {
+        set_error(error);
+    }
+    return n_generated;
+} catch (...) {
+    return on_exception(-1);
+}
+
+int32_t llm_context_generate_stream(llm_context* ctx, const char* prompt, int32_t max_tokens,
+                                    llm_token_callback callback, void* user_data) try {
+    return llm_context_generate_stream_progress(ctx, prompt, max_tokens, callback, nullptr, user_data);
+} catch (...) {
+    return on_exception(-1);
+}
+
+int32_t llm_context_generate(llm_context* ctx, const char* prompt,
+                             char* output_buffer, int32_t buffer_size) try {
+    if (ctx == nullptr || prompt == nullptr || output_buffer == nullptr || buffer_size <= 0) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+
+    // Collect the streamed pieces; stop once the buffer is full
+    std::string output;
+    std::string error;
+    const int32_t n_generated = ctx->ctx.generate(
+        prompt,
+        LLM_DEFAULT_MAX_TOKENS,
+        [&](const std::string& piece) {
+            output += piece;
+            return static_cast<int32_t>(output.size()) < buffer_size - 1;
+        },
+        error);
+
+    if (n_generated < 0) {
+        set_error(error);
+        return -1;
+    }
+
+    int32_t len = static_cast<int32_t>(output.size());
     if (len >= buffer_size) {
         len = buffer_size - 1;
+        // Never cut a UTF-8 sequence in half
+        while (len > 0 && (static_cast<unsigned char>(output[len]) & 0xC0) == 0x80) {
+            --len;
+        }
     }
-    
-    memcpy(output_buffer, placeholder, len);
+
+    memcpy(output_buffer, output.data(), len);
     output_buffer[len] = '\0';
-    
+
     return len;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// ============================================================================
+// State Snapshots
+// ============================================================================
+
+int32_t llm_context_save_state(llm_context* ctx, const char* path) try {
+    if (ctx == nullptr || path == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    std::string error;
+    const int32_t n_tokens = ctx->ctx.save_state(path, error);
+    if (n_tokens < 0) {
+        set_error(error);
+    }
+    return n_tokens;
+} catch (...) {
+    return on_exception(-1);
+}
+
+int32_t llm_context_load_state(llm_context* ctx, const char* path) try {
+    if (ctx == nullptr || path == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+
+    const ContextRef ref(ctx);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    std::string error;
+    const int32_t n_tokens = ctx->ctx.load_state(path, error);
+    if (n_tokens < 0) {
+        set_error(error);
+    }
+    return n_tokens;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// ============================================================================
+// Model Management (default session)
+// ============================================================================
+
+int32_t llm_load_model(const char* model_path, int32_t n_ctx, int32_t n_threads) try {
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    g_context.reset();
+    g_model.reset();
+
+    std::unique_ptr<llm_model> model(llm_model_load(model_path, n_threads));
+    if (!model) {
+        return -1;
+    }
+
+    g_n_ctx = n_ctx > 0 ? n_ctx : 2048;
+    llm_context* ctx = llm_context_create(model.get(), g_n_ctx);
+    if (ctx == nullptr) {
+        return -1;
+    }
+
+    g_model = std::move(model);
+    g_context.reset(ctx, llm_context_free);
+
+    return 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+int32_t llm_is_model_loaded() try {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return g_model ? 1 : 0;
+} catch (...) {
+    return on_exception(0);
+}
+
+void llm_unload_model() try {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_context.reset();
+    g_model.reset();
+} catch (...) {
+    on_exception();
+}
+
+// ============================================================================
+// Inference (default session)
+// ============================================================================
+
+int32_t llm_generate_stream(const char* prompt, int32_t max_tokens,
+                            llm_token_callback callback, void* user_data) try {
+    std::shared_ptr<llm_context> ctx = default_context();
+    if (!ctx) {
+        set_error("No model loaded");
+        return -1;
+    }
+    return llm_context_generate_stream(ctx.get(), prompt, max_tokens, callback, user_data);
+} catch (...) {
+    return on_exception(-1);
+}
+
+int32_t llm_generate(const char* prompt, char* output_buffer, int32_t buffer_size) try {
+    std::shared_ptr<llm_context> ctx = default_context();
+    if (!ctx) {
+        set_error("No model loaded");
+        return -1;
+    }
+    return llm_context_generate(ctx.get(), prompt, output_buffer, buffer_size);
+} catch (...) {
+    return on_exception(-1);
+}
+
+void llm_cancel() try {
+    std::shared_ptr<llm_context> ctx = default_context();
+    if (ctx) {
+        llm_context_cancel(ctx.get());
+    }
+} catch (...) {
+    on_exception();
 }
 
 // ============================================================================
 // Tokenization
 // ============================================================================
 
-int32_t llm_tokenize(const char* text) {
+// Tokenize text with the model's BPE vocabulary; special tokens such as
+// <|im_start|> are recognized. Writes up to n_max ids to tokens (which may
+// be NULL to only count) and returns the token count, or the negated
+// count if the buffer is too small.
+int32_t llm_model_tokenize(const llm_model* model, const char* text,
+                           int32_t* tokens, int32_t n_max) try {
+    if (model == nullptr || text == nullptr) {
+        set_error("Invalid parameters");
+        return 0;
+    }
+
+    std::vector<int32_t> ids;
+    model->model->tokenizer().encode(text, strlen(text), true, ids);
+
+    const int32_t n = static_cast<int32_t>(ids.size());
+    if (tokens == nullptr) {
+        return n;
+    }
+    if (n > n_max) {
+        return -n;
+    }
+    memcpy(tokens, ids.data(), ids.size() * sizeof(int32_t));
+    return n;
+} catch (...) {
+    return on_exception(0);
+}
+
+// Tokenize n_texts strings in one call. counts[i] receives the token count
+// of texts[i]; the ids are written back to back into tokens (may be NULL
+// to only count). Returns the total count, or its negation if tokens is
+// too small.
+int32_t llm_model_tokenize_batch(const llm_model* model, const char* const* texts, int32_t n_texts,
+                                 int32_t* counts, int32_t* tokens, int32_t n_max) try {
+    if (model == nullptr || texts == nullptr || counts == nullptr || n_texts < 0) {
+        set_error("Invalid parameters");
+        return 0;
+    }
+
+    const tutu::Tokenizer& tokenizer = model->model->tokenizer();
+    std::vector<int32_t> ids;
+    for (int32_t i = 0; i < n_texts; ++i) {
+        const size_t before = ids.size();
+        if (texts[i] != nullptr) {
+            tokenizer.encode(texts[i], strlen(texts[i]), true, ids);
+        }
+        counts[i] = static_cast<int32_t>(ids.size() - before);
+    }
+
+    const int32_t total = static_cast<int32_t>(ids.size());
+    if (tokens == nullptr) {
+        return total;
+    }
+    if (total > n_max) {
+        return -total;
+    }
+    memcpy(tokens, ids.data(), ids.size() * sizeof(int32_t));
+    return total;
+} catch (...) {
+    return on_exception(0);
+}
+
+// Token count with the default model
+int32_t llm_tokenize(const char* text) try {
     if (text == nullptr) {
         return -1;
     }
-    
-    // Rough estimate: 1 token ~ 4 characters
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_model) {
+        return llm_model_tokenize(g_model.get(), text, nullptr, 0);
+    }
+
+    // No vocabulary loaded: rough estimate of 1 token ~ 4 characters
     int32_t len = strlen(text);
     return len / 4;
+} catch (...) {
+    return on_exception(-1);
 }
 
 // ============================================================================
 // Model Information
 // ============================================================================
 
-int32_t llm_get_context_size() {
+int32_t llm_get_context_size() try {
     std::lock_guard<std::mutex> lock(g_mutex);
-    return g_model_loaded ? g_n_ctx : 0;
+    return g_model ? g_n_ctx : 0;
+} catch (...) {
+    return on_exception(0);
 }
 
-int32_t llm_get_vocab_size() {
-    return 49152; // SmolLM2 vocab size
+int32_t llm_get_vocab_size() try {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (!g_model) {
+        return 49152; // SmolLM2 vocab size
+    }
+    return llm_model_vocab_size(g_model.get());
+} catch (...) {
+    return on_exception(0);
 }
 
-int32_t llm_has_gpu_support() {
+int32_t llm_has_gpu_support() try {
     // Check for GPU support
     #ifdef GGML_USE_VULKAN
         return 1;
@@ -155,16 +852,452 @@ int32_t llm_has_gpu_support() {
     #else
         return 0;
     #endif
+} catch (...) {
+    return on_exception(0);
 }
 
-void llm_get_system_info(char* buffer, int32_t buffer_size) {
-    std::string info = "Local LLM (SmolLM2-360M)\n";
-    info += "Threads: 4\n";
+void llm_model_get_system_info(const llm_model* model, char* buffer, int32_t buffer_size) try {
+    if (buffer == nullptr || buffer_size <= 0) {
+        return;
+    }
+
+    std::string info;
+    if (model != nullptr) {
+        const tutu::LlamaModel& m = *model->model;
+        const tutu::LlamaHParams& hp = m.hparams();
+        info = "Local LLM (" + m.name() + ")\n";
+        info += "Layers: " + std::to_string(hp.n_layer) +
+                ", Embedding: " + std::to_string(hp.n_embd) + "\n";
+        info += "Weights: " + std::to_string(m.weights_size() / (1024 * 1024)) +
+                " MB (memory-mapped)\n";
+        info += "Threads: " + std::to_string(model->pool->size());
+        info += model->threads_tuned ? " (auto-tuned)" : "";
+        if (!model->pool->cpus().empty()) {
+            info += ", pinned to CPUs " + tutu::cpu_list_string(model->pool->cpus());
+        }
+        info += "\n";
+    } else {
+        info = "Local LLM (SmolLM2-360M)\n";
+    }
+    info += "CPU: " + tutu::cpu_topology_string() + "\n";
+    info += "SIMD: " + std::string(tutu::quant_kernels_name()) +
+            " (" + tutu::cpu_features_string() + ")\n";
     info += "GPU: ";
     info += llm_has_gpu_support() ? "YES" : "NO";
-    
+
     strncpy(buffer, info.c_str(), buffer_size - 1);
     buffer[buffer_size - 1] = '\0';
+} catch (...) {
+    on_exception();
+}
+
+void llm_get_system_info(char* buffer, int32_t buffer_size) try {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    llm_model_get_system_info(g_model.get(), buffer, buffer_size);
+} catch (...) {
+    on_exception();
+}
+
+// ============================================================================
+// Vector Index
+// ============================================================================
+
+// Bytes per id in llm_index_search's output, NUL terminator included
+#define LLM_INDEX_ID_SIZE 48
+
+// Open (or create) the nearest-neighbour index at path for vectors of dim
+// floats. Fails on a file of another dimension, or one that was being
+// changed when the app died; delete it and add the vectors again.
+llm_index* llm_index_open(const char* path, int32_t dim) try {
+    if (path == nullptr || dim <= 0) {
+        set_error("Invalid parameters");
+        return nullptr;
+    }
+    auto* handle = new llm_index();
+    std::string error;
+    if (!handle->index.open(path, static_cast<uint32_t>(dim), error)) {
+        delete handle;
+        set_error(error);
+        return nullptr;
+    }
+    return handle;
+} catch (...) {
+    return on_exception(nullptr);
+}
+
+// Write pending changes and close the index
+void llm_index_close(llm_index* index) try {
+    delete index;
+} catch (...) {
+    on_exception();
+}
+
+// Insert or replace the vector stored under id (at most
+// LLM_INDEX_ID_SIZE - 1 bytes)
+int32_t llm_index_add(llm_index* index, const char* id, const float* vector) try {
+    if (index == nullptr || id == nullptr || vector == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    std::string error;
+    if (!index->index.add(id, vector, error)) {
+        set_error(error);
+        return -1;
+    }
+    return 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Returns 1 if id had a vector, 0 if not
+int32_t llm_index_remove(llm_index* index, const char* id) try {
+    if (index == nullptr || id == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    return index->index.remove(id) ? 1 : 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Find the k vectors most similar to query. Writes their ids (k slots of
+// LLM_INDEX_ID_SIZE bytes) and cosine similarities, best first, and
+// returns how many were found.
+int32_t llm_index_search(llm_index* index, const float* query, int32_t k, char* ids, float* scores) try {
+    if (index == nullptr || query == nullptr || k < 0 || ids == nullptr || scores == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    const auto found = index->index.search(query, k);
+    for (size_t i = 0; i < found.size(); ++i) {
+        strncpy(ids + i * LLM_INDEX_ID_SIZE, found[i].first.c_str(), LLM_INDEX_ID_SIZE - 1);
+        ids[i * LLM_INDEX_ID_SIZE + LLM_INDEX_ID_SIZE - 1] = '\0';
+        scores[i] = found[i].second;
+    }
+    return static_cast<int32_t>(found.size());
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Dimension of the vectors in an index
+int32_t llm_index_dim(llm_index* index) try {
+    if (index == nullptr) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    return static_cast<int32_t>(index->index.dim());
+} catch (...) {
+    return on_exception(0);
+}
+
+// Vectors searches can return
+int32_t llm_index_size(llm_index* index) try {
+    if (index == nullptr) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    return static_cast<int32_t>(index->index.size());
+} catch (...) {
+    return on_exception(0);
+}
+
+// Removed vectors still taking up space (and search time) until
+// llm_index_compact
+int32_t llm_index_removed(llm_index* index) try {
+    if (index == nullptr) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    return static_cast<int32_t>(index->index.removed());
+} catch (...) {
+    return on_exception(0);
+}
+
+// Rebuild the file without removed vectors
+int32_t llm_index_compact(llm_index* index) try {
+    if (index == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    std::string error;
+    if (!index->index.compact(error)) {
+        set_error(error);
+        return -1;
+    }
+    return 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Make the changes so far durable
+void llm_index_flush(llm_index* index) try {
+    if (index == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    index->index.flush();
+} catch (...) {
+    on_exception();
+}
+
+// ============================================================================
+// Keyword Index
+// ============================================================================
+
+// Create an empty in-memory BM25 index
+llm_keyword_index* llm_keyword_index_create(void) try {
+    return new llm_keyword_index();
+} catch (...) {
+    return on_exception(nullptr);
+}
+
+void llm_keyword_index_free(llm_keyword_index* index) try {
+    delete index;
+} catch (...) {
+    on_exception();
+}
+
+// Index text under id, replacing what id had. importance weights id in
+// llm_memory_search, and expires_at (milliseconds since the epoch, 0 for
+// never) is when it stops being returned.
+int32_t llm_keyword_index_add(llm_keyword_index* index, const char* id, const char* text, float importance,
+                              int64_t expires_at) try {
+    if (index == nullptr || id == nullptr || text == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    tutu::KeywordIndex::Weight weight;
+    weight.importance = importance;
+    weight.expires_at = expires_at;
+    index->index.add(id, text, weight);
+    return 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Returns 1 if id was indexed, 0 if not
+int32_t llm_keyword_index_remove(llm_keyword_index* index, const char* id) try {
+    if (index == nullptr || id == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    return index->index.remove(id) ? 1 : 0;
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Find the k texts scoring best against query under BM25. Writes their
+// ids (k slots of LLM_INDEX_ID_SIZE bytes, longer ids truncated) and
+// scores, best first, and returns how many matched.
+int32_t llm_keyword_index_search(llm_keyword_index* index, const char* query, int32_t k, char* ids,
+                                 float* scores) try {
+    if (index == nullptr || query == nullptr || k < 0 || ids == nullptr || scores == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    const auto found = index->index.search(query, k);
+    for (size_t i = 0; i < found.size(); ++i) {
+        strncpy(ids + i * LLM_INDEX_ID_SIZE, found[i].first.c_str(), LLM_INDEX_ID_SIZE - 1);
+        ids[i * LLM_INDEX_ID_SIZE + LLM_INDEX_ID_SIZE - 1] = '\0';
+        scores[i] = found[i].second;
+    }
+    return static_cast<int32_t>(found.size());
+} catch (...) {
+    return on_exception(-1);
+}
+
+// Texts in the index
+int32_t llm_keyword_index_size(llm_keyword_index* index) try {
+    if (index == nullptr) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(index->mutex);
+    return static_cast<int32_t>(index->index.size());
+} catch (...) {
+    return on_exception(0);
+}
+
+// ============================================================================
+// Memory Search
+// ============================================================================
+
+// Find the k memories best matching query in one pass: a BM25 search of
+// keywords and, when vectors and query_vector are given, a nearest-
+// neighbour search ignoring matches below min_similarity, fused by
+// reciprocal rank and weighted by importance. Memories expired at now_ms
+// are skipped and removed from both indexes. Writes ids (k slots of
+// LLM_INDEX_ID_SIZE bytes) and fused scores, best first, plus each hit's
+// BM25 score and cosine similarity when lexical / semantic are not null.
+// Returns how many were found.
+int32_t llm_memory_search(llm_keyword_index* keywords, llm_index* vectors, const char* query,
+                          const float* query_vector, float min_similarity, int64_t now_ms, int32_t k,
+                          char* ids, float* scores, float* lexical, float* semantic) try {
+    if (keywords == nullptr || query == nullptr || k < 0 || ids == nullptr || scores == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    tutu::MemoryQuery q;
+    q.text = query;
+    q.vector = query_vector;
+    q.k = k;
+    q.min_similarity = min_similarity;
+    q.now = now_ms;
+
+    // Always keywords first, so two searches cannot deadlock
+    std::lock_guard<std::mutex> keyword_lock(keywords->mutex);
+    std::unique_lock<std::mutex> vector_lock;
+    if (vectors != nullptr) {
+        vector_lock = std::unique_lock<std::mutex>(vectors->mutex);
+    }
+    const auto hits = tutu::memory_search(keywords->index, vectors != nullptr ? &vectors->index : nullptr, q);
+    for (size_t i = 0; i < hits.size(); ++i) {
+        strncpy(ids + i * LLM_INDEX_ID_SIZE, hits[i].id.c_str(), LLM_INDEX_ID_SIZE - 1);
+        ids[i * LLM_INDEX_ID_SIZE + LLM_INDEX_ID_SIZE - 1] = '\0';
+        scores[i] = hits[i].score;
+        if (lexical != nullptr) lexical[i] = hits[i].lexical;
+        if (semantic != nullptr) semantic[i] = hits[i].semantic;
+    }
+    return static_cast<int32_t>(hits.size());
+} catch (...) {
+    return on_exception(-1);
+}
+
+// ============================================================================
+// QA Matcher
+// ============================================================================
+
+// Create an empty matcher for the offline QA bank
+llm_qa_matcher* llm_qa_matcher_create(void) try {
+    return new llm_qa_matcher();
+} catch (...) {
+    return on_exception(nullptr);
+}
+
+// Map a QA bank compiled by qa_bank_compiler. Nothing is parsed or
+// copied; entries are read from the mapping as they are used.
+llm_qa_matcher* llm_qa_matcher_open(const char* path) try {
+    if (path == nullptr) {
+        set_error("Invalid parameters");
+        return nullptr;
+    }
+    auto* handle = new llm_qa_matcher();
+    std::string error;
+    if (!handle->matcher.open(path, error)) {
+        delete handle;
+        set_error(error);
+        return nullptr;
+    }
+    return handle;
+} catch (...) {
+    return on_exception(nullptr);
+}
+
+void llm_qa_matcher_free(llm_qa_matcher* matcher) try {
+    delete matcher;
+} catch (...) {
+    on_exception();
+}
+
+// Add a bank entry; returns its index (entries are numbered in the order
+// added), or -1 on error. Matchers opened from a file are read-only.
+int32_t llm_qa_matcher_add(llm_qa_matcher* matcher, const char* id, const char* question, const char* answer,
+                           const char* category, const char** keywords, int32_t n_keywords, float priority) try {
+    if (matcher == nullptr || id == nullptr || question == nullptr || answer == nullptr || category == nullptr ||
+        n_keywords < 0 || (n_keywords > 0 && keywords == nullptr)) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    tutu::QAMatcher::Entry entry;
+    entry.id = id;
+    entry.question = question;
+    entry.answer = answer;
+    entry.category = category;
+    for (int32_t i = 0; i < n_keywords; ++i) {
+        entry.keywords.emplace_back(keywords[i] != nullptr ? keywords[i] : "");
+    }
+    entry.priority = priority;
+    std::lock_guard<std::mutex> lock(matcher->mutex);
+    const int32_t index = matcher->matcher.add(entry);
+    if (index < 0) set_error("QA bank is read-only");
+    return index;
+} catch (...) {
+    return on_exception(-1);
+}
+
+int32_t llm_qa_matcher_size(llm_qa_matcher* matcher) try {
+    if (matcher == nullptr) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(matcher->mutex);
+    return static_cast<int32_t>(matcher->matcher.size());
+} catch (...) {
+    return on_exception(0);
+}
+
+// A text field of an entry: 0 id, 1 question, 2 answer, 3 category.
+// Owned by the matcher and valid until the next llm_qa_matcher_add; null
+// if index or field is out of range.
+const char* llm_qa_matcher_entry_text(llm_qa_matcher* matcher, int32_t index, int32_t field) try {
+    if (matcher == nullptr || index < 0 || field < 0 || field > 3) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(matcher->mutex);
+    return matcher->matcher.text(static_cast<uint32_t>(index), static_cast<tutu::QAMatcher::Field>(field));
+} catch (...) {
+    return on_exception(nullptr);
+}
+
+// Store up to max_keywords of an entry's keywords (owned as above) in
+// keywords; returns how many it has
+int32_t llm_qa_matcher_entry_keywords(llm_qa_matcher* matcher, int32_t index, const char** keywords,
+                                      int32_t max_keywords) try {
+    if (matcher == nullptr || index < 0 || max_keywords < 0 || (max_keywords > 0 && keywords == nullptr)) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(matcher->mutex);
+    const std::vector<const char*> all = matcher->matcher.keywords(static_cast<uint32_t>(index));
+    for (size_t i = 0; i < all.size() && i < static_cast<size_t>(max_keywords); ++i) {
+        keywords[i] = all[i];
+    }
+    return static_cast<int32_t>(all.size());
+} catch (...) {
+    return on_exception(-1);
+}
+
+float llm_qa_matcher_entry_priority(llm_qa_matcher* matcher, int32_t index) try {
+    if (matcher == nullptr || index < 0) {
+        return 0.0f;
+    }
+    std::lock_guard<std::mutex> lock(matcher->mutex);
+    return matcher->matcher.priority(static_cast<uint32_t>(index));
+} catch (...) {
+    return on_exception(0.0f);
+}
+
+// Score every entry against query and return the best one's index, or -1
+// if none scored. scores receives its combined score, Levenshtein
+// similarity and keyword score.
+int32_t llm_qa_matcher_match(llm_qa_matcher* matcher, const char* query, float* scores) try {
+    if (matcher == nullptr || query == nullptr || scores == nullptr) {
+        set_error("Invalid parameters");
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(matcher->mutex);
+    const tutu::QAMatcher::Match best = matcher->matcher.match(query);
+    scores[0] = best.score;
+    scores[1] = best.levenshtein;
+    scores[2] = best.keyword;
+    return best.entry;
+} catch (...) {
+    return on_exception(-1);
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,1148 @@
+/**
+ * llama_context.cpp - Inference state for a loaded llama model
+ */
+
+#include "llama_context.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "batch_scheduler.h"
+#include "cpu_topology.h"
+#include "quants.h"
+
+namespace tutu {
+
+// ============================================================================
+// Tensor Ops
+// ============================================================================
+
+namespace {
+
+// Smallest row block worth handing to another thread
+constexpr int64_t kMatmulMinRows = 16;
+
+// The draft stops proposing once its top token is less likely than this
+constexpr float kDraftMinProb = 0.5f;
+
+// A cached run must match at least this many prompt tokens to be worth
+// shifting into place
+constexpr size_t kShiftMinMatch = 8;
+
+// n-gram lengths prompt lookup matches, tried longest first. Single
+// tokens match too often to predict much.
+constexpr int32_t kLookupNgramMax = 4;
+constexpr int32_t kLookupNgramMin = 2;
+
+void rms_norm(float* out, const float* x, const float* weight, int64_t n, float eps) {
+    float ss = 0.0f;
+    for (int64_t i = 0; i < n; ++i) ss += x[i] * x[i];
+    const float scale = 1.0f / std::sqrt(ss / static_cast<float>(n) + eps);
+    for (int64_t i = 0; i < n; ++i) out[i] = x[i] * scale * weight[i];
+}
+
+// y[b] = W x[b] for n_batch rows of x and a [ne0 = n_in, ne1 = n_out]
+// weight. Each x row is quantized into xq once to the weight's dot type,
+// then every weight row is dotted with all of them while it is in cache,
+// so a batch costs one pass over the weights. Weight rows are split
+// across the pool when there is one.
+void matmul(const GGUFTensor* w, const float* x, float* y, int64_t n_batch, uint8_t* xq, ThreadPool* pool) {
+    const int64_t n_in = w->ne[0];
+    const int64_t n_out = w->ne[1];
+    const size_t row_size = w->row_size();
+    const size_t xq_size = ggml_row_size(vec_dot_type(w->type), n_in);
+    const uint8_t* data = static_cast<const uint8_t*>(w->data);
+    for (int64_t b = 0; b < n_batch; ++b) {
+        quantize_activations(w->type, x + b * n_in, xq + b * xq_size, n_in);
+    }
+    auto rows = [&](int64_t begin, int64_t end) {
+        for (int64_t r = begin; r < end; ++r) {
+            const uint8_t* row = data + static_cast<size_t>(r) * row_size;
+            for (int64_t b = 0; b < n_batch; ++b) {
+                y[b * n_out + r] = vec_dot_q(w->type, row, xq + b * xq_size, n_in);
+            }
+        }
+    };
+    if (pool != nullptr) {
+        pool->parallel_for(n_out, kMatmulMinRows, rows);
+    } else {
+        rows(0, n_out);
+    }
+}
+
+// Rotate adjacent pairs (llama "normal" RoPE layout)
+void rope(float* x, int n_heads, int head_dim, int n_rot, int pos, const float* inv_freq) {
+    for (int h = 0; h < n_heads; ++h) {
+        float* v = x + h * head_dim;
+        for (int i = 0; i < n_rot; i += 2) {
+            const float theta = static_cast<float>(pos) * inv_freq[i / 2];
+            const float c = std::cos(theta);
+            const float s = std::sin(theta);
+            const float x0 = v[i];
+            const float x1 = v[i + 1];
+            v[i] = x0 * c - x1 * s;
+            v[i + 1] = x0 * s + x1 * c;
+        }
+    }
+}
+
+// Rotate adjacent pairs by precomputed angles: one cos/sin per pair index,
+// the same for every head. Used to move cached keys to new positions.
+void rope_rotate(float* x, int n_heads, int head_dim, int n_rot, const float* cos_t, const float* sin_t) {
+    for (int h = 0; h < n_heads; ++h) {
+        float* v = x + h * head_dim;
+        for (int i = 0; i < n_rot; i += 2) {
+            const float x0 = v[i];
+            const float x1 = v[i + 1];
+            v[i] = x0 * cos_t[i / 2] - x1 * sin_t[i / 2];
+            v[i + 1] = x0 * sin_t[i / 2] + x1 * cos_t[i / 2];
+        }
+    }
+}
+
+void softmax(float* x, int n) {
+    float max_val = x[0];
+    for (int i = 1; i < n; ++i) {
+        if (x[i] > max_val) max_val = x[i];
+    }
+    float sum = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        x[i] = std::exp(x[i] - max_val);
+        sum += x[i];
+    }
+    const float inv = 1.0f / sum;
+    for (int i = 0; i < n; ++i) x[i] *= inv;
+}
+
+inline float silu(float x) {
+    return x / (1.0f + std::exp(-x));
+}
+
+// q . k for one head of n values, with k stored as type. qq holds q in
+// Q8_0 when type is quantized, so the integer dot kernels apply.
+inline float kv_score(GGMLType type, const float* q, const uint8_t* qq, const uint8_t* k, int n) {
+    if (type != GGMLType::F16) return vec_dot_q(type, k, qq, n);
+    const uint16_t* kh = reinterpret_cast<const uint16_t*>(k);
+    float s = 0.0f;
+    for (int i = 0; i < n; ++i) s += q[i] * fp16_to_fp32(kh[i]);
+    return s;
+}
+
+// out += a * v for one head of n values, with v stored as type. Quantized
+// blocks fold a into their scale, so nothing is dequantized up front.
+void kv_accumulate(GGMLType type, float a, const uint8_t* v, float* out, int n) {
+    switch (type) {
+        case GGMLType::Q8_0: {
+            const block_q8_0* b = reinterpret_cast<const block_q8_0*>(v);
+            for (int ib = 0; ib < n / QK8_0; ++ib, out += QK8_0) {
+                const float ad = a * fp16_to_fp32(b[ib].d);
+                for (int j = 0; j < QK8_0; ++j) out[j] += ad * static_cast<float>(b[ib].qs[j]);
+            }
+            break;
+        }
+        case GGMLType::Q4_0: {
+            const block_q4_0* b = reinterpret_cast<const block_q4_0*>(v);
+            for (int ib = 0; ib < n / QK4_0; ++ib, out += QK4_0) {
+                const float ad = a * fp16_to_fp32(b[ib].d);
+                for (int j = 0; j < QK4_0 / 2; ++j) {
+                    out[j] += ad * static_cast<float>((b[ib].qs[j] & 0x0F) - 8);
+                    out[j + QK4_0 / 2] += ad * static_cast<float>((b[ib].qs[j] >> 4) - 8);
+                }
+            }
+            break;
+        }
+        default: {
+            const uint16_t* vh = reinterpret_cast<const uint16_t*>(v);
+            for (int i = 0; i < n; ++i) out[i] += a * fp16_to_fp32(vh[i]);
+            break;
+        }
+    }
+}
+
+// Highest logit and its softmax probability
+int32_t top_token(const float* logits, int32_t n, float* prob) {
+    const int32_t best = static_cast<int32_t>(std::max_element(logits, logits + n) - logits);
+    float sum = 0.0f;
+    for (int32_t i = 0; i < n; ++i) sum += std::exp(logits[i] - logits[best]);
+    *prob = 1.0f / sum;
+    return best;
+}
+
+// Whether two tokenizers map every id to the same text
+bool same_vocab(const Tokenizer& a, const Tokenizer& b) {
+    if (a.n_vocab() != b.n_vocab()) return false;
+    for (int32_t id = 0; id < a.n_vocab(); ++id) {
+        if (a.is_control(id) != b.is_control(id) || a.token_to_piece(id) != b.token_to_piece(id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Number of bytes that form complete UTF-8 sequences at the start of s
+size_t utf8_complete_prefix(const std::string& s) {
+    size_t i = s.size();
+    // Walk back over at most 3 continuation bytes to the last lead byte
+    size_t back = 0;
+    while (i > 0 && back < 4) {
+        const unsigned char c = static_cast<unsigned char>(s[i - 1]);
+        if ((c & 0xC0) != 0x80) {
+            size_t need = 1;
+            if ((c & 0xE0) == 0xC0) need = 2;
+            else if ((c & 0xF0) == 0xE0) need = 3;
+            else if ((c & 0xF8) == 0xF0) need = 4;
+            return back + 1 >= need ? s.size() : i - 1;
+        }
+        --i;
+        ++back;
+    }
+    return s.size();
+}
+
+// On-disk KV snapshot header, followed by n_tokens token ids and then,
+// per layer, n_tokens K rows and n_tokens V rows of n_embd_kv values in
+// the cache's type
+struct StateHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t model_fingerprint;
+    uint32_t n_layer;
+    uint32_t n_embd_kv;
+    uint32_t n_tokens;
+    uint32_t kv_type; // GGMLType
+};
+
+constexpr uint32_t kStateMagic = 0x53564B54; // "TKVS"
+// 2 added kv_type; older snapshots are discarded and prefilled again
+constexpr uint32_t kStateVersion = 2;
+
+} // namespace
+
+// ============================================================================
+// Setup
+// ============================================================================
+
+bool LlamaContext::init(const LlamaModel& model, int32_t n_ctx, std::string& error, ThreadPool* pool,
+                        GGMLType kv_type, int32_t n_ubatch) {
+    release();
+    if (!model.is_loaded()) {
+        error = "No model loaded";
+        return false;
+    }
+
+    const LlamaHParams& hp = model.hparams();
+    if (kv_type != GGMLType::F16 && kv_type != GGMLType::Q8_0 && kv_type != GGMLType::Q4_0) {
+        error = "Unsupported KV cache type";
+        return false;
+    }
+    // Blocks must not straddle heads
+    if (kv_type != GGMLType::F16 && hp.head_dim() % QK8_0 != 0) {
+        error = "A quantized KV cache needs a head size divisible by 32";
+        return false;
+    }
+    if (n_ubatch < 1 || n_ubatch > kMaxUBatch) {
+        error = "Micro-batch size must be between 1 and " + std::to_string(kMaxUBatch);
+        return false;
+    }
+
+    m_model = &model;
+    m_pool = pool;
+    m_n_ctx = n_ctx > 0 ? n_ctx : static_cast<int32_t>(hp.n_ctx_train);
+    m_kv_type = kv_type;
+    m_kv_row = ggml_row_size(kv_type, hp.n_embd_kv());
+
+    const size_t kv_size = static_cast<size_t>(hp.n_layer) * m_n_ctx * m_kv_row;
+    try {
+        m_k_cache.assign(kv_size, 0);
+        m_v_cache.assign(kv_size, 0);
+        m_att.assign(m_n_ctx, 0.0f);
+        m_qq.assign(ggml_row_size(GGMLType::Q8_0, hp.n_embd), 0);
+        m_tokens.reserve(m_n_ctx);
+        m_sampler.configure(m_sampler.params(), static_cast<int32_t>(hp.n_vocab));
+    } catch (const std::bad_alloc&) {
+        release();
+        error = "Not enough memory for a context of " + std::to_string(n_ctx) + " tokens";
+        return false;
+    }
+    if (!alloc_scratch(n_ubatch)) {
+        release();
+        error = "Not enough memory for micro-batches of " + std::to_string(n_ubatch) + " tokens";
+        return false;
+    }
+
+    m_rope_inv_freq.resize(hp.n_rot / 2);
+    for (uint32_t i = 0; i < hp.n_rot / 2; ++i) {
+        m_rope_inv_freq[i] = std::pow(hp.rope_freq_base, -2.0f * static_cast<float>(i) / static_cast<float>(hp.n_rot));
+    }
+
+    m_n_past = 0;
+    m_n_reused = 0;
+    m_tokens.clear();
+    return true;
+}
+
+bool LlamaContext::alloc_scratch(int32_t n_ubatch) {
+    const LlamaHParams& hp = m_model->hparams();
+    const size_t rows = static_cast<size_t>(n_ubatch);
+    try {
+        m_x.assign(rows * hp.n_embd, 0.0f);
+        m_xb.assign(rows * hp.n_embd, 0.0f);
+        m_xb2.assign(rows * hp.n_embd, 0.0f);
+        m_q.assign(rows * hp.n_embd, 0.0f);
+        m_k.assign(rows * hp.n_embd_kv(), 0.0f);
+        m_v.assign(rows * hp.n_embd_kv(), 0.0f);
+        m_hb.assign(rows * hp.n_ff, 0.0f);
+        m_hb2.assign(rows * hp.n_ff, 0.0f);
+        // Floats are the widest activation format (Q8_0/Q8_K are ~1.1 bytes)
+        m_xq.assign(rows * std::max(hp.n_embd, hp.n_ff) * sizeof(float), 0);
+        m_logits.assign(std::min<size_t>(rows, kMaxLogitRows) * hp.n_vocab, 0.0f);
+    } catch (const std::bad_alloc&) {
+        m_n_ubatch = 0;
+        return false;
+    }
+    m_n_ubatch = n_ubatch;
+    return true;
+}
+
+bool LlamaContext::set_ubatch(int32_t n_ubatch, std::string& error) {
+    if (m_model == nullptr) {
+        error = "No model loaded";
+        return false;
+    }
+    if (n_ubatch < 1 || n_ubatch > kMaxUBatch) {
+        error = "Micro-batch size must be between 1 and " + std::to_string(kMaxUBatch);
+        return false;
+    }
+    if (n_ubatch == m_n_ubatch) return true;
+    if (!alloc_scratch(n_ubatch)) {
+        error = "Not enough memory for micro-batches of " + std::to_string(n_ubatch) + " tokens";
+        // Fall back to what fits, so the context stays usable
+        alloc_scratch(1);
+        return false;
+    }
+    return true;
+}
+
+void LlamaContext::release() {
+    m_model = nullptr;
+    m_pool = nullptr;
+    m_draft = nullptr;
+    m_n_draft = 0;
+    m_grammar.reset();
+    std::vector<float>().swap(m_masked);
+    m_n_ctx = 0;
+    m_n_ubatch = 0;
+    m_n_past = 0;
+    m_n_reused = 0;
+    std::vector<int32_t>().swap(m_tokens);
+    for (std::vector<float>* buf : {&m_x, &m_xb, &m_xb2, &m_q, &m_k, &m_v, &m_att,
+                                    &m_hb, &m_hb2, &m_logits, &m_hidden, &m_rope_inv_freq}) {
+        std::vector<float>().swap(*buf);
+    }
+    for (std::vector<uint8_t>* buf : {&m_xq, &m_qq, &m_k_cache, &m_v_cache}) {
+        std::vector<uint8_t>().swap(*buf);
+    }
+    m_kv_row = 0;
+}
+
+void LlamaContext::truncate(int32_t n_keep) {
+    // Positions past n_past are simply overwritten by the next decode
+    if (n_keep < 0) n_keep = 0;
+    if (n_keep < m_n_past) {
+        m_n_past = n_keep;
+        m_tokens.resize(n_keep);
+    }
+}
+
+void LlamaContext::shift(int32_t n_keep, int32_t n_discard) {
+    if (m_model == nullptr || n_keep < 0 || n_discard <= 0 || n_keep + n_discard > m_n_past) {
+        return;
+    }
+    const LlamaHParams& hp = m_model->hparams();
+    const int n_embd_kv = static_cast<int>(hp.n_embd_kv());
+    const int n_rot = static_cast<int>(hp.n_rot);
+    const int32_t n_move = m_n_past - n_keep - n_discard;
+
+    // RoPE rotations compose, so moving a key back by n_discard positions
+    // is one more rotation by -n_discard times each pair's frequency
+    std::vector<float> cos_t(n_rot / 2);
+    std::vector<float> sin_t(n_rot / 2);
+    for (int i = 0; i < n_rot / 2; ++i) {
+        const float theta = -static_cast<float>(n_discard) * m_rope_inv_freq[i];
+        cos_t[i] = std::cos(theta);
+        sin_t[i] = std::sin(theta);
+    }
+
+    auto layers = [&](int64_t begin, int64_t end) {
+        std::vector<float> row(n_embd_kv);
+        for (int64_t il = begin; il < end; ++il) {
+            const size_t layer_off = static_cast<size_t>(il) * m_n_ctx * m_kv_row;
+            uint8_t* k_cache = m_k_cache.data() + layer_off;
+            uint8_t* v_cache = m_v_cache.data() + layer_off;
+            // Ascending, so a row is always read before it is overwritten
+            for (int32_t j = 0; j < n_move; ++j) {
+                const size_t src = static_cast<size_t>(n_keep + n_discard + j) * m_kv_row;
+                const size_t dst = static_cast<size_t>(n_keep + j) * m_kv_row;
+                dequantize_row(m_kv_type, k_cache + src, row.data(), n_embd_kv);
+                rope_rotate(row.data(), static_cast<int>(hp.n_head_kv), static_cast<int>(hp.head_dim()), n_rot,
+                            cos_t.data(), sin_t.data());
+                quantize_row(m_kv_type, row.data(), k_cache + dst, n_embd_kv);
+                memcpy(v_cache + dst, v_cache + src, m_kv_row);
+            }
+        }
+    };
+    if (m_pool != nullptr) {
+        m_pool->parallel_for(hp.n_layer, 1, layers);
+    } else {
+        layers(0, hp.n_layer);
+    }
+
+    m_tokens.erase(m_tokens.begin() + n_keep, m_tokens.begin() + n_keep + n_discard);
+    m_n_past -= n_discard;
+}
+
+int32_t LlamaContext::reuse_cache(const std::vector<int32_t>& tokens, size_t max_match, int32_t n_keep) {
+    const size_t n_cached = m_tokens.size();
+    max_match = std::min(max_match, tokens.size());
+    size_t p = 0;
+    while (p < n_cached && p < max_match && m_tokens[p] == tokens[p]) ++p;
+
+    // The prompt may have dropped turns the cache still holds (or evicted
+    // them in a different place): find where the cache picks it up again
+    if (p >= static_cast<size_t>(n_keep) && p < n_cached && p < max_match) {
+        for (size_t d = 1; p + d < n_cached; ++d) {
+            size_t len = 0;
+            while (p + d + len < n_cached && p + len < max_match && m_tokens[p + d + len] == tokens[p + len]) {
+                ++len;
+            }
+            if (len >= kShiftMinMatch || (len > 0 && p + len == max_match)) {
+                truncate(static_cast<int32_t>(p + d + len));
+                shift(static_cast<int32_t>(p), static_cast<int32_t>(d));
+                p += len;
+                break;
+            }
+        }
+    }
+    truncate(static_cast<int32_t>(p));
+    return static_cast<int32_t>(p);
+}
+
+// ============================================================================
+// Forward Pass
+// ============================================================================
+
+const float* LlamaContext::decode_batch(const int32_t* tokens, int32_t n, bool all_logits) {
+    Seq seq = {this, tokens, n, all_logits, nullptr};
+    decode_multi(&seq, 1);
+    return seq.logits;
+}
+
+void LlamaContext::decode_multi(Seq* seqs, int32_t n_seqs) {
+    if (n_seqs <= 0 || seqs[0].ctx == nullptr || seqs[0].ctx->m_model == nullptr) {
+        for (int32_t s = 0; s < n_seqs; ++s) seqs[s].logits = nullptr;
+        return;
+    }
+    // Every row goes through the first context's scratch buffers
+    LlamaContext& scratch = *seqs[0].ctx;
+    const LlamaModel& model = *scratch.m_model;
+    const LlamaHParams& hp = model.hparams();
+
+    // Rows of the merged batch: which context each belongs to and at what
+    // position. Sequences that do not fit are left out with no logits.
+    std::vector<LlamaContext*> row_ctx;
+    std::vector<int32_t> row_pos;
+    std::vector<int32_t> row_token;
+    std::vector<char> fits(n_seqs, 0);
+    int32_t n_out = 0;
+    for (int32_t s = 0; s < n_seqs; ++s) {
+        Seq& seq = seqs[s];
+        LlamaContext* ctx = seq.ctx;
+        seq.logits = nullptr;
+        const int32_t out = seq.hidden != nullptr ? 0 : seq.all_logits ? seq.n : 1;
+        bool ok = ctx != nullptr && ctx->m_model == &model && seq.n > 0 && seq.n <= ctx->m_n_ubatch &&
+                  ctx->m_n_past + seq.n <= ctx->m_n_ctx &&
+                  static_cast<int32_t>(row_ctx.size()) + seq.n <= scratch.m_n_ubatch &&
+                  n_out + out <= std::min(scratch.m_n_ubatch, kMaxLogitRows);
+        for (int32_t b = 0; ok && b < seq.n; ++b) {
+            ok = seq.tokens[b] >= 0 && seq.tokens[b] < static_cast<int32_t>(hp.n_vocab);
+        }
+        if (!ok) continue;
+        fits[s] = 1;
+        for (int32_t b = 0; b < seq.n; ++b) {
+            row_ctx.push_back(ctx);
+            row_pos.push_back(ctx->m_n_past + b);
+            row_token.push_back(seq.tokens[b]);
+        }
+        n_out += out;
+    }
+    const int32_t n = static_cast<int32_t>(row_ctx.size());
+    if (n == 0) return;
+
+    const int n_embd = static_cast<int>(hp.n_embd);
+    const int n_embd_kv = static_cast<int>(hp.n_embd_kv());
+    const int n_head = static_cast<int>(hp.n_head);
+    const int n_head_kv = static_cast<int>(hp.n_head_kv);
+    const int head_dim = static_cast<int>(hp.head_dim());
+    const int n_ff = static_cast<int>(hp.n_ff);
+    const int gqa = n_head / n_head_kv;
+    const float scale = 1.0f / std::sqrt(static_cast<float>(head_dim));
+    ThreadPool* pool = scratch.m_pool;
+    float* x = scratch.m_x.data();
+    float* xb = scratch.m_xb.data();
+    float* xb2 = scratch.m_xb2.data();
+    float* q_all = scratch.m_q.data();
+    float* hb = scratch.m_hb.data();
+    float* hb2 = scratch.m_hb2.data();
+    uint8_t* xq = scratch.m_xq.data();
+
+    // Token embeddings
+    const GGUFTensor* embd = model.tok_embd();
+    for (int32_t b = 0; b < n; ++b) {
+        dequantize_row(embd->type,
+                       static_cast<const uint8_t*>(embd->data) + static_cast<size_t>(row_token[b]) * embd->row_size(),
+                       x + static_cast<size_t>(b) * n_embd, n_embd);
+    }
+
+    for (uint32_t il = 0; il < hp.n_layer; ++il) {
+        const LlamaLayer& layer = model.layer(il);
+
+        // Attention
+        for (int32_t b = 0; b < n; ++b) {
+            rms_norm(xb + b * n_embd, x + b * n_embd,
+                     static_cast<const float*>(layer.attn_norm->data), n_embd, hp.rms_eps);
+        }
+        matmul(layer.wq, xb, q_all, n, xq, pool);
+        matmul(layer.wk, xb, scratch.m_k.data(), n, xq, pool);
+        matmul(layer.wv, xb, scratch.m_v.data(), n, xq, pool);
+
+        for (int32_t b = 0; b < n; ++b) {
+            LlamaContext& ctx = *row_ctx[b];
+            const int pos = row_pos[b];
+            const size_t row_off = (static_cast<size_t>(il) * ctx.m_n_ctx + pos) * ctx.m_kv_row;
+            float* k = scratch.m_k.data() + b * n_embd_kv;
+            const float* v = scratch.m_v.data() + b * n_embd_kv;
+            rope(q_all + b * n_embd, n_head, head_dim, static_cast<int>(hp.n_rot), pos, ctx.m_rope_inv_freq.data());
+            rope(k, n_head_kv, head_dim, static_cast<int>(hp.n_rot), pos, ctx.m_rope_inv_freq.data());
+            quantize_row(ctx.m_kv_type, k, ctx.m_k_cache.data() + row_off, n_embd_kv);
+            quantize_row(ctx.m_kv_type, v, ctx.m_v_cache.data() + row_off, n_embd_kv);
+        }
+
+        // Each token attends to every position of its own context up to
+        // its own
+        for (int32_t b = 0; b < n; ++b) {
+            LlamaContext& ctx = *row_ctx[b];
+            const int pos = row_pos[b];
+            const GGMLType kv_type = ctx.m_kv_type;
+            const size_t kv_row = ctx.m_kv_row;
+            const size_t layer_off = static_cast<size_t>(il) * ctx.m_n_ctx * kv_row;
+            const uint8_t* k_cache = ctx.m_k_cache.data() + layer_off;
+            const uint8_t* v_cache = ctx.m_v_cache.data() + layer_off;
+            float* att = ctx.m_att.data();
+            if (kv_type != GGMLType::F16) {
+                quantize_activations(kv_type, q_all + b * n_embd, ctx.m_qq.data(), n_embd);
+            }
+            for (int h = 0; h < n_head; ++h) {
+                const float* q = q_all + b * n_embd + h * head_dim;
+                const uint8_t* qq = ctx.m_qq.data() + ggml_row_size(GGMLType::Q8_0, h * head_dim);
+                const size_t kv_off = ggml_row_size(kv_type, (h / gqa) * head_dim);
+                for (int t = 0; t <= pos; ++t) {
+                    const uint8_t* k = k_cache + static_cast<size_t>(t) * kv_row + kv_off;
+                    att[t] = kv_score(kv_type, q, qq, k, head_dim) * scale;
+                }
+                softmax(att, pos + 1);
+
+                float* out = xb2 + b * n_embd + h * head_dim;
+                memset(out, 0, head_dim * sizeof(float));
+                for (int t = 0; t <= pos; ++t) {
+                    const uint8_t* v = v_cache + static_cast<size_t>(t) * kv_row + kv_off;
+                    kv_accumulate(kv_type, att[t], v, out, head_dim);
+                }
+            }
+        }
+
+        matmul(layer.wo, xb2, xb, n, xq, pool);
+        for (int i = 0; i < n * n_embd; ++i) x[i] += xb[i];
+
+        // Feed-forward (SwiGLU)
+        for (int32_t b = 0; b < n; ++b) {
+            rms_norm(xb + b * n_embd, x + b * n_embd,
+                     static_cast<const float*>(layer.ffn_norm->data), n_embd, hp.rms_eps);
+        }
+        matmul(layer.ffn_gate, xb, hb, n, xq, pool);
+        matmul(layer.ffn_up, xb, hb2, n, xq, pool);
+        for (int i = 0; i < n * n_ff; ++i) hb[i] = silu(hb[i]) * hb2[i];
+        matmul(layer.ffn_down, hb, xb, n, xq, pool);
+        for (int i = 0; i < n * n_embd; ++i) x[i] += xb[i];
+    }
+
+    // Output head, for each sequence's last token only unless it wants
+    // every row. The rows are packed to the front of xb first; sequences
+    // that want hidden states get them normalized in place of logits.
+    const float* output_norm = static_cast<const float*>(model.output_norm()->data);
+    int32_t row = 0;
+    int32_t packed = 0;
+    for (int32_t s = 0; s < n_seqs; ++s) {
+        const Seq& seq = seqs[s];
+        if (!fits[s]) continue;
+        if (seq.hidden != nullptr) {
+            for (int32_t b = 0; b < seq.n; ++b) {
+                rms_norm(seq.hidden + b * n_embd, x + (row + b) * n_embd, output_norm, n_embd, hp.rms_eps);
+            }
+            row += seq.n;
+            continue;
+        }
+        const int32_t first = seq.all_logits ? 0 : seq.n - 1;
+        for (int32_t b = row + first; b < row + seq.n; ++b) {
+            rms_norm(xb + packed++ * n_embd, x + b * n_embd, output_norm, n_embd, hp.rms_eps);
+        }
+        row += seq.n;
+    }
+    if (n_out > 0) {
+        matmul(model.output(), xb, scratch.m_logits.data(), n_out, xq, pool);
+    }
+
+    // Hand each context its rows of logits and advance it. The first
+    // sequence's rows are already in place.
+    const size_t n_vocab = hp.n_vocab;
+    int32_t out = 0;
+    for (int32_t s = 0; s < n_seqs; ++s) {
+        Seq& seq = seqs[s];
+        if (!fits[s]) continue;
+        LlamaContext& ctx = *seq.ctx;
+        ctx.m_tokens.insert(ctx.m_tokens.end(), seq.tokens, seq.tokens + seq.n);
+        ctx.m_n_past += seq.n;
+        if (seq.hidden != nullptr) {
+            seq.logits = seq.hidden;
+            continue;
+        }
+        const int32_t rows = seq.all_logits ? seq.n : 1;
+        if (&ctx != &scratch) {
+            memcpy(ctx.m_logits.data(), scratch.m_logits.data() + out * n_vocab, rows * n_vocab * sizeof(float));
+        }
+        out += rows;
+        seq.logits = ctx.m_logits.data();
+    }
+}
+
+bool LlamaContext::embed(const std::string& text, Pooling pooling, float* out, std::string& error) {
+    if (m_model == nullptr) {
+        error = "No model loaded";
+        return false;
+    }
+    std::vector<int32_t> tokens = m_model->tokenizer().encode(text, true);
+    if (tokens.empty()) {
+        error = "Text is empty";
+        return false;
+    }
+    if (static_cast<int32_t>(tokens.size()) > m_n_ctx) tokens.resize(m_n_ctx);
+
+    const size_t n_embd = m_model->hparams().n_embd;
+    try {
+        m_hidden.resize(static_cast<size_t>(m_n_ubatch) * n_embd);
+    } catch (const std::bad_alloc&) {
+        error = "Not enough memory for embeddings";
+        return false;
+    }
+
+    // Hidden states depend on everything before them, so nothing cached
+    // can be reused
+    reset();
+    std::fill(out, out + n_embd, 0.0f);
+    const int32_t n_tokens = static_cast<int32_t>(tokens.size());
+    for (int32_t i = 0; i < n_tokens; i += m_n_ubatch) {
+        const int32_t n = std::min(m_n_ubatch, n_tokens - i);
+        Seq seq = {this, tokens.data() + i, n, false, nullptr};
+        seq.hidden = m_hidden.data();
+        decode_multi(&seq, 1);
+        if (seq.logits == nullptr) {
+            reset();
+            error = "Failed to evaluate text";
+            return false;
+        }
+        if (pooling == Pooling::Last) {
+            if (i + n == n_tokens) {
+                std::copy_n(m_hidden.data() + static_cast<size_t>(n - 1) * n_embd, n_embd, out);
+            }
+        } else {
+            for (int32_t b = 0; b < n; ++b) {
+                const float* h = m_hidden.data() + static_cast<size_t>(b) * n_embd;
+                for (size_t j = 0; j < n_embd; ++j) out[j] += h[j];
+            }
+        }
+    }
+    reset();
+
+    // Mean pooling's 1/n drops out in the normalization
+    float ss = 0.0f;
+    for (size_t j = 0; j < n_embd; ++j) ss += out[j] * out[j];
+    const float inv = ss > 0.0f ? 1.0f / std::sqrt(ss) : 0.0f;
+    for (size_t j = 0; j < n_embd; ++j) out[j] *= inv;
+    return true;
+}
+
+const float* LlamaContext::step(const int32_t* tokens, int32_t n, bool all_logits) {
+    if (m_scheduler != nullptr) {
+        return m_scheduler->decode(*this, tokens, n, all_logits);
+    }
+    return decode_batch(tokens, n, all_logits);
+}
+
+// ============================================================================
+// Generation
+// ============================================================================
+
+void LlamaContext::set_sampler_params(const SamplerParams& params) {
+    if (m_model == nullptr) return;
+    m_sampler.configure(params, static_cast<int32_t>(m_model->hparams().n_vocab));
+}
+
+bool LlamaContext::set_grammar(const std::string& gbnf, std::string& error) {
+    if (gbnf.empty()) {
+        m_grammar.reset();
+        return true;
+    }
+    if (m_model == nullptr) {
+        error = "No model loaded";
+        return false;
+    }
+    auto grammar = std::make_unique<Grammar>();
+    if (!grammar->parse(gbnf, error)) return false;
+    grammar->bind(m_model->tokenizer());
+    m_grammar = std::move(grammar);
+    return true;
+}
+
+bool LlamaContext::set_draft(LlamaContext* draft, int32_t n_draft, std::string& error) {
+    if (draft == nullptr || n_draft <= 0) {
+        m_draft = nullptr;
+        m_n_draft = 0;
+        return true;
+    }
+    if (m_model == nullptr || draft->m_model == nullptr) {
+        error = "No model loaded";
+        return false;
+    }
+    if (draft == this || !same_vocab(m_model->tokenizer(), draft->m_model->tokenizer())) {
+        error = "Draft model uses a different vocabulary";
+        return false;
+    }
+    m_draft = draft;
+    m_n_draft = std::min(n_draft, kMaxLogitRows - 1);
+    return true;
+}
+
+void LlamaContext::set_prompt_lookup(int32_t n_draft) {
+    m_n_lookup = std::max(0, std::min(n_draft, kMaxLogitRows - 1));
+}
+
+std::vector<int32_t> LlamaContext::lookup(int32_t next, int32_t n_draft) const {
+    const int32_t len = static_cast<int32_t>(m_tokens.size()) + 1;
+    auto at = [&](int32_t i) { return i + 1 < len ? m_tokens[i] : next; };
+
+    for (int32_t n = std::min(kLookupNgramMax, len - 1); n >= kLookupNgramMin; --n) {
+        // Latest start s whose n tokens match the suffix and are followed
+        // by at least one more token
+        for (int32_t s = len - n - 1; s >= 0; --s) {
+            int32_t k = 0;
+            while (k < n && at(s + k) == at(len - n + k)) ++k;
+            if (k < n) continue;
+
+            std::vector<int32_t> drafted;
+            for (int32_t i = s + n; i < len && static_cast<int32_t>(drafted.size()) < n_draft; ++i) {
+                drafted.push_back(at(i));
+            }
+            return drafted;
+        }
+    }
+    return {};
+}
+
+std::vector<int32_t> LlamaContext::propose(const std::vector<int32_t>& prefix, int32_t next, int32_t n_draft,
+                                           int32_t n_keep) {
+    std::vector<int32_t> drafted;
+
+    // Usually only the last step's accepted tokens are new. After the main
+    // context shifts, the same shift lines this cache up again.
+    const int32_t n_cached = reuse_cache(prefix, prefix.size(), n_keep);
+
+    std::vector<int32_t> pending(prefix.begin() + n_cached, prefix.end());
+    pending.push_back(next);
+    const float* logits = nullptr;
+    for (size_t i = 0; i < pending.size(); i += m_n_ubatch) {
+        const int32_t n = static_cast<int32_t>(std::min<size_t>(m_n_ubatch, pending.size() - i));
+        logits = decode_batch(pending.data() + i, n, false);
+        if (logits == nullptr) return drafted;
+    }
+
+    const int32_t n_vocab = static_cast<int32_t>(m_model->hparams().n_vocab);
+    while (static_cast<int32_t>(drafted.size()) < n_draft) {
+        float prob = 0.0f;
+        const int32_t token = top_token(logits, n_vocab, &prob);
+        if (prob < kDraftMinProb) break;
+        drafted.push_back(token);
+        // The last proposal never needs its own logits
+        if (static_cast<int32_t>(drafted.size()) == n_draft) break;
+        logits = decode(token);
+        if (logits == nullptr) break;
+    }
+    return drafted;
+}
+
+void LlamaContext::reserve() {
+    m_reserved.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void LlamaContext::cancel() {
+    const uint64_t through = m_reserved.load(std::memory_order_acquire);
+    uint64_t current = m_cancelled_through.load(std::memory_order_relaxed);
+    while (current < through &&
+           !m_cancelled_through.compare_exchange_weak(current, through, std::memory_order_acq_rel)) {
+    }
+}
+
+int32_t LlamaContext::generate(const std::string& prompt, int32_t max_tokens,
+                               const TokenCallback& callback, std::string& error,
+                               const ProgressCallback& progress) {
+    if (m_model == nullptr) {
+        error = "No model loaded";
+        return -1;
+    }
+    const Tokenizer& tokenizer = m_model->tokenizer();
+    const uint64_t reserved = m_reserved.load(std::memory_order_acquire);
+    if (reserved > m_ticket) {
+        m_ticket = reserved;
+    } else {
+        m_ticket = m_reserved.fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
+    const BatchScheduler::Active active(m_scheduler);
+
+    std::vector<int32_t> tokens = tokenizer.encode(prompt, true);
+    if (tokens.empty()) {
+        error = "Prompt is empty";
+        return -1;
+    }
+
+    // Everything up to the first end-of-turn token is the system prompt,
+    // which eviction never touches
+    int32_t n_keep = tokenizer.add_bos() ? 1 : 0;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (tokenizer.is_eog(tokens[i])) {
+            n_keep = static_cast<int32_t>(i + 1);
+            break;
+        }
+    }
+    n_keep = std::min(n_keep, m_n_ctx / 2);
+
+    // A prompt that would leave less than a quarter of the window for the
+    // reply loses its oldest turns
+    const size_t n_prompt_max = static_cast<size_t>(m_n_ctx - m_n_ctx / 4);
+    if (tokens.size() > n_prompt_max) {
+        const size_t excess = tokens.size() - n_prompt_max;
+        tokens.erase(tokens.begin() + n_keep, tokens.begin() + n_keep + excess);
+    }
+
+    // Keep the cached tokens shared with the new prompt. The last prompt
+    // token is always re-evaluated so there are fresh logits to sample from.
+    const int32_t n_cached = reuse_cache(tokens, tokens.size() - 1, n_keep);
+    m_n_reused = n_cached;
+
+    // Prefill the new suffix in micro-batches
+    const int32_t n_prompt = static_cast<int32_t>(tokens.size());
+    const float* logits = nullptr;
+    for (int32_t i = n_cached; i < n_prompt; i += m_n_ubatch) {
+        if (cancelled()) return 0;
+        const int32_t n = std::min(m_n_ubatch, n_prompt - i);
+        logits = step(tokens.data() + i, n, false);
+        if (logits == nullptr) {
+            error = "Failed to evaluate prompt";
+            return -1;
+        }
+        if (progress && !progress(i + n, n_prompt)) return 0;
+    }
+
+    // The repetition penalty also looks back into the prompt
+    m_sampler.reset();
+    const size_t n_recent = static_cast<size_t>(std::max(m_sampler.params().repeat_last_n, 0));
+    for (size_t i = tokens.size() - std::min(tokens.size(), n_recent); i < tokens.size(); ++i) {
+        m_sampler.accept(tokens[i]);
+    }
+
+    // Sample a row, resampling from the masked row if the grammar rejects
+    // the token. -1 when the grammar allows no token at all.
+    const size_t n_vocab = m_model->hparams().n_vocab;
+    if (m_grammar) m_grammar->reset();
+    auto sample = [&](const float* row) {
+        int32_t token = m_sampler.sample(row);
+        if (!m_grammar || m_grammar->allows_token(token)) return token;
+        m_masked.assign(row, row + n_vocab);
+        m_grammar->mask(m_masked.data());
+        token = m_sampler.sample(m_masked.data());
+        return m_grammar->allows_token(token) ? token : -1;
+    };
+
+    // Decode, streaming complete UTF-8 fragments as they are produced.
+    // emit() returns false once generation should stop.
+    std::string pending;
+    int32_t n_generated = 0;
+    auto emit = [&](int32_t token) {
+        if (token < 0) return false;
+        m_sampler.accept(token);
+        if (tokenizer.is_eog(token)) return false;
+        ++n_generated;
+        if (m_grammar) m_grammar->accept_token(token);
+
+        pending += tokenizer.token_to_piece(token);
+        const size_t ready = utf8_complete_prefix(pending);
+        if (ready > 0) {
+            const std::string piece = pending.substr(0, ready);
+            pending.erase(0, ready);
+            if (!callback(piece)) return false;
+        }
+        if (m_grammar && m_grammar->finished()) return false;
+        return n_generated < max_tokens;
+    };
+
+    m_n_drafted = 0;
+    m_n_draft_accepted = 0;
+    bool running = max_tokens > 0 && !cancelled();
+    int32_t next = running ? sample(logits) : -1;
+    running = running && emit(next);
+
+    while (running && !cancelled()) {
+        // When the window is full, evict the older half of the
+        // conversation after the system prompt
+        if (m_n_past + 1 > m_n_ctx) {
+            const int32_t n_discard = (m_n_past - n_keep) / 2;
+            if (n_discard <= 0) break;
+            shift(n_keep, n_discard);
+        }
+        // Room left after next, which still has to be evaluated
+        const int32_t room = m_n_ctx - m_n_past - 1;
+
+        std::vector<int32_t> batch(1, next);
+        const int32_t budget = std::min({room, max_tokens - n_generated, m_n_ubatch - 1});
+        std::vector<int32_t> drafted;
+        if (m_n_lookup > 0 && budget > 0) {
+            drafted = lookup(next, std::min(m_n_lookup, budget));
+        }
+        if (drafted.empty() && m_draft != nullptr && budget > 0) {
+            drafted = m_draft->propose(m_tokens, next, std::min(m_n_draft, budget), n_keep);
+        }
+        batch.insert(batch.end(), drafted.begin(), drafted.end());
+        m_n_drafted += static_cast<int32_t>(drafted.size());
+
+        // Check every draft token in one pass. Row i of the logits follows
+        // batch[i]; sampling it either confirms batch[i + 1] and moves on,
+        // or gives the token to continue from instead.
+        const int32_t pos0 = m_n_past;
+        const int32_t n = static_cast<int32_t>(batch.size());
+        const float* rows = step(batch.data(), n, n > 1);
+        if (rows == nullptr) break;
+        int32_t i = 0;
+        for (; i < n; ++i) {
+            const int32_t token = sample(rows + static_cast<size_t>(i) * n_vocab);
+            if (!emit(token)) {
+                running = false;
+                break;
+            }
+            if (i + 1 == n || token != batch[i + 1]) {
+                next = token;
+                break;
+            }
+            ++m_n_draft_accepted;
+        }
+        // Drop the rejected draft tokens
+        truncate(pos0 + 1 + std::min(i, n - 1));
+    }
+    if (!pending.empty()) {
+        callback(pending);
+    }
+
+    return n_generated;
+}
+
+// ============================================================================
+// State Snapshots
+// ============================================================================
+
+int32_t LlamaContext::save_state(const std::string& path, std::string& error) const {
+    if (m_model == nullptr) {
+        error = "No model loaded";
+        return -1;
+    }
+    const LlamaHParams& hp = m_model->hparams();
+    const size_t n_embd_kv = hp.n_embd_kv();
+    const size_t n_tokens = m_tokens.size();
+
+    StateHeader header = {};
+    header.magic = kStateMagic;
+    header.version = kStateVersion;
+    header.model_fingerprint = m_model->fingerprint();
+    header.n_layer = hp.n_layer;
+    header.n_embd_kv = static_cast<uint32_t>(n_embd_kv);
+    header.n_tokens = static_cast<uint32_t>(n_tokens);
+    header.kv_type = static_cast<uint32_t>(m_kv_type);
+
+    const std::string tmp_path = path + ".tmp";
+    FILE* f = fopen(tmp_path.c_str(), "wb");
+    if (f == nullptr) {
+        error = "Cannot write state file: " + path;
+        return -1;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(m_tokens.data(), sizeof(int32_t), n_tokens, f) == n_tokens;
+    for (uint32_t il = 0; ok && il < hp.n_layer; ++il) {
+        const size_t layer_off = static_cast<size_t>(il) * m_n_ctx * m_kv_row;
+        const size_t n = n_tokens * m_kv_row;
+        ok = fwrite(m_k_cache.data() + layer_off, 1, n, f) == n &&
+             fwrite(m_v_cache.data() + layer_off, 1, n, f) == n;
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        remove(tmp_path.c_str());
+        error = "Failed to write state file: " + path;
+        return -1;
+    }
+    return static_cast<int32_t>(n_tokens);
+}
+
+int32_t LlamaContext::load_state(const std::string& path, std::string& error) {
+    if (m_model == nullptr) {
+        error = "No model loaded";
+        return -1;
+    }
+    const LlamaHParams& hp = m_model->hparams();
+    const size_t n_embd_kv = hp.n_embd_kv();
+
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        error = "No state file: " + path;
+        return -1;
+    }
+
+    StateHeader header = {};
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        header.magic != kStateMagic || header.version != kStateVersion) {
+        fclose(f);
+        error = "Invalid state file: " + path;
+        return -1;
+    }
+    if (header.model_fingerprint != m_model->fingerprint() ||
+        header.n_layer != hp.n_layer || header.n_embd_kv != n_embd_kv) {
+        fclose(f);
+        error = "State file was saved for a different model";
+        return -1;
+    }
+    if (static_cast<GGMLType>(header.kv_type) != m_kv_type) {
+        fclose(f);
+        error = "State file was saved with a different KV cache type";
+        return -1;
+    }
+
+    // Each saved token takes its id plus a K and a V row per layer; a
+    // count the file is too small for is corrupt, and must be caught
+    // before anything is sized by it
+    const size_t per_token = sizeof(int32_t) + 2 * static_cast<size_t>(hp.n_layer) * m_kv_row;
+    long file_size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) file_size = ftell(f);
+    if (file_size < static_cast<long>(sizeof(header)) || fseek(f, sizeof(header), SEEK_SET) != 0 ||
+        header.n_tokens > (static_cast<size_t>(file_size) - sizeof(header)) / per_token) {
+        fclose(f);
+        error = "Truncated or corrupt state file: " + path;
+        return -1;
+    }
+
+    // Keep room for at least one new token after the restored prefix
+    const size_t n_saved = header.n_tokens;
+    const size_t n_tokens = std::min<size_t>(n_saved, m_n_ctx > 0 ? m_n_ctx - 1 : 0);
+
+    reset();
+    std::vector<int32_t> tokens(n_saved);
+    bool ok = fread(tokens.data(), sizeof(int32_t), n_saved, f) == n_saved;
+    for (size_t i = 0; ok && i < n_tokens; ++i) {
+        ok = tokens[i] >= 0 && tokens[i] < static_cast<int32_t>(hp.n_vocab);
+    }
+
+    const long skip = static_cast<long>((n_saved - n_tokens) * m_kv_row);
+    for (uint32_t il = 0; ok && il < hp.n_layer; ++il) {
+        const size_t layer_off = static_cast<size_t>(il) * m_n_ctx * m_kv_row;
+        const size_t n = n_tokens * m_kv_row;
+        ok = fread(m_k_cache.data() + layer_off, 1, n, f) == n &&
+             fseek(f, skip, SEEK_CUR) == 0 &&
+             fread(m_v_cache.data() + layer_off, 1, n, f) == n &&
+             fseek(f, skip, SEEK_CUR) == 0;
+    }
+    fclose(f);
+
+    if (!ok) {
+        error = "Truncated or corrupt state file: " + path;
+        return -1;
+    }
+
+    tokens.resize(n_tokens);
+    m_tokens = std::move(tokens);
+    m_n_past = static_cast<int32_t>(n_tokens);
+    return m_n_past;
+}
+
+// ============================================================================
+// Thread Tuning
+// ============================================================================
+
+int tune_thread_count(const LlamaModel& model, int max_threads) {
+    // Layers timed per pass, passes per candidate (best one counts), and
+    // how close to the fastest a smaller pool must be to win
+    constexpr uint32_t kLayers = 2;
+    constexpr int kPasses = 3;
+    constexpr double kTolerance = 1.05;
+
+    const LlamaHParams& hp = model.hparams();
+    if (max_threads <= 1 || !model.is_loaded() || hp.n_layer == 0) return 1;
+
+    const size_t width = std::max({hp.n_embd, hp.n_ff, hp.n_embd_kv()});
+    std::vector<float> x(width);
+    for (size_t i = 0; i < width; ++i) x[i] = std::sin(static_cast<float>(i));
+    std::vector<float> y(width);
+    std::vector<uint8_t> xq(width * sizeof(float));
+
+    auto pass = [&](ThreadPool& pool) {
+        for (uint32_t il = 0; il < std::min(kLayers, hp.n_layer); ++il) {
+            const LlamaLayer& l = model.layer(il);
+            for (const GGUFTensor* w : {l.wq, l.wk, l.wv, l.wo, l.ffn_gate, l.ffn_up, l.ffn_down}) {
+                matmul(w, x.data(), y.data(), 1, xq.data(), &pool);
+            }
+        }
+    };
+
+    int best = 1;
+    std::vector<double> times;
+    for (int n = 1; n <= max_threads; ++n) {
+        ThreadPool pool(n, cpu_affinity_for(n));
+        if (pool.size() < n) break;
+        pass(pool); // page in the weights, wake the workers
+        double t_min = 0.0;
+        for (int i = 0; i < kPasses; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            pass(pool);
+            const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            t_min = i == 0 ? t : std::min(t_min, t);
+        }
+        times.push_back(t_min);
+    }
+
+    const double fastest = *std::min_element(times.begin(), times.end());
+    for (size_t i = 0; i < times.size(); ++i) {
+        if (times[i] <= fastest * kTolerance) {
+            best = static_cast<int>(i) + 1;
+            break;
+        }
+    }
+    return best;
+}
+
+} // namespace tutu
@@ -0,0 +1,305 @@
+/**
+ * llama_context.h - Inference state for a loaded llama model
+ *
+ * Owns the KV cache and scratch buffers for one conversation and runs
+ * the transformer forward pass over batches of tokens, reading each
+ * weight row once per batch. A prompt is prefilled in micro-batches of
+ * up to n_ubatch tokens, which bounds the scratch memory and gives a
+ * progress callback a chance to run (or cancel) between them.
+ * Generation streams each decoded piece to a callback as soon as it is
+ * sampled.
+ *
+ * The KV cache survives between generate() calls. The context remembers
+ * which tokens it holds, so a new prompt that extends the previous
+ * transcript only has to prefill the part after the common prefix.
+ *
+ * Long conversations never hit a hard limit. The prompt up to its first
+ * end-of-turn token (the system prompt) is always kept; when the window
+ * fills up, the oldest tokens after it are evicted and the rest of the
+ * cache slides down in place, with its keys rotated to their new
+ * positions, so nothing has to be prefilled again. A prompt that drops
+ * earlier turns lines up with a cache that still holds them the same way.
+ * The cached tokens and KV rows can also be saved to disk and restored
+ * in a later session.
+ *
+ * The KV cache is stored in F16, or block-quantized to Q8_0 or Q4_0 to
+ * fit a longer context in the same memory. Attention then works on the
+ * quantized blocks directly: scores use the integer dot kernels against
+ * the query quantized to Q8_0, and values are scaled per block as they
+ * are accumulated.
+ *
+ * Contexts of the same model can share a BatchScheduler: their decode
+ * steps are then merged into one forward pass, so the weights are read
+ * once per step for all of them.
+ *
+ * Generation can decode speculatively: a few tokens are proposed, either
+ * by prompt lookup (continuing an earlier occurrence of the last few
+ * tokens in the transcript, which catches text quoted from the prompt) or
+ * by a small draft model, and the main model checks them all in one
+ * batched pass. Every emitted token is still sampled from the
+ * main model's distribution; a draft token is kept only when that sample
+ * matches it, so output is the same as without a draft.
+ *
+ * A grammar can constrain generation to text it matches (JSON of a given
+ * schema, say). Each sampled token is checked against it, and only when
+ * the grammar rejects that token is the row masked and sampled again;
+ * generation ends as soon as the match is complete and cannot grow.
+ *
+ * A context can also embed text: the final hidden states of the text's
+ * tokens, after the output norm, are pooled (averaged, or the last
+ * token's taken) into one unit-length vector.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "grammar.h"
+#include "llama_model.h"
+#include "sampler.h"
+#include "thread_pool.h"
+
+namespace tutu {
+
+class BatchScheduler;
+
+// Receives each decoded UTF-8 fragment; return false to stop generating
+using TokenCallback = std::function<bool(const std::string& piece)>;
+
+// Called after each prefilled micro-batch with the prompt tokens
+// evaluated so far (cached ones included) and the prompt length; return
+// false to stop
+using ProgressCallback = std::function<bool(int32_t n_done, int32_t n_total)>;
+
+// How embed() turns per-token hidden states into one vector
+enum class Pooling {
+    Mean, // average over every token
+    Last, // the last token's, which has attended to all the others
+};
+
+class LlamaContext {
+public:
+    // Micro-batch size limits: the most tokens one decode_batch call takes
+    static constexpr int32_t kDefaultUBatch = 64;
+    static constexpr int32_t kMaxUBatch = 512;
+
+    // Most tokens decode_batch returns every row of logits for, which
+    // bounds a speculative step to kMaxLogitRows - 1 draft tokens
+    static constexpr int32_t kMaxLogitRows = 16;
+
+    // Matmuls run on pool when given (it must outlive the context),
+    // otherwise on the calling thread. kv_type is F16, Q8_0 or Q4_0.
+    bool init(const LlamaModel& model, int32_t n_ctx, std::string& error,
+              ThreadPool* pool = nullptr, GGMLType kv_type = GGMLType::F16,
+              int32_t n_ubatch = kDefaultUBatch);
+    void release();
+
+    // Resize the scratch buffers for micro-batches of n_ubatch tokens
+    // (1..kMaxUBatch). The KV cache is kept.
+    bool set_ubatch(int32_t n_ubatch, std::string& error);
+    int32_t n_ubatch() const { return m_n_ubatch; }
+
+    // Evaluate one token at the next position and return the logits
+    // (n_vocab floats, valid until the next call). Returns nullptr when
+    // the context is full.
+    const float* decode(int32_t token) { return decode_batch(&token, 1, false); }
+
+    // Evaluate n tokens (at most n_ubatch) at the next positions in one
+    // pass. Returns the last token's logits, or with all_logits (n at most
+    // kMaxLogitRows) n rows of n_vocab floats, one per token. Returns
+    // nullptr when they do not fit.
+    const float* decode_batch(const int32_t* tokens, int32_t n, bool all_logits);
+
+    // One context's part of a merged forward pass
+    struct Seq {
+        LlamaContext* ctx;
+        const int32_t* tokens;
+        int32_t n;
+        bool all_logits;
+        const float* logits; // out: what decode_batch would have returned
+        // When set, every row's final hidden state (after the output norm)
+        // is written here, n rows of n_embd, instead of computing logits;
+        // logits then points here
+        float* hidden = nullptr;
+    };
+
+    // Evaluate the tokens of several contexts of the same model in one
+    // forward pass, each at its own context's next positions and against
+    // its own KV cache. The rows go through seqs[0]'s scratch buffers, so
+    // together they must fit its n_ubatch (and kMaxLogitRows rows of
+    // logits); a sequence that does not fit gets null logits.
+    static void decode_multi(Seq* seqs, int32_t n_seqs);
+
+    // Forget everything in the KV cache
+    void reset() { truncate(0); }
+
+    // Embed text into out (n_embd floats, unit length). The text is run
+    // from an empty cache in micro-batches, and cut to the window if
+    // longer; the cache is left empty afterwards.
+    bool embed(const std::string& text, Pooling pooling, float* out, std::string& error);
+
+    // Drop cached positions from n_keep onwards
+    void truncate(int32_t n_keep);
+
+    // Drop cached positions [n_keep, n_keep + n_discard) and move the later
+    // ones down by n_discard, re-applying RoPE to their keys
+    void shift(int32_t n_keep, int32_t n_discard);
+
+    // Prefill the prompt (reusing any cached prefix) then sample up to
+    // max_tokens, streaming pieces to the callback. A prompt too long for
+    // the window loses its oldest tokens after the system prompt. progress,
+    // when set, follows the prefill. Returns the number of generated tokens
+    // or -1 on error.
+    int32_t generate(const std::string& prompt, int32_t max_tokens,
+                     const TokenCallback& callback, std::string& error,
+                     const ProgressCallback& progress = nullptr);
+
+    // Sampling settings for subsequent generate() calls. The default is
+    // greedy decoding.
+    void set_sampler_params(const SamplerParams& params);
+    const SamplerParams& sampler_params() const { return m_sampler.params(); }
+
+    // Constrain subsequent generate() calls to text the GBNF grammar
+    // matches. Empty text removes the constraint.
+    bool set_grammar(const std::string& gbnf, std::string& error);
+
+    // Announce a generate() about to be called (from any thread), so a
+    // cancel() from now on stops it even if it has not started yet, say
+    // while it waits for the previous one. generate() takes the latest
+    // reservation made since the last one started; without one it is
+    // only cancellable once running.
+    void reserve();
+
+    // Ask the running generate() and any reserved one to stop. Each
+    // checks before every decode step, so it returns within one step with
+    // the tokens produced so far. Later generations are not affected.
+    void cancel();
+
+    // Decode speculatively with draft proposing up to n_draft tokens per
+    // step. draft must use the same vocabulary and outlive this context
+    // (or be detached first); it is driven only from generate(). A null
+    // draft or n_draft <= 0 detaches.
+    bool set_draft(LlamaContext* draft, int32_t n_draft, std::string& error);
+
+    // Route generate()'s forward passes through scheduler, merging them
+    // with other contexts' (it must outlive the context). Null detaches.
+    void set_scheduler(BatchScheduler* scheduler) { m_scheduler = scheduler; }
+
+    // Propose up to n_draft tokens per step by prompt lookup. Costs no
+    // model and takes precedence over the draft model when it finds a
+    // match. n_draft <= 0 turns it off.
+    void set_prompt_lookup(int32_t n_draft);
+
+    // Draft tokens proposed and accepted during the last generate()
+    int32_t n_drafted() const { return m_n_drafted; }
+    int32_t n_draft_accepted() const { return m_n_draft_accepted; }
+
+    int32_t n_ctx() const { return m_n_ctx; }
+    int32_t n_past() const { return m_n_past; }
+    GGMLType kv_type() const { return m_kv_type; }
+    const LlamaModel* model() const { return m_model; }
+
+    // Tokens currently held in the KV cache, one per position
+    const std::vector<int32_t>& tokens() const { return m_tokens; }
+
+    // Prompt tokens served from the cache by the last generate() call
+    int32_t n_reused() const { return m_n_reused; }
+
+    // Write the cached tokens and their KV rows to path (atomically, via a
+    // temporary file). Returns the number of positions saved or -1.
+    int32_t save_state(const std::string& path, std::string& error) const;
+
+    // Restore a snapshot written by save_state for the same model. The
+    // restored tokens then act as a cached prefix for the next generate().
+    // Returns the number of positions restored or -1.
+    int32_t load_state(const std::string& path, std::string& error);
+
+private:
+    const LlamaModel* m_model = nullptr;
+    ThreadPool* m_pool = nullptr;
+    int32_t m_n_ctx = 0;
+    int32_t m_n_ubatch = 0;
+    int32_t m_n_past = 0;
+    int32_t m_n_reused = 0;
+    // Cancellation is by ticket: every generation gets one (a reserved
+    // one, or the next), and is cancelled once m_cancelled_through
+    // reaches it
+    bool cancelled() const { return m_cancelled_through.load(std::memory_order_acquire) >= m_ticket; }
+    std::atomic<uint64_t> m_reserved{0};           // last ticket handed out
+    std::atomic<uint64_t> m_cancelled_through{0};
+    uint64_t m_ticket = 0;                         // of the latest generate()
+    std::vector<int32_t> m_tokens;
+    Sampler m_sampler;
+
+    BatchScheduler* m_scheduler = nullptr;
+
+    // Constrained decoding; m_masked holds a logits row being masked
+    std::unique_ptr<Grammar> m_grammar;
+    std::vector<float> m_masked;
+
+    // Speculative decoding
+    LlamaContext* m_draft = nullptr;
+    int32_t m_n_draft = 0;
+    int32_t m_n_lookup = 0;
+    int32_t m_n_drafted = 0;
+    int32_t m_n_draft_accepted = 0;
+
+    // Bring the cache in line with prefix followed by next, then greedily
+    // extend it by up to n_draft tokens, stopping early when the model is
+    // unsure. Used on the draft context.
+    std::vector<int32_t> propose(const std::vector<int32_t>& prefix, int32_t next, int32_t n_draft,
+                                 int32_t n_keep);
+
+    // Keep the part of the cache that matches tokens[0, max_match): the
+    // common prefix plus, when tokens skips cached positions after n_keep,
+    // the cached run that resumes it, shifted into place. Truncates the
+    // rest and returns how many tokens are cached.
+    int32_t reuse_cache(const std::vector<int32_t>& tokens, size_t max_match, int32_t n_keep);
+
+    // decode_batch, through the scheduler when there is one
+    const float* step(const int32_t* tokens, int32_t n, bool all_logits);
+
+    // Tokens that followed the latest earlier occurrence of the last few
+    // tokens of the transcript (the cached tokens followed by next)
+    std::vector<int32_t> lookup(int32_t next, int32_t n_draft) const;
+
+    // KV cache: [n_layer][n_ctx] rows of n_embd_kv values in m_kv_type,
+    // m_kv_row bytes each
+    GGMLType m_kv_type = GGMLType::F16;
+    size_t m_kv_row = 0;
+    std::vector<uint8_t> m_k_cache;
+    std::vector<uint8_t> m_v_cache;
+
+    // Size the per-token scratch buffers for n_ubatch rows
+    bool alloc_scratch(int32_t n_ubatch);
+
+    // Scratch buffers, n_ubatch rows each (m_att: one row; m_logits:
+    // kMaxLogitRows rows at most)
+    std::vector<float> m_x;      // residual stream
+    std::vector<float> m_xb;     // normalized input
+    std::vector<float> m_xb2;    // attention output
+    std::vector<float> m_q;
+    std::vector<float> m_k;
+    std::vector<float> m_v;
+    std::vector<float> m_att;    // attention scores, n_ctx
+    std::vector<float> m_hb;     // ffn gate
+    std::vector<float> m_hb2;    // ffn up
+    std::vector<uint8_t> m_xq;   // matmul input quantized to the weight's dot type
+    std::vector<uint8_t> m_qq;   // one query row in Q8_0, for a quantized KV cache
+    std::vector<float> m_logits;
+    std::vector<float> m_hidden; // embed(): one micro-batch of hidden states
+    std::vector<float> m_rope_inv_freq;
+};
+
+// Pick a pool size for this model by timing the matmuls of its first
+// layers with 1..max_threads threads (pinned as cpu_affinity_for would
+// pin them). Returns the smallest count within a few percent of the
+// fastest. Takes tens of milliseconds.
+int tune_thread_count(const LlamaModel& model, int max_threads);
+
+} // namespace tutu
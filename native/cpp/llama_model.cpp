@@ -0,0 +1,226 @@
+/**
+ * llama_model.cpp - Llama-architecture model bound to a mapped GGUF file
+ */
+
+#include "llama_model.h"
+
+#include "quants.h"
+
+namespace tutu {
+
+namespace {
+
+// Look up a tensor and check it has the expected 2D/1D shape
+const GGUFTensor* require(const GGUFFile& file, const std::string& name,
+                          int64_t ne0, int64_t ne1, std::string& error) {
+    const GGUFTensor* t = file.tensor(name);
+    if (t == nullptr) {
+        error = "Missing tensor " + name;
+        return nullptr;
+    }
+    if (t->ne[0] != ne0 || t->ne[1] != ne1 || t->ne[2] != 1 || t->ne[3] != 1) {
+        error = "Unexpected shape for tensor " + name;
+        return nullptr;
+    }
+    return t;
+}
+
+} // namespace
+
+// ============================================================================
+// Loading
+// ============================================================================
+
+bool LlamaModel::load(const std::string& path, std::string& error) {
+    unload();
+
+    if (!m_file.open(path, error)) {
+        return false;
+    }
+
+    std::string arch;
+    if (!m_file.get_str("general.architecture", arch)) {
+        error = "Model has no architecture metadata";
+        unload();
+        return false;
+    }
+    if (arch != "llama") {
+        error = "Unsupported model architecture: " + arch;
+        unload();
+        return false;
+    }
+
+    LlamaHParams& hp = m_hparams;
+    bool ok = true;
+    ok &= m_file.get_u32("llama.embedding_length", hp.n_embd);
+    ok &= m_file.get_u32("llama.block_count", hp.n_layer);
+    ok &= m_file.get_u32("llama.feed_forward_length", hp.n_ff);
+    ok &= m_file.get_u32("llama.attention.head_count", hp.n_head);
+    if (!ok || hp.n_embd == 0 || hp.n_layer == 0 || hp.n_head == 0 || hp.n_embd % hp.n_head != 0) {
+        error = "Missing or invalid llama hyperparameters";
+        unload();
+        return false;
+    }
+
+    hp.n_head_kv = hp.n_head;
+    m_file.get_u32("llama.attention.head_count_kv", hp.n_head_kv);
+    if (hp.n_head_kv == 0 || hp.n_head % hp.n_head_kv != 0) {
+        error = "Invalid KV head count";
+        unload();
+        return false;
+    }
+    hp.n_ctx_train = 2048;
+    m_file.get_u32("llama.context_length", hp.n_ctx_train);
+    hp.n_rot = hp.head_dim();
+    m_file.get_u32("llama.rope.dimension_count", hp.n_rot);
+    // RoPE rotates pairs within each head
+    if (hp.n_rot == 0 || hp.n_rot % 2 != 0 || hp.n_rot > hp.head_dim()) {
+        error = "Invalid RoPE dimension count";
+        unload();
+        return false;
+    }
+    m_file.get_f32("llama.rope.freq_base", hp.rope_freq_base);
+    m_file.get_f32("llama.attention.layer_norm_rms_epsilon", hp.rms_eps);
+
+    if (!m_file.get_u32("llama.vocab_size", hp.n_vocab)) {
+        const GGUFValue* tokens = m_file.find("tokenizer.ggml.tokens");
+        hp.n_vocab = tokens != nullptr ? static_cast<uint32_t>(tokens->array_len) : 0;
+    }
+
+    if (!m_file.get_str("general.name", m_name)) {
+        m_name = "llama";
+    }
+    m_path = path;
+
+    if (!bind_tensors(error)) {
+        unload();
+        return false;
+    }
+
+    if (!m_tokenizer.load(m_file, error)) {
+        unload();
+        return false;
+    }
+    if (m_tokenizer.n_vocab() != static_cast<int32_t>(hp.n_vocab)) {
+        error = "Tokenizer vocabulary does not match the model";
+        unload();
+        return false;
+    }
+
+    compute_fingerprint();
+    m_file.prefetch();
+    return true;
+}
+
+void LlamaModel::unload() {
+    m_tokenizer.clear();
+    m_file.close();
+    m_hparams = LlamaHParams();
+    m_name.clear();
+    m_path.clear();
+    m_weights_size = 0;
+    m_fingerprint = 0;
+    m_tok_embd = nullptr;
+    m_output_norm = nullptr;
+    m_output = nullptr;
+    m_layers.clear();
+}
+
+bool LlamaModel::bind_tensors(std::string& error) {
+    const LlamaHParams& hp = m_hparams;
+    const int64_t n_embd = hp.n_embd;
+    const int64_t n_embd_kv = hp.n_embd_kv();
+
+    m_tok_embd = m_file.tensor("token_embd.weight");
+    if (m_tok_embd == nullptr || m_tok_embd->ne[0] != n_embd) {
+        error = "Missing or invalid token_embd.weight";
+        return false;
+    }
+    if (hp.n_vocab == 0) {
+        m_hparams.n_vocab = static_cast<uint32_t>(m_tok_embd->ne[1]);
+    }
+    const int64_t n_vocab = m_hparams.n_vocab;
+    if (m_tok_embd->ne[1] != n_vocab) {
+        error = "Vocabulary size does not match token_embd.weight";
+        return false;
+    }
+
+    if (!(m_output_norm = require(m_file, "output_norm.weight", n_embd, 1, error))) return false;
+
+    // SmolLM2 ties the output projection to the token embedding
+    m_output = m_file.tensor("output.weight");
+    if (m_output == nullptr) {
+        m_output = m_tok_embd;
+    } else if (m_output->ne[0] != n_embd || m_output->ne[1] != n_vocab) {
+        error = "Unexpected shape for tensor output.weight";
+        return false;
+    }
+
+    m_layers.resize(hp.n_layer);
+    for (uint32_t i = 0; i < hp.n_layer; ++i) {
+        LlamaLayer& l = m_layers[i];
+        const std::string p = "blk." + std::to_string(i) + ".";
+        if (!(l.attn_norm = require(m_file, p + "attn_norm.weight", n_embd, 1, error))) return false;
+        if (!(l.wq = require(m_file, p + "attn_q.weight", n_embd, n_embd, error))) return false;
+        if (!(l.wk = require(m_file, p + "attn_k.weight", n_embd, n_embd_kv, error))) return false;
+        if (!(l.wv = require(m_file, p + "attn_v.weight", n_embd, n_embd_kv, error))) return false;
+        if (!(l.wo = require(m_file, p + "attn_output.weight", n_embd, n_embd, error))) return false;
+        if (!(l.ffn_norm = require(m_file, p + "ffn_norm.weight", n_embd, 1, error))) return false;
+        if (!(l.ffn_gate = require(m_file, p + "ffn_gate.weight", n_embd, hp.n_ff, error))) return false;
+        if (!(l.ffn_up = require(m_file, p + "ffn_up.weight", n_embd, hp.n_ff, error))) return false;
+        if (!(l.ffn_down = require(m_file, p + "ffn_down.weight", hp.n_ff, n_embd, error))) return false;
+    }
+
+    // Norm weights are read directly as float vectors
+    if (m_output_norm->type != GGMLType::F32) {
+        error = "output_norm.weight must be f32";
+        return false;
+    }
+    for (const LlamaLayer& l : m_layers) {
+        if (l.attn_norm->type != GGMLType::F32 || l.ffn_norm->type != GGMLType::F32) {
+            error = "Layer norm weights must be f32";
+            return false;
+        }
+        for (const GGUFTensor* t : {l.wq, l.wk, l.wv, l.wo, l.ffn_gate, l.ffn_up, l.ffn_down}) {
+            if (!quant_type_supported(t->type)) {
+                error = std::string("Unsupported weight type ") + ggml_type_name(t->type) + " for " + t->name;
+                return false;
+            }
+        }
+    }
+    for (const GGUFTensor* t : {m_tok_embd, m_output}) {
+        if (!quant_type_supported(t->type)) {
+            error = std::string("Unsupported weight type ") + ggml_type_name(t->type) + " for " + t->name;
+            return false;
+        }
+    }
+
+    m_weights_size = 0;
+    for (const GGUFTensor& t : m_file.tensors()) {
+        m_weights_size += t.size;
+    }
+    return true;
+}
+
+void LlamaModel::compute_fingerprint() {
+    // FNV-1a over the header plus the first bytes of each tensor. Cheap
+    // enough for load time, and catches re-quantized or fine-tuned files
+    // that share the same metadata.
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto mix = [&h](const uint8_t* p, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            h ^= p[i];
+            h *= 0x100000001b3ULL;
+        }
+    };
+
+    const uint64_t size = m_file.file_size();
+    mix(reinterpret_cast<const uint8_t*>(&size), sizeof(size));
+    mix(m_file.data(), m_file.data_offset());
+    for (const GGUFTensor& t : m_file.tensors()) {
+        mix(static_cast<const uint8_t*>(t.data), t.size < 64 ? t.size : 64);
+    }
+    m_fingerprint = h;
+}
+
+} // namespace tutu
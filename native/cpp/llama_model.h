@@ -0,0 +1,94 @@
+/**
+ * llama_model.h - Llama-architecture model bound to a mapped GGUF file
+ *
+ * Holds the hyperparameters and per-layer weight views for models such
+ * as SmolLM2. Weights are GGUFTensor views into the file mapping; the
+ * model never owns a copy of them.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gguf.h"
+#include "tokenizer.h"
+
+namespace tutu {
+
+struct LlamaHParams {
+    uint32_t n_vocab = 0;
+    uint32_t n_ctx_train = 0;
+    uint32_t n_embd = 0;
+    uint32_t n_layer = 0;
+    uint32_t n_head = 0;
+    uint32_t n_head_kv = 0;
+    uint32_t n_ff = 0;
+    uint32_t n_rot = 0;
+    float rope_freq_base = 10000.0f;
+    float rms_eps = 1e-5f;
+
+    uint32_t head_dim() const { return n_embd / n_head; }
+    uint32_t n_embd_kv() const { return head_dim() * n_head_kv; }
+};
+
+struct LlamaLayer {
+    const GGUFTensor* attn_norm = nullptr;
+    const GGUFTensor* wq = nullptr;
+    const GGUFTensor* wk = nullptr;
+    const GGUFTensor* wv = nullptr;
+    const GGUFTensor* wo = nullptr;
+    const GGUFTensor* ffn_norm = nullptr;
+    const GGUFTensor* ffn_gate = nullptr;
+    const GGUFTensor* ffn_up = nullptr;
+    const GGUFTensor* ffn_down = nullptr;
+};
+
+class LlamaModel {
+public:
+    // Map the GGUF file and bind every weight. Returns false and fills
+    // error if the file is missing, malformed or not a llama model.
+    bool load(const std::string& path, std::string& error);
+    void unload();
+
+    bool is_loaded() const { return m_file.is_open(); }
+
+    const LlamaHParams& hparams() const { return m_hparams; }
+    const GGUFFile& file() const { return m_file; }
+    const Tokenizer& tokenizer() const { return m_tokenizer; }
+    const std::string& name() const { return m_name; }
+    const std::string& path() const { return m_path; }
+
+    const GGUFTensor* tok_embd() const { return m_tok_embd; }
+    const GGUFTensor* output_norm() const { return m_output_norm; }
+    // Falls back to the token embedding for tied-embedding models
+    const GGUFTensor* output() const { return m_output; }
+    const LlamaLayer& layer(uint32_t i) const { return m_layers[i]; }
+
+    // Total bytes of mapped tensor data
+    size_t weights_size() const { return m_weights_size; }
+
+    // Identifies the exact model file; used to key saved KV state.
+    // Hashes the metadata/tensor table and a sample of every tensor.
+    uint64_t fingerprint() const { return m_fingerprint; }
+
+private:
+    bool bind_tensors(std::string& error);
+    void compute_fingerprint();
+
+    GGUFFile m_file;
+    Tokenizer m_tokenizer;
+    LlamaHParams m_hparams;
+    std::string m_name;
+    std::string m_path;
+    size_t m_weights_size = 0;
+    uint64_t m_fingerprint = 0;
+
+    const GGUFTensor* m_tok_embd = nullptr;
+    const GGUFTensor* m_output_norm = nullptr;
+    const GGUFTensor* m_output = nullptr;
+    std::vector<LlamaLayer> m_layers;
+};
+
+} // namespace tutu
@@ -0,0 +1,169 @@
+/**
+ * mapped_file.cpp - Writable memory-mapped file that can grow
+ */
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tutu {
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path, std::string& error) {
+    return open(path, true, error);
+}
+
+bool MappedFile::open_read_only(const std::string& path, std::string& error) {
+    return open(path, false, error);
+}
+
+bool MappedFile::open(const std::string& path, bool writable, std::string& error) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = writable ? CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                                         OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr)
+                           : CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                         FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "Cannot open index file: " + path;
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        error = "Cannot open index file: " + path;
+        return false;
+    }
+    m_file_handle = file;
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    m_fd = writable ? ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)
+                    : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        error = "Cannot open index file: " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        ::close(m_fd);
+        m_fd = -1;
+        error = "Cannot open index file: " + path;
+        return false;
+    }
+    m_size = static_cast<size_t>(st.st_size);
+#endif
+
+    m_path = path;
+    m_open = true;
+    m_writable = writable;
+    if (m_size > 0 && !map(error)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (!m_open) return;
+    unmap();
+#ifdef _WIN32
+    CloseHandle(static_cast<HANDLE>(m_file_handle));
+    m_file_handle = nullptr;
+#else
+    ::close(m_fd);
+    m_fd = -1;
+#endif
+    m_open = false;
+    m_writable = false;
+    m_size = 0;
+    m_path.clear();
+}
+
+bool MappedFile::resize(size_t size, std::string& error) {
+    if (!m_open) {
+        error = "Index file is not open";
+        return false;
+    }
+    if (!m_writable) {
+        error = "File is mapped read-only: " + m_path;
+        return false;
+    }
+    unmap();
+#ifdef _WIN32
+    LARGE_INTEGER pos;
+    pos.QuadPart = static_cast<LONGLONG>(size);
+    const bool ok = SetFilePointerEx(static_cast<HANDLE>(m_file_handle), pos, nullptr, FILE_BEGIN) &&
+                    SetEndOfFile(static_cast<HANDLE>(m_file_handle));
+#else
+    const bool ok = ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+#endif
+    if (!ok) {
+        error = "Cannot grow index file: " + m_path;
+        // Map what is there again, so the file stays usable
+        std::string ignored;
+        if (m_size > 0) map(ignored);
+        return false;
+    }
+    m_size = size;
+    return size == 0 || map(error);
+}
+
+void MappedFile::sync() {
+    if (m_data == nullptr || !m_writable) return;
+#ifdef _WIN32
+    FlushViewOfFile(m_data, 0);
+    FlushFileBuffers(static_cast<HANDLE>(m_file_handle));
+#else
+    msync(m_data, m_size, MS_SYNC);
+#endif
+}
+
+bool MappedFile::map(std::string& error) {
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(static_cast<HANDLE>(m_file_handle), nullptr,
+                                        m_writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+    void* addr = mapping != nullptr
+                     ? MapViewOfFile(mapping, m_writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0)
+                     : nullptr;
+    if (addr == nullptr) {
+        if (mapping != nullptr) CloseHandle(mapping);
+        error = "Failed to map index file: " + m_path;
+        return false;
+    }
+    m_mapping_handle = mapping;
+#else
+    void* addr = mmap(nullptr, m_size, m_writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_fd, 0);
+    if (addr == MAP_FAILED) {
+        error = "Failed to map index file: " + m_path;
+        return false;
+    }
+#endif
+    m_data = static_cast<uint8_t*>(addr);
+    return true;
+}
+
+void MappedFile::unmap() {
+    if (m_data == nullptr) return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(static_cast<HANDLE>(m_mapping_handle));
+    m_mapping_handle = nullptr;
+#else
+    munmap(m_data, m_size);
+#endif
+    m_data = nullptr;
+}
+
+} // namespace tutu
@@ -0,0 +1,70 @@
+/**
+ * mapped_file.h - Writable memory-mapped file that can grow
+ *
+ * Backs on-disk indexes that are used in place: opening one maps it and
+ * touches nothing else, and pages are read in only when a lookup reaches
+ * them. Writes go straight to the shared mapping; the kernel writes them
+ * back, and sync() forces it. Growing remaps the file, so pointers into
+ * data() are invalidated by resize().
+ *
+ * Shipped data can be mapped read-only instead: its pages come straight
+ * from the page cache, shared with anything else mapping the same file,
+ * and are never copied into the heap.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tutu {
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Map path read-write, creating an empty file if it does not exist.
+    // An empty file is not mapped until it is resized.
+    bool open(const std::string& path, std::string& error);
+
+    // Map an existing file read-only; data() must not be written, and the
+    // file cannot be resized
+    bool open_read_only(const std::string& path, std::string& error);
+    void close();
+
+    // Change the file size (new bytes read as zero) and remap it
+    bool resize(size_t size, std::string& error);
+
+    // Write dirty pages back to the file
+    void sync();
+
+    bool is_open() const { return m_open; }
+    size_t size() const { return m_size; }
+    uint8_t* data() { return m_data; }
+    const uint8_t* data() const { return m_data; }
+    const std::string& path() const { return m_path; }
+
+private:
+    bool open(const std::string& path, bool writable, std::string& error);
+    bool map(std::string& error);
+    void unmap();
+
+    std::string m_path;
+    bool m_open = false;
+    bool m_writable = false;
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file_handle = nullptr;
+    void* m_mapping_handle = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
+
+} // namespace tutu
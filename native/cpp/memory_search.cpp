@@ -0,0 +1,73 @@
+/**
+ * memory_search.cpp - Hybrid keyword + embedding retrieval over memories
+ */
+
+#include "memory_search.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace tutu {
+
+std::vector<MemoryHit> memory_search(KeywordIndex& keywords, VectorIndex* vectors, const MemoryQuery& query) {
+    std::vector<MemoryHit> hits;
+    if (query.k <= 0) return hits;
+    const int32_t candidates = query.k * std::max(query.candidates_per_result, 1);
+
+    // The two lists are each well under a millisecond, so they run one
+    // after the other rather than paying for a thread handoff
+    const auto lexical = keywords.search(query.text, candidates);
+    std::vector<std::pair<std::string, float>> semantic;
+    if (vectors != nullptr && query.vector != nullptr) {
+        semantic = vectors->search(query.vector, candidates);
+        semantic.erase(std::remove_if(semantic.begin(), semantic.end(),
+                                      [&](const std::pair<std::string, float>& m) {
+                                          return m.second < query.min_similarity;
+                                      }),
+                       semantic.end());
+    }
+
+    std::unordered_map<std::string, size_t> by_id;
+    auto hit = [&](const std::string& id) -> MemoryHit& {
+        const auto it = by_id.emplace(id, hits.size());
+        if (it.second) hits.push_back({id, 0.0f, 0.0f, 0.0f});
+        return hits[it.first->second];
+    };
+    for (size_t rank = 0; rank < lexical.size(); ++rank) {
+        MemoryHit& h = hit(lexical[rank].first);
+        h.score += 1.0f / (kRrfK + static_cast<float>(rank + 1));
+        h.lexical = lexical[rank].second;
+    }
+    for (size_t rank = 0; rank < semantic.size(); ++rank) {
+        MemoryHit& h = hit(semantic[rank].first);
+        h.score += 1.0f / (kRrfK + static_cast<float>(rank + 1));
+        h.semantic = semantic[rank].second;
+    }
+
+    // Weight by importance; drop what expired from the results and the
+    // indexes. A vector match the keyword index does not know keeps the
+    // default weight.
+    bool removed = false;
+    std::vector<MemoryHit> live;
+    live.reserve(hits.size());
+    for (MemoryHit& h : hits) {
+        const KeywordIndex::Weight* weight = keywords.weight(h.id);
+        if (weight != nullptr && weight->expires_at != 0 && weight->expires_at <= query.now) {
+            keywords.remove(h.id);
+            if (vectors != nullptr) removed |= vectors->remove(h.id);
+            continue;
+        }
+        h.score *= weight != nullptr ? weight->importance : KeywordIndex::Weight().importance;
+        live.push_back(std::move(h));
+    }
+    if (removed) vectors->flush();
+
+    // Stable, so equal scores keep the order they were gathered in; the
+    // list is a few dozen hits at most
+    std::stable_sort(live.begin(), live.end(),
+                     [](const MemoryHit& a, const MemoryHit& b) { return a.score > b.score; });
+    live.resize(std::min(live.size(), static_cast<size_t>(query.k)));
+    return live;
+}
+
+} // namespace tutu
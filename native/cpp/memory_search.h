@@ -0,0 +1,55 @@
+/**
+ * memory_search.h - Hybrid keyword + embedding retrieval over memories
+ *
+ * Runs a BM25 query on an agent's keyword index and a nearest-neighbour
+ * query on its vector index, and merges the two rankings with reciprocal
+ * rank fusion: a memory scores 1 / (kRrfK + rank) for each list it is in,
+ * summed. Ranks, unlike raw scores, are comparable between BM25 and
+ * cosine similarity, and a memory near the top of both lists beats one
+ * that only tops one.
+ *
+ * The fused score is then multiplied by the memory's importance, and
+ * memories past their expiry time are left out and dropped from both
+ * indexes, so they are never paid for again. Memories with equal scores
+ * come in keyword rank order, then vector rank order for those only the
+ * vector index found.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "keyword_index.h"
+#include "vector_index.h"
+
+namespace tutu {
+
+struct MemoryHit {
+    std::string id;
+    float score;     // fused, importance weighted
+    float lexical;   // BM25, 0 if not a keyword match
+    float semantic;  // cosine similarity, 0 if not a vector match
+};
+
+struct MemoryQuery {
+    std::string text;
+    const float* vector = nullptr;  // embedding of text; null to match by keywords only
+    int32_t k = 5;
+    // Candidates taken from each index per result asked for
+    int32_t candidates_per_result = 4;
+    // Vector matches less similar than this are ignored
+    float min_similarity = 0.0f;
+    // Milliseconds since the epoch, for expiry
+    int64_t now = 0;
+};
+
+// Constant damping every rank in the fusion; 60 is the usual choice and
+// keeps the first few ranks from dominating
+constexpr float kRrfK = 60.0f;
+
+// The k best memories for query, best first. vectors may be null.
+std::vector<MemoryHit> memory_search(KeywordIndex& keywords, VectorIndex* vectors, const MemoryQuery& query);
+
+} // namespace tutu
@@ -0,0 +1,736 @@
+/**
+ * qa_matcher.cpp - Fuzzy question matching for the offline QA bank
+ */
+
+#include "qa_matcher.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string_view>
+#include <unordered_map>
+
+namespace tutu {
+
+namespace {
+
+constexpr float kLevenshteinWeight = 0.6f;
+constexpr float kKeywordWeight = 0.4f;
+
+// Within the keyword score: share of query words found in the question,
+// and of the entry's keywords hit by the query
+constexpr float kWordShare = 0.4f;
+constexpr float kKeywordShare = 0.6f;
+
+// Words shorter than this are not compared
+constexpr size_t kMinWordLength = 3;
+
+// A trigram in more than 1 / kCommonTrigramShare of the questions is too
+// common to pick candidates by
+constexpr size_t kCommonTrigramShare = 16;
+
+bool is_word_byte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+bool is_space(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+std::vector<std::string> split_words(const std::string& normalized) {
+    std::vector<std::string> words;
+    size_t start = 0;
+    while (start < normalized.size()) {
+        size_t end = normalized.find(' ', start);
+        if (end == std::string::npos) end = normalized.size();
+        if (end - start >= kMinWordLength) words.push_back(normalized.substr(start, end - start));
+        start = end + 1;
+    }
+    return words;
+}
+
+// Distinct trigrams of a normalized text, padded with a space each side
+std::vector<uint32_t> trigrams(const std::string& normalized) {
+    std::vector<uint32_t> out;
+    if (normalized.empty()) return out;
+    const std::string padded = " " + normalized + " ";
+    for (size_t i = 0; i + 3 <= padded.size(); ++i) {
+        out.push_back(static_cast<uint32_t>(static_cast<unsigned char>(padded[i])) << 16 |
+                      static_cast<uint32_t>(static_cast<unsigned char>(padded[i + 1])) << 8 |
+                      static_cast<uint32_t>(static_cast<unsigned char>(padded[i + 2])));
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+bool contains(const uint32_t* sorted, uint32_t n, int64_t id) {
+    return id >= 0 && std::binary_search(sorted, sorted + n, static_cast<uint32_t>(id));
+}
+
+// ============================================================================
+// Compiled Layout
+// ============================================================================
+//
+// A compiled bank is one block of 4-byte aligned sections in host byte
+// order (little-endian on every target), addressed by offsets so it can
+// be used wherever it is mapped:
+//
+//   Header
+//   EntryRecord[n_entries]     in add() order
+//   WordRecord[n_words]        sorted by text; a word's id is its index
+//   TrigramRecord[n_trigrams]  sorted by trigram
+//   uint32_t[]                 lists: postings, word ids, keyword texts
+//   strings                    each a uint32_t length, the bytes and a NUL,
+//                              padded to 4; identical strings stored once
+//
+// Texts are offsets into the strings section, lists are indexes into the
+// uint32_t lists section.
+
+constexpr uint32_t kMagic = 0x42415154;  // "TQAB"
+constexpr uint32_t kVersion = 2;
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;      // of the whole image, in bytes
+    uint32_t checksum;  // FNV-1a of everything after the header
+    uint32_t n_entries;
+    uint32_t n_words;
+    uint32_t n_trigrams;
+    uint32_t n_lists;
+    uint32_t entries;  // byte offsets of the sections
+    uint32_t words;
+    uint32_t trigrams;
+    uint32_t lists;
+    uint32_t strings;
+    uint32_t reserved[3];
+};
+
+struct EntryRecord {
+    uint32_t id;
+    uint32_t question;
+    uint32_t answer;
+    uint32_t category;
+    uint32_t normalized;   // the question, normalized
+    uint32_t keywords;     // texts as given, repeats included
+    uint32_t n_keywords;
+    uint32_t words;        // distinct word ids of the question
+    uint32_t n_words;
+    uint32_t keyword_ids;  // distinct word ids of the normalized keywords
+    uint32_t n_keyword_ids;
+    uint32_t n_trigrams;   // distinct
+    float priority;
+};
+
+struct WordRecord {
+    uint32_t text;
+    uint32_t keyed;  // entries listing it as a keyword
+    uint32_t n_keyed;
+};
+
+struct TrigramRecord {
+    uint32_t trigram;
+    uint32_t postings;  // entries whose question contains it
+    uint32_t count;
+};
+
+static_assert(sizeof(Header) == 64, "Header layout");
+static_assert(sizeof(EntryRecord) == 52, "EntryRecord layout");
+static_assert(sizeof(WordRecord) == 12, "WordRecord layout");
+static_assert(sizeof(TrigramRecord) == 12, "TrigramRecord layout");
+
+uint32_t fnv1a(const uint8_t* data, size_t n) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < n; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Read-only view of a compiled bank
+class Bank {
+public:
+    explicit Bank(const uint8_t* image) : m_image(image) {}
+
+    const Header& header() const { return *reinterpret_cast<const Header*>(m_image); }
+
+    const EntryRecord& entry(uint32_t i) const {
+        return reinterpret_cast<const EntryRecord*>(m_image + header().entries)[i];
+    }
+
+    const char* text(uint32_t offset) const {
+        return reinterpret_cast<const char*>(m_image + header().strings + offset + sizeof(uint32_t));
+    }
+
+    uint32_t length(uint32_t offset) const {
+        return *reinterpret_cast<const uint32_t*>(m_image + header().strings + offset);
+    }
+
+    const uint32_t* list(uint32_t index) const {
+        return reinterpret_cast<const uint32_t*>(m_image + header().lists) + index;
+    }
+
+    const WordRecord& word(uint32_t id) const {
+        return reinterpret_cast<const WordRecord*>(m_image + header().words)[id];
+    }
+
+    // Id of a normalized word, -1 if no entry has it
+    int64_t word(const std::string& word) const {
+        const auto* words = reinterpret_cast<const WordRecord*>(m_image + header().words);
+        const WordRecord* end = words + header().n_words;
+        const WordRecord* it = std::lower_bound(words, end, word, [&](const WordRecord& r, const std::string& w) {
+            return std::string_view(text(r.text), length(r.text)) < std::string_view(w);
+        });
+        if (it == end || std::string_view(text(it->text), length(it->text)) != std::string_view(word)) return -1;
+        return it - words;
+    }
+
+    const TrigramRecord* trigram(uint32_t gram) const {
+        const auto* trigrams = reinterpret_cast<const TrigramRecord*>(m_image + header().trigrams);
+        const TrigramRecord* end = trigrams + header().n_trigrams;
+        const TrigramRecord* it = std::lower_bound(
+            trigrams, end, gram, [](const TrigramRecord& r, uint32_t g) { return r.trigram < g; });
+        return it != end && it->trigram == gram ? it : nullptr;
+    }
+
+private:
+    const uint8_t* m_image;
+};
+
+// Strings section under construction; each distinct string stored once
+class StringPool {
+public:
+    uint32_t add(const std::string& s) {
+        const auto it = m_offsets.find(s);
+        if (it != m_offsets.end()) return it->second;
+        const auto offset = static_cast<uint32_t>(bytes.size());
+        const auto length = static_cast<uint32_t>(s.size());
+        bytes.insert(bytes.end(), reinterpret_cast<const uint8_t*>(&length),
+                     reinterpret_cast<const uint8_t*>(&length) + sizeof(length));
+        bytes.insert(bytes.end(), s.begin(), s.end());
+        bytes.push_back(0);
+        bytes.resize((bytes.size() + 3) & ~size_t(3), 0);
+        m_offsets.emplace(s, offset);
+        return offset;
+    }
+
+    std::vector<uint8_t> bytes;
+
+private:
+    std::unordered_map<std::string, uint32_t> m_offsets;
+};
+
+template <typename T>
+void append(std::vector<uint8_t>& out, const T* items, size_t n) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(items);
+    out.insert(out.end(), bytes, bytes + n * sizeof(T));
+}
+
+std::vector<uint8_t> compile(const std::vector<QAMatcher::Entry>& entries) {
+    std::vector<std::string> normalized;
+    std::vector<std::vector<std::string>> keywords;
+    std::map<std::string, uint32_t> word_ids;
+    for (const QAMatcher::Entry& entry : entries) {
+        normalized.push_back(QAMatcher::normalize(entry.question));
+        for (const std::string& word : split_words(normalized.back())) word_ids.emplace(word, 0);
+        keywords.emplace_back();
+        for (const std::string& keyword : entry.keywords) {
+            keywords.back().push_back(QAMatcher::normalize(keyword));
+            word_ids.emplace(keywords.back().back(), 0);
+        }
+    }
+
+    StringPool strings;
+    std::vector<WordRecord> words;
+    for (auto& w : word_ids) {
+        w.second = static_cast<uint32_t>(words.size());
+        words.push_back({strings.add(w.first), 0, 0});
+    }
+
+    std::vector<uint32_t> lists;
+    auto add_list = [&](std::vector<uint32_t> ids, bool distinct) {
+        if (distinct) {
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        }
+        const auto index = static_cast<uint32_t>(lists.size());
+        lists.insert(lists.end(), ids.begin(), ids.end());
+        return std::make_pair(index, static_cast<uint32_t>(ids.size()));
+    };
+
+    std::vector<EntryRecord> records;
+    std::map<uint32_t, std::vector<uint32_t>> postings;
+    std::vector<std::vector<uint32_t>> keyed(words.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const QAMatcher::Entry& entry = entries[i];
+        EntryRecord r{};
+        r.id = strings.add(entry.id);
+        r.question = strings.add(entry.question);
+        r.answer = strings.add(entry.answer);
+        r.category = strings.add(entry.category);
+        r.normalized = strings.add(normalized[i]);
+
+        std::vector<uint32_t> texts, question_ids, keyword_ids;
+        for (const std::string& keyword : entry.keywords) texts.push_back(strings.add(keyword));
+        for (const std::string& word : split_words(normalized[i])) question_ids.push_back(word_ids[word]);
+        for (const std::string& keyword : keywords[i]) keyword_ids.push_back(word_ids[keyword]);
+        std::tie(r.keywords, r.n_keywords) = add_list(texts, false);
+        std::tie(r.words, r.n_words) = add_list(question_ids, true);
+        std::tie(r.keyword_ids, r.n_keyword_ids) = add_list(keyword_ids, true);
+        for (uint32_t k = 0; k < r.n_keyword_ids; ++k) keyed[lists[r.keyword_ids + k]].push_back(static_cast<uint32_t>(i));
+
+        const std::vector<uint32_t> grams = trigrams(normalized[i]);
+        for (uint32_t gram : grams) postings[gram].push_back(static_cast<uint32_t>(i));
+        r.n_trigrams = static_cast<uint32_t>(grams.size());
+        r.priority = entry.priority;
+        records.push_back(r);
+    }
+
+    for (size_t w = 0; w < words.size(); ++w) {
+        std::tie(words[w].keyed, words[w].n_keyed) = add_list(keyed[w], false);
+    }
+
+    std::vector<TrigramRecord> trigram_records;
+    for (const auto& p : postings) {
+        const auto list = add_list(p.second, false);
+        trigram_records.push_back({p.first, list.first, list.second});
+    }
+
+    Header header{};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.n_entries = static_cast<uint32_t>(records.size());
+    header.n_words = static_cast<uint32_t>(words.size());
+    header.n_trigrams = static_cast<uint32_t>(trigram_records.size());
+    header.n_lists = static_cast<uint32_t>(lists.size());
+    header.entries = sizeof(Header);
+    header.words = header.entries + static_cast<uint32_t>(records.size() * sizeof(EntryRecord));
+    header.trigrams = header.words + static_cast<uint32_t>(words.size() * sizeof(WordRecord));
+    header.lists = header.trigrams + static_cast<uint32_t>(trigram_records.size() * sizeof(TrigramRecord));
+    header.strings = header.lists + static_cast<uint32_t>(lists.size() * sizeof(uint32_t));
+    header.size = header.strings + static_cast<uint32_t>(strings.bytes.size());
+
+    std::vector<uint8_t> image;
+    image.reserve(header.size);
+    append(image, &header, 1);
+    append(image, records.data(), records.size());
+    append(image, words.data(), words.size());
+    append(image, trigram_records.data(), trigram_records.size());
+    append(image, lists.data(), lists.size());
+    append(image, strings.bytes.data(), strings.bytes.size());
+
+    header.checksum = fnv1a(image.data() + sizeof(Header), image.size() - sizeof(Header));
+    memcpy(image.data(), &header, sizeof(Header));
+    return image;
+}
+
+// Checks of a compiled bank's contents against its header, so a bank
+// that passes can be read without bounds checks
+class Validator {
+public:
+    Validator(const uint8_t* data, const Header& h) : m_data(data), m_h(h) {}
+
+    // A string's length, bytes and NUL lie inside the strings section
+    bool string(uint32_t offset) const {
+        const uint64_t section = uint64_t(m_h.size) - m_h.strings;
+        if (offset % sizeof(uint32_t) != 0 || uint64_t(offset) + sizeof(uint32_t) + 1 > section) return false;
+        const uint8_t* at = m_data + m_h.strings + offset;
+        uint32_t length;
+        memcpy(&length, at, sizeof(length));
+        return uint64_t(offset) + sizeof(uint32_t) + length + 1 <= section && at[sizeof(uint32_t) + length] == 0;
+    }
+
+    // n items from index lie inside the lists section, each below limit
+    bool list(uint32_t index, uint32_t n, uint32_t limit) const {
+        if (uint64_t(index) + n > m_h.n_lists) return false;
+        const auto* items = reinterpret_cast<const uint32_t*>(m_data + m_h.lists) + index;
+        return std::all_of(items, items + n, [&](uint32_t item) { return item < limit; });
+    }
+
+    // As list(), for items that are string offsets
+    bool strings(uint32_t index, uint32_t n) const {
+        if (uint64_t(index) + n > m_h.n_lists) return false;
+        const auto* items = reinterpret_cast<const uint32_t*>(m_data + m_h.lists) + index;
+        return std::all_of(items, items + n, [&](uint32_t offset) { return string(offset); });
+    }
+
+private:
+    const uint8_t* m_data;
+    const Header& m_h;
+};
+
+// Whether a mapped file of size bytes holds an intact bank this build
+// can read: layout, checksum, and every offset and index in it
+bool valid(const uint8_t* data, size_t size) {
+    if (size < sizeof(Header)) return false;
+    const Header& h = *reinterpret_cast<const Header*>(data);
+    if (h.magic != kMagic || h.version != kVersion || h.size != size) return false;
+    const uint64_t entries_end = uint64_t(h.entries) + uint64_t(h.n_entries) * sizeof(EntryRecord);
+    const uint64_t words_end = uint64_t(h.words) + uint64_t(h.n_words) * sizeof(WordRecord);
+    const uint64_t trigrams_end = uint64_t(h.trigrams) + uint64_t(h.n_trigrams) * sizeof(TrigramRecord);
+    const uint64_t lists_end = uint64_t(h.lists) + uint64_t(h.n_lists) * sizeof(uint32_t);
+    if (h.entries != sizeof(Header) || entries_end > h.words || words_end > h.trigrams ||
+        trigrams_end > h.lists || lists_end > h.strings || h.strings > size ||
+        (h.words | h.trigrams | h.lists | h.strings) % sizeof(uint32_t) != 0) {
+        return false;
+    }
+    if (fnv1a(data + sizeof(Header), size - sizeof(Header)) != h.checksum) return false;
+
+    const Validator check(data, h);
+    const auto* entries = reinterpret_cast<const EntryRecord*>(data + h.entries);
+    for (uint32_t i = 0; i < h.n_entries; ++i) {
+        const EntryRecord& r = entries[i];
+        if (!check.string(r.id) || !check.string(r.question) || !check.string(r.answer) ||
+            !check.string(r.category) || !check.string(r.normalized) ||
+            !check.strings(r.keywords, r.n_keywords) || !check.list(r.words, r.n_words, h.n_words) ||
+            !check.list(r.keyword_ids, r.n_keyword_ids, h.n_words)) {
+            return false;
+        }
+    }
+    const auto* words = reinterpret_cast<const WordRecord*>(data + h.words);
+    if (!std::all_of(words, words + h.n_words, [&](const WordRecord& r) {
+            return check.string(r.text) && check.list(r.keyed, r.n_keyed, h.n_entries);
+        })) {
+        return false;
+    }
+    const auto* trigrams = reinterpret_cast<const TrigramRecord*>(data + h.trigrams);
+    return std::all_of(trigrams, trigrams + h.n_trigrams, [&](const TrigramRecord& r) {
+        return check.list(r.postings, r.count, h.n_entries);
+    });
+}
+
+} // namespace
+
+// ============================================================================
+// Text
+// ============================================================================
+
+std::string QAMatcher::normalize(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    bool space = false;
+    for (unsigned char c : text) {
+        if (c >= 'A' && c <= 'Z') c = static_cast<unsigned char>(c - 'A' + 'a');
+        if (is_word_byte(c)) {
+            if (space && !out.empty()) out += ' ';
+            out += static_cast<char>(c);
+            space = false;
+        } else if (is_space(c)) {
+            space = true;
+        }
+        // Anything else (punctuation, non-ASCII) is dropped without
+        // separating the words around it
+    }
+    return out;
+}
+
+// ============================================================================
+// Myers' bit-parallel edit distance
+// ============================================================================
+
+QAMatcher::Pattern::Pattern(const std::string& text) : length(text.size()), blocks((text.size() + 63) / 64) {
+    peq.assign(blocks * 256, 0);
+    for (size_t i = 0; i < length; ++i) {
+        peq[(i / 64) * 256 + static_cast<unsigned char>(text[i])] |= uint64_t(1) << (i % 64);
+    }
+}
+
+// Column by column over text, each block of 64 pattern rows holds the
+// vertical deltas (+1 in P, -1 in M) of its rows. A block's bottom
+// horizontal delta carries into the next block's top row, and the score
+// follows the horizontal delta of the pattern's last row.
+int32_t QAMatcher::Pattern::distance(const char* text, size_t n, std::vector<uint64_t>& scratch) const {
+    if (length == 0) return static_cast<int32_t>(n);
+
+    scratch.assign(blocks * 2, 0);
+    uint64_t* P = scratch.data();
+    uint64_t* M = scratch.data() + blocks;
+    for (size_t b = 0; b < blocks; ++b) P[b] = ~uint64_t(0);
+
+    const uint64_t last = uint64_t(1) << ((length - 1) % 64);
+    int32_t score = static_cast<int32_t>(length);
+
+    for (size_t j = 0; j < n; ++j) {
+        const auto c = static_cast<unsigned char>(text[j]);
+        int hin = 1; // the first row grows by one per column
+        for (size_t b = 0; b < blocks; ++b) {
+            uint64_t eq = peq[b * 256 + c];
+            const uint64_t pv = P[b];
+            const uint64_t mv = M[b];
+
+            const uint64_t xv = eq | mv;
+            if (hin < 0) eq |= 1;
+            const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+
+            if (b == blocks - 1) {
+                if (ph & last) {
+                    ++score;
+                } else if (mh & last) {
+                    --score;
+                }
+            }
+            const int hout = (ph >> 63) ? 1 : (mh >> 63) ? -1 : 0;
+
+            ph <<= 1;
+            mh <<= 1;
+            if (hin < 0) {
+                mh |= 1;
+            } else if (hin > 0) {
+                ph |= 1;
+            }
+            P[b] = mh | ~(xv | ph);
+            M[b] = ph & xv;
+            hin = hout;
+        }
+    }
+    return score;
+}
+
+int32_t QAMatcher::edit_distance(const std::string& a, const std::string& b) {
+    std::vector<uint64_t> scratch;
+    return Pattern(a).distance(b.data(), b.size(), scratch);
+}
+
+
+// ============================================================================
+// Entries
+// ============================================================================
+
+int32_t QAMatcher::add(const Entry& entry) {
+    if (m_file.is_open()) return -1;
+    m_added.push_back(entry);
+    m_stale = true;
+    return static_cast<int32_t>(m_added.size() - 1);
+}
+
+const uint8_t* QAMatcher::image() {
+    if (m_file.is_open()) return m_file.data();
+    if (m_stale || m_built.empty()) {
+        m_built = compile(m_added);
+        m_overlap.assign(m_added.size(), 0);
+        m_stale = false;
+    }
+    return m_built.data();
+}
+
+uint32_t QAMatcher::size() const {
+    if (m_file.is_open()) return Bank(m_file.data()).header().n_entries;
+    return static_cast<uint32_t>(m_added.size());
+}
+
+bool QAMatcher::save(const std::string& path, std::string& error) {
+    const uint8_t* data = image();
+    const uint32_t n = Bank(data).header().size;
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+        error = "Cannot write QA bank: " + path;
+        return false;
+    }
+    const bool ok = fwrite(data, 1, n, f) == n;
+    if (fclose(f) != 0 || !ok) {
+        error = "Cannot write QA bank: " + path;
+        return false;
+    }
+    return true;
+}
+
+std::string QAMatcher::stamp() {
+    const Header& h = Bank(image()).header();
+    char text[32];
+    snprintf(text, sizeof(text), "%u-%08x", h.size, h.checksum);
+    return text;
+}
+
+bool QAMatcher::open(const std::string& path, std::string& error) {
+    if (!m_file.open_read_only(path, error)) return false;
+    if (!valid(m_file.data(), m_file.size())) {
+        m_file.close();
+        error = "Not a compiled QA bank, corrupt, or from another version: " + path;
+        return false;
+    }
+    m_added.clear();
+    m_built.clear();
+    m_stale = false;
+    m_overlap.assign(size(), 0);
+    return true;
+}
+
+const char* QAMatcher::text(uint32_t index, Field field) {
+    if (index >= size()) return nullptr;
+    const Bank bank(image());
+    const EntryRecord& r = bank.entry(index);
+    switch (field) {
+        case Field::Id: return bank.text(r.id);
+        case Field::Question: return bank.text(r.question);
+        case Field::Answer: return bank.text(r.answer);
+        case Field::Category: return bank.text(r.category);
+    }
+    return nullptr;
+}
+
+std::vector<const char*> QAMatcher::keywords(uint32_t index) {
+    std::vector<const char*> out;
+    if (index >= size()) return out;
+    const Bank bank(image());
+    const EntryRecord& r = bank.entry(index);
+    const uint32_t* texts = bank.list(r.keywords);
+    for (uint32_t i = 0; i < r.n_keywords; ++i) out.push_back(bank.text(texts[i]));
+    return out;
+}
+
+float QAMatcher::priority(uint32_t index) {
+    if (index >= size()) return 0.0f;
+    return Bank(image()).entry(index).priority;
+}
+
+// ============================================================================
+// Matching
+// ============================================================================
+
+namespace {
+
+// Append the entries of the kMaxCandidates highest ranks to out
+void keep_best(std::vector<std::pair<float, uint32_t>>& ranked, std::vector<uint32_t>& out) {
+    if (ranked.size() > QAMatcher::kMaxCandidates) {
+        std::nth_element(ranked.begin(), ranked.begin() + QAMatcher::kMaxCandidates, ranked.end(),
+                         [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+                             return a.first > b.first;
+                         });
+        ranked.resize(QAMatcher::kMaxCandidates);
+    }
+    for (const auto& r : ranked) out.push_back(r.second);
+}
+
+float keyword_score(const Bank& bank, const std::vector<int64_t>& query_words, const EntryRecord& entry) {
+    if (query_words.empty()) return 0.0f;
+
+    const uint32_t* words = bank.list(entry.words);
+    const uint32_t* keywords = bank.list(entry.keyword_ids);
+    uint32_t matches = 0;
+    uint32_t keyword_matches = 0;
+    for (int64_t id : query_words) {
+        if (contains(words, entry.n_words, id)) ++matches;
+        if (contains(keywords, entry.n_keyword_ids, id)) keyword_matches += 2; // keywords count double
+    }
+
+    const float word_score = static_cast<float>(matches) / static_cast<float>(query_words.size());
+    const float key_score = entry.n_keywords == 0
+                                ? 0.0f
+                                : static_cast<float>(keyword_matches) / static_cast<float>(entry.n_keywords * 2);
+    return word_score * kWordShare + key_score * kKeywordShare;
+}
+
+} // namespace
+
+std::vector<uint32_t> QAMatcher::candidates(const uint8_t* image, const std::string& normalized,
+                                            const std::vector<int64_t>& query_words) {
+    const Bank bank(image);
+    const std::vector<uint32_t> grams = trigrams(normalized);
+    std::vector<const TrigramRecord*> postings;
+    for (uint32_t gram : grams) {
+        const TrigramRecord* r = bank.trigram(gram);
+        if (r != nullptr) postings.push_back(r);
+    }
+
+    // Trigrams most questions share ("how", "what") say little and cost
+    // the most to count, so they are skipped unless nothing else matched
+    const size_t common =
+        std::max(kMaxCandidates, static_cast<size_t>(bank.header().n_entries) / kCommonTrigramShare);
+    const bool any_rare = std::any_of(postings.begin(), postings.end(),
+                                      [&](const TrigramRecord* p) { return p->count <= common; });
+    for (const TrigramRecord* p : postings) {
+        if (any_rare && p->count > common) continue;
+        const uint32_t* entries = bank.list(p->postings);
+        for (uint32_t i = 0; i < p->count; ++i) {
+            if (m_overlap[entries[i]]++ == 0) m_touched.push_back(entries[i]);
+        }
+    }
+
+    // Rank by the share of trigrams in common (Jaccard), so long questions
+    // do not win just by containing more
+    std::vector<std::pair<float, uint32_t>> ranked;
+    ranked.reserve(m_touched.size());
+    for (uint32_t entry : m_touched) {
+        const float shared = static_cast<float>(m_overlap[entry]);
+        const float total = static_cast<float>(grams.size() + bank.entry(entry).n_trigrams) - shared;
+        ranked.emplace_back(shared / total, entry);
+        m_overlap[entry] = 0;
+    }
+    m_touched.clear();
+
+    std::vector<uint32_t> out;
+    keep_best(ranked, out);
+
+    // An entry listing a query word as a keyword scores on it even when
+    // its question shares nothing with the query; the entries listing the
+    // most of them are shortlisted too
+    ranked.clear();
+    for (int64_t id : query_words) {
+        if (id < 0) continue;
+        const WordRecord& word = bank.word(static_cast<uint32_t>(id));
+        const uint32_t* entries = bank.list(word.keyed);
+        for (uint32_t i = 0; i < word.n_keyed; ++i) {
+            if (m_overlap[entries[i]]++ == 0) m_touched.push_back(entries[i]);
+        }
+    }
+    for (uint32_t entry : m_touched) {
+        ranked.emplace_back(static_cast<float>(m_overlap[entry]), entry);
+        m_overlap[entry] = 0;
+    }
+    m_touched.clear();
+    keep_best(ranked, out);
+
+    // Index order, so ties go to the earlier entry as in a full scan
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+QAMatcher::Match QAMatcher::match(const std::string& query) {
+    const uint8_t* data = image();
+    const Bank bank(data);
+    const std::string normalized = normalize(query);
+
+    // Query words as ids; words no entry has can never match
+    std::vector<int64_t> query_words;
+    for (const std::string& word : split_words(normalized)) {
+        query_words.push_back(bank.word(word));
+    }
+
+    const Pattern pattern(normalized);
+    std::vector<uint64_t> scratch;
+
+    Match best;
+    for (uint32_t i : candidates(data, normalized, query_words)) {
+        const EntryRecord& entry = bank.entry(i);
+        const char* question = bank.text(entry.normalized);
+        const uint32_t length = bank.length(entry.normalized);
+
+        float levenshtein;
+        if (normalized.size() == length && memcmp(normalized.data(), question, length) == 0) {
+            levenshtein = 1.0f;
+        } else if (normalized.empty() || length == 0) {
+            levenshtein = 0.0f;
+        } else {
+            const size_t longer = std::max(normalized.size(), static_cast<size_t>(length));
+            levenshtein = 1.0f - static_cast<float>(pattern.distance(question, length, scratch)) /
+                                     static_cast<float>(longer);
+        }
+        const float keyword = keyword_score(bank, query_words, entry);
+
+        const float score = (levenshtein * kLevenshteinWeight + keyword * kKeywordWeight) * entry.priority;
+        if (score > best.score) {
+            best.entry = static_cast<int32_t>(i);
+            best.score = score;
+            best.levenshtein = levenshtein;
+            best.keyword = keyword;
+        }
+    }
+    return best;
+}
+
+} // namespace tutu
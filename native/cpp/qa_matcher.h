@@ -0,0 +1,146 @@
+/**
+ * qa_matcher.h - Fuzzy question matching for the offline QA bank
+ *
+ * Finds the bank question closest to what the user typed, scoring each
+ * one as OfflineQAService always has:
+ *
+ *   score = (0.6 * levenshtein + 0.4 * keyword) * priority
+ *
+ * where levenshtein is 1 - edit distance / longer length over the
+ * normalized texts, and keyword mixes how many query words the question
+ * contains with how many of the entry's keywords the query hits.
+ *
+ * Questions are normalized and split into interned word ids once, when
+ * the bank is compiled. Edit distances use Myers' bit-parallel
+ * algorithm: the query is turned into one bit mask per character per 64
+ * rows, after which every column of the DP table costs a handful of word
+ * operations per 64 query characters instead of one cell update per
+ * character.
+ *
+ * Only a shortlist is scored. A trigram index maps every three-character
+ * run of each question (space padded, so word starts and ends count) to
+ * the entries containing it; the entries sharing the largest fraction of
+ * trigrams with the query are the candidates. A question sharing none
+ * has no word in common with the query, and as every edit breaks at most
+ * three trigrams, it is at least a third of its length away. Its entry
+ * can still score through its keywords, so every word also lists the
+ * entries keyed by it, and the entries keyed by the most query words are
+ * candidates too. Anything else scores 0.4 at most before priority.
+ * Lookups touch only the postings of the query's own trigrams and words,
+ * however large the bank grows.
+ *
+ * Matching always runs on the compiled form of the bank: one flat,
+ * pointer-free image holding the entries' text, the normalized questions,
+ * their word and keyword ids, the sorted word table and the trigram
+ * postings. save() writes it out (tools/qa_bank_compiler does this for
+ * the shipped bank at build time) and open() maps such a file read-only,
+ * so loading the bank parses nothing and its pages are shared with the
+ * page cache. open() checks the checksum and every offset and index
+ * first, so a damaged file is refused rather than read out of bounds.
+ * Entries given to add() are compiled in memory on first use.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace tutu {
+
+class QAMatcher {
+public:
+    struct Match {
+        int32_t entry = -1;  // index in add() order, -1 if nothing scored
+        float score = 0.0f;
+        float levenshtein = 0.0f;
+        float keyword = 0.0f;
+    };
+
+    // An entry as the bank source writes it
+    struct Entry {
+        std::string id;
+        std::string question;
+        std::string answer;
+        std::string category;
+        std::vector<std::string> keywords;
+        float priority = 1.0f;
+    };
+
+    enum class Field { Id, Question, Answer, Category };
+
+    QAMatcher() = default;
+
+    QAMatcher(const QAMatcher&) = delete;
+    QAMatcher& operator=(const QAMatcher&) = delete;
+
+    // Add an entry; returns its index, or -1 if the bank was opened from
+    // a file (those are read-only)
+    int32_t add(const Entry& entry);
+
+    // Write the compiled bank to path
+    bool save(const std::string& path, std::string& error);
+
+    // Map a bank written by save(), replacing any entries added; fails on
+    // a checksum mismatch or any offset outside the file
+    bool open(const std::string& path, std::string& error);
+
+    // Size and checksum of the compiled bank, which identify its contents
+    // (the app compares it to decide whether its copy is current)
+    std::string stamp();
+
+    // Most entries scored per query, picked by trigram overlap
+    static constexpr size_t kMaxCandidates = 64;
+
+    // The best scoring entry for query
+    Match match(const std::string& query);
+
+    uint32_t size() const;
+
+    // Fields of entry index, null if out of range. Pointers stay valid
+    // until the next add().
+    const char* text(uint32_t index, Field field);
+    std::vector<const char*> keywords(uint32_t index);
+    float priority(uint32_t index);
+
+    // Lowercase ASCII letters, drop everything but letters, digits,
+    // underscores and whitespace, and collapse whitespace runs to single
+    // spaces (as the app's Dart normalization does)
+    static std::string normalize(const std::string& text);
+
+    // Levenshtein distance between a and b
+    static int32_t edit_distance(const std::string& a, const std::string& b);
+
+private:
+    // Query compiled for Myers' algorithm: for each 64-row block, a mask
+    // per byte value of the rows holding that byte
+    struct Pattern {
+        std::vector<uint64_t> peq;  // blocks x 256
+        size_t length = 0;
+        size_t blocks = 0;
+
+        explicit Pattern(const std::string& text);
+        int32_t distance(const char* text, size_t n, std::vector<uint64_t>& scratch) const;
+    };
+
+    // The compiled bank: the mapped file, or built from the added entries
+    const uint8_t* image();
+
+    // Entries worth scoring for a normalized query and its word ids, in
+    // index order
+    std::vector<uint32_t> candidates(const uint8_t* image, const std::string& normalized,
+                                     const std::vector<int64_t>& query_words);
+
+    std::vector<Entry> m_added;
+    std::vector<uint8_t> m_built;
+    bool m_stale = false;
+    MappedFile m_file;
+
+    // Shared trigram counts while picking candidates, by entry
+    std::vector<uint32_t> m_overlap;
+    std::vector<uint32_t> m_touched;
+};
+
+} // namespace tutu
@@ -0,0 +1,613 @@
+/**
+ * quants.cpp - ggml block formats, scalar kernels and runtime dispatch
+ */
+
+#include "quants.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "cpu_features.h"
+#include "quants_kernels.h"
+
+namespace tutu {
+
+// ============================================================================
+// Half Precision
+// ============================================================================
+
+namespace {
+
+float fp16_to_fp32_slow(uint16_t h) {
+    const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    uint32_t bits;
+
+    if (exp == 0) {
+        if (mant == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: renormalize
+            exp = 127 - 15 + 1;
+            while ((mant & 0x400) == 0) {
+                mant <<= 1;
+                --exp;
+            }
+            mant &= 0x3FF;
+            bits = sign | (exp << 23) | (mant << 13);
+        }
+    } else if (exp == 0x1F) {
+        bits = sign | 0x7F800000 | (mant << 13);
+    } else {
+        bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Every fp16 value precomputed; 256 KB, filled once at library load
+struct FP16Table {
+    float values[1 << 16];
+    FP16Table() {
+        for (uint32_t i = 0; i < (1u << 16); ++i) {
+            values[i] = fp16_to_fp32_slow(static_cast<uint16_t>(i));
+        }
+    }
+};
+
+const FP16Table g_fp16_table;
+
+} // namespace
+
+float fp16_to_fp32(uint16_t h) {
+    return g_fp16_table.values[h];
+}
+
+uint16_t fp32_to_fp16(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const uint32_t abs = x & 0x7FFFFFFF;
+
+    if (abs >= 0x7F800000) {
+        // Inf / NaN
+        return static_cast<uint16_t>(sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 : 0));
+    }
+    if (abs >= 0x477FF000) {
+        // Overflows to infinity after rounding
+        return static_cast<uint16_t>(sign | 0x7C00);
+    }
+    if (abs < 0x38800000) {
+        // Subnormal or zero in half precision
+        if (abs < 0x33000000) return static_cast<uint16_t>(sign);
+        const uint32_t shift = 113 - (abs >> 23);
+        const uint32_t mant = (abs & 0x7FFFFF) | 0x800000;
+        uint32_t half = mant >> (shift + 13);
+        const uint32_t rem = mant & ((1u << (shift + 13)) - 1);
+        const uint32_t midpoint = 1u << (shift + 12);
+        if (rem > midpoint || (rem == midpoint && (half & 1))) ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+    // Normal: round to nearest even
+    uint32_t half = ((abs - 0x38000000) >> 13);
+    const uint32_t rem = abs & 0x1FFF;
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) ++half;
+    return static_cast<uint16_t>(sign | half);
+}
+
+// ============================================================================
+// Dequantization
+// ============================================================================
+
+namespace {
+
+inline void get_scale_min_k4(int j, const uint8_t* q, uint8_t* d, uint8_t* m) {
+    if (j < 4) {
+        *d = q[j] & 63;
+        *m = q[j + 4] & 63;
+    } else {
+        *d = (q[j + 4] & 0xF) | ((q[j - 4] >> 6) << 4);
+        *m = (q[j + 4] >> 4) | ((q[j] >> 6) << 4);
+    }
+}
+
+void dequantize_q4_0(const block_q4_0* x, float* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i) {
+        const float d = fp16_to_fp32(x[i].d);
+        for (int j = 0; j < QK4_0 / 2; ++j) {
+            y[j] = ((x[i].qs[j] & 0x0F) - 8) * d;
+            y[j + QK4_0 / 2] = ((x[i].qs[j] >> 4) - 8) * d;
+        }
+        y += QK4_0;
+    }
+}
+
+void dequantize_q4_1(const block_q4_1* x, float* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i) {
+        const float d = fp16_to_fp32(x[i].d);
+        const float m = fp16_to_fp32(x[i].m);
+        for (int j = 0; j < QK4_1 / 2; ++j) {
+            y[j] = (x[i].qs[j] & 0x0F) * d + m;
+            y[j + QK4_1 / 2] = (x[i].qs[j] >> 4) * d + m;
+        }
+        y += QK4_1;
+    }
+}
+
+void dequantize_q5_0(const block_q5_0* x, float* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i) {
+        const float d = fp16_to_fp32(x[i].d);
+        uint32_t qh;
+        memcpy(&qh, x[i].qh, sizeof(qh));
+        for (int j = 0; j < QK5_0 / 2; ++j) {
+            const uint8_t xh_0 = ((qh >> j) << 4) & 0x10;
+            const uint8_t xh_1 = ((qh >> (j + 12))) & 0x10;
+            y[j] = (((x[i].qs[j] & 0x0F) | xh_0) - 16) * d;
+            y[j + QK5_0 / 2] = (((x[i].qs[j] >> 4) | xh_1) - 16) * d;
+        }
+        y += QK5_0;
+    }
+}
+
+void dequantize_q5_1(const block_q5_1* x, float* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i) {
+        const float d = fp16_to_fp32(x[i].d);
+        const float m = fp16_to_fp32(x[i].m);
+        uint32_t qh;
+        memcpy(&qh, x[i].qh, sizeof(qh));
+        for (int j = 0; j < QK5_1 / 2; ++j) {
+            const uint8_t xh_0 = ((qh >> j) << 4) & 0x10;
+            const uint8_t xh_1 = ((qh >> (j + 12))) & 0x10;
+            y[j] = ((x[i].qs[j] & 0x0F) | xh_0) * d + m;
+            y[j + QK5_1 / 2] = ((x[i].qs[j] >> 4) | xh_1) * d + m;
+        }
+        y += QK5_1;
+    }
+}
+
+void dequantize_q8_0(const block_q8_0* x, float* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i) {
+        const float d = fp16_to_fp32(x[i].d);
+        for (int j = 0; j < QK8_0; ++j) {
+            y[j] = x[i].qs[j] * d;
+        }
+        y += QK8_0;
+    }
+}
+
+void dequantize_q4_K(const block_q4_K* x, float* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i) {
+        const uint8_t* q = x[i].qs;
+        const float d = fp16_to_fp32(x[i].d);
+        const float min = fp16_to_fp32(x[i].dmin);
+        int is = 0;
+        uint8_t sc, m;
+        for (int j = 0; j < QK_K; j += 64) {
+            get_scale_min_k4(is + 0, x[i].scales, &sc, &m);
+            const float d1 = d * sc;
+            const float m1 = min * m;
+            get_scale_min_k4(is + 1, x[i].scales, &sc, &m);
+            const float d2 = d * sc;
+            const float m2 = min * m;
+            for (int l = 0; l < 32; ++l) *y++ = d1 * (q[l] & 0xF) - m1;
+            for (int l = 0; l < 32; ++l) *y++ = d2 * (q[l] >> 4) - m2;
+            q += 32;
+            is += 2;
+        }
+    }
+}
+
+void dequantize_q5_K(const block_q5_K* x, float* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i) {
+        const uint8_t* ql = x[i].qs;
+        const uint8_t* qh = x[i].qh;
+        const float d = fp16_to_fp32(x[i].d);
+        const float min = fp16_to_fp32(x[i].dmin);
+        int is = 0;
+        uint8_t sc, m;
+        uint8_t u1 = 1, u2 = 2;
+        for (int j = 0; j < QK_K; j += 64) {
+            get_scale_min_k4(is + 0, x[i].scales, &sc, &m);
+            const float d1 = d * sc;
+            const float m1 = min * m;
+            get_scale_min_k4(is + 1, x[i].scales, &sc, &m);
+            const float d2 = d * sc;
+            const float m2 = min * m;
+            for (int l = 0; l < 32; ++l) *y++ = d1 * ((ql[l] & 0xF) + (qh[l] & u1 ? 16 : 0)) - m1;
+            for (int l = 0; l < 32; ++l) *y++ = d2 * ((ql[l] >> 4) + (qh[l] & u2 ? 16 : 0)) - m2;
+            ql += 32;
+            is += 2;
+            u1 <<= 2;
+            u2 <<= 2;
+        }
+    }
+}
+
+void dequantize_q6_K(const block_q6_K* x, float* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i) {
+        const float d = fp16_to_fp32(x[i].d);
+        const uint8_t* ql = x[i].ql;
+        const uint8_t* qh = x[i].qh;
+        const int8_t* sc = x[i].scales;
+        for (int n = 0; n < QK_K; n += 128) {
+            for (int l = 0; l < 32; ++l) {
+                const int is = l / 16;
+                const int8_t q1 = static_cast<int8_t>((ql[l + 0] & 0xF) | (((qh[l] >> 0) & 3) << 4)) - 32;
+                const int8_t q2 = static_cast<int8_t>((ql[l + 32] & 0xF) | (((qh[l] >> 2) & 3) << 4)) - 32;
+                const int8_t q3 = static_cast<int8_t>((ql[l + 0] >> 4) | (((qh[l] >> 4) & 3) << 4)) - 32;
+                const int8_t q4 = static_cast<int8_t>((ql[l + 32] >> 4) | (((qh[l] >> 6) & 3) << 4)) - 32;
+                y[l + 0] = d * sc[is + 0] * q1;
+                y[l + 32] = d * sc[is + 2] * q2;
+                y[l + 64] = d * sc[is + 4] * q3;
+                y[l + 96] = d * sc[is + 6] * q4;
+            }
+            y += 128;
+            ql += 64;
+            qh += 32;
+            sc += 8;
+        }
+    }
+}
+
+} // namespace
+
+bool quant_type_supported(GGMLType type) {
+    switch (type) {
+        case GGMLType::F32:
+        case GGMLType::F16:
+        case GGMLType::BF16:
+        case GGMLType::Q4_0:
+        case GGMLType::Q4_1:
+        case GGMLType::Q5_0:
+        case GGMLType::Q5_1:
+        case GGMLType::Q8_0:
+        case GGMLType::Q4_K:
+        case GGMLType::Q5_K:
+        case GGMLType::Q6_K:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void dequantize_row(GGMLType type, const void* src, float* dst, int64_t n) {
+    switch (type) {
+        case GGMLType::F32:
+            memcpy(dst, src, static_cast<size_t>(n) * sizeof(float));
+            break;
+        case GGMLType::F16: {
+            const uint16_t* s = static_cast<const uint16_t*>(src);
+            for (int64_t i = 0; i < n; ++i) dst[i] = fp16_to_fp32(s[i]);
+            break;
+        }
+        case GGMLType::BF16: {
+            const uint16_t* s = static_cast<const uint16_t*>(src);
+            for (int64_t i = 0; i < n; ++i) {
+                const uint32_t bits = static_cast<uint32_t>(s[i]) << 16;
+                memcpy(&dst[i], &bits, sizeof(float));
+            }
+            break;
+        }
+        case GGMLType::Q4_0: dequantize_q4_0(static_cast<const block_q4_0*>(src), dst, n / QK4_0); break;
+        case GGMLType::Q4_1: dequantize_q4_1(static_cast<const block_q4_1*>(src), dst, n / QK4_1); break;
+        case GGMLType::Q5_0: dequantize_q5_0(static_cast<const block_q5_0*>(src), dst, n / QK5_0); break;
+        case GGMLType::Q5_1: dequantize_q5_1(static_cast<const block_q5_1*>(src), dst, n / QK5_1); break;
+        case GGMLType::Q8_0: dequantize_q8_0(static_cast<const block_q8_0*>(src), dst, n / QK8_0); break;
+        case GGMLType::Q4_K: dequantize_q4_K(static_cast<const block_q4_K*>(src), dst, n / QK_K); break;
+        case GGMLType::Q5_K: dequantize_q5_K(static_cast<const block_q5_K*>(src), dst, n / QK_K); break;
+        case GGMLType::Q6_K: dequantize_q6_K(static_cast<const block_q6_K*>(src), dst, n / QK_K); break;
+        default:
+            memset(dst, 0, static_cast<size_t>(n) * sizeof(float));
+            break;
+    }
+}
+
+// ============================================================================
+// Dot Products
+// ============================================================================
+
+float vec_dot(GGMLType type, const void* row, const float* x, int64_t n) {
+    if (type == GGMLType::F32) {
+        const float* w = static_cast<const float*>(row);
+        float sum = 0.0f;
+        for (int64_t i = 0; i < n; ++i) sum += w[i] * x[i];
+        return sum;
+    }
+
+    // Dequantize one super-block at a time into a stack buffer so the
+    // whole row never has to be materialized.
+    const int64_t block = ggml_block_size(type);
+    const int64_t chunk = block >= QK_K ? block : QK_K;
+    const size_t chunk_bytes = ggml_row_size(type, chunk);
+    const uint8_t* src = static_cast<const uint8_t*>(row);
+    float tmp[QK_K];
+    float sum = 0.0f;
+
+    for (int64_t i = 0; i < n; i += chunk) {
+        const int64_t len = n - i < chunk ? n - i : chunk;
+        dequantize_row(type, src, tmp, len);
+        for (int64_t j = 0; j < len; ++j) sum += tmp[j] * x[i + j];
+        src += chunk_bytes;
+    }
+    return sum;
+}
+
+// ============================================================================
+// Integer Kernels (portable reference)
+// ============================================================================
+
+namespace {
+
+inline int nearest_int(float f) {
+    return static_cast<int>(std::lrintf(f));
+}
+
+void quantize_q8_0_scalar(const float* x, block_q8_0* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i, x += QK8_0) {
+        float amax = 0.0f;
+        for (int j = 0; j < QK8_0; ++j) amax = std::max(amax, std::fabs(x[j]));
+        const float d = amax / 127.0f;
+        const float id = d != 0.0f ? 1.0f / d : 0.0f;
+        y[i].d = fp32_to_fp16(d);
+        for (int j = 0; j < QK8_0; ++j) y[i].qs[j] = static_cast<int8_t>(nearest_int(x[j] * id));
+    }
+}
+
+void quantize_q8_K_scalar(const float* x, block_q8_K* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i, x += QK_K) {
+        // Scale by the signed extreme so it maps exactly to -128
+        float amax = 0.0f;
+        float max = 0.0f;
+        for (int j = 0; j < QK_K; ++j) {
+            const float ax = std::fabs(x[j]);
+            if (ax > amax) {
+                amax = ax;
+                max = x[j];
+            }
+        }
+        if (amax == 0.0f) {
+            memset(&y[i], 0, sizeof(block_q8_K));
+            continue;
+        }
+        const float iscale = -128.0f / max;
+        for (int j = 0; j < QK_K; ++j) {
+            y[i].qs[j] = static_cast<int8_t>(std::min(127, nearest_int(iscale * x[j])));
+        }
+        for (int j = 0; j < QK_K / 16; ++j) {
+            int sum = 0;
+            for (int k = 0; k < 16; ++k) sum += y[i].qs[j * 16 + k];
+            y[i].bsums[j] = static_cast<int16_t>(sum);
+        }
+        y[i].d = 1.0f / iscale;
+    }
+}
+
+float dot_q4_0_q8_0_scalar(const block_q4_0* x, const block_q8_0* y, int64_t nb) {
+    float sum = 0.0f;
+    for (int64_t i = 0; i < nb; ++i) {
+        int sumi = 0;
+        for (int j = 0; j < QK4_0 / 2; ++j) {
+            sumi += ((x[i].qs[j] & 0x0F) - 8) * y[i].qs[j];
+            sumi += ((x[i].qs[j] >> 4) - 8) * y[i].qs[j + QK4_0 / 2];
+        }
+        sum += fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d) * static_cast<float>(sumi);
+    }
+    return sum;
+}
+
+float dot_q5_0_q8_0_scalar(const block_q5_0* x, const block_q8_0* y, int64_t nb) {
+    float sum = 0.0f;
+    for (int64_t i = 0; i < nb; ++i) {
+        uint32_t qh;
+        memcpy(&qh, x[i].qh, sizeof(qh));
+        int sumi = 0;
+        for (int j = 0; j < QK5_0 / 2; ++j) {
+            const int x0 = ((x[i].qs[j] & 0x0F) | (((qh >> j) << 4) & 0x10)) - 16;
+            const int x1 = ((x[i].qs[j] >> 4) | ((qh >> (j + 12)) & 0x10)) - 16;
+            sumi += x0 * y[i].qs[j] + x1 * y[i].qs[j + QK5_0 / 2];
+        }
+        sum += fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d) * static_cast<float>(sumi);
+    }
+    return sum;
+}
+
+float dot_q8_0_q8_0_scalar(const block_q8_0* x, const block_q8_0* y, int64_t nb) {
+    float sum = 0.0f;
+    for (int64_t i = 0; i < nb; ++i) {
+        int sumi = 0;
+        for (int j = 0; j < QK8_0; ++j) sumi += x[i].qs[j] * y[i].qs[j];
+        sum += fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d) * static_cast<float>(sumi);
+    }
+    return sum;
+}
+
+float dot_q4_K_q8_K_scalar(const block_q4_K* x, const block_q8_K* y, int64_t nb) {
+    float sum = 0.0f;
+    for (int64_t i = 0; i < nb; ++i) {
+        uint32_t utmp[4];
+        unpack_q4_K_scales(x[i].scales, utmp);
+        const uint8_t* scales = reinterpret_cast<const uint8_t*>(utmp);
+        const uint8_t* mins = scales + 8;
+
+        const uint8_t* q4 = x[i].qs;
+        const int8_t* q8 = y[i].qs;
+        int sumi = 0;
+        for (int j = 0; j < QK_K / 64; ++j) {
+            int lo = 0;
+            int hi = 0;
+            for (int l = 0; l < 32; ++l) {
+                lo += (q4[l] & 0x0F) * q8[l];
+                hi += (q4[l] >> 4) * q8[l + 32];
+            }
+            sumi += scales[2 * j] * lo + scales[2 * j + 1] * hi;
+            q4 += 32;
+            q8 += 64;
+        }
+
+        int summs = 0;
+        for (int j = 0; j < QK_K / 16; ++j) summs += y[i].bsums[j] * mins[j / 2];
+
+        sum += y[i].d * (fp16_to_fp32(x[i].d) * static_cast<float>(sumi) -
+                         fp16_to_fp32(x[i].dmin) * static_cast<float>(summs));
+    }
+    return sum;
+}
+
+float dot_q6_K_q8_K_scalar(const block_q6_K* x, const block_q8_K* y, int64_t nb) {
+    float sum = 0.0f;
+    for (int64_t i = 0; i < nb; ++i) {
+        const uint8_t* ql = x[i].ql;
+        const uint8_t* qh = x[i].qh;
+        const int8_t* sc = x[i].scales;
+        const int8_t* q8 = y[i].qs;
+        int sumi = 0;
+        for (int n = 0; n < QK_K / 128; ++n) {
+            int s[8] = {};
+            for (int l = 0; l < 32; ++l) {
+                const int is = l / 16;
+                const int q1 = ((ql[l] & 0x0F) | (((qh[l] >> 0) & 3) << 4)) - 32;
+                const int q2 = ((ql[l + 32] & 0x0F) | (((qh[l] >> 2) & 3) << 4)) - 32;
+                const int q3 = ((ql[l] >> 4) | (((qh[l] >> 4) & 3) << 4)) - 32;
+                const int q4 = ((ql[l + 32] >> 4) | (((qh[l] >> 6) & 3) << 4)) - 32;
+                s[is + 0] += q1 * q8[l];
+                s[is + 2] += q2 * q8[l + 32];
+                s[is + 4] += q3 * q8[l + 64];
+                s[is + 6] += q4 * q8[l + 96];
+            }
+            for (int k = 0; k < 8; ++k) sumi += sc[k] * s[k];
+            ql += 64;
+            qh += 32;
+            sc += 8;
+            q8 += 128;
+        }
+        sum += fp16_to_fp32(x[i].d) * y[i].d * static_cast<float>(sumi);
+    }
+    return sum;
+}
+
+const QuantKernels kScalarKernels = {
+    "scalar",
+    quantize_q8_0_scalar,
+    quantize_q8_K_scalar,
+    dot_q4_0_q8_0_scalar,
+    dot_q5_0_q8_0_scalar,
+    dot_q8_0_q8_0_scalar,
+    dot_q4_K_q8_K_scalar,
+    dot_q6_K_q8_K_scalar,
+};
+
+// Best kernel set for the running CPU, chosen on first use
+const QuantKernels& select_kernels() {
+    const CpuFeatures& cpu = cpu_features();
+    const QuantKernels* k = nullptr;
+    if (cpu.avx512f && cpu.avx512bw && cpu.avx2 && cpu.fma) k = quant_kernels_avx512();
+    if (k == nullptr && cpu.avx2 && cpu.fma) k = quant_kernels_avx2();
+    if (k == nullptr && cpu.dotprod) k = quant_kernels_neon_dotprod();
+    if (k == nullptr && cpu.neon) k = quant_kernels_neon();
+    return k != nullptr ? *k : kScalarKernels;
+}
+
+const QuantKernels& kernels() {
+    static const QuantKernels& k = select_kernels();
+    return k;
+}
+
+} // namespace
+
+const QuantKernels* quant_kernels_scalar() {
+    return &kScalarKernels;
+}
+
+const char* quant_kernels_name() {
+    return kernels().name;
+}
+
+GGMLType vec_dot_type(GGMLType type) {
+    switch (type) {
+        case GGMLType::Q4_0:
+        case GGMLType::Q5_0:
+        case GGMLType::Q8_0:
+            return GGMLType::Q8_0;
+        case GGMLType::Q4_K:
+        case GGMLType::Q6_K:
+            return GGMLType::Q8_K;
+        default:
+            return GGMLType::F32;
+    }
+}
+
+void quantize_activations(GGMLType type, const float* x, void* dst, int64_t n) {
+    switch (vec_dot_type(type)) {
+        case GGMLType::Q8_0:
+            kernels().quantize_q8_0(x, static_cast<block_q8_0*>(dst), n / QK8_0);
+            break;
+        case GGMLType::Q8_K:
+            kernels().quantize_q8_K(x, static_cast<block_q8_K*>(dst), n / QK_K);
+            break;
+        default:
+            memcpy(dst, x, static_cast<size_t>(n) * sizeof(float));
+            break;
+    }
+}
+
+bool quantize_row(GGMLType type, const float* x, void* dst, int64_t n) {
+    switch (type) {
+        case GGMLType::F16: {
+            uint16_t* d = static_cast<uint16_t*>(dst);
+            for (int64_t i = 0; i < n; ++i) d[i] = fp32_to_fp16(x[i]);
+            return true;
+        }
+        case GGMLType::Q8_0:
+            kernels().quantize_q8_0(x, static_cast<block_q8_0*>(dst), n / QK8_0);
+            return true;
+        case GGMLType::Q4_0: {
+            // Scale by the signed extreme so it maps exactly to -8
+            block_q4_0* y = static_cast<block_q4_0*>(dst);
+            for (int64_t i = 0; i < n / QK4_0; ++i, x += QK4_0) {
+                float amax = 0.0f;
+                float max = 0.0f;
+                for (int j = 0; j < QK4_0; ++j) {
+                    if (std::fabs(x[j]) > amax) {
+                        amax = std::fabs(x[j]);
+                        max = x[j];
+                    }
+                }
+                const float d = max / -8.0f;
+                const float id = d != 0.0f ? 1.0f / d : 0.0f;
+                y[i].d = fp32_to_fp16(d);
+                for (int j = 0; j < QK4_0 / 2; ++j) {
+                    const int lo = std::min(15, static_cast<int>(x[j] * id + 8.5f));
+                    const int hi = std::min(15, static_cast<int>(x[j + QK4_0 / 2] * id + 8.5f));
+                    y[i].qs[j] = static_cast<uint8_t>(lo | (hi << 4));
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+float vec_dot_q(GGMLType type, const void* row, const void* xq, int64_t n) {
+    const QuantKernels& k = kernels();
+    switch (type) {
+        case GGMLType::Q4_0:
+            return k.dot_q4_0_q8_0(static_cast<const block_q4_0*>(row), static_cast<const block_q8_0*>(xq), n / QK4_0);
+        case GGMLType::Q5_0:
+            return k.dot_q5_0_q8_0(static_cast<const block_q5_0*>(row), static_cast<const block_q8_0*>(xq), n / QK5_0);
+        case GGMLType::Q8_0:
+            return k.dot_q8_0_q8_0(static_cast<const block_q8_0*>(row), static_cast<const block_q8_0*>(xq), n / QK8_0);
+        case GGMLType::Q4_K:
+            return k.dot_q4_K_q8_K(static_cast<const block_q4_K*>(row), static_cast<const block_q8_K*>(xq), n / QK_K);
+        case GGMLType::Q6_K:
+            return k.dot_q6_K_q8_K(static_cast<const block_q6_K*>(row), static_cast<const block_q8_K*>(xq), n / QK_K);
+        default:
+            return vec_dot(type, row, static_cast<const float*>(xq), n);
+    }
+}
+
+} // namespace tutu
@@ -0,0 +1,125 @@
+/**
+ * quants.h - ggml block formats and row kernels
+ *
+ * Block layouts match ggml so GGUF tensor data can be consumed in place.
+ * Kernels operate on a single row: dequantize it, or dot it with a float
+ * activation vector.
+ *
+ * The hot weight formats (Q4_0, Q5_0, Q8_0, Q4_K, Q6_K) also have integer
+ * kernels: the activations are quantized once to Q8_0/Q8_K and every row
+ * is dotted against them with AVX2, AVX-512 or NEON (with or without the
+ * dotprod extension), chosen at runtime from the CPU features.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "gguf.h"
+
+namespace tutu {
+
+constexpr int QK4_0 = 32;
+constexpr int QK4_1 = 32;
+constexpr int QK5_0 = 32;
+constexpr int QK5_1 = 32;
+constexpr int QK8_0 = 32;
+constexpr int QK_K = 256;
+constexpr int K_SCALE_SIZE = 12;
+
+#pragma pack(push, 1)
+struct block_q4_0 {
+    uint16_t d;
+    uint8_t qs[QK4_0 / 2];
+};
+struct block_q4_1 {
+    uint16_t d;
+    uint16_t m;
+    uint8_t qs[QK4_1 / 2];
+};
+struct block_q5_0 {
+    uint16_t d;
+    uint8_t qh[4];
+    uint8_t qs[QK5_0 / 2];
+};
+struct block_q5_1 {
+    uint16_t d;
+    uint16_t m;
+    uint8_t qh[4];
+    uint8_t qs[QK5_1 / 2];
+};
+struct block_q8_0 {
+    uint16_t d;
+    int8_t qs[QK8_0];
+};
+struct block_q4_K {
+    uint16_t d;
+    uint16_t dmin;
+    uint8_t scales[K_SCALE_SIZE];
+    uint8_t qs[QK_K / 2];
+};
+struct block_q5_K {
+    uint16_t d;
+    uint16_t dmin;
+    uint8_t scales[K_SCALE_SIZE];
+    uint8_t qh[QK_K / 8];
+    uint8_t qs[QK_K / 2];
+};
+struct block_q6_K {
+    uint8_t ql[QK_K / 2];
+    uint8_t qh[QK_K / 4];
+    int8_t scales[QK_K / 16];
+    uint16_t d;
+};
+// Activation format for the k-quant kernels; bsums holds the sum of each
+// group of 16 quants
+struct block_q8_K {
+    float d;
+    int8_t qs[QK_K];
+    int16_t bsums[QK_K / 16];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(block_q4_0) == 18, "wrong q4_0 block size");
+static_assert(sizeof(block_q4_1) == 20, "wrong q4_1 block size");
+static_assert(sizeof(block_q5_0) == 22, "wrong q5_0 block size");
+static_assert(sizeof(block_q5_1) == 24, "wrong q5_1 block size");
+static_assert(sizeof(block_q8_0) == 34, "wrong q8_0 block size");
+static_assert(sizeof(block_q4_K) == 144, "wrong q4_K block size");
+static_assert(sizeof(block_q5_K) == 176, "wrong q5_K block size");
+static_assert(sizeof(block_q6_K) == 210, "wrong q6_K block size");
+static_assert(sizeof(block_q8_K) == 292, "wrong q8_K block size");
+
+// Half-precision conversion
+float fp16_to_fp32(uint16_t h);
+uint16_t fp32_to_fp16(float f);
+
+// Whether weights of this type can be used by the kernels below
+bool quant_type_supported(GGMLType type);
+
+// Dequantize n elements (a multiple of the block size) of one row
+void dequantize_row(GGMLType type, const void* src, float* dst, int64_t n);
+
+// Dot product of one quantized row with a float vector of n elements
+float vec_dot(GGMLType type, const void* row, const float* x, int64_t n);
+
+// Format the activations must be in for vec_dot_q with weights of this
+// type: Q8_0 or Q8_K for the integer kernels, F32 for everything else
+GGMLType vec_dot_type(GGMLType type);
+
+// Convert n activations to vec_dot_type(type); dst must hold
+// ggml_row_size(vec_dot_type(type), n) bytes
+void quantize_activations(GGMLType type, const float* x, void* dst, int64_t n);
+
+// Store n floats (a multiple of the block size) as one row of type: F16,
+// Q8_0 or Q4_0. Used for the KV cache; returns false for other types.
+bool quantize_row(GGMLType type, const float* x, void* dst, int64_t n);
+
+// Dot product of one weight row with activations from quantize_activations
+float vec_dot_q(GGMLType type, const void* row, const void* xq, int64_t n);
+
+// Kernel set picked for this CPU ("AVX-512", "AVX2", "NEON dotprod",
+// "NEON" or "scalar")
+const char* quant_kernels_name();
+
+} // namespace tutu
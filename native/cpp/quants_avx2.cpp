@@ -0,0 +1,338 @@
+/**
+ * quants_avx2.cpp - AVX2/FMA integer dot-product kernels
+ *
+ * Built with -mavx2 -mfma on x86; compiles to an empty table elsewhere.
+ */
+
+#include "quants_kernels.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+#include <immintrin.h>
+
+#include <cmath>
+
+namespace tutu {
+
+namespace {
+
+inline float hsum_float_8(__m256 x) {
+    __m128 res = _mm_add_ps(_mm256_extractf128_ps(x, 1), _mm256_castps256_ps128(x));
+    res = _mm_add_ps(res, _mm_movehl_ps(res, res));
+    res = _mm_add_ss(res, _mm_movehdup_ps(res));
+    return _mm_cvtss_f32(res);
+}
+
+inline float hmax_float_8(__m256 x) {
+    __m128 res = _mm_max_ps(_mm256_extractf128_ps(x, 1), _mm256_castps256_ps128(x));
+    res = _mm_max_ps(res, _mm_movehl_ps(res, res));
+    res = _mm_max_ss(res, _mm_movehdup_ps(res));
+    return _mm_cvtss_f32(res);
+}
+
+// Sum of signed int8 products, 4 adjacent pairs per int32 lane, as floats
+inline __m256 mul_sum_i8_pairs_float(__m256i x, __m256i y) {
+    // maddubs needs one unsigned operand: move x's sign onto y
+    const __m256i ax = _mm256_sign_epi8(x, x);
+    const __m256i sy = _mm256_sign_epi8(y, x);
+    const __m256i dot = _mm256_maddubs_epi16(ax, sy);
+    return _mm256_cvtepi32_ps(_mm256_madd_epi16(dot, _mm256_set1_epi16(1)));
+}
+
+// 16 packed bytes -> 32 nibbles: low nibbles first, then high nibbles
+inline __m256i bytes_from_nibbles_32(const uint8_t* p) {
+    const __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m256i bytes = _mm256_set_m128i(_mm_srli_epi16(tmp, 4), tmp);
+    return _mm256_and_si256(bytes, _mm256_set1_epi8(0x0F));
+}
+
+// 32 bits -> 32 bytes, 0xFF where the bit is set
+inline __m256i bytes_from_bits_32(const uint8_t* p) {
+    uint32_t x32;
+    memcpy(&x32, p, sizeof(x32));
+    const __m256i shuf_mask = _mm256_set_epi64x(0x0303030303030303, 0x0202020202020202,
+                                                0x0101010101010101, 0x0000000000000000);
+    __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(x32)), shuf_mask);
+    bytes = _mm256_or_si256(bytes, _mm256_set1_epi64x(0x7fbfdfeff7fbfdfe));
+    return _mm256_cmpeq_epi8(bytes, _mm256_set1_epi64x(-1));
+}
+
+// ============================================================================
+// Activation Quantization
+// ============================================================================
+
+void quantize_q8_0_avx2(const float* x, block_q8_0* y, int64_t nb) {
+    const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+    for (int64_t i = 0; i < nb; ++i, x += QK8_0) {
+        __m256 v0 = _mm256_loadu_ps(x);
+        __m256 v1 = _mm256_loadu_ps(x + 8);
+        __m256 v2 = _mm256_loadu_ps(x + 16);
+        __m256 v3 = _mm256_loadu_ps(x + 24);
+
+        __m256 amax = _mm256_andnot_ps(sign_bit, v0);
+        amax = _mm256_max_ps(amax, _mm256_andnot_ps(sign_bit, v1));
+        amax = _mm256_max_ps(amax, _mm256_andnot_ps(sign_bit, v2));
+        amax = _mm256_max_ps(amax, _mm256_andnot_ps(sign_bit, v3));
+        const float max_scalar = hmax_float_8(amax);
+
+        const float d = max_scalar / 127.0f;
+        y[i].d = fp32_to_fp16(d);
+        const __m256 mul = _mm256_set1_ps(max_scalar != 0.0f ? 127.0f / max_scalar : 0.0f);
+
+        // Round to nearest, then pack 32 int32 -> 32 int8 in order
+        __m256i i0 = _mm256_cvtps_epi32(_mm256_round_ps(_mm256_mul_ps(v0, mul), _MM_ROUND_NEAREST));
+        __m256i i1 = _mm256_cvtps_epi32(_mm256_round_ps(_mm256_mul_ps(v1, mul), _MM_ROUND_NEAREST));
+        __m256i i2 = _mm256_cvtps_epi32(_mm256_round_ps(_mm256_mul_ps(v2, mul), _MM_ROUND_NEAREST));
+        __m256i i3 = _mm256_cvtps_epi32(_mm256_round_ps(_mm256_mul_ps(v3, mul), _MM_ROUND_NEAREST));
+        i0 = _mm256_packs_epi32(i0, i1);
+        i2 = _mm256_packs_epi32(i2, i3);
+        i0 = _mm256_packs_epi16(i0, i2);
+        // The packs interleave 128-bit lanes; restore element order
+        const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        i0 = _mm256_permutevar8x32_epi32(i0, perm);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y[i].qs), i0);
+    }
+}
+
+void quantize_q8_K_avx2(const float* x, block_q8_K* y, int64_t nb) {
+    const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i ones8 = _mm256_set1_epi8(1);
+    const __m256i ones16 = _mm256_set1_epi16(1);
+
+    for (int64_t i = 0; i < nb; ++i, x += QK_K) {
+        // Signed extreme: whichever of max/min has the larger magnitude
+        __m256 vmax = _mm256_loadu_ps(x);
+        __m256 vmin = vmax;
+        for (int j = 8; j < QK_K; j += 8) {
+            const __m256 v = _mm256_loadu_ps(x + j);
+            vmax = _mm256_max_ps(vmax, v);
+            vmin = _mm256_min_ps(vmin, v);
+        }
+        const float hi = hmax_float_8(vmax);
+        const float lo = -hmax_float_8(_mm256_sub_ps(_mm256_setzero_ps(), vmin));
+        const float max = -lo > hi ? lo : hi;
+        if (max == 0.0f) {
+            memset(&y[i], 0, sizeof(block_q8_K));
+            continue;
+        }
+
+        const float iscale = -128.0f / max;
+        const __m256 mul = _mm256_set1_ps(iscale);
+        for (int j = 0; j < QK_K; j += 32) {
+            __m256i i0 = _mm256_cvtps_epi32(_mm256_round_ps(_mm256_mul_ps(_mm256_loadu_ps(x + j), mul), _MM_ROUND_NEAREST));
+            __m256i i1 = _mm256_cvtps_epi32(_mm256_round_ps(_mm256_mul_ps(_mm256_loadu_ps(x + j + 8), mul), _MM_ROUND_NEAREST));
+            __m256i i2 = _mm256_cvtps_epi32(_mm256_round_ps(_mm256_mul_ps(_mm256_loadu_ps(x + j + 16), mul), _MM_ROUND_NEAREST));
+            __m256i i3 = _mm256_cvtps_epi32(_mm256_round_ps(_mm256_mul_ps(_mm256_loadu_ps(x + j + 24), mul), _MM_ROUND_NEAREST));
+            // Saturating packs also clamp +128 to 127
+            i0 = _mm256_packs_epi32(i0, i1);
+            i2 = _mm256_packs_epi32(i2, i3);
+            const __m256i q = _mm256_permutevar8x32_epi32(_mm256_packs_epi16(i0, i2), perm);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(y[i].qs + j), q);
+
+            // Sums of each 16 quants: 4-wide partial sums, then two hadds
+            __m256i s = _mm256_madd_epi16(_mm256_maddubs_epi16(ones8, q), ones16);
+            s = _mm256_hadd_epi32(s, s);
+            s = _mm256_hadd_epi32(s, s);
+            y[i].bsums[j / 16] = static_cast<int16_t>(_mm256_extract_epi32(s, 0));
+            y[i].bsums[j / 16 + 1] = static_cast<int16_t>(_mm256_extract_epi32(s, 4));
+        }
+        y[i].d = 1.0f / iscale;
+    }
+}
+
+// ============================================================================
+// Dot Products
+// ============================================================================
+
+float dot_q4_0_q8_0_avx2(const block_q4_0* x, const block_q8_0* y, int64_t nb) {
+    __m256 acc = _mm256_setzero_ps();
+    const __m256i off = _mm256_set1_epi8(8);
+    for (int64_t i = 0; i < nb; ++i) {
+        const __m256 d = _mm256_set1_ps(fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d));
+        const __m256i qx = _mm256_sub_epi8(bytes_from_nibbles_32(x[i].qs), off);
+        const __m256i qy = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y[i].qs));
+        acc = _mm256_fmadd_ps(d, mul_sum_i8_pairs_float(qx, qy), acc);
+    }
+    return hsum_float_8(acc);
+}
+
+float dot_q5_0_q8_0_avx2(const block_q5_0* x, const block_q8_0* y, int64_t nb) {
+    __m256 acc = _mm256_setzero_ps();
+    const __m256i high_off = _mm256_set1_epi8(static_cast<char>(0xF0));
+    for (int64_t i = 0; i < nb; ++i) {
+        const __m256 d = _mm256_set1_ps(fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d));
+        // nibble | (bit << 4) - 16 == nibble | 0xF0 where the bit is clear
+        __m256i qx = bytes_from_nibbles_32(x[i].qs);
+        const __m256i hi = _mm256_andnot_si256(bytes_from_bits_32(x[i].qh), high_off);
+        qx = _mm256_or_si256(qx, hi);
+        const __m256i qy = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y[i].qs));
+        acc = _mm256_fmadd_ps(d, mul_sum_i8_pairs_float(qx, qy), acc);
+    }
+    return hsum_float_8(acc);
+}
+
+float dot_q8_0_q8_0_avx2(const block_q8_0* x, const block_q8_0* y, int64_t nb) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int64_t i = 0; i < nb; ++i) {
+        const __m256 d = _mm256_set1_ps(fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d));
+        const __m256i qx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x[i].qs));
+        const __m256i qy = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y[i].qs));
+        acc = _mm256_fmadd_ps(d, mul_sum_i8_pairs_float(qx, qy), acc);
+    }
+    return hsum_float_8(acc);
+}
+
+float dot_q4_K_q8_K_avx2(const block_q4_K* x, const block_q8_K* y, int64_t nb) {
+    const __m256i m4 = _mm256_set1_epi8(0x0F);
+    __m256 acc = _mm256_setzero_ps();
+    __m128 acc_m = _mm_setzero_ps();
+
+    for (int64_t i = 0; i < nb; ++i) {
+        const float d = y[i].d * fp16_to_fp32(x[i].d);
+        const float dmin = -y[i].d * fp16_to_fp32(x[i].dmin);
+
+        uint32_t utmp[4];
+        unpack_q4_K_scales(x[i].scales, utmp);
+        const __m256i mins_and_scales = _mm256_cvtepu8_epi16(
+            _mm_set_epi32(static_cast<int>(utmp[3]), static_cast<int>(utmp[2]),
+                          static_cast<int>(utmp[1]), static_cast<int>(utmp[0])));
+
+        // Min correction from the per-16 activation sums
+        const __m256i q8sums = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y[i].bsums));
+        const __m128i q8s = _mm_hadd_epi16(_mm256_extracti128_si256(q8sums, 0),
+                                           _mm256_extracti128_si256(q8sums, 1));
+        const __m128i prod = _mm_madd_epi16(_mm256_extracti128_si256(mins_and_scales, 1), q8s);
+        acc_m = _mm_fmadd_ps(_mm_set1_ps(dmin), _mm_cvtepi32_ps(prod), acc_m);
+
+        const __m128i sc128 = _mm256_extracti128_si256(mins_and_scales, 0);
+        const __m256i scales = _mm256_set_m128i(sc128, sc128);
+
+        const uint8_t* q4 = x[i].qs;
+        const int8_t* q8 = y[i].qs;
+        __m256i sumi = _mm256_setzero_si256();
+        for (int j = 0; j < QK_K / 64; ++j) {
+            // Broadcast the int16 scales of sub-blocks 2j and 2j+1
+            const __m256i scale_l = _mm256_shuffle_epi8(scales, _mm256_set1_epi16(static_cast<short>(((4 * j + 1) << 8) | (4 * j))));
+            const __m256i scale_h = _mm256_shuffle_epi8(scales, _mm256_set1_epi16(static_cast<short>(((4 * j + 3) << 8) | (4 * j + 2))));
+
+            const __m256i q4bits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q4));
+            q4 += 32;
+            const __m256i q4l = _mm256_and_si256(q4bits, m4);
+            const __m256i q4h = _mm256_and_si256(_mm256_srli_epi16(q4bits, 4), m4);
+
+            const __m256i q8l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q8));
+            q8 += 32;
+            const __m256i q8h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q8));
+            q8 += 32;
+
+            const __m256i p16l = _mm256_madd_epi16(scale_l, _mm256_maddubs_epi16(q4l, q8l));
+            const __m256i p16h = _mm256_madd_epi16(scale_h, _mm256_maddubs_epi16(q4h, q8h));
+            sumi = _mm256_add_epi32(sumi, _mm256_add_epi32(p16l, p16h));
+        }
+
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(d), _mm256_cvtepi32_ps(sumi), acc);
+    }
+
+    acc_m = _mm_add_ps(acc_m, _mm_movehl_ps(acc_m, acc_m));
+    acc_m = _mm_add_ss(acc_m, _mm_movehdup_ps(acc_m));
+    return hsum_float_8(acc) + _mm_cvtss_f32(acc_m);
+}
+
+float dot_q6_K_q8_K_avx2(const block_q6_K* x, const block_q8_K* y, int64_t nb) {
+    const __m256i m4 = _mm256_set1_epi8(0x0F);
+    const __m256i m2 = _mm256_set1_epi8(3);
+    const __m256i m32s = _mm256_set1_epi8(32);
+    __m256 acc = _mm256_setzero_ps();
+
+    for (int64_t i = 0; i < nb; ++i) {
+        const float d = y[i].d * fp16_to_fp32(x[i].d);
+        const uint8_t* q4 = x[i].ql;
+        const uint8_t* qh = x[i].qh;
+        const int8_t* q8 = y[i].qs;
+        const __m128i scales = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x[i].scales));
+
+        __m256i sumi = _mm256_setzero_si256();
+        int is = 0;
+        for (int j = 0; j < QK_K / 128; ++j) {
+            const __m256i q4bits_h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qh));
+            qh += 32;
+            const __m256i q4h_0 = _mm256_slli_epi16(_mm256_and_si256(q4bits_h, m2), 4);
+            const __m256i q4h_1 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bits_h, 2), m2), 4);
+            const __m256i q4h_2 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bits_h, 4), m2), 4);
+            const __m256i q4h_3 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bits_h, 6), m2), 4);
+
+            const __m256i q4bits_1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q4));
+            const __m256i q4bits_2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q4 + 32));
+            q4 += 64;
+
+            const __m256i q4_0 = _mm256_or_si256(_mm256_and_si256(q4bits_1, m4), q4h_0);
+            const __m256i q4_1 = _mm256_or_si256(_mm256_and_si256(q4bits_2, m4), q4h_1);
+            const __m256i q4_2 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(q4bits_1, 4), m4), q4h_2);
+            const __m256i q4_3 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(q4bits_2, 4), m4), q4h_3);
+
+            const __m256i q8_0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q8));
+            const __m256i q8_1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q8 + 32));
+            const __m256i q8_2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q8 + 64));
+            const __m256i q8_3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q8 + 96));
+            q8 += 128;
+
+            // (q - 32) * y == q * y - 32 * y, keeping maddubs' first operand unsigned
+            __m256i p16_0 = _mm256_sub_epi16(_mm256_maddubs_epi16(q4_0, q8_0), _mm256_maddubs_epi16(m32s, q8_0));
+            __m256i p16_1 = _mm256_sub_epi16(_mm256_maddubs_epi16(q4_1, q8_1), _mm256_maddubs_epi16(m32s, q8_1));
+            __m256i p16_2 = _mm256_sub_epi16(_mm256_maddubs_epi16(q4_2, q8_2), _mm256_maddubs_epi16(m32s, q8_2));
+            __m256i p16_3 = _mm256_sub_epi16(_mm256_maddubs_epi16(q4_3, q8_3), _mm256_maddubs_epi16(m32s, q8_3));
+
+            // Each 32-wide chunk spans two 16-element scale groups
+            auto scale_pair = [&scales](int k) {
+                const __m128i shuf = _mm_set_epi8(
+                    static_cast<char>(k + 1), static_cast<char>(k + 1), static_cast<char>(k + 1), static_cast<char>(k + 1),
+                    static_cast<char>(k + 1), static_cast<char>(k + 1), static_cast<char>(k + 1), static_cast<char>(k + 1),
+                    static_cast<char>(k), static_cast<char>(k), static_cast<char>(k), static_cast<char>(k),
+                    static_cast<char>(k), static_cast<char>(k), static_cast<char>(k), static_cast<char>(k));
+                return _mm256_cvtepi8_epi16(_mm_shuffle_epi8(scales, shuf));
+            };
+            p16_0 = _mm256_madd_epi16(scale_pair(is + 0), p16_0);
+            p16_1 = _mm256_madd_epi16(scale_pair(is + 2), p16_1);
+            p16_2 = _mm256_madd_epi16(scale_pair(is + 4), p16_2);
+            p16_3 = _mm256_madd_epi16(scale_pair(is + 6), p16_3);
+            is += 8;
+
+            sumi = _mm256_add_epi32(sumi, _mm256_add_epi32(p16_0, p16_1));
+            sumi = _mm256_add_epi32(sumi, _mm256_add_epi32(p16_2, p16_3));
+        }
+
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(d), _mm256_cvtepi32_ps(sumi), acc);
+    }
+    return hsum_float_8(acc);
+}
+
+const QuantKernels kAvx2Kernels = {
+    "AVX2",
+    quantize_q8_0_avx2,
+    quantize_q8_K_avx2,
+    dot_q4_0_q8_0_avx2,
+    dot_q5_0_q8_0_avx2,
+    dot_q8_0_q8_0_avx2,
+    dot_q4_K_q8_K_avx2,
+    dot_q6_K_q8_K_avx2,
+};
+
+} // namespace
+
+const QuantKernels* quant_kernels_avx2() {
+    return &kAvx2Kernels;
+}
+
+} // namespace tutu
+
+#else
+
+namespace tutu {
+
+const QuantKernels* quant_kernels_avx2() {
+    return nullptr;
+}
+
+} // namespace tutu
+
+#endif
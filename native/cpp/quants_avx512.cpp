@@ -0,0 +1,248 @@
+/**
+ * quants_avx512.cpp - AVX-512 (F + BW) integer dot-product kernels
+ *
+ * Processes two Q8_0 blocks or two 64-element Q4_K/Q6_K chunks per
+ * 512-bit step. Activation quantization reuses the AVX2 code, which is
+ * memory-bound either way.
+ */
+
+#include "quants_kernels.h"
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX2__) && defined(__FMA__)
+
+#include <immintrin.h>
+
+namespace tutu {
+
+namespace {
+
+// Signed int8 dot products, 4 adjacent pairs per int32 lane
+inline __m512i mul_sum_i8_pairs(__m512i x, __m512i y) {
+    const __m512i ax = _mm512_abs_epi8(x);
+    const __m512i sy = _mm512_mask_sub_epi8(y, _mm512_movepi8_mask(x), _mm512_setzero_si512(), y);
+    return _mm512_madd_epi16(_mm512_maddubs_epi16(ax, sy), _mm512_set1_epi16(1));
+}
+
+// Two 256-bit halves into one register
+inline __m512i join(__m256i lo, __m256i hi) {
+    return _mm512_mask_broadcast_i64x4(_mm512_castsi256_si512(lo), 0xF0, hi);
+}
+
+inline __m256i load256(const void* p) {
+    return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+}
+
+// Per-block scale for a pair of blocks: low 8 lanes d0, high 8 lanes d1
+inline __m512 scale_pair(float d0, float d1) {
+    return _mm512_mask_blend_ps(0xFF00, _mm512_set1_ps(d0), _mm512_set1_ps(d1));
+}
+
+// 16 packed bytes of each of two blocks -> their 32 nibbles, low first
+inline __m512i nibbles_pair(const uint8_t* a, const uint8_t* b) {
+    const __m128i ta = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    const __m128i tb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    const __m512i bytes = join(_mm256_set_m128i(_mm_srli_epi16(ta, 4), ta),
+                               _mm256_set_m128i(_mm_srli_epi16(tb, 4), tb));
+    return _mm512_and_si512(bytes, _mm512_set1_epi8(0x0F));
+}
+
+// ============================================================================
+// Dot Products
+// ============================================================================
+
+float dot_q4_0_q8_0_avx512(const block_q4_0* x, const block_q8_0* y, int64_t nb) {
+    __m512 acc = _mm512_setzero_ps();
+    const __m512i off = _mm512_set1_epi8(8);
+    int64_t i = 0;
+    for (; i + 1 < nb; i += 2) {
+        const __m512 d = scale_pair(fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d),
+                                    fp16_to_fp32(x[i + 1].d) * fp16_to_fp32(y[i + 1].d));
+        const __m512i qx = _mm512_sub_epi8(nibbles_pair(x[i].qs, x[i + 1].qs), off);
+        const __m512i qy = join(load256(y[i].qs), load256(y[i + 1].qs));
+        acc = _mm512_fmadd_ps(d, _mm512_cvtepi32_ps(mul_sum_i8_pairs(qx, qy)), acc);
+    }
+    float sum = _mm512_reduce_add_ps(acc);
+    if (i < nb) {
+        sum += quant_kernels_avx2()->dot_q4_0_q8_0(x + i, y + i, nb - i);
+    }
+    return sum;
+}
+
+float dot_q5_0_q8_0_avx512(const block_q5_0* x, const block_q8_0* y, int64_t nb) {
+    __m512 acc = _mm512_setzero_ps();
+    const __m512i high_off = _mm512_set1_epi8(static_cast<char>(0xF0));
+    int64_t i = 0;
+    for (; i + 1 < nb; i += 2) {
+        const __m512 d = scale_pair(fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d),
+                                    fp16_to_fp32(x[i + 1].d) * fp16_to_fp32(y[i + 1].d));
+        // Bit k of the 64-bit mask is the 5th bit of quant k
+        uint32_t qh0;
+        uint32_t qh1;
+        memcpy(&qh0, x[i].qh, sizeof(qh0));
+        memcpy(&qh1, x[i + 1].qh, sizeof(qh1));
+        const __mmask64 bits = static_cast<__mmask64>(qh0) | (static_cast<__mmask64>(qh1) << 32);
+        // nibble | (bit << 4) - 16 == nibble | 0xF0 where the bit is clear
+        const __m512i qx = _mm512_or_si512(nibbles_pair(x[i].qs, x[i + 1].qs),
+                                           _mm512_maskz_mov_epi8(~bits, high_off));
+        const __m512i qy = join(load256(y[i].qs), load256(y[i + 1].qs));
+        acc = _mm512_fmadd_ps(d, _mm512_cvtepi32_ps(mul_sum_i8_pairs(qx, qy)), acc);
+    }
+    float sum = _mm512_reduce_add_ps(acc);
+    if (i < nb) {
+        sum += quant_kernels_avx2()->dot_q5_0_q8_0(x + i, y + i, nb - i);
+    }
+    return sum;
+}
+
+float dot_q8_0_q8_0_avx512(const block_q8_0* x, const block_q8_0* y, int64_t nb) {
+    __m512 acc = _mm512_setzero_ps();
+    int64_t i = 0;
+    for (; i + 1 < nb; i += 2) {
+        const __m512 d = scale_pair(fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d),
+                                    fp16_to_fp32(x[i + 1].d) * fp16_to_fp32(y[i + 1].d));
+        const __m512i qx = join(load256(x[i].qs), load256(x[i + 1].qs));
+        const __m512i qy = join(load256(y[i].qs), load256(y[i + 1].qs));
+        acc = _mm512_fmadd_ps(d, _mm512_cvtepi32_ps(mul_sum_i8_pairs(qx, qy)), acc);
+    }
+    float sum = _mm512_reduce_add_ps(acc);
+    if (i < nb) {
+        sum += quant_kernels_avx2()->dot_q8_0_q8_0(x + i, y + i, nb - i);
+    }
+    return sum;
+}
+
+float dot_q4_K_q8_K_avx512(const block_q4_K* x, const block_q8_K* y, int64_t nb) {
+    const __m512i m4 = _mm512_set1_epi8(0x0F);
+    __m512 acc = _mm512_setzero_ps();
+    float summs = 0.0f;
+
+    for (int64_t i = 0; i < nb; ++i) {
+        const float d = y[i].d * fp16_to_fp32(x[i].d);
+        const float dmin = y[i].d * fp16_to_fp32(x[i].dmin);
+
+        uint32_t utmp[4];
+        unpack_q4_K_scales(x[i].scales, utmp);
+        const uint8_t* scales = reinterpret_cast<const uint8_t*>(utmp);
+
+        // Min correction from the per-16 activation sums
+        const __m256i mins = _mm256_cvtepu8_epi16(_mm_set_epi32(0, 0, static_cast<int>(utmp[3]), static_cast<int>(utmp[2])));
+        const __m256i q8sums = load256(y[i].bsums);
+        const __m128i q8s = _mm_hadd_epi16(_mm256_extracti128_si256(q8sums, 0), _mm256_extracti128_si256(q8sums, 1));
+        const __m128i prod = _mm_madd_epi16(_mm256_castsi256_si128(mins), q8s);
+        const __m128i p2 = _mm_add_epi32(prod, _mm_unpackhi_epi64(prod, prod));
+        const int32_t msum = _mm_cvtsi128_si32(_mm_add_epi32(p2, _mm_shuffle_epi32(p2, 1)));
+        summs += dmin * static_cast<float>(msum);
+
+        const uint8_t* q4 = x[i].qs;
+        const int8_t* q8 = y[i].qs;
+        __m512i sumi = _mm512_setzero_si512();
+        // 64 packed bytes = sub-blocks 2j..2j+3 (elements 64j..64j+127)
+        for (int j = 0; j < QK_K / 64; j += 2) {
+            const __m512i q4bits = _mm512_loadu_si512(q4);
+            q4 += 64;
+            const __m512i q4l = _mm512_and_si512(q4bits, m4);
+            const __m512i q4h = _mm512_and_si512(_mm512_srli_epi16(q4bits, 4), m4);
+
+            const __m512i q8l = join(load256(q8), load256(q8 + 64));
+            const __m512i q8h = join(load256(q8 + 32), load256(q8 + 96));
+            q8 += 128;
+
+            const __m512i scale_l = join(_mm256_set1_epi16(scales[2 * j]), _mm256_set1_epi16(scales[2 * j + 2]));
+            const __m512i scale_h = join(_mm256_set1_epi16(scales[2 * j + 1]), _mm256_set1_epi16(scales[2 * j + 3]));
+
+            const __m512i p32l = _mm512_madd_epi16(scale_l, _mm512_maddubs_epi16(q4l, q8l));
+            const __m512i p32h = _mm512_madd_epi16(scale_h, _mm512_maddubs_epi16(q4h, q8h));
+            sumi = _mm512_add_epi32(sumi, _mm512_add_epi32(p32l, p32h));
+        }
+
+        acc = _mm512_fmadd_ps(_mm512_set1_ps(d), _mm512_cvtepi32_ps(sumi), acc);
+    }
+    return _mm512_reduce_add_ps(acc) - summs;
+}
+
+float dot_q6_K_q8_K_avx512(const block_q6_K* x, const block_q8_K* y, int64_t nb) {
+    const __m512i m4 = _mm512_set1_epi8(0x0F);
+    const __m512i m2 = _mm512_set1_epi8(3);
+    const __m512i m32s = _mm512_set1_epi8(32);
+    // High-bit shifts for the two 32-byte halves of each register
+    const __m512i shift_a = join(_mm256_set1_epi16(0), _mm256_set1_epi16(2));
+    const __m512i shift_b = join(_mm256_set1_epi16(4), _mm256_set1_epi16(6));
+    // Lane k of a 64-element chunk belongs to scale group k / 8
+    const __m512i group_a = _mm512_set_epi16(3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,
+                                             1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m512i group_b = _mm512_add_epi16(group_a, _mm512_set1_epi16(4));
+    __m512 acc = _mm512_setzero_ps();
+
+    for (int64_t i = 0; i < nb; ++i) {
+        const float d = y[i].d * fp16_to_fp32(x[i].d);
+        const uint8_t* ql = x[i].ql;
+        const uint8_t* qh = x[i].qh;
+        const int8_t* sc = x[i].scales;
+        const int8_t* q8 = y[i].qs;
+
+        __m512i sumi = _mm512_setzero_si512();
+        for (int j = 0; j < QK_K / 128; ++j) {
+            const __m512i q4bits = _mm512_loadu_si512(ql);
+            const __m256i hbits256 = load256(qh);
+            const __m512i hbits = join(hbits256, hbits256);
+            ql += 64;
+            qh += 32;
+
+            // Elements 0-63 and 64-127 of this half
+            const __m512i h_a = _mm512_slli_epi16(_mm512_and_si512(_mm512_srlv_epi16(hbits, shift_a), m2), 4);
+            const __m512i h_b = _mm512_slli_epi16(_mm512_and_si512(_mm512_srlv_epi16(hbits, shift_b), m2), 4);
+            const __m512i q_a = _mm512_or_si512(_mm512_and_si512(q4bits, m4), h_a);
+            const __m512i q_b = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi16(q4bits, 4), m4), h_b);
+
+            const __m512i q8_a = _mm512_loadu_si512(q8);
+            const __m512i q8_b = _mm512_loadu_si512(q8 + 64);
+            q8 += 128;
+
+            const __m512i p_a = _mm512_sub_epi16(_mm512_maddubs_epi16(q_a, q8_a), _mm512_maddubs_epi16(m32s, q8_a));
+            const __m512i p_b = _mm512_sub_epi16(_mm512_maddubs_epi16(q_b, q8_b), _mm512_maddubs_epi16(m32s, q8_b));
+
+            const __m512i scales = _mm512_castsi128_si512(_mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(sc))));
+            sc += 8;
+            const __m512i scale_a = _mm512_permutexvar_epi16(group_a, scales);
+            const __m512i scale_b = _mm512_permutexvar_epi16(group_b, scales);
+
+            sumi = _mm512_add_epi32(sumi, _mm512_madd_epi16(scale_a, p_a));
+            sumi = _mm512_add_epi32(sumi, _mm512_madd_epi16(scale_b, p_b));
+        }
+
+        acc = _mm512_fmadd_ps(_mm512_set1_ps(d), _mm512_cvtepi32_ps(sumi), acc);
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+
+QuantKernels make_avx512_kernels() {
+    QuantKernels k = *quant_kernels_avx2();
+    k.name = "AVX-512";
+    k.dot_q4_0_q8_0 = dot_q4_0_q8_0_avx512;
+    k.dot_q5_0_q8_0 = dot_q5_0_q8_0_avx512;
+    k.dot_q8_0_q8_0 = dot_q8_0_q8_0_avx512;
+    k.dot_q4_K_q8_K = dot_q4_K_q8_K_avx512;
+    k.dot_q6_K_q8_K = dot_q6_K_q8_K_avx512;
+    return k;
+}
+
+} // namespace
+
+const QuantKernels* quant_kernels_avx512() {
+    static const QuantKernels kernels = make_avx512_kernels();
+    return &kernels;
+}
+
+} // namespace tutu
+
+#else
+
+namespace tutu {
+
+const QuantKernels* quant_kernels_avx512() {
+    return nullptr;
+}
+
+} // namespace tutu
+
+#endif
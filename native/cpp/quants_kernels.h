@@ -0,0 +1,63 @@
+/**
+ * quants_kernels.h - Integer dot-product kernel table (internal)
+ *
+ * Each SIMD flavour lives in its own translation unit compiled with the
+ * matching target flags. A unit built without its instruction set (e.g.
+ * the AVX2 file in an ARM build) returns nullptr from its getter, and
+ * quants.cpp picks the best non-null table the running CPU supports.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "quants.h"
+
+namespace tutu {
+
+struct QuantKernels {
+    const char* name;
+
+    // Activation quantization, nb blocks
+    void (*quantize_q8_0)(const float* x, block_q8_0* y, int64_t nb);
+    void (*quantize_q8_K)(const float* x, block_q8_K* y, int64_t nb);
+
+    // Weight row . quantized activations, nb blocks
+    float (*dot_q4_0_q8_0)(const block_q4_0* x, const block_q8_0* y, int64_t nb);
+    float (*dot_q5_0_q8_0)(const block_q5_0* x, const block_q8_0* y, int64_t nb);
+    float (*dot_q8_0_q8_0)(const block_q8_0* x, const block_q8_0* y, int64_t nb);
+    float (*dot_q4_K_q8_K)(const block_q4_K* x, const block_q8_K* y, int64_t nb);
+    float (*dot_q6_K_q8_K)(const block_q6_K* x, const block_q8_K* y, int64_t nb);
+};
+
+const QuantKernels* quant_kernels_scalar();
+const QuantKernels* quant_kernels_avx2();
+const QuantKernels* quant_kernels_avx512();
+const QuantKernels* quant_kernels_neon();
+const QuantKernels* quant_kernels_neon_dotprod();
+
+// Internal linkage: each kernel unit compiles its own copy with its own
+// target flags, and the linker must not pick one for all of them
+namespace {
+
+// Unpack the 6-bit scales and mins of a Q4_K/Q5_K block: bytes 0-7 of the
+// result are the scales, bytes 8-15 the mins
+inline void unpack_q4_K_scales(const uint8_t* scales, uint32_t utmp[4]) {
+    constexpr uint32_t kmask1 = 0x3f3f3f3f;
+    constexpr uint32_t kmask2 = 0x0f0f0f0f;
+    constexpr uint32_t kmask3 = 0x03030303;
+    uint32_t s[3];
+    memcpy(s, scales, sizeof(s));
+    const uint32_t s0 = s[0];
+    const uint32_t s1 = s[1];
+    const uint32_t s2 = s[2];
+    utmp[0] = s0 & kmask1;
+    utmp[1] = (s2 & kmask2) | (((s0 >> 6) & kmask3) << 4);
+    utmp[2] = s1 & kmask1;
+    utmp[3] = ((s2 >> 4) & kmask2) | (((s1 >> 6) & kmask3) << 4);
+}
+
+} // namespace
+
+} // namespace tutu
@@ -0,0 +1,38 @@
+/**
+ * quants_neon.cpp - Baseline AArch64 NEON integer dot-product kernels
+ *
+ * Widening multiplies only, so this runs on every ARMv8 core. CPUs with
+ * the dot-product extension use quants_neon_dotprod.cpp instead.
+ */
+
+#include "quants_kernels.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+
+#include "quants_neon_impl.h"
+
+namespace tutu {
+
+namespace {
+
+const QuantKernels kNeonKernels = make_neon_kernels("NEON");
+
+} // namespace
+
+const QuantKernels* quant_kernels_neon() {
+    return &kNeonKernels;
+}
+
+} // namespace tutu
+
+#else
+
+namespace tutu {
+
+const QuantKernels* quant_kernels_neon() {
+    return nullptr;
+}
+
+} // namespace tutu
+
+#endif
@@ -0,0 +1,38 @@
+/**
+ * quants_neon_dotprod.cpp - NEON kernels using the SDOT instruction
+ *
+ * Built with -march=armv8.2-a+dotprod on AArch64 and only selected when
+ * the running CPU reports the extension (Cortex-A55/A75 and later).
+ */
+
+#include "quants_kernels.h"
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_DOTPROD)
+
+#include "quants_neon_impl.h"
+
+namespace tutu {
+
+namespace {
+
+const QuantKernels kNeonDotprodKernels = make_neon_kernels("NEON dotprod");
+
+} // namespace
+
+const QuantKernels* quant_kernels_neon_dotprod() {
+    return &kNeonDotprodKernels;
+}
+
+} // namespace tutu
+
+#else
+
+namespace tutu {
+
+const QuantKernels* quant_kernels_neon_dotprod() {
+    return nullptr;
+}
+
+} // namespace tutu
+
+#endif
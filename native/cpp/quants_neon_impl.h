@@ -0,0 +1,238 @@
+/**
+ * quants_neon_impl.h - NEON integer dot-product kernels (internal)
+ *
+ * Shared by quants_neon.cpp and quants_neon_dotprod.cpp. The two units
+ * differ only in the int8 dot primitive, which uses SDOT when the unit is
+ * compiled with +dotprod. Everything here has internal linkage so the two
+ * builds never collide at link time.
+ */
+
+#pragma once
+
+#include <arm_neon.h>
+
+#include "quants_kernels.h"
+
+namespace tutu {
+
+namespace {
+
+// acc + per-lane sums of 4 int8 products
+inline int32x4_t dot_s8(int32x4_t acc, int8x16_t a, int8x16_t b) {
+#if defined(__ARM_FEATURE_DOTPROD)
+    return vdotq_s32(acc, a, b);
+#else
+    const int16x8_t lo = vmull_s8(vget_low_s8(a), vget_low_s8(b));
+    const int16x8_t hi = vmull_s8(vget_high_s8(a), vget_high_s8(b));
+    return vaddq_s32(acc, vaddq_s32(vpaddlq_s16(lo), vpaddlq_s16(hi)));
+#endif
+}
+
+// Round to nearest and narrow 16 floats to int8 with saturation
+inline int8x16_t quantize_16(const float32x4_t* v, float scale) {
+    const int16x8_t lo = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(v[0], scale))),
+                                      vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(v[1], scale))));
+    const int16x8_t hi = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(v[2], scale))),
+                                      vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(v[3], scale))));
+    return vcombine_s8(vqmovn_s16(lo), vqmovn_s16(hi));
+}
+
+// 16 bits -> 16 bytes, 0xFF where the bit is set
+inline uint8x16_t bits_to_bytes(uint32_t bits) {
+    static const uint8_t kBit[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t b = vcombine_u8(vdup_n_u8(static_cast<uint8_t>(bits)),
+                                     vdup_n_u8(static_cast<uint8_t>(bits >> 8)));
+    return vtstq_u8(b, vld1q_u8(kBit));
+}
+
+// ============================================================================
+// Activation Quantization
+// ============================================================================
+
+void quantize_q8_0_neon(const float* x, block_q8_0* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i, x += QK8_0) {
+        float32x4_t v[8];
+        float32x4_t amax = vdupq_n_f32(0.0f);
+        for (int j = 0; j < 8; ++j) {
+            v[j] = vld1q_f32(x + 4 * j);
+            amax = vmaxq_f32(amax, vabsq_f32(v[j]));
+        }
+        const float d = vmaxvq_f32(amax) / 127.0f;
+        const float id = d != 0.0f ? 1.0f / d : 0.0f;
+        y[i].d = fp32_to_fp16(d);
+        vst1q_s8(y[i].qs, quantize_16(v, id));
+        vst1q_s8(y[i].qs + 16, quantize_16(v + 4, id));
+    }
+}
+
+void quantize_q8_K_neon(const float* x, block_q8_K* y, int64_t nb) {
+    for (int64_t i = 0; i < nb; ++i, x += QK_K) {
+        // Scale by the signed extreme so it maps exactly to -128
+        float amax = 0.0f;
+        float max = 0.0f;
+        for (int j = 0; j < QK_K; ++j) {
+            const float ax = x[j] < 0.0f ? -x[j] : x[j];
+            if (ax > amax) {
+                amax = ax;
+                max = x[j];
+            }
+        }
+        if (amax == 0.0f) {
+            memset(&y[i], 0, sizeof(block_q8_K));
+            continue;
+        }
+        const float iscale = -128.0f / max;
+        for (int j = 0; j < QK_K / 16; ++j) {
+            float32x4_t v[4];
+            for (int k = 0; k < 4; ++k) v[k] = vld1q_f32(x + 16 * j + 4 * k);
+            const int8x16_t q = quantize_16(v, iscale);
+            vst1q_s8(y[i].qs + 16 * j, q);
+            y[i].bsums[j] = static_cast<int16_t>(vaddlvq_s8(q));
+        }
+        y[i].d = 1.0f / iscale;
+    }
+}
+
+// ============================================================================
+// Dot Products
+// ============================================================================
+
+float dot_q4_0_q8_0_neon(const block_q4_0* x, const block_q8_0* y, int64_t nb) {
+    const uint8x16_t m4 = vdupq_n_u8(0x0F);
+    const int8x16_t off = vdupq_n_s8(8);
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (int64_t i = 0; i < nb; ++i) {
+        const uint8x16_t v = vld1q_u8(x[i].qs);
+        const int8x16_t lo = vsubq_s8(vreinterpretq_s8_u8(vandq_u8(v, m4)), off);
+        const int8x16_t hi = vsubq_s8(vreinterpretq_s8_u8(vshrq_n_u8(v, 4)), off);
+        int32x4_t p = dot_s8(vdupq_n_s32(0), lo, vld1q_s8(y[i].qs));
+        p = dot_s8(p, hi, vld1q_s8(y[i].qs + 16));
+        acc = vmlaq_n_f32(acc, vcvtq_f32_s32(p), fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d));
+    }
+    return vaddvq_f32(acc);
+}
+
+float dot_q5_0_q8_0_neon(const block_q5_0* x, const block_q8_0* y, int64_t nb) {
+    const uint8x16_t m4 = vdupq_n_u8(0x0F);
+    const uint8x16_t high_off = vdupq_n_u8(0xF0);
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (int64_t i = 0; i < nb; ++i) {
+        uint32_t qh;
+        memcpy(&qh, x[i].qh, sizeof(qh));
+        const uint8x16_t v = vld1q_u8(x[i].qs);
+        // nibble | (bit << 4) - 16 == nibble | 0xF0 where the bit is clear
+        const int8x16_t lo = vreinterpretq_s8_u8(
+            vorrq_u8(vandq_u8(v, m4), vbicq_u8(high_off, bits_to_bytes(qh))));
+        const int8x16_t hi = vreinterpretq_s8_u8(
+            vorrq_u8(vshrq_n_u8(v, 4), vbicq_u8(high_off, bits_to_bytes(qh >> 16))));
+        int32x4_t p = dot_s8(vdupq_n_s32(0), lo, vld1q_s8(y[i].qs));
+        p = dot_s8(p, hi, vld1q_s8(y[i].qs + 16));
+        acc = vmlaq_n_f32(acc, vcvtq_f32_s32(p), fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d));
+    }
+    return vaddvq_f32(acc);
+}
+
+float dot_q8_0_q8_0_neon(const block_q8_0* x, const block_q8_0* y, int64_t nb) {
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (int64_t i = 0; i < nb; ++i) {
+        int32x4_t p = dot_s8(vdupq_n_s32(0), vld1q_s8(x[i].qs), vld1q_s8(y[i].qs));
+        p = dot_s8(p, vld1q_s8(x[i].qs + 16), vld1q_s8(y[i].qs + 16));
+        acc = vmlaq_n_f32(acc, vcvtq_f32_s32(p), fp16_to_fp32(x[i].d) * fp16_to_fp32(y[i].d));
+    }
+    return vaddvq_f32(acc);
+}
+
+float dot_q4_K_q8_K_neon(const block_q4_K* x, const block_q8_K* y, int64_t nb) {
+    const uint8x16_t m4 = vdupq_n_u8(0x0F);
+    float sum = 0.0f;
+    for (int64_t i = 0; i < nb; ++i) {
+        uint32_t utmp[4];
+        unpack_q4_K_scales(x[i].scales, utmp);
+        const uint8_t* scales = reinterpret_cast<const uint8_t*>(utmp);
+
+        // Min correction: pairwise bsums give the 8 sub-block sums
+        const int16x8_t q8sums = vpaddq_s16(vld1q_s16(y[i].bsums), vld1q_s16(y[i].bsums + 8));
+        const int16x8_t mins = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(scales + 8)));
+        const int32x4_t prod = vaddq_s32(vmull_s16(vget_low_s16(q8sums), vget_low_s16(mins)),
+                                         vmull_s16(vget_high_s16(q8sums), vget_high_s16(mins)));
+        const int32_t summs = vaddvq_s32(prod);
+
+        const uint8_t* q4 = x[i].qs;
+        const int8_t* q8 = y[i].qs;
+        int32x4_t sumi = vdupq_n_s32(0);
+        for (int j = 0; j < QK_K / 64; ++j) {
+            const uint8x16_t b0 = vld1q_u8(q4);
+            const uint8x16_t b1 = vld1q_u8(q4 + 16);
+            int32x4_t lo = dot_s8(vdupq_n_s32(0), vreinterpretq_s8_u8(vandq_u8(b0, m4)), vld1q_s8(q8));
+            lo = dot_s8(lo, vreinterpretq_s8_u8(vandq_u8(b1, m4)), vld1q_s8(q8 + 16));
+            int32x4_t hi = dot_s8(vdupq_n_s32(0), vreinterpretq_s8_u8(vshrq_n_u8(b0, 4)), vld1q_s8(q8 + 32));
+            hi = dot_s8(hi, vreinterpretq_s8_u8(vshrq_n_u8(b1, 4)), vld1q_s8(q8 + 48));
+            sumi = vmlaq_n_s32(sumi, lo, scales[2 * j]);
+            sumi = vmlaq_n_s32(sumi, hi, scales[2 * j + 1]);
+            q4 += 32;
+            q8 += 64;
+        }
+
+        sum += y[i].d * (fp16_to_fp32(x[i].d) * static_cast<float>(vaddvq_s32(sumi)) -
+                         fp16_to_fp32(x[i].dmin) * static_cast<float>(summs));
+    }
+    return sum;
+}
+
+float dot_q6_K_q8_K_neon(const block_q6_K* x, const block_q8_K* y, int64_t nb) {
+    const uint8x16_t m4 = vdupq_n_u8(0x0F);
+    const uint8x16_t m3 = vdupq_n_u8(0x03);
+    const int8x16_t m32 = vdupq_n_s8(32);
+    float sum = 0.0f;
+    for (int64_t i = 0; i < nb; ++i) {
+        const uint8_t* ql = x[i].ql;
+        const uint8_t* qh = x[i].qh;
+        const int8_t* sc = x[i].scales;
+        const int8_t* q8 = y[i].qs;
+        int32x4_t sumi = vdupq_n_s32(0);
+        for (int n = 0; n < QK_K / 128; ++n) {
+            // Each half covers 16 elements of each of the four 32-wide groups
+            for (int h = 0; h < 2; ++h) {
+                const uint8x16_t la = vld1q_u8(ql + 16 * h);
+                const uint8x16_t lb = vld1q_u8(ql + 32 + 16 * h);
+                const uint8x16_t hb = vld1q_u8(qh + 16 * h);
+                const int8x16_t q1 = vsubq_s8(vreinterpretq_s8_u8(
+                    vorrq_u8(vandq_u8(la, m4), vshlq_n_u8(vandq_u8(hb, m3), 4))), m32);
+                const int8x16_t q2 = vsubq_s8(vreinterpretq_s8_u8(
+                    vorrq_u8(vandq_u8(lb, m4), vshlq_n_u8(vandq_u8(vshrq_n_u8(hb, 2), m3), 4))), m32);
+                const int8x16_t q3 = vsubq_s8(vreinterpretq_s8_u8(
+                    vorrq_u8(vshrq_n_u8(la, 4), vshlq_n_u8(vandq_u8(vshrq_n_u8(hb, 4), m3), 4))), m32);
+                const int8x16_t q4 = vsubq_s8(vreinterpretq_s8_u8(
+                    vorrq_u8(vshrq_n_u8(lb, 4), vshlq_n_u8(vshrq_n_u8(hb, 6), 4))), m32);
+                const int32x4_t zero = vdupq_n_s32(0);
+                sumi = vmlaq_n_s32(sumi, dot_s8(zero, q1, vld1q_s8(q8 + 16 * h)), sc[h]);
+                sumi = vmlaq_n_s32(sumi, dot_s8(zero, q2, vld1q_s8(q8 + 32 + 16 * h)), sc[2 + h]);
+                sumi = vmlaq_n_s32(sumi, dot_s8(zero, q3, vld1q_s8(q8 + 64 + 16 * h)), sc[4 + h]);
+                sumi = vmlaq_n_s32(sumi, dot_s8(zero, q4, vld1q_s8(q8 + 96 + 16 * h)), sc[6 + h]);
+            }
+            ql += 64;
+            qh += 32;
+            sc += 8;
+            q8 += 128;
+        }
+        sum += fp16_to_fp32(x[i].d) * y[i].d * static_cast<float>(vaddvq_s32(sumi));
+    }
+    return sum;
+}
+
+constexpr QuantKernels make_neon_kernels(const char* name) {
+    return {
+        name,
+        quantize_q8_0_neon,
+        quantize_q8_K_neon,
+        dot_q4_0_q8_0_neon,
+        dot_q5_0_q8_0_neon,
+        dot_q8_0_q8_0_neon,
+        dot_q4_K_q8_K_neon,
+        dot_q6_K_q8_K_neon,
+    };
+}
+
+} // namespace
+
+} // namespace tutu
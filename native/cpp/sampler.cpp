@@ -0,0 +1,213 @@
+/**
+ * sampler.cpp - Token sampling chain for one context
+ */
+
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace tutu {
+
+namespace {
+
+// Logits further than this below the top are outside the top-k histogram
+// (and fall back to a full gather if that leaves fewer than k)
+constexpr float kTopKRange = 64.0f;
+
+// With top-p alone, tokens more than this below the top are dropped:
+// each has under e^-20 of the top token's probability
+constexpr float kTopPRange = 20.0f;
+
+// Index of the largest logit. Several independent running maxima and no
+// data-dependent branches, so the loop pipelines instead of mispredicting.
+int32_t argmax(const float* l, int32_t n) {
+    constexpr int kLanes = 8;
+    float lane[kLanes];
+    // Not l[0]: a NaN there would stick, since no comparison replaces it
+    for (int j = 0; j < kLanes; ++j) lane[j] = -INFINITY;
+    int32_t i = 0;
+    for (; i + kLanes <= n; i += kLanes) {
+        for (int j = 0; j < kLanes; ++j) lane[j] = l[i + j] > lane[j] ? l[i + j] : lane[j];
+    }
+    float max = lane[0];
+    for (int j = 1; j < kLanes; ++j) max = lane[j] > max ? lane[j] : max;
+    for (; i < n; ++i) max = l[i] > max ? l[i] : max;
+
+    for (int32_t k = 0; k < n; ++k) {
+        if (l[k] == max) return k;
+    }
+    return 0; // all NaN
+}
+
+} // namespace
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+void Sampler::configure(const SamplerParams& params, int32_t n_vocab) {
+    m_params = params;
+    m_n_vocab = n_vocab;
+    m_rng.seed(params.seed != 0 ? params.seed : std::random_device{}());
+    m_recent.assign(static_cast<size_t>(std::max(params.repeat_last_n, 0)), 0);
+    m_cand.resize(static_cast<size_t>(n_vocab));
+    m_work.resize(static_cast<size_t>(n_vocab));
+    m_hist.assign(kBuckets + 1, 0);
+    m_mass.assign(kBuckets, 0.0);
+    m_penalized.assign(static_cast<size_t>(n_vocab), 0);
+    m_stamp = 0;
+    reset();
+}
+
+void Sampler::reset() {
+    m_recent_head = 0;
+    m_recent_count = 0;
+}
+
+void Sampler::accept(int32_t token) {
+    if (m_recent.empty()) return;
+    m_recent[m_recent_head] = token;
+    m_recent_head = (m_recent_head + 1) % m_recent.size();
+    m_recent_count = std::min(m_recent_count + 1, m_recent.size());
+}
+
+// ============================================================================
+// Sampling
+// ============================================================================
+
+// Lower bound on the k-th largest logit, from a histogram of the logits
+// near the top. Returns -inf when fewer than k lie in the histogram range.
+float Sampler::top_k_floor(const float* logits, float max_logit, int32_t k) {
+    const float lo = max_logit - kTopKRange;
+    if (!(max_logit > lo)) return lo;
+    const float scale = static_cast<float>(kBuckets) / (max_logit - lo);
+
+    // m_hist[0] collects everything below lo, so the loop needs no branch
+    std::fill(m_hist.begin(), m_hist.end(), 0);
+    for (int32_t i = 0; i < m_n_vocab; ++i) {
+        const float x = std::min(std::max((logits[i] - lo) * scale, -1.0f), kBuckets - 1.0f);
+        ++m_hist[static_cast<int>(x + 1.0f)];
+    }
+
+    int64_t count = 0;
+    for (int b = kBuckets - 1; b >= 0; --b) {
+        count += m_hist[b + 1];
+        if (count >= k) {
+            // Step below the edge so rounding never drops a counted token
+            return lo + static_cast<float>(b) / scale - (max_logit - lo) * 1e-5f;
+        }
+    }
+    return -INFINITY;
+}
+
+// Reorder cand so its first entries are the fewest highest-probability
+// candidates holding top_p of the mass, and return how many. The mass is
+// binned by logit, so only the bin the cut falls in gets sorted.
+int64_t Sampler::top_p_cut(Candidate* cand, int64_t n, float max_logit, float top_p) {
+    float lo = max_logit;
+    for (int64_t i = 0; i < n; ++i) lo = std::min(lo, cand[i].logit);
+    const float scale = max_logit > lo ? static_cast<float>(kBuckets) / (max_logit - lo) : 0.0f;
+    auto bucket = [&](float logit) {
+        return std::min(static_cast<int>((logit - lo) * scale), kBuckets - 1);
+    };
+
+    std::fill(m_mass.begin(), m_mass.end(), 0.0);
+    double total = 0.0;
+    for (int64_t i = 0; i < n; ++i) {
+        const double w = std::exp(static_cast<double>(cand[i].logit - max_logit));
+        m_mass[bucket(cand[i].logit)] += w;
+        total += w;
+    }
+    const double target = static_cast<double>(top_p) * total;
+
+    // Bins above b are kept whole; the cut falls inside bin b
+    double cum = 0.0;
+    int b = kBuckets - 1;
+    for (; b > 0 && cum + m_mass[b] < target; --b) cum += m_mass[b];
+
+    Candidate* mid = std::partition(cand, cand + n, [&](const Candidate& c) { return bucket(c.logit) > b; });
+    Candidate* end = std::partition(mid, cand + n, [&](const Candidate& c) { return bucket(c.logit) == b; });
+    std::sort(mid, end, [](const Candidate& x, const Candidate& y) { return x.logit > y.logit; });
+    for (Candidate* c = mid; c < end; ++c) {
+        cum += std::exp(static_cast<double>(c->logit - max_logit));
+        if (cum >= target) return c - cand + 1;
+    }
+    return end - cand;
+}
+
+int32_t Sampler::sample(const float* logits) {
+    const SamplerParams& p = m_params;
+    const int32_t n_vocab = m_n_vocab;
+
+    // Repetition penalty on a copy, once per distinct recent token
+    const float* l = logits;
+    if (p.repeat_penalty != 1.0f && m_recent_count > 0) {
+        std::copy(logits, logits + n_vocab, m_work.begin());
+        if (++m_stamp == 0) {
+            std::fill(m_penalized.begin(), m_penalized.end(), 0);
+            m_stamp = 1;
+        }
+        for (size_t i = 0; i < m_recent_count; ++i) {
+            const int32_t t = m_recent[i];
+            if (t < 0 || t >= n_vocab || m_penalized[t] == m_stamp) continue;
+            m_penalized[t] = m_stamp;
+            float& v = m_work[t];
+            v = v > 0.0f ? v / p.repeat_penalty : v * p.repeat_penalty;
+        }
+        l = m_work.data();
+    }
+
+    const int32_t best = argmax(l, n_vocab);
+    const float max_logit = l[best];
+    // Without a finite top logit (all NaN or -inf) there is no
+    // distribution to draw from
+    if (p.temperature <= 0.0f || !std::isfinite(max_logit)) return best;
+
+    // Logit floor from the cheap bounds, so only plausible tokens are
+    // gathered. min-p usually leaves a handful, and top-k selects among those.
+    float floor = -INFINITY;
+    if (p.min_p > 0.0f && p.min_p <= 1.0f) {
+        // prob >= min_p * max prob  <=>  logit >= max + log(min_p)
+        floor = max_logit + std::log(p.min_p);
+    } else if (p.top_k > 0 && p.top_k < n_vocab) {
+        floor = top_k_floor(l, max_logit, p.top_k);
+    } else if (p.top_p < 1.0f) {
+        // Tokens this far below the top carry negligible mass
+        floor = max_logit - kTopPRange;
+    }
+
+    Candidate* cand = m_cand.data();
+    int64_t n = 0;
+    for (int32_t i = 0; i < n_vocab; ++i) {
+        // Write unconditionally, keep by advancing: no branch to mispredict
+        cand[n] = {i, l[i]};
+        n += l[i] >= floor;
+    }
+    if (n == 0) return best;
+
+    // top-k: exact selection among the gathered, no sort
+    if (p.top_k > 0 && p.top_k < n) {
+        std::nth_element(cand, cand + p.top_k - 1, cand + n,
+                         [](const Candidate& x, const Candidate& y) { return x.logit > y.logit; });
+        n = p.top_k;
+    }
+
+    if (p.top_p < 1.0f && n > 1) n = top_p_cut(cand, n, max_logit, p.top_p);
+
+    // Temperature and draw
+    const float inv_temp = 1.0f / p.temperature;
+    double sum = 0.0;
+    for (int64_t i = 0; i < n; ++i) {
+        cand[i].logit = std::exp((cand[i].logit - max_logit) * inv_temp);
+        sum += cand[i].logit;
+    }
+    double r = std::uniform_real_distribution<double>(0.0, sum)(m_rng);
+    for (int64_t i = 0; i < n; ++i) {
+        r -= cand[i].logit;
+        if (r < 0.0) return cand[i].id;
+    }
+    return cand[n - 1].id;
+}
+
+} // namespace tutu
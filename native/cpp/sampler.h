@@ -0,0 +1,76 @@
+/**
+ * sampler.h - Token sampling chain for one context
+ *
+ * Applies, in order: repetition penalty over a ring buffer of recent
+ * tokens, min-p, top-k, top-p, then temperature, and draws a token.
+ * Temperature <= 0 picks the highest logit instead (after the penalty).
+ *
+ * The vocabulary is never sorted. min-p (or, without it, top-k via a
+ * histogram) becomes a logit floor, only tokens above it are gathered,
+ * and top-k is then an exact selection (nth_element) among those.
+ * top-p bins the probability mass the same way and sorts only the one
+ * bin its cut falls in.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace tutu {
+
+struct SamplerParams {
+    float temperature = 0.0f;    // <= 0: greedy
+    int32_t top_k = 40;          // <= 0: off
+    float top_p = 0.95f;         // >= 1: off
+    float min_p = 0.05f;         // <= 0: off; relative to the top token
+    float repeat_penalty = 1.0f; // 1: off
+    int32_t repeat_last_n = 64;  // tokens the penalty looks back over
+    uint32_t seed = 0;           // 0: random
+};
+
+class Sampler {
+public:
+    void configure(const SamplerParams& params, int32_t n_vocab);
+    const SamplerParams& params() const { return m_params; }
+
+    // Forget the recent-token history
+    void reset();
+
+    // Record a token (prompt or generated) for the repetition penalty
+    void accept(int32_t token);
+
+    // Pick the next token from n_vocab logits; logits are not modified
+    int32_t sample(const float* logits);
+
+private:
+    struct Candidate {
+        int32_t id;
+        float logit;
+    };
+
+    static constexpr int kBuckets = 256;
+
+    float top_k_floor(const float* logits, float max_logit, int32_t k);
+    int64_t top_p_cut(Candidate* cand, int64_t n, float max_logit, float top_p);
+
+    SamplerParams m_params;
+    int32_t m_n_vocab = 0;
+    std::mt19937 m_rng;
+
+    // Ring buffer of the last repeat_last_n tokens
+    std::vector<int32_t> m_recent;
+    size_t m_recent_head = 0;
+    size_t m_recent_count = 0;
+
+    // Scratch, sized once per vocabulary
+    std::vector<Candidate> m_cand;
+    std::vector<float> m_work;         // penalized logits
+    std::vector<uint32_t> m_hist;      // top-k histogram
+    std::vector<double> m_mass;        // top-p histogram
+    std::vector<uint32_t> m_penalized; // stamp per token id, dedups the ring
+    uint32_t m_stamp = 0;
+};
+
+} // namespace tutu
@@ -0,0 +1,215 @@
+/**
+ * thread_pool.cpp - Persistent worker pool for the forward pass
+ */
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <system_error>
+#include <utility>
+
+#include "cpu_topology.h"
+
+namespace tutu {
+
+namespace {
+
+// How long an idle worker polls for the next job before sleeping. Covers
+// the gaps between matmuls within a token, not the pause between tokens.
+constexpr auto kSpinTime = std::chrono::microseconds(200);
+
+// Chunks dealt to each thread up front; more gives stealing finer grain
+constexpr int64_t kChunksPerThread = 4;
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+inline uint64_t pack(uint32_t begin, uint32_t end) {
+    return (static_cast<uint64_t>(end) << 32) | begin;
+}
+
+inline uint32_t range_begin(uint64_t r) {
+    return static_cast<uint32_t>(r);
+}
+
+inline uint32_t range_end(uint64_t r) {
+    return static_cast<uint32_t>(r >> 32);
+}
+
+// Pool whose job this thread is running chunks of, if any. A nested
+// parallel_for on it must not wait for the job it is part of.
+thread_local const ThreadPool* t_current_pool = nullptr;
+
+class CurrentPool {
+public:
+    explicit CurrentPool(const ThreadPool* pool) : m_previous(t_current_pool) { t_current_pool = pool; }
+    ~CurrentPool() { t_current_pool = m_previous; }
+    CurrentPool(const CurrentPool&) = delete;
+    CurrentPool& operator=(const CurrentPool&) = delete;
+
+private:
+    const ThreadPool* m_previous;
+};
+
+} // namespace
+
+// ============================================================================
+// Lifecycle
+// ============================================================================
+
+ThreadPool::ThreadPool(int n_threads, std::vector<int> cpus) : m_cpus(std::move(cpus)) {
+    const int hw = static_cast<int>(std::thread::hardware_concurrency());
+    if (hw > 0) n_threads = std::min(n_threads, hw);
+    n_threads = std::max(n_threads, 1);
+
+    m_slots.reset(new Slot[n_threads]);
+    m_workers.reserve(n_threads - 1);
+    for (int i = 1; i < n_threads; ++i) {
+        try {
+            m_workers.emplace_back(&ThreadPool::worker_main, this, i);
+        } catch (const std::system_error&) {
+            // Run with the threads we did get
+            break;
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop.store(true);
+    }
+    m_cv.notify_all();
+    for (std::thread& t : m_workers) t.join();
+}
+
+// ============================================================================
+// Jobs
+// ============================================================================
+
+void ThreadPool::run(int64_t n, int64_t min_chunk, RangeTask task, void* arg) {
+    if (n <= 0) return;
+    min_chunk = std::max<int64_t>(min_chunk, 1);
+    // Called from inside one of our own jobs: every thread is busy with
+    // it, so run the range here
+    if (m_workers.empty() || n <= min_chunk || t_current_pool == this) {
+        task(arg, 0, n);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(m_submit);
+    const int n_threads = size();
+    const int64_t target = n_threads * kChunksPerThread;
+    m_chunk = std::max(min_chunk, (n + target - 1) / target);
+    m_n = n;
+    m_task = task;
+    m_arg = arg;
+
+    const int64_t n_chunks = (n + m_chunk - 1) / m_chunk;
+    for (int i = 0; i < n_threads; ++i) {
+        const uint32_t begin = static_cast<uint32_t>(n_chunks * i / n_threads);
+        const uint32_t end = static_cast<uint32_t>(n_chunks * (i + 1) / n_threads);
+        m_slots[i].range.store(pack(begin, end), std::memory_order_relaxed);
+    }
+    m_pending.store(static_cast<int>(m_workers.size()), std::memory_order_relaxed);
+
+    // Publish; the epoch bump releases the job fields above
+    m_epoch.fetch_add(1);
+    if (m_sleeping.load() > 0) {
+        { std::lock_guard<std::mutex> lock(m_mutex); }
+        m_cv.notify_all();
+    }
+
+    {
+        const CurrentPool current(this);
+        run_chunks(0);
+    }
+
+    // Every chunk is claimed; wait for the workers still running theirs
+    while (m_pending.load(std::memory_order_acquire) != 0) cpu_relax();
+}
+
+void ThreadPool::worker_main(int id) {
+    if (!m_cpus.empty()) pin_current_thread(m_cpus);
+    // Workers only ever run this pool's jobs
+    const CurrentPool current(this);
+
+    uint64_t seen = 0;
+    for (;;) {
+        auto spin_start = std::chrono::steady_clock::now();
+        int spins = 0;
+        uint64_t epoch;
+        while ((epoch = m_epoch.load(std::memory_order_acquire)) == seen) {
+            if (m_stop.load(std::memory_order_relaxed)) return;
+            cpu_relax();
+            // Check the clock only now and then; it is not free either
+            if ((++spins & 63) != 0 || std::chrono::steady_clock::now() - spin_start < kSpinTime) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_sleeping.fetch_add(1);
+            m_cv.wait(lock, [&] { return m_epoch.load() != seen || m_stop.load(); });
+            m_sleeping.fetch_sub(1);
+            spin_start = std::chrono::steady_clock::now();
+        }
+        seen = epoch;
+
+        run_chunks(id);
+        m_pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void ThreadPool::run_chunks(int id) {
+    for (;;) {
+        const int64_t chunk = pop(id);
+        if (chunk < 0) {
+            if (!steal(id)) return;
+            continue;
+        }
+        const int64_t begin = chunk * m_chunk;
+        m_task(m_arg, begin, std::min(m_n, begin + m_chunk));
+    }
+}
+
+// Take the next chunk from the front of our own range
+int64_t ThreadPool::pop(int id) {
+    std::atomic<uint64_t>& range = m_slots[id].range;
+    uint64_t r = range.load(std::memory_order_relaxed);
+    for (;;) {
+        const uint32_t begin = range_begin(r);
+        const uint32_t end = range_end(r);
+        if (begin >= end) return -1;
+        if (range.compare_exchange_weak(r, pack(begin + 1, end), std::memory_order_relaxed)) {
+            return begin;
+        }
+    }
+}
+
+// Move the back half of another thread's range into our own (empty) one
+bool ThreadPool::steal(int id) {
+    const int n_threads = size();
+    for (int k = 1; k < n_threads; ++k) {
+        std::atomic<uint64_t>& victim = m_slots[(id + k) % n_threads].range;
+        uint64_t r = victim.load(std::memory_order_relaxed);
+        for (;;) {
+            const uint32_t begin = range_begin(r);
+            const uint32_t end = range_end(r);
+            if (begin >= end) break;
+            const uint32_t mid = begin + (end - begin) / 2;
+            if (victim.compare_exchange_weak(r, pack(begin, mid), std::memory_order_relaxed)) {
+                // Nobody steals from an empty range, so a plain store is safe
+                m_slots[id].range.store(pack(mid, end), std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace tutu
@@ -0,0 +1,91 @@
+/**
+ * thread_pool.h - Persistent worker pool for the forward pass
+ *
+ * Created once per model and shared by its contexts. parallel_for splits
+ * a range into chunks, deals them out evenly, and lets workers that run
+ * dry steal half of another worker's remaining chunks, so a slow core
+ * never holds up the rest. The calling thread works too.
+ *
+ * Between jobs workers spin for a short while before sleeping. Back-to-back
+ * matmuls inside a token then never pay a wake-up, while an idle pool
+ * costs no CPU.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace tutu {
+
+class ThreadPool {
+public:
+    // n_threads counts the calling thread; values below 1 mean 1. Capped
+    // at the number of hardware threads, since spinning workers that
+    // share a core only slow each other down. Workers are pinned to cpus
+    // when given; the calling thread is left alone.
+    explicit ThreadPool(int n_threads, std::vector<int> cpus = {});
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Threads taking part in each job, including the caller
+    int size() const { return static_cast<int>(m_workers.size()) + 1; }
+
+    // Cores the workers are pinned to; empty when unpinned
+    const std::vector<int>& cpus() const { return m_cpus; }
+
+    // Call fn(begin, end) over disjoint sub-ranges covering [0, n), in
+    // parallel, and return once all of them are done. Ranges are at
+    // least min_chunk long (except the last). Jobs from different threads
+    // are serialized; a call from inside a job of this pool runs the whole
+    // range on the calling thread.
+    template <typename Fn>
+    void parallel_for(int64_t n, int64_t min_chunk, Fn&& fn) {
+        using F = typename std::remove_reference<Fn>::type;
+        run(n, min_chunk, [](void* f, int64_t begin, int64_t end) { (*static_cast<F*>(f))(begin, end); },
+            const_cast<void*>(static_cast<const void*>(&fn)));
+    }
+
+private:
+    using RangeTask = void (*)(void* arg, int64_t begin, int64_t end);
+
+    // Chunk indices [begin, end) still owned by one thread, packed as
+    // (end << 32) | begin so owner and thieves update it with one CAS
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> range{0};
+    };
+
+    void run(int64_t n, int64_t min_chunk, RangeTask task, void* arg);
+    void worker_main(int id);
+    void run_chunks(int id);
+    int64_t pop(int id);
+    bool steal(int id);
+
+    std::vector<std::thread> m_workers;
+    std::vector<int> m_cpus;
+    std::unique_ptr<Slot[]> m_slots;
+
+    // Current job
+    RangeTask m_task = nullptr;
+    void* m_arg = nullptr;
+    int64_t m_n = 0;
+    int64_t m_chunk = 0;
+
+    std::mutex m_submit;                // one job at a time
+    std::atomic<uint64_t> m_epoch{0};   // bumped to publish a job
+    std::atomic<int> m_pending{0};      // workers yet to finish the job
+    std::atomic<int> m_sleeping{0};
+    std::atomic<bool> m_stop{false};
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+} // namespace tutu
@@ -0,0 +1,558 @@
+/**
+ * tokenizer.cpp - Byte-level BPE tokenizer loaded from GGUF vocab metadata
+ */
+
+#include "tokenizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+namespace tutu {
+
+// ============================================================================
+// Unicode Helpers
+// ============================================================================
+
+namespace {
+
+void utf8_append(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Length of the UTF-8 sequence starting with byte c (1 for invalid bytes)
+size_t utf8_len(unsigned char c) {
+    if (c < 0x80) return 1;
+    if ((c & 0xE0) == 0xC0) return 2;
+    if ((c & 0xF0) == 0xE0) return 3;
+    if ((c & 0xF8) == 0xF0) return 4;
+    return 1;
+}
+
+// Decode text into code points; invalid bytes decode as themselves.
+// offsets[k] is the byte offset of code point k, plus a final entry for n.
+void utf8_decode(const char* s, size_t n, std::vector<uint32_t>& cps, std::vector<uint32_t>& offsets) {
+    cps.clear();
+    offsets.clear();
+    size_t i = 0;
+    while (i < n) {
+        const unsigned char c = static_cast<unsigned char>(s[i]);
+        size_t len = utf8_len(c);
+        if (i + len > n) len = 1;
+        uint32_t cp = c;
+        if (len > 1) {
+            cp = c & (0xFF >> (len + 1));
+            for (size_t k = 1; k < len; ++k) {
+                const unsigned char cc = static_cast<unsigned char>(s[i + k]);
+                if ((cc & 0xC0) != 0x80) {
+                    cp = c;
+                    len = 1;
+                    break;
+                }
+                cp = (cp << 6) | (cc & 0x3F);
+            }
+        }
+        cps.push_back(cp);
+        offsets.push_back(static_cast<uint32_t>(i));
+        i += len;
+    }
+    offsets.push_back(static_cast<uint32_t>(n));
+}
+
+std::vector<uint32_t> utf8_decode(const std::string& s) {
+    std::vector<uint32_t> cps;
+    std::vector<uint32_t> offsets;
+    utf8_decode(s.data(), s.size(), cps, offsets);
+    return cps;
+}
+
+// GPT-2 byte <-> printable code point mapping
+struct ByteMap {
+    uint32_t byte_to_cp[256];
+    std::unordered_map<uint32_t, uint8_t> cp_to_byte;
+
+    ByteMap() {
+        int n = 0;
+        for (int b = 0; b < 256; ++b) {
+            const bool printable = (b >= '!' && b <= '~') || (b >= 0xA1 && b <= 0xAC) || (b >= 0xAE && b <= 0xFF);
+            byte_to_cp[b] = printable ? static_cast<uint32_t>(b) : static_cast<uint32_t>(256 + n++);
+            cp_to_byte[byte_to_cp[b]] = static_cast<uint8_t>(b);
+        }
+    }
+};
+
+const ByteMap& byte_map() {
+    static const ByteMap map;
+    return map;
+}
+
+// Approximate Unicode categories. Latin, Greek, Cyrillic, CJK and the other
+// alphabetic blocks count as letters; the punctuation, symbol, mark and
+// emoji blocks below do not.
+bool is_space(uint32_t cp) {
+    return (cp >= 0x09 && cp <= 0x0D) || cp == 0x20 || cp == 0x85 || cp == 0xA0 ||
+           cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200A) || cp == 0x2028 ||
+           cp == 0x2029 || cp == 0x202F || cp == 0x205F || cp == 0x3000;
+}
+
+bool is_digit(uint32_t cp) {
+    return (cp >= '0' && cp <= '9') || (cp >= 0x0660 && cp <= 0x0669) ||
+           (cp >= 0x06F0 && cp <= 0x06F9) || (cp >= 0x0966 && cp <= 0x096F) ||
+           (cp >= 0xFF10 && cp <= 0xFF19);
+}
+
+bool is_letter(uint32_t cp) {
+    if (cp < 0x80) {
+        return (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z');
+    }
+    if (is_space(cp) || is_digit(cp)) return false;
+    if (cp <= 0xBF) return cp == 0xAA || cp == 0xB5 || cp == 0xBA;
+    if (cp == 0xD7 || cp == 0xF7) return false;
+    if (cp >= 0x0300 && cp <= 0x036F) return false;  // combining marks
+    if (cp >= 0x2000 && cp <= 0x2BFF) return false;  // punctuation, symbols, arrows
+    if (cp >= 0x3000 && cp <= 0x303F) return false;  // CJK punctuation
+    if (cp >= 0xE000 && cp <= 0xF8FF) return false;  // private use
+    if (cp >= 0xFE00 && cp <= 0xFE4F) return false;  // variation selectors, CJK compat
+    if ((cp >= 0xFF00 && cp <= 0xFF0F) || (cp >= 0xFF1A && cp <= 0xFF20) ||
+        (cp >= 0xFF3B && cp <= 0xFF40) || (cp >= 0xFF5B && cp <= 0xFF65)) return false;
+    if (cp >= 0x1F000 && cp <= 0x1FAFF) return false; // emoji
+    return true;
+}
+
+// Pre-tokenize one fragment following the SmolLM2 rules:
+//   \p{N}  then  's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+
+// Emits [start, end) code point ranges.
+void pretokenize(const std::vector<uint32_t>& cps, std::vector<std::pair<size_t, size_t>>& words) {
+    const size_t n = cps.size();
+    auto is_other = [](uint32_t cp) { return !is_space(cp) && !is_letter(cp) && !is_digit(cp); };
+
+    // Digits are always split first, so each segment between digits is
+    // matched independently and a space never attaches to a digit.
+    size_t seg_start = 0;
+    while (seg_start < n) {
+        if (is_digit(cps[seg_start])) {
+            words.emplace_back(seg_start, seg_start + 1);
+            ++seg_start;
+            continue;
+        }
+        size_t seg_end = seg_start;
+        while (seg_end < n && !is_digit(cps[seg_end])) ++seg_end;
+
+        size_t pos = seg_start;
+        while (pos < seg_end) {
+            const uint32_t c = cps[pos];
+
+            // Contractions
+            if (c == '\'' && pos + 1 < seg_end) {
+                const uint32_t c1 = cps[pos + 1];
+                if (c1 == 's' || c1 == 't' || c1 == 'm' || c1 == 'd') {
+                    words.emplace_back(pos, pos + 2);
+                    pos += 2;
+                    continue;
+                }
+                if (pos + 2 < seg_end) {
+                    const uint32_t c2 = cps[pos + 2];
+                    if ((c1 == 'r' && c2 == 'e') || (c1 == 'v' && c2 == 'e') || (c1 == 'l' && c2 == 'l')) {
+                        words.emplace_back(pos, pos + 3);
+                        pos += 3;
+                        continue;
+                    }
+                }
+            }
+
+            // Optional leading space, then a run of one class
+            size_t p = pos;
+            if (c == ' ' && p + 1 < seg_end && !is_space(cps[p + 1])) ++p;
+            if (is_letter(cps[p])) {
+                while (p < seg_end && is_letter(cps[p])) ++p;
+                words.emplace_back(pos, p);
+                pos = p;
+                continue;
+            }
+            if (is_other(cps[p])) {
+                while (p < seg_end && is_other(cps[p])) ++p;
+                words.emplace_back(pos, p);
+                pos = p;
+                continue;
+            }
+
+            // Whitespace: leave the last space to prefix the next word
+            p = pos;
+            while (p < seg_end && is_space(cps[p])) ++p;
+            if (p < seg_end && p - pos > 1) --p;
+            if (p == pos) ++p;
+            words.emplace_back(pos, p);
+            pos = p;
+        }
+        seg_start = seg_end;
+    }
+}
+
+} // namespace
+
+// ============================================================================
+// Loading
+// ============================================================================
+
+bool Tokenizer::load(const GGUFFile& file, std::string& error) {
+    clear();
+
+    std::string model;
+    if (!file.get_str("tokenizer.ggml.model", model) || model != "gpt2") {
+        error = "Unsupported tokenizer model: " + (model.empty() ? std::string("none") : model);
+        return false;
+    }
+
+    const GGUFValue* tokens = file.find("tokenizer.ggml.tokens");
+    if (tokens == nullptr || tokens->array_type != GGUFValueType::STRING || tokens->array_len == 0) {
+        error = "Model has no tokenizer vocabulary";
+        return false;
+    }
+    const size_t n_vocab = tokens->array_str.size();
+
+    // Only needed while loading; encoding works on ids
+    std::unordered_map<std::string, int32_t> token_to_id;
+    m_tokens.reserve(n_vocab);
+    token_to_id.reserve(n_vocab);
+    for (size_t i = 0; i < n_vocab; ++i) {
+        m_tokens.emplace_back(tokens->array_str[i]);
+        token_to_id.emplace(m_tokens.back(), static_cast<int32_t>(i));
+    }
+
+    m_types.assign(n_vocab, TokenType::NORMAL);
+    const GGUFValue* types = file.find("tokenizer.ggml.token_type");
+    if (types != nullptr && types->array_type == GGUFValueType::INT32 && types->array_len == n_vocab) {
+        const uint8_t* p = static_cast<const uint8_t*>(types->array_data);
+        for (size_t i = 0; i < n_vocab; ++i) {
+            int32_t t;
+            memcpy(&t, p + i * sizeof(int32_t), sizeof(t));
+            m_types[i] = static_cast<TokenType>(t);
+        }
+    }
+
+    const GGUFValue* merges = file.find("tokenizer.ggml.merges");
+    if (merges == nullptr || merges->array_type != GGUFValueType::STRING) {
+        error = "Model has no BPE merges";
+        return false;
+    }
+    // Resolve "left right" merge strings to (left id, right id) -> merged id
+    const size_t n_merges = merges->array_str.size();
+    std::vector<std::pair<int32_t, int32_t>> pairs(n_merges, {-1, -1});
+    std::vector<int32_t> results(n_merges, -1);
+    std::string merged;
+    for (size_t i = 0; i < n_merges; ++i) {
+        const std::string_view m = merges->array_str[i];
+        const size_t sep = m.find(' ', 1);
+        if (sep == std::string_view::npos) continue;
+        auto left = token_to_id.find(std::string(m.substr(0, sep)));
+        auto right = token_to_id.find(std::string(m.substr(sep + 1)));
+        merged.assign(m.data(), sep);
+        merged.append(m.data() + sep + 1, m.size() - sep - 1);
+        auto result = token_to_id.find(merged);
+        if (left == token_to_id.end() || right == token_to_id.end() || result == token_to_id.end()) continue;
+        pairs[i] = {left->second, right->second};
+        results[i] = result->second;
+    }
+    build_merges(pairs, results);
+
+    // Decoded bytes for every token
+    const ByteMap& bm = byte_map();
+    m_pieces.resize(n_vocab);
+    for (size_t i = 0; i < n_vocab; ++i) {
+        switch (m_types[i]) {
+            case TokenType::CONTROL:
+                break;
+            case TokenType::USER_DEFINED:
+                m_pieces[i] = m_tokens[i];
+                break;
+            default:
+                for (uint32_t cp : utf8_decode(m_tokens[i])) {
+                    auto it = bm.cp_to_byte.find(cp);
+                    if (it != bm.cp_to_byte.end()) {
+                        m_pieces[i] += static_cast<char>(it->second);
+                    } else {
+                        utf8_append(m_pieces[i], cp);
+                    }
+                }
+                break;
+        }
+    }
+
+    // Single-byte fallback tokens
+    for (int b = 0; b < 256; ++b) {
+        std::string s;
+        utf8_append(s, bm.byte_to_cp[b]);
+        auto it = token_to_id.find(s);
+        m_byte_tokens[b] = it != token_to_id.end() ? it->second : -1;
+    }
+
+    // Special tokens, bucketed by first byte and matched longest first
+    for (size_t i = 0; i < n_vocab; ++i) {
+        if (m_types[i] == TokenType::CONTROL || m_types[i] == TokenType::USER_DEFINED) {
+            if (m_tokens[i].empty()) continue;
+            m_special_by_byte[static_cast<unsigned char>(m_tokens[i][0])].push_back(static_cast<int32_t>(i));
+            m_has_special = true;
+        }
+    }
+    for (std::vector<int32_t>& bucket : m_special_by_byte) {
+        std::sort(bucket.begin(), bucket.end(), [this](int32_t a, int32_t b) {
+            return m_tokens[a].size() > m_tokens[b].size();
+        });
+    }
+
+    uint32_t id;
+    if (file.get_u32("tokenizer.ggml.bos_token_id", id) && id < n_vocab) m_bos_id = static_cast<int32_t>(id);
+    if (file.get_u32("tokenizer.ggml.eos_token_id", id) && id < n_vocab) m_eos_id = static_cast<int32_t>(id);
+    const GGUFValue* add_bos = file.find("tokenizer.ggml.add_bos_token");
+    m_add_bos = add_bos != nullptr && add_bos->type == GGUFValueType::BOOL && add_bos->u64 != 0 && m_bos_id >= 0;
+
+    // End-of-generation tokens: EOS/EOT plus the chat turn terminators
+    m_eog.assign(n_vocab, false);
+    if (m_eos_id >= 0) m_eog[m_eos_id] = true;
+    if (file.get_u32("tokenizer.ggml.eot_token_id", id) && id < n_vocab) m_eog[id] = true;
+    for (const char* text : {"<|im_end|>", "<|endoftext|>", "<|eot_id|>", "<end_of_turn>"}) {
+        auto it = token_to_id.find(text);
+        if (it != token_to_id.end()) m_eog[it->second] = true;
+    }
+
+    return true;
+}
+
+void Tokenizer::clear() {
+    m_tokens.clear();
+    m_pieces.clear();
+    m_types.clear();
+    m_eog.clear();
+    m_merges.clear();
+    m_merge_shift = 64;
+    for (std::vector<int32_t>& bucket : m_special_by_byte) bucket.clear();
+    m_has_special = false;
+    m_bos_id = -1;
+    m_eos_id = -1;
+    m_add_bos = false;
+}
+
+// ============================================================================
+// Encoding
+// ============================================================================
+
+namespace {
+
+// Symbol in a word being merged; a doubly linked list over the word's bytes
+struct Symbol {
+    int32_t id;   // -1 once merged into its left neighbour
+    int32_t prev;
+    int32_t next;
+};
+
+// Candidate merge of symbols[left] and symbols[right]
+struct MergeCandidate {
+    int32_t rank;
+    int32_t left;
+    int32_t right;
+    int32_t left_id;
+    int32_t right_id;
+    int32_t result;
+
+    // Min-heap order: lowest rank first, leftmost first on ties
+    bool operator<(const MergeCandidate& o) const {
+        return rank != o.rank ? rank > o.rank : left > o.left;
+    }
+};
+
+} // namespace
+
+// Buffers reused across the words of one encode call
+struct Tokenizer::Scratch {
+    std::vector<uint32_t> cps;
+    std::vector<uint32_t> offsets;
+    std::vector<std::pair<size_t, size_t>> words;
+    std::vector<Symbol> symbols;
+    std::vector<MergeCandidate> queue;
+};
+
+std::vector<int32_t> Tokenizer::encode(const std::string& text, bool parse_special) const {
+    std::vector<int32_t> out;
+    encode(text.data(), text.size(), parse_special, out);
+    return out;
+}
+
+void Tokenizer::encode(const char* text, size_t len, bool parse_special, std::vector<int32_t>& out) const {
+    if (m_add_bos) out.push_back(m_bos_id);
+
+    Scratch scratch;
+    if (!parse_special || !m_has_special) {
+        encode_fragment(text, len, out, scratch);
+        return;
+    }
+
+    // Split out special tokens in one pass, then encode the text between them
+    size_t start = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        const int32_t id = match_special(text + pos, len - pos);
+        if (id < 0) {
+            ++pos;
+            continue;
+        }
+        encode_fragment(text + start, pos - start, out, scratch);
+        out.push_back(id);
+        pos += m_tokens[id].size();
+        start = pos;
+    }
+    encode_fragment(text + start, len - start, out, scratch);
+}
+
+int32_t Tokenizer::match_special(const char* text, size_t len) const {
+    for (int32_t id : m_special_by_byte[static_cast<unsigned char>(text[0])]) {
+        const std::string& s = m_tokens[id];
+        if (s.size() <= len && memcmp(text, s.data(), s.size()) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+void Tokenizer::encode_fragment(const char* text, size_t len, std::vector<int32_t>& out, Scratch& scratch) const {
+    if (len == 0) return;
+
+    utf8_decode(text, len, scratch.cps, scratch.offsets);
+    scratch.words.clear();
+    pretokenize(scratch.cps, scratch.words);
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text);
+    for (const auto& w : scratch.words) {
+        const uint32_t begin = scratch.offsets[w.first];
+        const uint32_t end = scratch.offsets[w.second];
+        encode_word(bytes + begin, end - begin, out, scratch);
+    }
+}
+
+void Tokenizer::encode_word(const uint8_t* bytes, size_t len, std::vector<int32_t>& out, Scratch& scratch) const {
+    // Byte-level BPE: every byte starts out as its own token
+    std::vector<Symbol>& symbols = scratch.symbols;
+    symbols.clear();
+    for (size_t i = 0; i < len; ++i) {
+        const int32_t id = m_byte_tokens[bytes[i]];
+        if (id < 0) continue; // vocab lacks this byte
+        const int32_t n = static_cast<int32_t>(symbols.size());
+        symbols.push_back({id, n - 1, -1});
+        if (n > 0) symbols[n - 1].next = n;
+    }
+    if (symbols.empty()) return;
+
+    std::vector<MergeCandidate>& queue = scratch.queue;
+    queue.clear();
+    auto push_pair = [&](int32_t left, int32_t right) {
+        if (left < 0 || right < 0) return;
+        const MergeEntry* m = find_merge(symbols[left].id, symbols[right].id);
+        if (m == nullptr) return;
+        queue.push_back({m->rank, left, right, symbols[left].id, symbols[right].id, m->result});
+        std::push_heap(queue.begin(), queue.end());
+    };
+
+    for (int32_t i = 0; i + 1 < static_cast<int32_t>(symbols.size()); ++i) {
+        push_pair(i, i + 1);
+    }
+
+    // Apply the best-ranked merge until none is left. Candidates whose
+    // symbols have changed since they were queued are skipped.
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end());
+        const MergeCandidate c = queue.back();
+        queue.pop_back();
+
+        Symbol& left = symbols[c.left];
+        Symbol& right = symbols[c.right];
+        if (left.id != c.left_id || right.id != c.right_id || left.next != c.right) {
+            continue;
+        }
+
+        left.id = c.result;
+        left.next = right.next;
+        if (right.next >= 0) symbols[right.next].prev = c.left;
+        right.id = -1;
+
+        push_pair(left.prev, c.left);
+        push_pair(c.left, left.next);
+    }
+
+    for (int32_t i = 0; i >= 0; i = symbols[i].next) {
+        out.push_back(symbols[i].id);
+    }
+}
+
+// ============================================================================
+// Merge Table
+// ============================================================================
+
+void Tokenizer::build_merges(const std::vector<std::pair<int32_t, int32_t>>& pairs,
+                             const std::vector<int32_t>& results) {
+    // Keep the load factor at or below 50% so probes stay short
+    uint32_t bits = 4;
+    while ((size_t{1} << bits) < pairs.size() * 2) ++bits;
+    m_merge_shift = 64 - bits;
+    m_merges.assign(size_t{1} << bits, MergeEntry{kEmptyKey, 0, 0});
+
+    const size_t mask = m_merges.size() - 1;
+    for (size_t rank = 0; rank < pairs.size(); ++rank) {
+        if (results[rank] < 0) continue;
+        const uint64_t key = (static_cast<uint64_t>(pairs[rank].first) << 32) |
+                             static_cast<uint32_t>(pairs[rank].second);
+        size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> m_merge_shift);
+        while (m_merges[slot].key != kEmptyKey && m_merges[slot].key != key) {
+            slot = (slot + 1) & mask;
+        }
+        // Duplicate merges keep their first (best) rank
+        if (m_merges[slot].key == kEmptyKey) {
+            m_merges[slot] = {key, static_cast<int32_t>(rank), results[rank]};
+        }
+    }
+}
+
+const Tokenizer::MergeEntry* Tokenizer::find_merge(int32_t left, int32_t right) const {
+    const uint64_t key = (static_cast<uint64_t>(left) << 32) | static_cast<uint32_t>(right);
+    const size_t mask = m_merges.size() - 1;
+    size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> m_merge_shift);
+    while (true) {
+        const MergeEntry& e = m_merges[slot];
+        if (e.key == key) return &e;
+        if (e.key == kEmptyKey) return nullptr;
+        slot = (slot + 1) & mask;
+    }
+}
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+const std::string& Tokenizer::token_to_piece(int32_t id) const {
+    static const std::string empty;
+    if (id < 0 || id >= n_vocab()) return empty;
+    return m_pieces[id];
+}
+
+bool Tokenizer::is_eog(int32_t id) const {
+    return id >= 0 && id < n_vocab() && m_eog[id];
+}
+
+bool Tokenizer::is_control(int32_t id) const {
+    return id >= 0 && id < n_vocab() && m_types[id] == TokenType::CONTROL;
+}
+
+} // namespace tutu
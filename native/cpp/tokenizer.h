@@ -0,0 +1,93 @@
+/**
+ * tokenizer.h - Byte-level BPE tokenizer loaded from GGUF vocab metadata
+ *
+ * Implements the GPT-2 style tokenizer used by SmolLM2: special tokens
+ * are split out first, text is pre-tokenized with the SmolLM2 rules
+ * (digits are always single tokens), and each word is merged by BPE
+ * rank.
+ *
+ * Merges are stored as a flat open-addressing table keyed by the pair of
+ * token ids, and each word is merged with a priority queue over a linked
+ * list of symbols, so encoding never builds intermediate strings.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gguf.h"
+
+namespace tutu {
+
+// tokenizer.ggml.token_type values
+enum class TokenType : int32_t {
+    UNDEFINED    = 0,
+    NORMAL       = 1,
+    UNKNOWN      = 2,
+    CONTROL      = 3,
+    USER_DEFINED = 4,
+    UNUSED       = 5,
+    BYTE         = 6,
+};
+
+class Tokenizer {
+public:
+    bool load(const GGUFFile& file, std::string& error);
+    void clear();
+
+    // Encode text into token ids. With parse_special, control tokens such
+    // as <|im_start|> are recognized in the text.
+    std::vector<int32_t> encode(const std::string& text, bool parse_special) const;
+
+    // Append the ids for text[0, len) to out
+    void encode(const char* text, size_t len, bool parse_special, std::vector<int32_t>& out) const;
+
+    // Raw bytes of a token; empty for control tokens
+    const std::string& token_to_piece(int32_t id) const;
+
+    bool is_eog(int32_t id) const;
+    bool is_control(int32_t id) const;
+
+    int32_t n_vocab() const { return static_cast<int32_t>(m_tokens.size()); }
+    int32_t bos_id() const { return m_bos_id; }
+    int32_t eos_id() const { return m_eos_id; }
+    bool add_bos() const { return m_add_bos; }
+
+private:
+    struct Scratch;
+
+    // 16 bytes per entry; key is (left << 32 | right), kEmptyKey if unused
+    struct MergeEntry {
+        uint64_t key;
+        int32_t rank;
+        int32_t result;
+    };
+    static constexpr uint64_t kEmptyKey = ~0ULL;
+
+    void build_merges(const std::vector<std::pair<int32_t, int32_t>>& pairs,
+                      const std::vector<int32_t>& results);
+    const MergeEntry* find_merge(int32_t left, int32_t right) const;
+    int32_t match_special(const char* text, size_t len) const;
+
+    void encode_fragment(const char* text, size_t len, std::vector<int32_t>& out, Scratch& scratch) const;
+    void encode_word(const uint8_t* bytes, size_t len, std::vector<int32_t>& out, Scratch& scratch) const;
+
+    std::vector<std::string> m_tokens;   // byte-level encoded vocab strings
+    std::vector<std::string> m_pieces;   // decoded raw bytes per token
+    std::vector<TokenType> m_types;
+    std::vector<bool> m_eog;
+    std::vector<MergeEntry> m_merges;    // power-of-two open-addressing table
+    uint32_t m_merge_shift = 64;
+    std::vector<int32_t> m_special_by_byte[256]; // keyed by first byte, longest text first
+    bool m_has_special = false;
+    int32_t m_byte_tokens[256] = {};
+
+    int32_t m_bos_id = -1;
+    int32_t m_eos_id = -1;
+    bool m_add_bos = false;
+};
+
+} // namespace tutu
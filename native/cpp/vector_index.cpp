@@ -0,0 +1,528 @@
+/**
+ * vector_index.cpp - HNSW nearest-neighbour index over embeddings, on disk
+ */
+
+#include "vector_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+namespace tutu {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x58495654; // "TVIX"
+constexpr uint32_t kVersion = 1;
+
+// Links per node on the upper layers; layer 0 holds twice as many
+constexpr uint32_t kM = 16;
+
+// Layers above 0. A node reaches layer l with probability kM^-l, so
+// this covers millions of vectors.
+constexpr int32_t kMaxLevel = 4;
+
+// Candidates kept while linking a new node, and while answering a query
+constexpr int32_t kEfConstruction = 100;
+constexpr int32_t kEfSearch = 64;
+
+constexpr uint32_t kInitialCapacity = 64;
+
+// Node record: id, level, removed flag, links per layer, vector
+constexpr size_t kIdSize = VectorIndex::kMaxIdLength + 1;
+constexpr size_t kLevelOffset = kIdSize;
+constexpr size_t kRemovedOffset = kLevelOffset + 4;
+constexpr size_t kLinksOffset = kRemovedOffset + 4;
+constexpr size_t kLinkWords = (1 + 2 * kM) + kMaxLevel * (1 + kM);
+constexpr size_t kVectorOffset = kLinksOffset + kLinkWords * sizeof(uint32_t);
+
+float dot(const float* a, const float* b, uint32_t n) {
+    // Independent partial sums, so the loop vectorizes
+    float s[8] = {};
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (int j = 0; j < 8; ++j) s[j] += a[i + j] * b[i + j];
+    }
+    float sum = (s[0] + s[4]) + (s[1] + s[5]) + (s[2] + s[6]) + (s[3] + s[7]);
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+void normalize(float* v, uint32_t n) {
+    const float norm = std::sqrt(dot(v, v, n));
+    if (norm > 0.0f) {
+        const float inv = 1.0f / norm;
+        for (uint32_t i = 0; i < n; ++i) v[i] *= inv;
+    }
+}
+
+} // namespace
+
+struct VectorIndex::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dim;
+    uint32_t m;
+    uint32_t capacity;  // node records the file has room for
+    uint32_t count;     // node records in use, removed ones included
+    uint32_t n_removed;
+    int32_t entry;      // node searches start from; -1 when empty
+    int32_t max_level;  // entry's level
+    uint32_t dirty;     // set while changes may be half-written
+    uint64_t rng;       // level generator state
+    uint8_t reserved[16];
+};
+
+VectorIndex::~VectorIndex() {
+    close();
+}
+
+// ============================================================================
+// File
+// ============================================================================
+
+bool VectorIndex::open(const std::string& path, uint32_t dim, std::string& error) {
+    close();
+    if (dim == 0) {
+        error = "Vector dimension must be positive";
+        return false;
+    }
+    if (!m_file.open(path, error)) return false;
+    m_dim = dim;
+    m_node_size = kVectorOffset + static_cast<size_t>(dim) * sizeof(float);
+
+    if (m_file.size() == 0) {
+        if (!m_file.resize(sizeof(Header), error)) {
+            close();
+            return false;
+        }
+        Header* h = header();
+        h->magic = kMagic;
+        h->version = kVersion;
+        h->dim = dim;
+        h->m = kM;
+        h->entry = -1;
+        h->max_level = -1;
+        h->rng = 0x9E3779B97F4A7C15ull;
+        if (!reserve(kInitialCapacity, error)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    const Header* h = header();
+    if (m_file.size() < sizeof(Header) || h->magic != kMagic || h->version != kVersion || h->m != kM) {
+        close();
+        error = "Not a vector index file: " + path;
+        return false;
+    }
+    if (h->dim != dim) {
+        // Before close() unmaps the header
+        error = "Vector index has dimension " + std::to_string(h->dim) + ", not " + std::to_string(dim);
+        close();
+        return false;
+    }
+    if (h->dirty != 0 || h->count > h->capacity || h->n_removed > h->count ||
+        m_file.size() < sizeof(Header) + static_cast<size_t>(h->capacity) * m_node_size) {
+        close();
+        error = "Vector index was not closed cleanly: " + path;
+        return false;
+    }
+    if (!valid_graph()) {
+        close();
+        error = "Vector index is damaged: " + path;
+        return false;
+    }
+    return true;
+}
+
+void VectorIndex::close() {
+    if (m_file.is_open()) {
+        flush();
+        m_file.close();
+    }
+    m_dim = 0;
+    m_node_size = 0;
+    m_dirty = false;
+    m_ids.clear();
+    m_ids_loaded = false;
+    std::vector<uint32_t>().swap(m_visited);
+    m_epoch = 0;
+}
+
+void VectorIndex::flush() {
+    if (!m_dirty) return;
+    // Everything else reaches the disk before the header says it is whole
+    m_file.sync();
+    header()->dirty = 0;
+    m_file.sync();
+    m_dirty = false;
+}
+
+void VectorIndex::mark_dirty() {
+    if (m_dirty) return;
+    header()->dirty = 1;
+    m_file.sync();
+    m_dirty = true;
+}
+
+bool VectorIndex::reserve(uint32_t capacity, std::string& error) {
+    if (!m_file.resize(sizeof(Header) + static_cast<size_t>(capacity) * m_node_size, error)) return false;
+    header()->capacity = capacity;
+    return true;
+}
+
+bool VectorIndex::compact(std::string& error) {
+    if (!m_file.is_open()) {
+        error = "Vector index is not open";
+        return false;
+    }
+    const std::string path = m_file.path();
+    const std::string tmp_path = path + ".tmp";
+    const uint32_t dim = m_dim;
+    std::remove(tmp_path.c_str());
+    {
+        VectorIndex fresh;
+        if (!fresh.open(tmp_path, dim, error)) return false;
+        const int32_t count = static_cast<int32_t>(header()->count);
+        for (int32_t i = 0; i < count; ++i) {
+            if (node_removed(i)) continue;
+            if (!fresh.add(node_id(i), node_vector(i), error)) {
+                fresh.close();
+                std::remove(tmp_path.c_str());
+                return false;
+            }
+        }
+    }
+    close();
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        error = "Failed to replace vector index: " + path;
+        open(path, dim, error);
+        return false;
+    }
+    return open(path, dim, error);
+}
+
+// ============================================================================
+// Records
+// ============================================================================
+
+VectorIndex::Header* VectorIndex::header() {
+    static_assert(sizeof(Header) == 64, "index header layout");
+    return reinterpret_cast<Header*>(m_file.data());
+}
+
+const VectorIndex::Header* VectorIndex::header() const {
+    return reinterpret_cast<const Header*>(m_file.data());
+}
+
+uint8_t* VectorIndex::node(int32_t i) {
+    return m_file.data() + sizeof(Header) + static_cast<size_t>(i) * m_node_size;
+}
+
+const uint8_t* VectorIndex::node(int32_t i) const {
+    return m_file.data() + sizeof(Header) + static_cast<size_t>(i) * m_node_size;
+}
+
+const char* VectorIndex::node_id(int32_t i) const {
+    return reinterpret_cast<const char*>(node(i));
+}
+
+int32_t VectorIndex::node_level(int32_t i) const {
+    int32_t level;
+    memcpy(&level, node(i) + kLevelOffset, sizeof(level));
+    return level;
+}
+
+bool VectorIndex::node_removed(int32_t i) const {
+    return node(i)[kRemovedOffset] != 0;
+}
+
+const float* VectorIndex::node_vector(int32_t i) const {
+    return reinterpret_cast<const float*>(node(i) + kVectorOffset);
+}
+
+uint32_t VectorIndex::max_links(int32_t l) {
+    return l == 0 ? 2 * kM : kM;
+}
+
+uint32_t* VectorIndex::links(int32_t i, int32_t l) {
+    uint32_t* base = reinterpret_cast<uint32_t*>(node(i) + kLinksOffset);
+    return l == 0 ? base : base + (1 + 2 * kM) + static_cast<size_t>(l - 1) * (1 + kM);
+}
+
+const uint32_t* VectorIndex::links(int32_t i, int32_t l) const {
+    const uint32_t* base = reinterpret_cast<const uint32_t*>(node(i) + kLinksOffset);
+    return l == 0 ? base : base + (1 + 2 * kM) + static_cast<size_t>(l - 1) * (1 + kM);
+}
+
+uint32_t VectorIndex::size() const {
+    return m_file.is_open() ? header()->count - header()->n_removed : 0;
+}
+
+uint32_t VectorIndex::removed() const {
+    return m_file.is_open() ? header()->n_removed : 0;
+}
+
+bool VectorIndex::valid_graph() const {
+    const Header* h = header();
+    const int32_t count = static_cast<int32_t>(h->count);
+    if (count == 0) return h->entry == -1 && h->max_level == -1 && h->n_removed == 0;
+    if (h->entry < 0 || h->entry >= count || h->max_level < 0 || h->max_level > kMaxLevel ||
+        node_level(h->entry) != h->max_level) {
+        return false;
+    }
+
+    // Searches follow links without checking them, so every one must
+    // point at a node that exists on its layer
+    uint32_t n_removed = 0;
+    for (int32_t i = 0; i < count; ++i) {
+        const int32_t level = node_level(i);
+        if (level < 0 || level > h->max_level || memchr(node_id(i), '\0', kIdSize) == nullptr) return false;
+        n_removed += node_removed(i) ? 1 : 0;
+        for (int32_t l = 0; l <= level; ++l) {
+            const uint32_t* ln = links(i, l);
+            if (ln[0] > max_links(l)) return false;
+            for (uint32_t j = 1; j <= ln[0]; ++j) {
+                if (ln[j] >= h->count || node_level(static_cast<int32_t>(ln[j])) < l) return false;
+            }
+        }
+    }
+    return n_removed == h->n_removed;
+}
+
+void VectorIndex::load_ids() {
+    if (m_ids_loaded) return;
+    const int32_t count = static_cast<int32_t>(header()->count);
+    m_ids.reserve(count);
+    for (int32_t i = 0; i < count; ++i) {
+        if (!node_removed(i)) m_ids[node_id(i)] = i;
+    }
+    m_ids_loaded = true;
+}
+
+int32_t VectorIndex::random_level() {
+    // xorshift64*
+    uint64_t& x = header()->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    const uint64_t r = x * 0x2545F4914F6CDD1Dull;
+    const double u = (static_cast<double>(r >> 11) + 1.0) / 9007199254740993.0; // (0, 1]
+    const int32_t level = static_cast<int32_t>(-std::log(u) / std::log(static_cast<double>(kM)));
+    return std::min(level, kMaxLevel);
+}
+
+// ============================================================================
+// Graph
+// ============================================================================
+
+float VectorIndex::distance(const float* q, int32_t i) const {
+    return 1.0f - dot(q, node_vector(i), m_dim);
+}
+
+std::vector<VectorIndex::Candidate> VectorIndex::search_layer(const float* q, const std::vector<Candidate>& entry,
+                                                              int32_t ef, int32_t l, bool skip_removed) {
+    const uint32_t count = header()->count;
+    if (m_visited.size() < count) m_visited.resize(header()->capacity, 0);
+    if (++m_epoch == 0) {
+        std::fill(m_visited.begin(), m_visited.end(), 0);
+        m_epoch = 1;
+    }
+
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> frontier;
+    std::priority_queue<Candidate> best; // worst on top
+    for (const Candidate& c : entry) {
+        if (m_visited[c.node] == m_epoch) continue;
+        m_visited[c.node] = m_epoch;
+        frontier.push(c);
+        if (!skip_removed || !node_removed(c.node)) best.push(c);
+    }
+
+    while (!frontier.empty()) {
+        const Candidate c = frontier.top();
+        if (static_cast<int32_t>(best.size()) >= ef && c.dist > best.top().dist) break;
+        frontier.pop();
+
+        const uint32_t* ln = links(c.node, l);
+        for (uint32_t j = 1; j <= ln[0]; ++j) {
+            const int32_t nb = static_cast<int32_t>(ln[j]);
+            if (m_visited[nb] == m_epoch) continue;
+            m_visited[nb] = m_epoch;
+            const float d = distance(q, nb);
+            if (static_cast<int32_t>(best.size()) < ef || d < best.top().dist) {
+                frontier.push({d, nb});
+                if (!skip_removed || !node_removed(nb)) {
+                    best.push({d, nb});
+                    if (static_cast<int32_t>(best.size()) > ef) best.pop();
+                }
+            }
+        }
+    }
+
+    std::vector<Candidate> out(best.size());
+    for (size_t i = out.size(); i-- > 0;) {
+        out[i] = best.top();
+        best.pop();
+    }
+    return out;
+}
+
+std::vector<int32_t> VectorIndex::select(const std::vector<Candidate>& candidates, uint32_t max) const {
+    std::vector<int32_t> picked;
+    for (const Candidate& c : candidates) {
+        if (picked.size() >= max) break;
+        bool keep = true;
+        for (int32_t p : picked) {
+            if (distance(node_vector(c.node), p) < c.dist) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) picked.push_back(c.node);
+    }
+    return picked;
+}
+
+void VectorIndex::connect(int32_t i, int32_t l, const std::vector<int32_t>& neighbours) {
+    uint32_t* own = links(i, l);
+    own[0] = static_cast<uint32_t>(neighbours.size());
+    for (size_t j = 0; j < neighbours.size(); ++j) own[1 + j] = static_cast<uint32_t>(neighbours[j]);
+
+    const uint32_t cap = max_links(l);
+    for (int32_t nb : neighbours) {
+        uint32_t* ln = links(nb, l);
+        if (ln[0] < cap) {
+            ln[1 + ln[0]] = static_cast<uint32_t>(i);
+            ++ln[0];
+            continue;
+        }
+        // Full: keep the best spread of its links and the new node
+        const float* base = node_vector(nb);
+        std::vector<Candidate> cands;
+        cands.reserve(cap + 1);
+        for (uint32_t j = 1; j <= ln[0]; ++j) {
+            cands.push_back({distance(base, static_cast<int32_t>(ln[j])), static_cast<int32_t>(ln[j])});
+        }
+        cands.push_back({distance(base, i), i});
+        std::sort(cands.begin(), cands.end());
+        const std::vector<int32_t> kept = select(cands, cap);
+        ln[0] = static_cast<uint32_t>(kept.size());
+        for (size_t j = 0; j < kept.size(); ++j) ln[1 + j] = static_cast<uint32_t>(kept[j]);
+    }
+}
+
+// ============================================================================
+// Operations
+// ============================================================================
+
+bool VectorIndex::add(const std::string& id, const float* vector, std::string& error) {
+    if (!m_file.is_open()) {
+        error = "Vector index is not open";
+        return false;
+    }
+    if (id.empty() || id.size() > kMaxIdLength || id.find('\0') != std::string::npos) {
+        error = "Invalid vector id";
+        return false;
+    }
+    load_ids();
+    remove(id);
+    mark_dirty();
+
+    if (header()->count == header()->capacity && !reserve(header()->capacity * 2, error)) return false;
+
+    const int32_t i = static_cast<int32_t>(header()->count);
+    const int32_t level = random_level();
+    uint8_t* rec = node(i);
+    memset(rec, 0, kVectorOffset);
+    memcpy(rec, id.data(), id.size());
+    memcpy(rec + kLevelOffset, &level, sizeof(level));
+    float* v = reinterpret_cast<float*>(rec + kVectorOffset);
+    memcpy(v, vector, m_dim * sizeof(float));
+    normalize(v, m_dim);
+    ++header()->count;
+    m_ids[id] = i;
+
+    Header* h = header();
+    if (h->entry < 0) {
+        h->entry = i;
+        h->max_level = level;
+        return true;
+    }
+
+    // Descend greedily to the new node's top layer, then link it on each
+    // layer from there down
+    Candidate cur = {distance(v, h->entry), h->entry};
+    for (int32_t l = h->max_level; l > level; --l) {
+        for (bool moved = true; moved;) {
+            moved = false;
+            const uint32_t* ln = links(cur.node, l);
+            for (uint32_t j = 1; j <= ln[0]; ++j) {
+                const float d = distance(v, static_cast<int32_t>(ln[j]));
+                if (d < cur.dist) {
+                    cur = {d, static_cast<int32_t>(ln[j])};
+                    moved = true;
+                }
+            }
+        }
+    }
+    std::vector<Candidate> entry(1, cur);
+    for (int32_t l = std::min(level, h->max_level); l >= 0; --l) {
+        entry = search_layer(v, entry, kEfConstruction, l, false);
+        connect(i, l, select(entry, kM));
+    }
+    if (level > h->max_level) {
+        h->entry = i;
+        h->max_level = level;
+    }
+    return true;
+}
+
+bool VectorIndex::remove(const std::string& id) {
+    if (!m_file.is_open()) return false;
+    load_ids();
+    auto it = m_ids.find(id);
+    if (it == m_ids.end()) return false;
+    mark_dirty();
+    node(it->second)[kRemovedOffset] = 1;
+    ++header()->n_removed;
+    m_ids.erase(it);
+    return true;
+}
+
+std::vector<std::pair<std::string, float>> VectorIndex::search(const float* query, int32_t k) {
+    std::vector<std::pair<std::string, float>> out;
+    if (!m_file.is_open() || k <= 0 || header()->entry < 0) return out;
+
+    std::vector<float> q(query, query + m_dim);
+    normalize(q.data(), m_dim);
+
+    const Header* h = header();
+    Candidate cur = {distance(q.data(), h->entry), h->entry};
+    for (int32_t l = h->max_level; l > 0; --l) {
+        for (bool moved = true; moved;) {
+            moved = false;
+            const uint32_t* ln = links(cur.node, l);
+            for (uint32_t j = 1; j <= ln[0]; ++j) {
+                const float d = distance(q.data(), static_cast<int32_t>(ln[j]));
+                if (d < cur.dist) {
+                    cur = {d, static_cast<int32_t>(ln[j])};
+                    moved = true;
+                }
+            }
+        }
+    }
+    const std::vector<Candidate> found =
+        search_layer(q.data(), std::vector<Candidate>(1, cur), std::max(k, kEfSearch), 0, true);
+    for (size_t j = 0; j < found.size() && static_cast<int32_t>(j) < k; ++j) {
+        out.emplace_back(node_id(found[j].node), 1.0f - found[j].dist);
+    }
+    return out;
+}
+
+} // namespace tutu
@@ -0,0 +1,138 @@
+/**
+ * vector_index.h - HNSW nearest-neighbour index over embeddings, on disk
+ *
+ * A hierarchical navigable small world graph: every vector is a node
+ * linked to its nearest neighbours on layer 0, and a geometrically
+ * thinning subset also on the layers above, so a query descends from a
+ * sparse top layer and only explores a small neighbourhood at the bottom.
+ * Scores are dot products of unit-length vectors (cosine similarity);
+ * vectors are normalized on the way in.
+ *
+ * The file is the index: a header followed by fixed-size node records
+ * (id, links for every layer, vector), used in place through a shared
+ * mapping. Opening it walks the records once to check the graph, and
+ * otherwise the pages a query touches come in from the page cache. It
+ * grows by doubling.
+ *
+ * Removing a vector leaves a tombstone: the node still routes searches
+ * but is never returned. compact() rebuilds the file without them.
+ *
+ * A file that was being modified when the process died may have
+ * half-written links, so it is marked while modified and refused when
+ * opened in that state, as is one whose graph points out of range;
+ * callers rebuild it from their own records.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace tutu {
+
+class VectorIndex {
+public:
+    // Longest id, in bytes
+    static constexpr size_t kMaxIdLength = 47;
+
+    VectorIndex() = default;
+    ~VectorIndex();
+
+    VectorIndex(const VectorIndex&) = delete;
+    VectorIndex& operator=(const VectorIndex&) = delete;
+
+    // Open the index at path for dim-dimensional vectors, creating it if
+    // the file does not exist. Fails on a file of another dimension or one
+    // left damaged.
+    bool open(const std::string& path, uint32_t dim, std::string& error);
+    void close();
+
+    // Insert vector (dim floats) under id, replacing any vector it had
+    bool add(const std::string& id, const float* vector, std::string& error);
+
+    // Remove id's vector. Returns false if there was none.
+    bool remove(const std::string& id);
+
+    // Ids and scores of the (approximately) k most similar vectors, best
+    // first
+    std::vector<std::pair<std::string, float>> search(const float* query, int32_t k);
+
+    // Rewrite the file without removed vectors
+    bool compact(std::string& error);
+
+    // Write changes back to the file and mark it consistent
+    void flush();
+
+    uint32_t dim() const { return m_dim; }
+    uint32_t size() const;    // vectors that can be returned
+    uint32_t removed() const; // tombstones
+
+private:
+    struct Candidate {
+        float dist;
+        int32_t node;
+        bool operator<(const Candidate& o) const { return dist < o.dist; }
+        bool operator>(const Candidate& o) const { return dist > o.dist; }
+    };
+
+    struct Header;
+    Header* header();
+    const Header* header() const;
+
+    // Node record fields
+    uint8_t* node(int32_t i);
+    const uint8_t* node(int32_t i) const;
+    const char* node_id(int32_t i) const;
+    int32_t node_level(int32_t i) const;
+    bool node_removed(int32_t i) const;
+    const float* node_vector(int32_t i) const;
+    // Link count followed by the links, for layer l
+    uint32_t* links(int32_t i, int32_t l);
+    const uint32_t* links(int32_t i, int32_t l) const;
+    static uint32_t max_links(int32_t l);
+
+    float distance(const float* q, int32_t i) const;
+
+    // Best-first search of layer l from entry points, keeping ef results
+    // (only live nodes when skip_removed). Sorted nearest first.
+    std::vector<Candidate> search_layer(const float* q, const std::vector<Candidate>& entry, int32_t ef,
+                                        int32_t l, bool skip_removed);
+
+    // Pick up to max neighbours from candidates (nearest first), skipping
+    // any that is closer to an already picked one than to the base point,
+    // which keeps links spread out in different directions
+    std::vector<int32_t> select(const std::vector<Candidate>& candidates, uint32_t max) const;
+
+    // Link node i into layer l with the given neighbours, and back
+    void connect(int32_t i, int32_t l, const std::vector<int32_t>& neighbours);
+
+    // Whether the header and every node's level, id and links are in
+    // range, checked when a file is opened
+    bool valid_graph() const;
+
+    bool reserve(uint32_t capacity, std::string& error);
+    void mark_dirty();
+    void load_ids();
+    int32_t random_level();
+
+    MappedFile m_file;
+    uint32_t m_dim = 0;
+    size_t m_node_size = 0;
+    bool m_dirty = false;
+
+    // id -> live node, built on first change so opening stays free
+    std::unordered_map<std::string, int32_t> m_ids;
+    bool m_ids_loaded = false;
+
+    // Visit marks for searches: node i was visited if m_visited[i] equals
+    // the current epoch
+    std::vector<uint32_t> m_visited;
+    uint32_t m_epoch = 0;
+};
+
+} // namespace tutu
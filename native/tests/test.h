@@ -0,0 +1,66 @@
+/**
+ * test.h - Minimal checks for the native unit tests
+ *
+ * Each test is a host executable registered with ctest. CHECK records a
+ * failure with its location and carries on, so one run reports every
+ * broken expectation; main returns test_result().
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace tutu_test {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline void fail(const char* file, int line, const std::string& what) {
+    fprintf(stderr, "%s:%d: %s\n", file, line, what.c_str());
+    ++failures();
+}
+
+// A file name under the system temporary directory
+inline std::string temp_path(const std::string& name) {
+    const char* dir = getenv("TMPDIR");
+    return std::string(dir != nullptr && *dir != '\0' ? dir : "/tmp") + "/tutu_test_" + name;
+}
+
+} // namespace tutu_test
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) tutu_test::fail(__FILE__, __LINE__, "CHECK(" #cond ")");  \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+    do {                                                                       \
+        if (!((a) == (b))) {                                                   \
+            tutu_test::fail(__FILE__, __LINE__, "CHECK_EQ(" #a ", " #b ")");   \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tolerance)                                            \
+    do {                                                                       \
+        const double check_a_ = (a), check_b_ = (b);                           \
+        if (!(std::fabs(check_a_ - check_b_) <= (tolerance))) {                \
+            tutu_test::fail(__FILE__, __LINE__,                                \
+                            "CHECK_NEAR(" #a ", " #b "): " +                   \
+                                std::to_string(check_a_) + " vs " +            \
+                                std::to_string(check_b_));                     \
+        }                                                                      \
+    } while (0)
+
+inline int test_result(const char* name) {
+    if (tutu_test::failures() == 0) {
+        printf("%s: all checks passed\n", name);
+        return 0;
+    }
+    fprintf(stderr, "%s: %d check(s) failed\n", name, tutu_test::failures());
+    return 1;
+}
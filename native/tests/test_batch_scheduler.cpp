@@ -0,0 +1,329 @@
+/**
+ * test_batch_scheduler.cpp - Merged forward passes of several contexts
+ *
+ * A tiny random llama model (two layers, grouped-query attention, Q8_0
+ * weights) is written to a GGUF file. Two contexts of it then evaluate
+ * different prompts and steps, once each on its own, once merged through
+ * LlamaContext::decode_multi and once from two threads sharing a
+ * BatchScheduler. Every row of logits must match the solo run.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch_scheduler.h"
+#include "llama_context.h"
+#include "llama_model.h"
+#include "quants.h"
+#include "test.h"
+
+using tutu::BatchScheduler;
+using tutu::GGMLType;
+using tutu::LlamaContext;
+using tutu::LlamaModel;
+
+namespace {
+
+constexpr uint32_t kEmbd = 64;
+constexpr uint32_t kHead = 4;
+constexpr uint32_t kHeadKv = 2;
+constexpr uint32_t kFf = 96;
+constexpr uint32_t kLayers = 2;
+constexpr uint32_t kVocab = 40;
+constexpr int32_t kCtx = 64;
+
+// ============================================================================
+// GGUF writer
+// ============================================================================
+
+class GGUFWriter {
+public:
+    void str(const std::string& key, const std::string& value) {
+        key_header(key, 8);
+        string(m_kv, value);
+        ++m_n_kv;
+    }
+
+    void u32(const std::string& key, uint32_t value) {
+        key_header(key, 4);
+        raw(m_kv, &value, sizeof(value));
+        ++m_n_kv;
+    }
+
+    void f32(const std::string& key, float value) {
+        key_header(key, 6);
+        raw(m_kv, &value, sizeof(value));
+        ++m_n_kv;
+    }
+
+    void strings(const std::string& key, const std::vector<std::string>& values) {
+        key_header(key, 9);
+        const uint32_t type = 8;
+        const uint64_t n = values.size();
+        raw(m_kv, &type, sizeof(type));
+        raw(m_kv, &n, sizeof(n));
+        for (const std::string& v : values) string(m_kv, v);
+        ++m_n_kv;
+    }
+
+    // A 2D (or, with rows 1, 1D) tensor of already encoded data
+    void tensor(const std::string& name, GGMLType type, uint64_t ne0, uint64_t rows, const std::vector<uint8_t>& data) {
+        m_data.resize((m_data.size() + 31) & ~size_t(31), 0);
+        const uint32_t n_dims = rows > 1 ? 2 : 1;
+        const uint32_t t = static_cast<uint32_t>(type);
+        const uint64_t offset = m_data.size();
+        string(m_info, name);
+        raw(m_info, &n_dims, sizeof(n_dims));
+        raw(m_info, &ne0, sizeof(ne0));
+        if (n_dims == 2) raw(m_info, &rows, sizeof(rows));
+        raw(m_info, &t, sizeof(t));
+        raw(m_info, &offset, sizeof(offset));
+        raw(m_data, data.data(), data.size());
+        ++m_n_tensors;
+    }
+
+    bool write(const std::string& path) const {
+        std::vector<uint8_t> out;
+        const uint32_t magic = 0x46554747, version = 3;
+        raw(out, &magic, sizeof(magic));
+        raw(out, &version, sizeof(version));
+        raw(out, &m_n_tensors, sizeof(m_n_tensors));
+        raw(out, &m_n_kv, sizeof(m_n_kv));
+        out.insert(out.end(), m_kv.begin(), m_kv.end());
+        out.insert(out.end(), m_info.begin(), m_info.end());
+        out.resize((out.size() + 31) & ~size_t(31), 0);
+        out.insert(out.end(), m_data.begin(), m_data.end());
+
+        FILE* f = fopen(path.c_str(), "wb");
+        if (f == nullptr) return false;
+        const bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+        return fclose(f) == 0 && ok;
+    }
+
+private:
+    static void raw(std::vector<uint8_t>& out, const void* p, size_t n) {
+        out.insert(out.end(), static_cast<const uint8_t*>(p), static_cast<const uint8_t*>(p) + n);
+    }
+
+    static void string(std::vector<uint8_t>& out, const std::string& s) {
+        const uint64_t n = s.size();
+        raw(out, &n, sizeof(n));
+        raw(out, s.data(), s.size());
+    }
+
+    void key_header(const std::string& key, uint32_t type) {
+        string(m_kv, key);
+        raw(m_kv, &type, sizeof(type));
+    }
+
+    std::vector<uint8_t> m_kv;
+    std::vector<uint8_t> m_info;
+    std::vector<uint8_t> m_data;
+    uint64_t m_n_kv = 0;
+    uint64_t m_n_tensors = 0;
+};
+
+// rows x ne0 random weights, each row quantized to Q8_0
+std::vector<uint8_t> random_q8_0(std::mt19937& rng, uint32_t ne0, uint32_t rows) {
+    std::normal_distribution<float> normal(0.0f, 1.0f / std::sqrt(static_cast<float>(ne0)));
+    const size_t row_size = tutu::ggml_row_size(GGMLType::Q8_0, ne0);
+    std::vector<uint8_t> data(row_size * rows);
+    std::vector<float> row(ne0);
+    for (uint32_t r = 0; r < rows; ++r) {
+        for (float& x : row) x = normal(rng);
+        tutu::quantize_row(GGMLType::Q8_0, row.data(), data.data() + r * row_size, ne0);
+    }
+    return data;
+}
+
+std::vector<uint8_t> random_norm(std::mt19937& rng) {
+    std::uniform_real_distribution<float> uniform(0.8f, 1.2f);
+    std::vector<float> w(kEmbd);
+    for (float& x : w) x = uniform(rng);
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(w.data());
+    return std::vector<uint8_t>(p, p + w.size() * sizeof(float));
+}
+
+bool write_model(const std::string& path) {
+    std::mt19937 rng(11);
+    GGUFWriter writer;
+    writer.str("general.architecture", "llama");
+    writer.u32("llama.embedding_length", kEmbd);
+    writer.u32("llama.block_count", kLayers);
+    writer.u32("llama.feed_forward_length", kFf);
+    writer.u32("llama.attention.head_count", kHead);
+    writer.u32("llama.attention.head_count_kv", kHeadKv);
+    writer.u32("llama.context_length", kCtx);
+    writer.f32("llama.rope.freq_base", 10000.0f);
+    writer.f32("llama.attention.layer_norm_rms_epsilon", 1e-5f);
+
+    std::vector<std::string> tokens;
+    for (uint32_t i = 0; i < kVocab; ++i) tokens.push_back("t" + std::to_string(i));
+    writer.str("tokenizer.ggml.model", "gpt2");
+    writer.strings("tokenizer.ggml.tokens", tokens);
+    writer.strings("tokenizer.ggml.merges", {});
+
+    const uint32_t n_embd_kv = kEmbd / kHead * kHeadKv;
+    writer.tensor("token_embd.weight", GGMLType::Q8_0, kEmbd, kVocab, random_q8_0(rng, kEmbd, kVocab));
+    writer.tensor("output_norm.weight", GGMLType::F32, kEmbd, 1, random_norm(rng));
+    for (uint32_t i = 0; i < kLayers; ++i) {
+        const std::string p = "blk." + std::to_string(i) + ".";
+        writer.tensor(p + "attn_norm.weight", GGMLType::F32, kEmbd, 1, random_norm(rng));
+        writer.tensor(p + "attn_q.weight", GGMLType::Q8_0, kEmbd, kEmbd, random_q8_0(rng, kEmbd, kEmbd));
+        writer.tensor(p + "attn_k.weight", GGMLType::Q8_0, kEmbd, n_embd_kv, random_q8_0(rng, kEmbd, n_embd_kv));
+        writer.tensor(p + "attn_v.weight", GGMLType::Q8_0, kEmbd, n_embd_kv, random_q8_0(rng, kEmbd, n_embd_kv));
+        writer.tensor(p + "attn_output.weight", GGMLType::Q8_0, kEmbd, kEmbd, random_q8_0(rng, kEmbd, kEmbd));
+        writer.tensor(p + "ffn_norm.weight", GGMLType::F32, kEmbd, 1, random_norm(rng));
+        writer.tensor(p + "ffn_gate.weight", GGMLType::Q8_0, kEmbd, kFf, random_q8_0(rng, kEmbd, kFf));
+        writer.tensor(p + "ffn_up.weight", GGMLType::Q8_0, kEmbd, kFf, random_q8_0(rng, kEmbd, kFf));
+        writer.tensor(p + "ffn_down.weight", GGMLType::Q8_0, kFf, kEmbd, random_q8_0(rng, kFf, kEmbd));
+    }
+    return writer.write(path);
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+// What one context evaluates: a prompt with every row of logits, then
+// single tokens, then a two-token step with its last row only
+struct Script {
+    std::vector<int32_t> prompt;
+    std::vector<int32_t> steps;
+    std::vector<int32_t> pair;
+};
+
+const Script kScripts[2] = {
+    {{1, 7, 3, 22, 9}, {4, 31, 17}, {8, 2}},
+    {{5, 12, 39}, {0, 26, 11}, {19, 19}},
+};
+
+// Logits rows in the order the script produces them
+using Rows = std::vector<std::vector<float>>;
+
+void append(Rows& rows, const float* logits, int32_t n_rows) {
+    CHECK(logits != nullptr);
+    for (int32_t r = 0; r < n_rows; ++r) {
+        rows.emplace_back(kVocab, 0.0f);
+        if (logits != nullptr) std::copy(logits + r * kVocab, logits + (r + 1) * kVocab, rows.back().begin());
+    }
+}
+
+// Run a script through ctx.decode_batch, which goes through the
+// context's scheduler when it has one
+Rows run(LlamaContext& ctx, const Script& s) {
+    Rows rows;
+    const int32_t n_prompt = static_cast<int32_t>(s.prompt.size());
+    append(rows, ctx.decode_batch(s.prompt.data(), n_prompt, true), n_prompt);
+    for (int32_t t : s.steps) append(rows, ctx.decode_batch(&t, 1, false), 1);
+    append(rows, ctx.decode_batch(s.pair.data(), static_cast<int32_t>(s.pair.size()), false), 1);
+    return rows;
+}
+
+// Every solo row, to float rounding of the same arithmetic
+void check_same(const Rows& actual, const Rows& expected) {
+    CHECK_EQ(actual.size(), expected.size());
+    for (size_t r = 0; r < actual.size() && r < expected.size(); ++r) {
+        for (uint32_t i = 0; i < kVocab; ++i) {
+            CHECK_NEAR(actual[r][i], expected[r][i], 1e-5 * (1.0 + std::fabs(expected[r][i])));
+        }
+    }
+}
+
+bool init(LlamaContext& ctx, const LlamaModel& model) {
+    std::string error;
+    const bool ok = ctx.init(model, kCtx, error);
+    if (!ok) fprintf(stderr, "%s\n", error.c_str());
+    CHECK(ok);
+    return ok;
+}
+
+void test_decode_multi(const LlamaModel& model, const Rows solo[2]) {
+    LlamaContext a, b;
+    if (!init(a, model) || !init(b, model)) return;
+    const Script& sa = kScripts[0];
+    const Script& sb = kScripts[1];
+    Rows rows[2];
+
+    // Prompts of different lengths, one with every row of logits
+    LlamaContext::Seq seqs[2] = {
+        {&a, sa.prompt.data(), static_cast<int32_t>(sa.prompt.size()), true, nullptr},
+        {&b, sb.prompt.data(), static_cast<int32_t>(sb.prompt.size()), true, nullptr},
+    };
+    LlamaContext::decode_multi(seqs, 2);
+    append(rows[0], seqs[0].logits, seqs[0].n);
+    append(rows[1], seqs[1].logits, seqs[1].n);
+
+    for (size_t i = 0; i < sa.steps.size(); ++i) {
+        seqs[0] = {&a, &sa.steps[i], 1, false, nullptr};
+        seqs[1] = {&b, &sb.steps[i], 1, false, nullptr};
+        LlamaContext::decode_multi(seqs, 2);
+        append(rows[0], seqs[0].logits, 1);
+        append(rows[1], seqs[1].logits, 1);
+    }
+
+    // Listed the other way round, so b's rows come first
+    seqs[0] = {&b, sb.pair.data(), 2, false, nullptr};
+    seqs[1] = {&a, sa.pair.data(), 2, false, nullptr};
+    LlamaContext::decode_multi(seqs, 2);
+    append(rows[1], seqs[0].logits, 1);
+    append(rows[0], seqs[1].logits, 1);
+
+    check_same(rows[0], solo[0]);
+    check_same(rows[1], solo[1]);
+}
+
+void test_scheduler(const LlamaModel& model, const Rows solo[2]) {
+    BatchScheduler scheduler;
+    LlamaContext contexts[2];
+    Rows rows[2];
+    for (int round = 0; round < 3; ++round) {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 2; ++i) {
+            if (!init(contexts[i], model)) return;
+            contexts[i].set_scheduler(&scheduler);
+        }
+        for (int i = 0; i < 2; ++i) {
+            threads.emplace_back([&, i] {
+                BatchScheduler::Active active(&scheduler);
+                rows[i] = run(contexts[i], kScripts[i]);
+            });
+        }
+        for (std::thread& t : threads) t.join();
+        check_same(rows[0], solo[0]);
+        check_same(rows[1], solo[1]);
+    }
+}
+
+} // namespace
+
+int main() {
+    const std::string path = tutu_test::temp_path("batch_model.gguf");
+    CHECK(write_model(path));
+
+    LlamaModel model;
+    std::string error;
+    if (!model.load(path, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        CHECK(false);
+        remove(path.c_str());
+        return test_result("test_batch_scheduler");
+    }
+
+    Rows solo[2];
+    for (int i = 0; i < 2; ++i) {
+        LlamaContext ctx;
+        if (init(ctx, model)) solo[i] = run(ctx, kScripts[i]);
+    }
+    test_decode_multi(model, solo);
+    test_scheduler(model, solo);
+
+    model.unload();
+    remove(path.c_str());
+    return test_result("test_batch_scheduler");
+}
@@ -0,0 +1,138 @@
+/**
+ * test_grammar.cpp - GBNF matching and JSON schema conversion
+ *
+ * Checks the byte-level grammar matcher on hand-written GBNF (literals,
+ * classes, repetition, alternatives, rejected left recursion) and that
+ * grammars generated from JSON schemas accept the documents the schema
+ * allows and nothing else.
+ */
+
+#include <string>
+
+#include "grammar.h"
+#include "json_schema.h"
+#include "test.h"
+
+using tutu::Grammar;
+
+namespace {
+
+// Whether grammar matches text completely, fed in one piece per byte
+bool matches(Grammar& grammar, const std::string& text) {
+    grammar.reset();
+    for (char c : text) {
+        if (!grammar.accept(std::string(1, c))) return false;
+    }
+    return grammar.complete();
+}
+
+void test_gbnf() {
+    Grammar g;
+    std::string error;
+
+    CHECK(g.parse("root ::= \"yes\" | \"no\"", error));
+    CHECK(matches(g, "yes"));
+    CHECK(matches(g, "no"));
+    CHECK(!matches(g, "ye"));
+    CHECK(!matches(g, "yess"));
+    g.reset();
+    CHECK(g.allows("y"));
+    CHECK(!g.allows("x"));
+    CHECK(g.accept("no"));
+    CHECK(g.finished());
+
+    CHECK(g.parse("root ::= [a-c]+ digit{2,3} # trailing comment\ndigit ::= [0-9]", error));
+    CHECK(matches(g, "abc12"));
+    CHECK(matches(g, "a123"));
+    CHECK(!matches(g, "a1"));
+    CHECK(!matches(g, "a1234"));
+    CHECK(!matches(g, "12"));
+
+    CHECK(g.parse("root ::= \"(\" [^)]* \")\" (\",\" root)?", error));
+    CHECK(matches(g, "(x y)"));
+    CHECK(matches(g, "()"));
+    CHECK(matches(g, "(a),(b)"));
+    CHECK(!matches(g, "(a))"));
+
+    // A rejected accept leaves the state alone
+    CHECK(g.parse("root ::= \"ab\"", error));
+    g.reset();
+    CHECK(g.accept("a"));
+    CHECK(!g.accept("x"));
+    CHECK(g.accept("b"));
+    CHECK(g.complete());
+
+    CHECK(!g.parse("root ::= root \"a\"", error));
+    CHECK(!g.parse("root ::= undefined", error));
+    CHECK(!g.parse("root ::= \"unterminated", error));
+}
+
+void test_json_schema() {
+    // The shape RAGService asks the model for
+    const std::string schema = R"({
+        "type": "object",
+        "properties": {
+            "memories": {
+                "type": "array",
+                "maxItems": 2,
+                "items": {
+                    "type": "object",
+                    "properties": {
+                        "content": {"type": "string", "minLength": 1, "maxLength": 20},
+                        "type": {"enum": ["preference", "fact", "event"]},
+                        "importance": {"type": "number"},
+                        "tag": {"type": ["string", "null"]}
+                    },
+                    "required": ["content", "type", "importance"]
+                }
+            },
+            "done": {"type": "boolean"}
+        },
+        "required": ["memories"]
+    })";
+
+    std::string gbnf, error;
+    CHECK(tutu::json_schema_to_gbnf(schema, gbnf, error));
+    Grammar g;
+    const bool parsed = g.parse(gbnf, error);
+    CHECK(parsed);
+    if (!parsed) {
+        fprintf(stderr, "%s\n%s\n", error.c_str(), gbnf.c_str());
+        return;
+    }
+
+    CHECK(matches(g, R"({"memories":[]})"));
+    CHECK(matches(g, R"({"memories":[{"content":"likes tea","type":"preference","importance":0.8}]})"));
+    CHECK(matches(g, R"({"memories":[{"content":"x","type":"fact","importance":1,"tag":null}],"done":true})"));
+    CHECK(matches(g, "{\n  \"memories\": [\n    {\"content\": \"a\", \"type\": \"event\", \"importance\": -2.5e3}\n  ]\n}"));
+    CHECK(matches(g, R"({"memories":[{"content":"a \"quoted\" é","type":"fact","importance":0}]})"));
+
+    // Missing required, unknown property, bad enum, too many items,
+    // string too long or empty, wrong type, trailing text
+    CHECK(!matches(g, R"({})"));
+    CHECK(!matches(g, R"({"memories":[],"extra":1})"));
+    CHECK(!matches(g, R"({"memories":[{"content":"a","type":"opinion","importance":1}]})"));
+    CHECK(!matches(g,
+                   R"({"memories":[{"content":"a","type":"fact","importance":1},)"
+                   R"({"content":"b","type":"fact","importance":1},{"content":"c","type":"fact","importance":1}]})"));
+    CHECK(!matches(g, R"({"memories":[{"content":"this is far too long for it","type":"fact","importance":1}]})"));
+    CHECK(!matches(g, R"({"memories":[{"content":"","type":"fact","importance":1}]})"));
+    CHECK(!matches(g, R"({"memories":[{"content":"a","type":"fact","importance":"high"}]})"));
+    CHECK(!matches(g, R"({"memories":[]} )"));
+
+    // An empty schema takes any JSON value
+    CHECK(tutu::json_schema_to_gbnf("{}", gbnf, error));
+    CHECK(g.parse(gbnf, error));
+    CHECK(matches(g, R"([1,"two",{"three":null},true])"));
+    CHECK(!matches(g, "[1,"));
+
+    CHECK(!tutu::json_schema_to_gbnf("{not json", gbnf, error));
+}
+
+} // namespace
+
+int main() {
+    test_gbnf();
+    test_json_schema();
+    return test_result("test_grammar");
+}
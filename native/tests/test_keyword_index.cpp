@@ -0,0 +1,118 @@
+/**
+ * test_keyword_index.cpp - BM25 inverted index
+ *
+ * Scores are checked against Okapi BM25 computed directly from the
+ * documents, before and after documents are replaced and removed.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "keyword_index.h"
+#include "test.h"
+
+using tutu::KeywordIndex;
+
+namespace {
+
+// BM25 of every document sharing a term with the query, by brute force
+std::map<std::string, double> reference_scores(const std::map<std::string, std::string>& docs,
+                                               const std::string& query) {
+    std::map<std::string, std::vector<std::string>> terms;
+    double total = 0;
+    for (const auto& d : docs) {
+        terms[d.first] = KeywordIndex::tokenize(d.second);
+        total += static_cast<double>(terms[d.first].size());
+    }
+    const double n = static_cast<double>(docs.size());
+    const double avg = total / n;
+
+    std::vector<std::string> query_terms = KeywordIndex::tokenize(query);
+    std::sort(query_terms.begin(), query_terms.end());
+    query_terms.erase(std::unique(query_terms.begin(), query_terms.end()), query_terms.end());
+
+    std::map<std::string, double> scores;
+    for (const std::string& term : query_terms) {
+        double df = 0;
+        for (const auto& t : terms) df += std::count(t.second.begin(), t.second.end(), term) > 0 ? 1 : 0;
+        if (df == 0) continue;
+        const double idf = std::log(1.0 + (n - df + 0.5) / (df + 0.5));
+        for (const auto& t : terms) {
+            const double tf = static_cast<double>(std::count(t.second.begin(), t.second.end(), term));
+            if (tf == 0) continue;
+            const double norm =
+                KeywordIndex::kK1 * (1.0 - KeywordIndex::kB + KeywordIndex::kB * static_cast<double>(t.second.size()) / avg);
+            scores[t.first] += idf * tf * (KeywordIndex::kK1 + 1.0) / (tf + norm);
+        }
+    }
+    return scores;
+}
+
+void check_search(KeywordIndex& index, const std::map<std::string, std::string>& docs, const std::string& query) {
+    const std::map<std::string, double> expected = reference_scores(docs, query);
+    const auto results = index.search(query, 1000);
+    CHECK_EQ(results.size(), expected.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto it = expected.find(results[i].first);
+        CHECK(it != expected.end());
+        if (it != expected.end()) CHECK_NEAR(results[i].second, it->second, 1e-4 * std::max(1.0, it->second));
+        if (i > 0) CHECK(results[i - 1].second >= results[i].second);
+    }
+}
+
+void test_tokenize() {
+    const std::vector<std::string> terms = KeywordIndex::tokenize("I LOVE green-tea, it's my_fav! \xc3\xa9t\xc3\xa9 42 1234");
+    const std::vector<std::string> expected = {"love", "green", "tea", "my_fav", "\xc3\xa9t\xc3\xa9", "1234"};
+    CHECK(terms == expected);
+}
+
+void test_scores() {
+    const char* const words[] = {"tea", "coffee", "green", "morning", "walk", "dog", "park", "music",
+                                 "jazz", "book", "read", "cook", "pasta", "travel", "japan", "work"};
+    std::mt19937 rng(9);
+    std::map<std::string, std::string> docs;
+    KeywordIndex index;
+    for (int i = 0; i < 60; ++i) {
+        std::string text;
+        for (size_t n = 2 + rng() % 12; n > 0; --n) text += std::string(words[rng() % 16]) + " ";
+        const std::string id = "m" + std::to_string(i);
+        docs[id] = text;
+        index.add(id, text, {});
+    }
+    CHECK_EQ(index.size(), 60u);
+    check_search(index, docs, "green tea in the morning");
+    check_search(index, docs, "jazz jazz music");
+    CHECK(index.search("nothing matches", 10).empty());
+
+    // Top k are the k best
+    const auto all = index.search("dog park walk", 1000);
+    const auto top = index.search("dog park walk", 5);
+    CHECK_EQ(top.size(), size_t(5));
+    for (size_t i = 0; i < top.size() && i < all.size(); ++i) CHECK_NEAR(top[i].second, all[i].second, 1e-6);
+
+    // Replacing and removing keep postings and lengths consistent
+    index.add("m3", "japan travel travel", {0.9f, 0});
+    docs["m3"] = "japan travel travel";
+    CHECK(index.remove("m7"));
+    docs.erase("m7");
+    CHECK(!index.remove("m7"));
+    CHECK_EQ(index.size(), 59u);
+    check_search(index, docs, "travel to japan");
+    check_search(index, docs, "cook pasta book");
+
+    const KeywordIndex::Weight* weight = index.weight("m3");
+    CHECK(weight != nullptr && weight->importance == 0.9f);
+    CHECK(index.weight("m7") == nullptr);
+}
+
+} // namespace
+
+int main() {
+    test_tokenize();
+    test_scores();
+    return test_result("test_keyword_index");
+}
@@ -0,0 +1,170 @@
+/**
+ * test_memory_search.cpp - Reciprocal rank fusion of keyword and vector hits
+ *
+ * Fused scores and their order are checked against RRF computed from
+ * the two indexes' own rankings, and so are equal scores, importance
+ * weighting, the similarity floor, and dropping expired memories.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "keyword_index.h"
+#include "memory_search.h"
+#include "test.h"
+#include "vector_index.h"
+
+using tutu::KeywordIndex;
+using tutu::MemoryHit;
+using tutu::MemoryQuery;
+using tutu::VectorIndex;
+
+namespace {
+
+constexpr uint32_t kDim = 4;
+
+float rrf(size_t rank) {
+    return 1.0f / (tutu::kRrfK + static_cast<float>(rank + 1));
+}
+
+// A unit vector at angle a in the first two dimensions, so similarities
+// to the query (angle 0) fall as a grows
+std::vector<float> at_angle(float a) {
+    return {std::cos(a), std::sin(a), 0.0f, 0.0f};
+}
+
+void test_fusion() {
+    const std::string path = tutu_test::temp_path("fusion.hnsw");
+    remove(path.c_str());
+    std::string error;
+    KeywordIndex keywords;
+    VectorIndex vectors;
+    CHECK(vectors.open(path, kDim, error));
+
+    // Keyword order m0 > m1 > m2 > m3 by term frequency; vector order
+    // m3 > m2 > m4 > m0 > m1 by angle
+    keywords.add("m0", "tea tea tea tea", {});
+    keywords.add("m1", "tea tea tea cake", {});
+    keywords.add("m2", "tea tea cake cake", {});
+    keywords.add("m3", "tea cake cake cake", {});
+    keywords.add("m4", "cake cake cake cake", {});
+    keywords.add("m5", "coffee", {});
+    const float angles[] = {0.9f, 1.4f, 0.2f, 0.1f, 0.5f};
+    for (int i = 0; i < 5; ++i) {
+        CHECK(vectors.add("m" + std::to_string(i), at_angle(angles[i]).data(), error));
+    }
+
+    const std::vector<float> q = at_angle(0.0f);
+    MemoryQuery query;
+    query.text = "tea";
+    query.vector = q.data();
+    query.k = 10;
+
+    // Reference: RRF over the indexes' own lists
+    std::map<std::string, float> expected;
+    const auto lexical = keywords.search(query.text, 40);
+    const auto semantic = vectors.search(q.data(), 40);
+    CHECK_EQ(lexical.size(), size_t(4));
+    CHECK_EQ(semantic.size(), size_t(5));
+    for (size_t r = 0; r < lexical.size(); ++r) expected[lexical[r].first] += rrf(r);
+    for (size_t r = 0; r < semantic.size(); ++r) expected[semantic[r].first] += rrf(r);
+
+    const std::vector<MemoryHit> hits = tutu::memory_search(keywords, &vectors, query);
+    CHECK_EQ(hits.size(), expected.size());
+    for (size_t i = 0; i < hits.size(); ++i) {
+        CHECK_NEAR(hits[i].score, expected[hits[i].id], 1e-6);
+        if (i > 0) CHECK(hits[i - 1].score >= hits[i].score);
+    }
+    // m0 and m3 are 1st and 4th in opposite lists and tie, in keyword
+    // order; m4, in one list only, comes last
+    const char* const order[] = {"m0", "m3", "m2", "m1", "m4"};
+    for (size_t i = 0; i < hits.size() && i < 5; ++i) CHECK_EQ(hits[i].id, std::string(order[i]));
+    for (const MemoryHit& h : hits) {
+        if (h.id == "m4") CHECK(h.lexical == 0.0f && h.semantic > 0.0f);
+        if (h.id == "m0") CHECK(h.lexical > 0.0f && h.semantic > 0.0f);
+    }
+
+    // Importance scales the fused score and can reorder
+    keywords.add("m1", "tea tea tea cake", {40.0f, 0});
+    const std::vector<MemoryHit> weighted = tutu::memory_search(keywords, &vectors, query);
+    CHECK(!weighted.empty() && weighted[0].id == "m1");
+    if (!weighted.empty()) CHECK_NEAR(weighted[0].score, 40.0f * expected["m1"], 1e-5);
+
+    // k cuts the list; the similarity floor drops far vectors
+    query.k = 2;
+    CHECK_EQ(tutu::memory_search(keywords, &vectors, query).size(), size_t(2));
+    query.k = 10;
+    query.min_similarity = std::cos(0.3f);
+    for (const MemoryHit& h : tutu::memory_search(keywords, &vectors, query)) {
+        if (h.id == "m4" || h.id == "m0" || h.id == "m1") CHECK(h.semantic == 0.0f);
+    }
+
+    // Expired memories are left out and removed from both indexes
+    query.min_similarity = 0.0f;
+    query.now = 1000;
+    keywords.add("m3", "tea cake cake cake", {1.0f, 999});
+    for (const MemoryHit& h : tutu::memory_search(keywords, &vectors, query)) CHECK(h.id != "m3");
+    CHECK(keywords.weight("m3") == nullptr);
+    CHECK(!vectors.remove("m3"));
+
+    vectors.close();
+    remove(path.c_str());
+}
+
+// Equal fused scores keep keyword rank order, then vector rank order
+void test_ties() {
+    const std::string path = tutu_test::temp_path("ties.hnsw");
+    remove(path.c_str());
+    std::string error;
+    KeywordIndex keywords;
+    VectorIndex vectors;
+    CHECK(vectors.open(path, kDim, error));
+
+    // Only keywords find k0 and k1, only vectors find v0 and v1
+    keywords.add("k0", "tea tea", {});
+    keywords.add("k1", "tea cake", {});
+    keywords.add("v0", "cake", {});
+    keywords.add("v1", "cake cake", {});
+    CHECK(vectors.add("v0", at_angle(0.1f).data(), error));
+    CHECK(vectors.add("v1", at_angle(0.2f).data(), error));
+    CHECK(vectors.add("far", at_angle(3.0f).data(), error));
+
+    const std::vector<float> q = at_angle(0.0f);
+    MemoryQuery query;
+    query.text = "tea";
+    query.vector = q.data();
+    query.k = 10;
+    query.min_similarity = 0.5f;
+
+    for (int run = 0; run < 3; ++run) {
+        const std::vector<MemoryHit> hits = tutu::memory_search(keywords, &vectors, query);
+        const char* const order[] = {"k0", "v0", "k1", "v1"};
+        CHECK_EQ(hits.size(), size_t(4));
+        for (size_t i = 0; i < hits.size() && i < 4; ++i) CHECK_EQ(hits[i].id, std::string(order[i]));
+        if (hits.size() == 4) {
+            CHECK_EQ(hits[0].score, hits[1].score);
+            CHECK_EQ(hits[2].score, hits[3].score);
+            CHECK_NEAR(hits[0].score, rrf(0), 1e-7);
+            CHECK_NEAR(hits[2].score, rrf(1), 1e-7);
+        }
+    }
+
+    // Keywords alone: plain RRF of the BM25 order
+    query.vector = nullptr;
+    const std::vector<MemoryHit> lexical = tutu::memory_search(keywords, nullptr, query);
+    CHECK(lexical.size() == 2 && lexical[0].id == "k0" && lexical[1].id == "k1");
+
+    vectors.close();
+    remove(path.c_str());
+}
+
+} // namespace
+
+int main() {
+    test_fusion();
+    test_ties();
+    return test_result("test_memory_search");
+}
@@ -0,0 +1,306 @@
+/**
+ * test_qa_matcher.cpp - QAMatcher against the app's original Dart scorer
+ *
+ * The reference functions below transcribe OfflineQAService's Dart
+ * scoring (normalization, two-row Levenshtein, keyword overlap) so the
+ * native matcher can be checked to score exactly as it did. Also covers
+ * the compiled bank: save, open, stamp, and refusing damaged files.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "qa_matcher.h"
+#include "test.h"
+
+using tutu::QAMatcher;
+
+namespace {
+
+// ============================================================================
+// Dart reference
+// ============================================================================
+
+// text.toLowerCase().replaceAll(RegExp(r'[^\w\s]'), '')
+//     .replaceAll(RegExp(r'\s+'), ' ').trim()
+std::string dart_normalize(const std::string& text) {
+    std::string kept;
+    for (char c : text) {
+        const auto u = static_cast<unsigned char>(c);
+        const char lower = (u >= 'A' && u <= 'Z') ? static_cast<char>(u - 'A' + 'a') : c;
+        const bool word = (lower >= 'a' && lower <= 'z') || (lower >= '0' && lower <= '9') || lower == '_';
+        const bool space = lower == ' ' || (lower >= '\t' && lower <= '\r');
+        if (word || space) kept += lower;
+    }
+    std::string out;
+    bool pending = false;
+    for (char c : kept) {
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            pending = true;
+        } else {
+            if (pending && !out.empty()) out += ' ';
+            out += c;
+            pending = false;
+        }
+    }
+    return out;
+}
+
+// text.split(' ').where((w) => w.length > 2)
+std::vector<std::string> dart_tokenize(const std::string& text) {
+    std::vector<std::string> words;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(' ', start);
+        if (end == std::string::npos) end = text.size();
+        if (end - start > 2) words.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return words;
+}
+
+int dart_levenshtein(const std::string& s1, const std::string& s2) {
+    if (s1.empty()) return static_cast<int>(s2.size());
+    if (s2.empty()) return static_cast<int>(s1.size());
+    std::vector<int> previous(s2.size() + 1), current(s2.size() + 1);
+    for (size_t j = 0; j <= s2.size(); ++j) previous[j] = static_cast<int>(j);
+    for (size_t i = 1; i <= s1.size(); ++i) {
+        current[0] = static_cast<int>(i);
+        for (size_t j = 1; j <= s2.size(); ++j) {
+            const int cost = s1[i - 1] == s2[j - 1] ? 0 : 1;
+            current[j] = std::min(std::min(current[j - 1] + 1, previous[j] + 1), previous[j - 1] + cost);
+        }
+        previous = current;
+    }
+    return current[s2.size()];
+}
+
+double dart_similarity(const std::string& s1, const std::string& s2) {
+    if (s1 == s2) return 1.0;
+    if (s1.empty() || s2.empty()) return 0.0;
+    return 1.0 - static_cast<double>(dart_levenshtein(s1, s2)) / static_cast<double>(std::max(s1.size(), s2.size()));
+}
+
+double dart_keyword_score(const std::vector<std::string>& query_words, const std::vector<std::string>& entry_words,
+                          const std::vector<std::string>& entry_keywords) {
+    if (query_words.empty()) return 0.0;
+    int matches = 0;
+    int keyword_matches = 0;
+    for (const std::string& word : query_words) {
+        if (std::find(entry_words.begin(), entry_words.end(), word) != entry_words.end()) ++matches;
+        if (std::find(entry_keywords.begin(), entry_keywords.end(), word) != entry_keywords.end()) {
+            keyword_matches += 2;
+        }
+    }
+    const double word_score = static_cast<double>(matches) / static_cast<double>(query_words.size());
+    const double key_score = entry_keywords.empty()
+                                 ? 0.0
+                                 : static_cast<double>(keyword_matches) / static_cast<double>(entry_keywords.size() * 2);
+    return word_score * 0.4 + key_score * 0.6;
+}
+
+struct DartMatch {
+    int entry = -1;
+    double score = 0.0;
+    double levenshtein = 0.0;
+    double keyword = 0.0;
+};
+
+double dart_score(const std::string& query, const QAMatcher::Entry& entry, double* lev, double* key) {
+    const std::string normalized_query = dart_normalize(query);
+    const std::string normalized_question = dart_normalize(entry.question);
+    std::vector<std::string> keywords;
+    for (const std::string& k : entry.keywords) keywords.push_back(dart_normalize(k));
+    *lev = dart_similarity(normalized_query, normalized_question);
+    *key = dart_keyword_score(dart_tokenize(normalized_query), dart_tokenize(normalized_question), keywords);
+    return (*lev * 0.6 + *key * 0.4) * entry.priority;
+}
+
+DartMatch dart_match(const std::string& query, const std::vector<QAMatcher::Entry>& bank) {
+    DartMatch best;
+    for (size_t i = 0; i < bank.size(); ++i) {
+        double lev, key;
+        const double score = dart_score(query, bank[i], &lev, &key);
+        if (score > best.score) {
+            best = {static_cast<int>(i), score, lev, key};
+        }
+    }
+    return best;
+}
+
+// ============================================================================
+// Fixtures
+// ============================================================================
+
+const char* const kWords[] = {
+    "how",   "do",      "what",   "is",     "agent", "create", "delete", "voice",  "memory", "api",
+    "key",   "private", "data",   "export", "face",  "camera", "setup",  "change", "name",   "the",
+    "my",    "can",     "i",      "work",   "model", "offline", "chat",  "tutu",   "new",    "settings",
+};
+
+std::string random_sentence(std::mt19937& rng, size_t min_words, size_t max_words) {
+    const size_t n = min_words + rng() % (max_words - min_words + 1);
+    std::string out;
+    for (size_t i = 0; i < n; ++i) {
+        std::string word = kWords[rng() % (sizeof(kWords) / sizeof(kWords[0]))];
+        if (rng() % 5 == 0) word[0] = static_cast<char>(word[0] - 'a' + 'A');
+        if (!out.empty()) out += rng() % 7 == 0 ? "  " : " ";
+        out += word;
+    }
+    out += rng() % 2 ? "?" : "";
+    return out;
+}
+
+std::vector<QAMatcher::Entry> random_bank(std::mt19937& rng, size_t n) {
+    std::vector<QAMatcher::Entry> bank;
+    for (size_t i = 0; i < n; ++i) {
+        QAMatcher::Entry e;
+        e.id = std::to_string(i + 1);
+        e.question = random_sentence(rng, 3, 8);
+        e.answer = "Answer " + e.id;
+        e.category = i % 2 ? "features" : "app_usage";
+        for (size_t k = rng() % 5; k > 0; --k) e.keywords.push_back(kWords[rng() % (sizeof(kWords) / sizeof(kWords[0]))]);
+        // At most 1.5, so an entry sharing no trigram with the query (at
+        // most 0.4 before priority) never outscores a shortlisted one
+        e.priority = (rng() % 2) ? 1.0f : 1.5f;
+        bank.push_back(e);
+    }
+    return bank;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+void test_normalize() {
+    const char* const samples[] = {
+        "What is TuTu?", "  How   do I\tcreate a NEW agent?! ", "api-key: setup", "", "???", "snake_case and 123",
+    };
+    for (const char* text : samples) {
+        CHECK_EQ(QAMatcher::normalize(text), dart_normalize(text));
+    }
+}
+
+void test_edit_distance() {
+    std::mt19937 rng(7);
+    // Lengths either side of the 64-row block boundaries
+    for (int i = 0; i < 600; ++i) {
+        std::string a, b;
+        const size_t la = rng() % 200, lb = rng() % 200;
+        for (size_t k = 0; k < la; ++k) a += static_cast<char>('a' + rng() % 4);
+        for (size_t k = 0; k < lb; ++k) b += static_cast<char>('a' + rng() % 4);
+        CHECK_EQ(QAMatcher::edit_distance(a, b), dart_levenshtein(a, b));
+    }
+    CHECK_EQ(QAMatcher::edit_distance("kitten", "sitting"), 3);
+    CHECK_EQ(QAMatcher::edit_distance("", "abc"), 3);
+    CHECK_EQ(QAMatcher::edit_distance("abc", ""), 3);
+}
+
+void test_match_parity() {
+    std::mt19937 rng(11);
+    const std::vector<QAMatcher::Entry> bank = random_bank(rng, 48);
+    QAMatcher matcher;
+    for (const QAMatcher::Entry& e : bank) matcher.add(e);
+
+    for (int i = 0; i < 400; ++i) {
+        // Half the queries are a bank question, lightly edited
+        std::string query = i % 2 ? random_sentence(rng, 2, 8) : bank[rng() % bank.size()].question;
+        if (i % 4 == 0 && !query.empty()) query.erase(rng() % query.size(), 1);
+
+        const DartMatch expected = dart_match(query, bank);
+        const QAMatcher::Match got = matcher.match(query);
+        if (expected.score <= 0.6) continue;
+
+        CHECK(got.entry >= 0);
+        if (got.entry < 0) continue;
+        CHECK_NEAR(got.score, expected.score, 1e-4);
+        // A different entry only on a tie
+        double lev, key;
+        CHECK_NEAR(dart_score(query, bank[got.entry], &lev, &key), expected.score, 1e-4);
+        CHECK_NEAR(got.levenshtein, lev, 1e-4);
+        CHECK_NEAR(got.keyword, key, 1e-4);
+    }
+
+    // A bank question finds itself at full similarity
+    const QAMatcher::Match self = matcher.match(bank[5].question);
+    CHECK(self.entry >= 0);
+    CHECK_NEAR(self.levenshtein, 1.0, 1e-6);
+}
+
+void test_compiled_round_trip() {
+    std::mt19937 rng(3);
+    const std::vector<QAMatcher::Entry> bank = random_bank(rng, 30);
+    QAMatcher built;
+    for (const QAMatcher::Entry& e : bank) built.add(e);
+
+    const std::string path = tutu_test::temp_path("qa_bank.bin");
+    std::string error;
+    CHECK(built.save(path, error));
+
+    QAMatcher mapped;
+    CHECK(mapped.open(path, error));
+    CHECK_EQ(mapped.size(), static_cast<uint32_t>(bank.size()));
+    CHECK_EQ(mapped.stamp(), built.stamp());
+    CHECK_EQ(mapped.add(bank[0]), -1);
+    for (uint32_t i = 0; i < mapped.size(); ++i) {
+        CHECK_EQ(std::string(mapped.text(i, QAMatcher::Field::Id)), bank[i].id);
+        CHECK_EQ(std::string(mapped.text(i, QAMatcher::Field::Question)), bank[i].question);
+        CHECK_EQ(std::string(mapped.text(i, QAMatcher::Field::Answer)), bank[i].answer);
+        CHECK_EQ(std::string(mapped.text(i, QAMatcher::Field::Category)), bank[i].category);
+        const std::vector<const char*> keywords = mapped.keywords(i);
+        CHECK_EQ(keywords.size(), bank[i].keywords.size());
+        for (size_t k = 0; k < keywords.size() && k < bank[i].keywords.size(); ++k) {
+            CHECK_EQ(std::string(keywords[k]), bank[i].keywords[k]);
+        }
+        CHECK_EQ(mapped.priority(i), bank[i].priority);
+    }
+    CHECK(mapped.text(mapped.size(), QAMatcher::Field::Id) == nullptr);
+
+    for (int i = 0; i < 50; ++i) {
+        const std::string query = random_sentence(rng, 2, 6);
+        const QAMatcher::Match a = built.match(query);
+        const QAMatcher::Match b = mapped.match(query);
+        CHECK_EQ(a.entry, b.entry);
+        CHECK_EQ(a.score, b.score);
+    }
+
+    // Damaged copies are refused: a flipped byte fails the checksum, a
+    // short file the size check
+    FILE* f = fopen(path.c_str(), "rb");
+    std::vector<uint8_t> image(1 << 20);
+    image.resize(fread(image.data(), 1, image.size(), f));
+    fclose(f);
+
+    const std::string damaged = tutu_test::temp_path("qa_bank_damaged.bin");
+    auto write = [&](const std::vector<uint8_t>& bytes) {
+        FILE* out = fopen(damaged.c_str(), "wb");
+        fwrite(bytes.data(), 1, bytes.size(), out);
+        fclose(out);
+    };
+    std::vector<uint8_t> flipped = image;
+    flipped[image.size() / 2] ^= 0x20;
+    write(flipped);
+    QAMatcher rejected;
+    CHECK(!rejected.open(damaged, error));
+    write(std::vector<uint8_t>(image.begin(), image.end() - 4));
+    CHECK(!rejected.open(damaged, error));
+    write(std::vector<uint8_t>(image.begin(), image.begin() + 16));
+    CHECK(!rejected.open(damaged, error));
+
+    remove(path.c_str());
+    remove(damaged.c_str());
+}
+
+} // namespace
+
+int main() {
+    test_normalize();
+    test_edit_distance();
+    test_match_parity();
+    test_compiled_round_trip();
+    return test_result("test_qa_matcher");
+}
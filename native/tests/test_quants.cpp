@@ -0,0 +1,218 @@
+/**
+ * test_quants.cpp - SIMD quantized kernels against the scalar reference
+ *
+ * Every kernel table compiled into this build and supported by the
+ * running CPU (AVX2, AVX-512, NEON, NEON dotprod) is compared, function
+ * by function, with the scalar table on random blocks of each supported
+ * weight type. The scalar dots are in turn checked against float dots of
+ * the dequantized weights and activations.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "cpu_features.h"
+#include "quants.h"
+#include "quants_kernels.h"
+#include "test.h"
+
+using namespace tutu;
+
+namespace {
+
+constexpr int kBlocksK = 8;          // super-blocks per row
+constexpr int kN = kBlocksK * QK_K;  // elements per row
+constexpr int kBlocks0 = kN / QK8_0; // 32-element blocks per row
+constexpr int kRows = 20;
+
+struct Table {
+    const char* name;
+    const QuantKernels* kernels;
+    bool supported;
+};
+
+std::vector<Table> tables() {
+    const CpuFeatures& cpu = cpu_features();
+    return {
+        {"AVX2", quant_kernels_avx2(), cpu.avx2 && cpu.fma && cpu.f16c},
+        {"AVX-512", quant_kernels_avx512(), cpu.avx512f && cpu.avx512bw && cpu.avx2 && cpu.fma && cpu.f16c},
+        {"NEON", quant_kernels_neon(), cpu.neon},
+        {"NEON dotprod", quant_kernels_neon_dotprod(), cpu.dotprod},
+    };
+}
+
+uint16_t random_scale(std::mt19937& rng) {
+    return fp32_to_fp16(std::uniform_real_distribution<float>(-0.05f, 0.05f)(rng));
+}
+
+void random_bytes(std::mt19937& rng, void* p, size_t n) {
+    uint8_t* b = static_cast<uint8_t*>(p);
+    for (size_t i = 0; i < n; ++i) b[i] = static_cast<uint8_t>(rng());
+}
+
+template <typename Block>
+Block* blocks(std::vector<uint8_t>& row) {
+    return reinterpret_cast<Block*>(row.data());
+}
+
+// A weight row of type: random quants, sane fp16 scales
+std::vector<uint8_t> random_row(GGMLType type, std::mt19937& rng) {
+    std::vector<uint8_t> row(ggml_row_size(type, kN));
+    random_bytes(rng, row.data(), row.size());
+    for (int i = 0; i < kBlocks0; ++i) {
+        if (type == GGMLType::Q4_0) blocks<block_q4_0>(row)[i].d = random_scale(rng);
+        if (type == GGMLType::Q5_0) blocks<block_q5_0>(row)[i].d = random_scale(rng);
+        if (type == GGMLType::Q8_0) blocks<block_q8_0>(row)[i].d = random_scale(rng);
+    }
+    for (int i = 0; i < kBlocksK; ++i) {
+        if (type == GGMLType::Q4_K) {
+            blocks<block_q4_K>(row)[i].d = random_scale(rng);
+            blocks<block_q4_K>(row)[i].dmin = random_scale(rng);
+        }
+        if (type == GGMLType::Q6_K) blocks<block_q6_K>(row)[i].d = random_scale(rng);
+    }
+    return row;
+}
+
+std::vector<float> random_activations(std::mt19937& rng) {
+    std::normal_distribution<float> normal(0.0f, 2.0f);
+    std::vector<float> x(kN);
+    for (float& v : x) v = normal(rng);
+    // An all-zero block, which the quantizers special-case
+    std::fill(x.begin() + QK_K, x.begin() + QK_K + QK8_0, 0.0f);
+    return x;
+}
+
+// Activations as the integer kernels see them, back in floats
+std::vector<float> dequantize_q8_K(const std::vector<block_q8_K>& y) {
+    std::vector<float> x;
+    for (const block_q8_K& b : y) {
+        for (int j = 0; j < QK_K; ++j) x.push_back(b.d * b.qs[j]);
+    }
+    return x;
+}
+
+std::vector<float> dequantize_q8_0(const std::vector<block_q8_0>& y) {
+    std::vector<float> x(kN);
+    dequantize_row(GGMLType::Q8_0, y.data(), x.data(), kN);
+    return x;
+}
+
+// Sum of |w_i * x_i|, the scale of any float rounding difference
+double abs_dot(const std::vector<float>& w, const std::vector<float>& x) {
+    double s = 0.0;
+    for (size_t i = 0; i < w.size(); ++i) s += std::fabs(static_cast<double>(w[i]) * x[i]);
+    return s;
+}
+
+double float_dot(const std::vector<float>& w, const std::vector<float>& x) {
+    double s = 0.0;
+    for (size_t i = 0; i < w.size(); ++i) s += static_cast<double>(w[i]) * x[i];
+    return s;
+}
+
+float dot(const QuantKernels& k, GGMLType type, const void* row, const void* xq) {
+    switch (type) {
+        case GGMLType::Q4_0:
+            return k.dot_q4_0_q8_0(static_cast<const block_q4_0*>(row), static_cast<const block_q8_0*>(xq), kBlocks0);
+        case GGMLType::Q5_0:
+            return k.dot_q5_0_q8_0(static_cast<const block_q5_0*>(row), static_cast<const block_q8_0*>(xq), kBlocks0);
+        case GGMLType::Q8_0:
+            return k.dot_q8_0_q8_0(static_cast<const block_q8_0*>(row), static_cast<const block_q8_0*>(xq), kBlocks0);
+        case GGMLType::Q4_K:
+            return k.dot_q4_K_q8_K(static_cast<const block_q4_K*>(row), static_cast<const block_q8_K*>(xq), kBlocksK);
+        case GGMLType::Q6_K:
+            return k.dot_q6_K_q8_K(static_cast<const block_q6_K*>(row), static_cast<const block_q8_K*>(xq), kBlocksK);
+        default:
+            return 0.0f;
+    }
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+// Quantized activations may differ by one step where a value sits on a
+// rounding boundary; scales must agree
+void test_quantize(const Table& t, std::mt19937& rng) {
+    const QuantKernels& ref = *quant_kernels_scalar();
+    for (int r = 0; r < kRows; ++r) {
+        const std::vector<float> x = random_activations(rng);
+
+        std::vector<block_q8_0> a0(kBlocks0), b0(kBlocks0);
+        ref.quantize_q8_0(x.data(), a0.data(), kBlocks0);
+        t.kernels->quantize_q8_0(x.data(), b0.data(), kBlocks0);
+        for (int i = 0; i < kBlocks0; ++i) {
+            CHECK_NEAR(fp16_to_fp32(b0[i].d), fp16_to_fp32(a0[i].d), 1e-3 * std::fabs(fp16_to_fp32(a0[i].d)));
+            for (int j = 0; j < QK8_0; ++j) CHECK(std::abs(a0[i].qs[j] - b0[i].qs[j]) <= 1);
+        }
+
+        std::vector<block_q8_K> aK(kBlocksK), bK(kBlocksK);
+        ref.quantize_q8_K(x.data(), aK.data(), kBlocksK);
+        t.kernels->quantize_q8_K(x.data(), bK.data(), kBlocksK);
+        for (int i = 0; i < kBlocksK; ++i) {
+            CHECK_NEAR(bK[i].d, aK[i].d, 1e-6 * std::fabs(aK[i].d));
+            for (int j = 0; j < QK_K; ++j) CHECK(std::abs(aK[i].qs[j] - bK[i].qs[j]) <= 1);
+            // bsums must describe the block's own quants
+            for (int g = 0; g < QK_K / 16; ++g) {
+                int sum = 0;
+                for (int j = 0; j < 16; ++j) sum += bK[i].qs[g * 16 + j];
+                CHECK_EQ(bK[i].bsums[g], sum);
+            }
+        }
+    }
+}
+
+// Both tables dot the same weights with the same (scalar-quantized)
+// activations. With t null, the scalar table is checked against float
+// dots of the dequantized operands instead.
+void test_dots(const Table* t, std::mt19937& rng) {
+    const QuantKernels& ref = *quant_kernels_scalar();
+    const GGMLType types[] = {GGMLType::Q4_0, GGMLType::Q5_0, GGMLType::Q8_0, GGMLType::Q4_K, GGMLType::Q6_K};
+    for (GGMLType type : types) {
+        CHECK(quant_type_supported(type));
+        const bool k_quant = vec_dot_type(type) == GGMLType::Q8_K;
+        for (int r = 0; r < kRows; ++r) {
+            const std::vector<uint8_t> row = random_row(type, rng);
+            const std::vector<float> x = random_activations(rng);
+            std::vector<block_q8_0> x0(kBlocks0);
+            std::vector<block_q8_K> xK(kBlocksK);
+            ref.quantize_q8_0(x.data(), x0.data(), kBlocks0);
+            ref.quantize_q8_K(x.data(), xK.data(), kBlocksK);
+            const void* xq = k_quant ? static_cast<const void*>(xK.data()) : static_cast<const void*>(x0.data());
+
+            std::vector<float> w(kN);
+            dequantize_row(type, row.data(), w.data(), kN);
+            const std::vector<float> xd = k_quant ? dequantize_q8_K(xK) : dequantize_q8_0(x0);
+            const double tolerance = 1e-5 * abs_dot(w, xd) + 1e-6;
+
+            const float expected = dot(ref, type, row.data(), xq);
+            const double actual = t != nullptr ? dot(*t->kernels, type, row.data(), xq) : float_dot(w, xd);
+            if (std::fabs(actual - expected) > tolerance) {
+                fprintf(stderr, "%s dot, type %u, row %d\n", t != nullptr ? t->name : "scalar",
+                        static_cast<unsigned>(type), r);
+            }
+            CHECK_NEAR(actual, expected, tolerance);
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(7);
+    test_dots(nullptr, rng);
+    for (const Table& t : tables()) {
+        if (t.kernels == nullptr) continue;
+        if (!t.supported) {
+            printf("%s kernels built but not supported by this CPU, skipped\n", t.name);
+            continue;
+        }
+        printf("checking %s kernels\n", t.name);
+        test_quantize(t, rng);
+        test_dots(&t, rng);
+    }
+    return test_result("test_quants");
+}
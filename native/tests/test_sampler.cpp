@@ -0,0 +1,214 @@
+/**
+ * test_sampler.cpp - Token sampling chain
+ *
+ * Each filter (top-k, top-p, min-p, temperature, repetition penalty) is
+ * checked by drawing many tokens from small hand-made logit vectors and
+ * comparing the frequencies with the distribution worked out by hand.
+ * Greedy picks and degenerate logits (all NaN or -inf) must be exact.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "sampler.h"
+#include "test.h"
+
+using tutu::Sampler;
+using tutu::SamplerParams;
+
+namespace {
+
+constexpr int kDraws = 40000;
+// Several standard deviations of a frequency over kDraws draws
+constexpr double kTolerance = 0.015;
+
+// Every filter off, so each test turns on only the one it checks
+SamplerParams plain(float temperature) {
+    SamplerParams p;
+    p.temperature = temperature;
+    p.top_k = 0;
+    p.top_p = 1.0f;
+    p.min_p = 0.0f;
+    p.repeat_penalty = 1.0f;
+    p.seed = 1234;
+    return p;
+}
+
+// Logits whose softmax is probs
+std::vector<float> logits_of(const std::vector<double>& probs) {
+    std::vector<float> l;
+    for (double p : probs) l.push_back(static_cast<float>(std::log(p)));
+    return l;
+}
+
+std::vector<double> softmax(const std::vector<float>& l, float temperature) {
+    double max = -INFINITY;
+    for (float x : l) max = std::max(max, static_cast<double>(x));
+    std::vector<double> p;
+    double sum = 0.0;
+    for (float x : l) {
+        p.push_back(std::exp((x - max) / temperature));
+        sum += p.back();
+    }
+    for (double& x : p) x /= sum;
+    return p;
+}
+
+// Draw kDraws tokens and compare their frequencies with expected
+void check_distribution(Sampler& sampler, const std::vector<float>& logits, const std::vector<double>& expected) {
+    std::vector<int> counts(logits.size(), 0);
+    for (int i = 0; i < kDraws; ++i) {
+        const int32_t t = sampler.sample(logits.data());
+        CHECK(t >= 0 && t < static_cast<int32_t>(logits.size()));
+        if (t >= 0 && t < static_cast<int32_t>(logits.size())) ++counts[t];
+    }
+    for (size_t i = 0; i < logits.size(); ++i) {
+        const double freq = static_cast<double>(counts[i]) / kDraws;
+        if (expected[i] == 0.0) {
+            CHECK_EQ(counts[i], 0);
+        } else {
+            CHECK_NEAR(freq, expected[i], kTolerance);
+        }
+    }
+}
+
+void test_greedy() {
+    Sampler s;
+    const std::vector<float> l = {0.5f, 2.0f, -1.0f, 1.9f};
+    s.configure(plain(0.0f), 4);
+    CHECK_EQ(s.sample(l.data()), 1);
+
+    // Penalty divides a positive logit: 2.0 / 1.5 < 1.9
+    SamplerParams p = plain(0.0f);
+    p.repeat_penalty = 1.5f;
+    s.configure(p, 4);
+    s.accept(1);
+    CHECK_EQ(s.sample(l.data()), 3);
+    s.reset();
+    CHECK_EQ(s.sample(l.data()), 1);
+
+    // top_k = 1 is greedy at any temperature
+    p = plain(5.0f);
+    p.top_k = 1;
+    s.configure(p, 4);
+    for (int i = 0; i < 100; ++i) CHECK_EQ(s.sample(l.data()), 1);
+}
+
+void test_temperature() {
+    Sampler s;
+    const std::vector<float> l = logits_of({0.5, 0.25, 0.15, 0.1});
+    for (float t : {1.0f, 0.5f, 2.0f}) {
+        s.configure(plain(t), 4);
+        check_distribution(s, l, softmax(l, t));
+    }
+}
+
+void test_top_k() {
+    Sampler s;
+    SamplerParams p = plain(1.0f);
+    p.top_k = 2;
+    s.configure(p, 4);
+    // The two best renormalized: 0.4 / 0.7 and 0.3 / 0.7
+    check_distribution(s, logits_of({0.2, 0.4, 0.1, 0.3}), {0.0, 4.0 / 7, 0.0, 3.0 / 7});
+
+    // A vocabulary large enough for the histogram floor
+    std::mt19937 rng(3);
+    std::normal_distribution<float> normal(0.0f, 3.0f);
+    std::vector<float> big(5000);
+    for (float& x : big) x = normal(rng);
+    p.top_k = 3;
+    s.configure(p, 5000);
+    std::vector<size_t> order(big.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::partial_sort(order.begin(), order.begin() + 3, order.end(),
+                      [&](size_t a, size_t b) { return big[a] > big[b]; });
+    const std::vector<float> top3 = {big[order[0]], big[order[1]], big[order[2]]};
+    const std::vector<double> p3 = softmax(top3, 1.0f);
+    std::vector<double> expected(big.size(), 0.0);
+    for (int i = 0; i < 3; ++i) expected[order[i]] = p3[i];
+    check_distribution(s, big, expected);
+}
+
+void test_top_p() {
+    Sampler s;
+    SamplerParams p = plain(1.0f);
+    // 0.5 < 0.75 <= 0.5 + 0.3: the two best stay
+    p.top_p = 0.75f;
+    s.configure(p, 4);
+    check_distribution(s, logits_of({0.3, 0.05, 0.5, 0.15}), {0.3 / 0.8, 0.0, 0.5 / 0.8, 0.0});
+
+    // Ties in the bin the cut falls in: 0.25 each, 0.6 needs three
+    p.top_p = 0.6f;
+    s.configure(p, 4);
+    std::vector<int> counts(4, 0);
+    const std::vector<float> flat = logits_of({0.25, 0.25, 0.25, 0.25});
+    for (int i = 0; i < kDraws; ++i) ++counts[s.sample(flat.data())];
+    int kept = 0;
+    for (int c : counts) kept += c > 0 ? 1 : 0;
+    CHECK_EQ(kept, 3);
+}
+
+void test_min_p() {
+    Sampler s;
+    SamplerParams p = plain(1.0f);
+    // Kept: probability >= 0.3 * 0.4 = 0.12
+    p.min_p = 0.3f;
+    s.configure(p, 5);
+    check_distribution(s, logits_of({0.4, 0.1, 0.3, 0.13, 0.07}), {0.4 / 0.83, 0.0, 0.3 / 0.83, 0.13 / 0.83, 0.0});
+}
+
+void test_repetition_penalty() {
+    Sampler s;
+    SamplerParams p = plain(1.0f);
+    p.repeat_penalty = 2.0f;
+    p.repeat_last_n = 2;
+    s.configure(p, 4);
+    const std::vector<float> l = {2.0f, 1.0f, -1.0f, 0.5f};
+
+    // Positive logits halve, negative ones double
+    s.accept(0);
+    s.accept(2);
+    check_distribution(s, l, softmax({1.0f, 1.0f, -2.0f, 0.5f}, 1.0f));
+    // Only the last two tokens count, and a repeated one is penalized once
+    s.accept(2);
+    s.accept(2);
+    check_distribution(s, l, softmax({2.0f, 1.0f, -2.0f, 0.5f}, 1.0f));
+}
+
+void test_degenerate() {
+    Sampler s;
+    SamplerParams p = plain(0.8f);
+    p.top_k = 2;
+    p.top_p = 0.9f;
+    p.min_p = 0.1f;
+    s.configure(p, 4);
+
+    const std::vector<float> nan(4, NAN);
+    const std::vector<float> neg_inf(4, -INFINITY);
+    const int32_t a = s.sample(nan.data());
+    const int32_t b = s.sample(neg_inf.data());
+    CHECK(a >= 0 && a < 4);
+    CHECK(b >= 0 && b < 4);
+
+    // The one finite logit wins, wherever the NaNs are
+    const std::vector<float> one = {NAN, -INFINITY, 0.3f, NAN};
+    for (int i = 0; i < 100; ++i) CHECK_EQ(s.sample(one.data()), 2);
+    s.configure(plain(0.0f), 4);
+    CHECK_EQ(s.sample(one.data()), 2);
+}
+
+} // namespace
+
+int main() {
+    test_greedy();
+    test_temperature();
+    test_top_k();
+    test_top_p();
+    test_min_p();
+    test_repetition_penalty();
+    test_degenerate();
+    return test_result("test_sampler");
+}
@@ -0,0 +1,116 @@
+/**
+ * test_thread_pool.cpp - Work-stealing pool used by the forward pass
+ *
+ * Checks that parallel_for runs every index exactly once in ranges that
+ * respect min_chunk, for pools of several sizes, and that jobs submitted
+ * from several threads at once or from inside a running job complete. A
+ * watchdog fails the test instead of letting a deadlock hang ctest.
+ *
+ * Pools are capped at the hardware thread count, so on a single-core
+ * host only the inline path runs.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+#include "thread_pool.h"
+
+using tutu::ThreadPool;
+
+namespace {
+
+void test_coverage(ThreadPool& pool) {
+    const int64_t sizes[] = {1, 7, 64, 1000, 4099};
+    const int64_t chunks[] = {1, 16, 100};
+    for (int64_t n : sizes) {
+        for (int64_t min_chunk : chunks) {
+            std::unique_ptr<std::atomic<int>[]> hits(new std::atomic<int>[n]);
+            for (int64_t i = 0; i < n; ++i) hits[i].store(0);
+            std::atomic<int> short_ranges{0};
+            pool.parallel_for(n, min_chunk, [&](int64_t begin, int64_t end) {
+                if (end - begin < min_chunk && end != n) ++short_ranges;
+                for (int64_t i = begin; i < end; ++i) ++hits[i];
+            });
+            bool once = true;
+            for (int64_t i = 0; i < n; ++i) once = once && hits[i].load() == 1;
+            CHECK(once);
+            CHECK_EQ(short_ranges.load(), 0);
+        }
+    }
+    // Nothing to do is not an error
+    pool.parallel_for(0, 1, [](int64_t, int64_t) { CHECK(false); });
+}
+
+// parallel_for from inside a job, on the caller and on the workers
+void test_nested(ThreadPool& pool) {
+    std::atomic<int64_t> sum{0};
+    pool.parallel_for(64, 1, [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; ++i) {
+            pool.parallel_for(100, 10, [&](int64_t b, int64_t e) { sum += e - b; });
+        }
+    });
+    CHECK_EQ(sum.load(), int64_t(64 * 100));
+}
+
+// Jobs from several threads at once are serialized, not lost
+void test_concurrent(ThreadPool& pool) {
+    constexpr int kThreads = 4;
+    constexpr int kJobs = 200;
+    std::atomic<int64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&] {
+            for (int j = 0; j < kJobs; ++j) {
+                pool.parallel_for(256, 8, [&](int64_t begin, int64_t end) { sum += end - begin; });
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+    CHECK_EQ(sum.load(), int64_t(kThreads) * kJobs * 256);
+}
+
+} // namespace
+
+int main() {
+    std::atomic<bool> finished{false};
+    std::thread watchdog([&] {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+        while (!finished.load()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                fprintf(stderr, "test_thread_pool: timed out, probably deadlocked\n");
+                std::_Exit(1);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    });
+
+    if (std::thread::hardware_concurrency() < 2) printf("single hardware thread: pools run inline\n");
+    for (int n_threads : {1, 2, 4, 8}) {
+        ThreadPool pool(n_threads);
+        CHECK(pool.size() >= 1 && pool.size() <= n_threads);
+        test_coverage(pool);
+        test_nested(pool);
+        test_concurrent(pool);
+    }
+    {
+        // Two pools, one's jobs calling into the other
+        ThreadPool outer(4), inner(4);
+        std::atomic<int64_t> sum{0};
+        outer.parallel_for(32, 1, [&](int64_t begin, int64_t end) {
+            for (int64_t i = begin; i < end; ++i) {
+                inner.parallel_for(50, 5, [&](int64_t b, int64_t e) { sum += e - b; });
+            }
+        });
+        CHECK_EQ(sum.load(), int64_t(32 * 50));
+    }
+
+    finished.store(true);
+    watchdog.join();
+    return test_result("test_thread_pool");
+}
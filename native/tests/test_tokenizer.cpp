@@ -0,0 +1,259 @@
+/**
+ * test_tokenizer.cpp - Byte-level BPE tokenizer on a generated vocabulary
+ *
+ * Writes a small GGUF holding only tokenizer metadata (the 256 byte
+ * tokens, control tokens and a few merged words, GPT-2 style) and checks
+ * merging, pre-tokenization, special tokens and that decoding the pieces
+ * gives back the input bytes.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gguf.h"
+#include "test.h"
+#include "tokenizer.h"
+
+using tutu::Tokenizer;
+
+namespace {
+
+// ============================================================================
+// GGUF writer
+// ============================================================================
+
+class GGUFWriter {
+public:
+    void str(const std::string& key, const std::string& value) {
+        key_header(key, 8);
+        string(value);
+        ++m_n_kv;
+    }
+
+    void u32(const std::string& key, uint32_t value) {
+        key_header(key, 4);
+        raw(&value, sizeof(value));
+        ++m_n_kv;
+    }
+
+    void strings(const std::string& key, const std::vector<std::string>& values) {
+        key_header(key, 9);
+        const uint32_t type = 8;
+        const uint64_t n = values.size();
+        raw(&type, sizeof(type));
+        raw(&n, sizeof(n));
+        for (const std::string& v : values) string(v);
+        ++m_n_kv;
+    }
+
+    void ints(const std::string& key, const std::vector<int32_t>& values) {
+        key_header(key, 9);
+        const uint32_t type = 5;
+        const uint64_t n = values.size();
+        raw(&type, sizeof(type));
+        raw(&n, sizeof(n));
+        raw(values.data(), values.size() * sizeof(int32_t));
+        ++m_n_kv;
+    }
+
+    bool write(const std::string& path) const {
+        std::vector<uint8_t> out;
+        const uint32_t magic = 0x46554747, version = 3;
+        const uint64_t n_tensors = 0;
+        auto put = [&](const void* p, size_t n) {
+            out.insert(out.end(), static_cast<const uint8_t*>(p), static_cast<const uint8_t*>(p) + n);
+        };
+        put(&magic, sizeof(magic));
+        put(&version, sizeof(version));
+        put(&n_tensors, sizeof(n_tensors));
+        put(&m_n_kv, sizeof(m_n_kv));
+        out.insert(out.end(), m_kv.begin(), m_kv.end());
+        out.resize((out.size() + 31) & ~size_t(31), 0);
+
+        FILE* f = fopen(path.c_str(), "wb");
+        if (f == nullptr) return false;
+        const bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+        return fclose(f) == 0 && ok;
+    }
+
+private:
+    void raw(const void* p, size_t n) {
+        m_kv.insert(m_kv.end(), static_cast<const uint8_t*>(p), static_cast<const uint8_t*>(p) + n);
+    }
+
+    void string(const std::string& s) {
+        const uint64_t n = s.size();
+        raw(&n, sizeof(n));
+        raw(s.data(), s.size());
+    }
+
+    void key_header(const std::string& key, uint32_t type) {
+        string(key);
+        raw(&type, sizeof(type));
+    }
+
+    std::vector<uint8_t> m_kv;
+    uint64_t m_n_kv = 0;
+};
+
+// ============================================================================
+// Vocabulary
+// ============================================================================
+
+std::string utf8(uint32_t cp) {
+    std::string out;
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+// GPT-2's printable stand-in for each byte
+std::vector<std::string> byte_symbols() {
+    std::vector<std::string> symbols(256);
+    uint32_t next = 256;
+    for (uint32_t b = 0; b < 256; ++b) {
+        const bool printable = (b >= '!' && b <= '~') || (b >= 0xA1 && b <= 0xAC) || (b >= 0xAE && b <= 0xFF);
+        symbols[b] = utf8(printable ? b : next++);
+    }
+    return symbols;
+}
+
+struct Vocab {
+    std::vector<std::string> tokens;
+    std::vector<int32_t> types;
+    std::vector<std::string> merges;
+
+    int32_t id(const std::string& token) const {
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (tokens[i] == token) return static_cast<int32_t>(i);
+        }
+        return -1;
+    }
+};
+
+Vocab make_vocab() {
+    Vocab v;
+    v.tokens = {"<|endoftext|>", "<|im_start|>", "<|im_end|>"};
+    v.types = {3, 3, 3};
+    const std::vector<std::string> symbols = byte_symbols();
+    for (const std::string& s : symbols) {
+        v.tokens.push_back(s);
+        v.types.push_back(1);
+    }
+    // Each word merged left to right, with and without its leading space;
+    // the spaced merges rank first, or the bare word would win and leave
+    // the space on its own
+    const std::string space = symbols[' '];
+    for (const std::string word : {"hello", "world", "the", "you", "assistant"}) {
+        for (const std::string& start : {space, std::string()}) {
+            std::string acc = start.empty() ? std::string(1, word[0]) : start;
+            for (size_t i = start.empty() ? 1 : 0; i < word.size(); ++i) {
+                const std::string merge = acc + " " + word[i];
+                acc += word[i];
+                if (v.id(acc) < 0) {
+                    v.merges.push_back(merge);
+                    v.tokens.push_back(acc);
+                    v.types.push_back(1);
+                }
+            }
+        }
+    }
+    return v;
+}
+
+std::string decode(const Tokenizer& tokenizer, const std::vector<int32_t>& ids) {
+    std::string out;
+    for (int32_t id : ids) out += tokenizer.token_to_piece(id);
+    return out;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+void test_tokenizer(const Tokenizer& tokenizer, const Vocab& vocab) {
+    const std::string space = byte_symbols()[' '];
+
+    // Whole words merge, the space joining the word after it
+    const std::vector<int32_t> words = tokenizer.encode("hello world", false);
+    CHECK_EQ(words.size(), size_t(2));
+    if (words.size() == 2) {
+        CHECK_EQ(words[0], vocab.id("hello"));
+        CHECK_EQ(words[1], vocab.id(space + "world"));
+    }
+
+    // Words without merges fall back to byte tokens
+    const std::vector<int32_t> bytes = tokenizer.encode("xyz", false);
+    CHECK_EQ(bytes.size(), size_t(3));
+
+    // Digits are always single tokens
+    CHECK_EQ(tokenizer.encode("2024", false).size(), size_t(4));
+
+    // Control tokens only with parse_special
+    const std::vector<int32_t> special = tokenizer.encode("<|im_start|>assistant", true);
+    CHECK(!special.empty() && special[0] == vocab.id("<|im_start|>"));
+    CHECK(special.size() == 2 && special[1] == vocab.id("assistant"));
+    for (int32_t id : tokenizer.encode("<|im_start|>assistant", false)) CHECK(!tokenizer.is_control(id));
+    CHECK(tokenizer.is_control(vocab.id("<|im_end|>")));
+    CHECK(tokenizer.token_to_piece(vocab.id("<|im_end|>")).empty());
+    CHECK(tokenizer.is_eog(tokenizer.eos_id()));
+
+    // Pieces decode back to the input, whatever the bytes
+    const char* const samples[] = {
+        "hello world", "  the   you\n\nassistant\t", "caf\xc3\xa9 \xe2\x9c\x93 2024-10-16", "hello, world! it's 3:45pm",
+        "",
+    };
+    for (const char* text : samples) {
+        CHECK_EQ(decode(tokenizer, tokenizer.encode(text, false)), std::string(text));
+    }
+    std::mt19937 rng(5);
+    for (int i = 0; i < 200; ++i) {
+        std::string text;
+        for (size_t n = rng() % 40; n > 0; --n) text += static_cast<char>(rng() % 2 ? "helo wrd"[rng() % 8] : rng() % 256);
+        CHECK_EQ(decode(tokenizer, tokenizer.encode(text, false)), text);
+    }
+
+    // The pointer and length overload appends
+    std::vector<int32_t> appended = {7};
+    tokenizer.encode("hello", 5, false, appended);
+    CHECK(appended.size() == 2 && appended[0] == 7 && appended[1] == vocab.id("hello"));
+}
+
+} // namespace
+
+int main() {
+    const Vocab vocab = make_vocab();
+    GGUFWriter writer;
+    writer.str("general.architecture", "llama");
+    writer.str("tokenizer.ggml.model", "gpt2");
+    writer.str("tokenizer.ggml.pre", "smollm");
+    writer.strings("tokenizer.ggml.tokens", vocab.tokens);
+    writer.ints("tokenizer.ggml.token_type", vocab.types);
+    writer.strings("tokenizer.ggml.merges", vocab.merges);
+    writer.u32("tokenizer.ggml.bos_token_id", 1);
+    writer.u32("tokenizer.ggml.eos_token_id", 2);
+
+    const std::string path = tutu_test::temp_path("tokenizer.gguf");
+    CHECK(writer.write(path));
+
+    tutu::GGUFFile file;
+    std::string error;
+    Tokenizer tokenizer;
+    const bool loaded = file.open(path, error) && tokenizer.load(file, error);
+    if (!loaded) fprintf(stderr, "%s\n", error.c_str());
+    CHECK(loaded);
+    if (loaded) {
+        CHECK_EQ(tokenizer.n_vocab(), static_cast<int32_t>(vocab.tokens.size()));
+        test_tokenizer(tokenizer, vocab);
+    }
+    file.close();
+    remove(path.c_str());
+    return test_result("test_tokenizer");
+}
@@ -0,0 +1,177 @@
+/**
+ * test_vector_index.cpp - HNSW index over a memory-mapped file
+ *
+ * Checks recall against exact cosine search, removal, persistence across
+ * reopening, compaction, and that a file of another dimension or with a
+ * damaged graph is refused.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "test.h"
+#include "vector_index.h"
+
+using tutu::VectorIndex;
+
+namespace {
+
+constexpr uint32_t kDim = 24;
+constexpr int kCount = 800;
+constexpr int kTop = 10;
+
+std::vector<float> random_vector(std::mt19937& rng) {
+    std::normal_distribution<float> normal;
+    std::vector<float> v(kDim);
+    for (float& x : v) x = normal(rng);
+    return v;
+}
+
+float cosine(const std::vector<float>& a, const std::vector<float>& b) {
+    double dot = 0, na = 0, nb = 0;
+    for (uint32_t i = 0; i < kDim; ++i) {
+        dot += double(a[i]) * b[i];
+        na += double(a[i]) * a[i];
+        nb += double(b[i]) * b[i];
+    }
+    return static_cast<float>(dot / std::sqrt(na * nb));
+}
+
+// Share of the exact top k found by the index, over queries
+double recall(VectorIndex& index, const std::vector<std::vector<float>>& vectors, const std::set<int>& removed,
+              std::mt19937& rng) {
+    int found = 0, wanted = 0;
+    for (int q = 0; q < 50; ++q) {
+        const std::vector<float> query = random_vector(rng);
+        std::vector<std::pair<float, int>> exact;
+        for (int i = 0; i < static_cast<int>(vectors.size()); ++i) {
+            if (!removed.count(i)) exact.emplace_back(cosine(query, vectors[i]), i);
+        }
+        std::sort(exact.rbegin(), exact.rend());
+        std::set<std::string> truth;
+        for (int i = 0; i < kTop; ++i) truth.insert("v" + std::to_string(exact[i].second));
+
+        const auto results = index.search(query.data(), kTop);
+        for (size_t i = 0; i < results.size(); ++i) {
+            found += truth.count(results[i].first) ? 1 : 0;
+            if (i > 0) CHECK(results[i - 1].second >= results[i].second);
+        }
+        wanted += kTop;
+    }
+    return static_cast<double>(found) / wanted;
+}
+
+void test_vector_index() {
+    const std::string path = tutu_test::temp_path("vectors.hnsw");
+    remove(path.c_str());
+
+    std::mt19937 rng(13);
+    std::vector<std::vector<float>> vectors;
+    std::set<int> removed;
+    std::string error;
+    {
+        VectorIndex index;
+        CHECK(index.open(path, kDim, error));
+        for (int i = 0; i < kCount; ++i) {
+            vectors.push_back(random_vector(rng));
+            CHECK(index.add("v" + std::to_string(i), vectors.back().data(), error));
+        }
+        CHECK_EQ(index.size(), static_cast<uint32_t>(kCount));
+
+        // A stored vector finds itself first, at similarity 1
+        const auto self = index.search(vectors[42].data(), 1);
+        CHECK(self.size() == 1 && self[0].first == "v42");
+        if (!self.empty()) CHECK_NEAR(self[0].second, 1.0, 1e-4);
+
+        CHECK(recall(index, vectors, removed, rng) >= 0.9);
+
+        for (int i = 0; i < kCount; i += 7) {
+            CHECK(index.remove("v" + std::to_string(i)));
+            removed.insert(i);
+        }
+        CHECK(!index.remove("v0"));
+        CHECK_EQ(index.removed(), static_cast<uint32_t>(removed.size()));
+        for (const auto& r : index.search(vectors[0].data(), kTop)) CHECK(r.first != "v0");
+
+        // Re-adding an id replaces its vector
+        vectors[1] = random_vector(rng);
+        CHECK(index.add("v1", vectors[1].data(), error));
+        const auto replaced = index.search(vectors[1].data(), 1);
+        CHECK(!replaced.empty() && replaced[0].first == "v1");
+        index.flush();
+    }
+
+    {
+        // Everything survives reopening
+        VectorIndex index;
+        CHECK(index.open(path, kDim, error));
+        CHECK_EQ(index.size(), static_cast<uint32_t>(kCount - removed.size()));
+        CHECK(recall(index, vectors, removed, rng) >= 0.9);
+
+        CHECK(index.compact(error));
+        CHECK_EQ(index.removed(), 0u);
+        CHECK_EQ(index.size(), static_cast<uint32_t>(kCount - removed.size()));
+        CHECK(recall(index, vectors, removed, rng) >= 0.9);
+        index.flush();
+    }
+
+    {
+        VectorIndex other;
+        CHECK(!other.open(path, kDim + 1, error));
+    }
+    remove(path.c_str());
+}
+
+// Overwrite 4 bytes of the file at offset
+void poke(const std::string& path, long offset, uint32_t value) {
+    FILE* f = fopen(path.c_str(), "r+b");
+    CHECK(f != nullptr);
+    if (f == nullptr) return;
+    CHECK(fseek(f, offset, SEEK_SET) == 0 && fwrite(&value, sizeof(value), 1, f) == 1);
+    fclose(f);
+}
+
+void test_damaged() {
+    const std::string path = tutu_test::temp_path("damaged.hnsw");
+    std::mt19937 rng(17);
+    std::string error;
+
+    // Header: entry at byte 28. Node 0 starts after the 64-byte header;
+    // its layer-0 link count is at byte 56 of the record.
+    constexpr long kEntry = 28;
+    constexpr long kLinks = 64 + 56;
+    const std::pair<long, uint32_t> damage[] = {
+        {kEntry, 100000},    // entry past the last node
+        {kLinks, 1000},      // more links than a node holds
+        {kLinks + 4, 99999}, // link to a node that does not exist
+    };
+    for (const auto& d : damage) {
+        remove(path.c_str());
+        {
+            VectorIndex index;
+            CHECK(index.open(path, kDim, error));
+            for (int i = 0; i < 50; ++i) CHECK(index.add("v" + std::to_string(i), random_vector(rng).data(), error));
+        }
+        {
+            VectorIndex index;
+            CHECK(index.open(path, kDim, error));
+        }
+        poke(path, d.first, d.second);
+        VectorIndex index;
+        CHECK(!index.open(path, kDim, error));
+    }
+    remove(path.c_str());
+}
+
+} // namespace
+
+int main() {
+    test_vector_index();
+    test_damaged();
+    return test_result("test_vector_index");
+}
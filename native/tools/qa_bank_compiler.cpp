@@ -0,0 +1,113 @@
+/**
+ * qa_bank_compiler.cpp - Compile the offline QA bank for memory mapping
+ *
+ * Reads the QA bank JSON (an array of {id, question, answer, category,
+ * keywords, priority}) and writes it in QAMatcher's compiled form, which
+ * the app maps as is instead of decoding JSON at startup. Optionally also
+ * writes the bank's stamp (size and checksum), which the app reads to tell
+ * whether its extracted copy is current without loading the bank. Built
+ * for the host only; run through the qa_bank target:
+ *
+ *   cmake --build <dir> --target qa_bank
+ *
+ * or by hand:
+ *
+ *   qa_bank_compiler assets/qa_bank.json assets/qa_bank.bin assets/qa_bank.stamp
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "json.h"
+#include "qa_matcher.h"
+
+namespace {
+
+// A field that may be written as a string or a number, as the id is
+std::string field_text(const tutu::Json& entry, const char* key) {
+    const tutu::Json* v = entry.find(key);
+    if (v == nullptr) return std::string();
+    if (v->kind == tutu::Json::Kind::String || v->kind == tutu::Json::Kind::Number) return v->text;
+    return std::string();
+}
+
+bool read_entry(const tutu::Json& json, tutu::QAMatcher::Entry& entry, std::string& error) {
+    if (json.kind != tutu::Json::Kind::Object) {
+        error = "entry is not an object";
+        return false;
+    }
+    entry.id = field_text(json, "id");
+    entry.question = field_text(json, "question");
+    entry.answer = field_text(json, "answer");
+    entry.category = field_text(json, "category");
+    if (entry.id.empty() || entry.question.empty() || entry.answer.empty()) {
+        error = "entry needs an id, a question and an answer";
+        return false;
+    }
+    if (const tutu::Json* keywords = json.find("keywords")) {
+        for (const tutu::Json& k : keywords->items) {
+            if (k.kind == tutu::Json::Kind::String) entry.keywords.push_back(k.text);
+        }
+    }
+    const tutu::Json* priority = json.find("priority");
+    entry.priority = priority != nullptr && priority->kind == tutu::Json::Kind::Number
+                         ? static_cast<float>(priority->number)
+                         : 1.0f;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "usage: %s <qa_bank.json> <qa_bank.bin> [qa_bank.stamp]\n", argv[0]);
+        return 2;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        fprintf(stderr, "Cannot read %s\n", argv[1]);
+        return 1;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+
+    tutu::Json root;
+    std::string error;
+    if (!tutu::parse_json(text.str(), root, error)) {
+        fprintf(stderr, "%s: %s\n", argv[1], error.c_str());
+        return 1;
+    }
+    if (root.kind != tutu::Json::Kind::Array) {
+        fprintf(stderr, "%s: expected an array of entries\n", argv[1]);
+        return 1;
+    }
+
+    tutu::QAMatcher matcher;
+    for (size_t i = 0; i < root.items.size(); ++i) {
+        tutu::QAMatcher::Entry entry;
+        if (!read_entry(root.items[i], entry, error)) {
+            fprintf(stderr, "%s: entry %zu: %s\n", argv[1], i, error.c_str());
+            return 1;
+        }
+        matcher.add(entry);
+    }
+
+    if (!matcher.save(argv[2], error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (argc == 4) {
+        FILE* stamp = fopen(argv[3], "w");
+        const std::string text = matcher.stamp();
+        const bool ok = stamp != nullptr && fputs(text.c_str(), stamp) >= 0;
+        if (stamp == nullptr || fclose(stamp) != 0 || !ok) {
+            fprintf(stderr, "Cannot write %s\n", argv[3]);
+            return 1;
+        }
+    }
+    printf("Compiled %u entries into %s\n", matcher.size(), argv[2]);
+    return 0;
+}